@@ -38,6 +38,8 @@ DEFINE_int32(max_retry, 3, "Max retries(not including the first RPC)");
 DEFINE_bool(dont_fail, false, "Print fatal when some call failed");
 DEFINE_bool(enable_ssl, false, "Use SSL connection");
 DEFINE_int32(dummy_port, -1, "Launch dummy server at this port");
+DEFINE_int32(write_linger_us, 0, "Wait for at most so many microseconds to "
+             "batch concurrent small requests into one write");
 
 std::string g_request;
 std::string g_attachment;
@@ -101,6 +103,7 @@ int main(int argc, char* argv[]) {
     options.connect_timeout_ms = std::min(FLAGS_timeout_ms / 2, 100);
     options.timeout_ms = FLAGS_timeout_ms;
     options.max_retry = FLAGS_max_retry;
+    options.write_linger_us = FLAGS_write_linger_us;
     if (channel.Init(FLAGS_server.c_str(), FLAGS_load_balancer.c_str(), &options) != 0) {
         LOG(ERROR) << "Fail to initialize channel";
         return -1;
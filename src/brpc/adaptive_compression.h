@@ -0,0 +1,70 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+
+#ifndef BRPC_ADAPTIVE_COMPRESSION_H
+#define BRPC_ADAPTIVE_COMPRESSION_H
+
+// To brpc developers: This is a header included by user, don't depend
+// on internal structures, use opaque pointers instead.
+
+#include <stddef.h>
+#include "brpc/options.pb.h"
+
+namespace brpc {
+
+// Compress messages only when it pays off:
+//  - Messages serialized into fewer than `min_size' bytes are not compressed.
+//  - Compression ratio and CPU time are sampled per method. Compression of
+//    a method is turned off when it does not save enough, and turned on
+//    again when later samples show that it does.
+// Messages whose compress type is set by Controller::set_request_compress_type
+// or set_response_compress_type are not affected.
+// Only baidu_std supports adaptive compression right now.
+struct AdaptiveCompressionOptions {
+    AdaptiveCompressionOptions()
+        : compress_type(COMPRESS_TYPE_NONE)
+        , min_size(512)
+        , max_ratio(0.9)
+        , min_saved_bytes_per_us(0) {}
+
+    // Compression to use when it pays off. COMPRESS_TYPE_NONE disables
+    // adaptive compression.
+    // Default: COMPRESS_TYPE_NONE
+    CompressType compress_type;
+
+    // Messages serialized into fewer bytes are not compressed.
+    // Default: 512
+    size_t min_size;
+
+    // Compression is turned off when compressed size / original size is
+    // larger than this value.
+    // Default: 0.9
+    double max_ratio;
+
+    // Compression is turned off when it saves fewer bytes than this value
+    // per microsecond of CPU, in which case sending the saved bytes takes
+    // less time than compressing them, e.g. 1250 for a 10Gbps network.
+    // 0 means CPU time is not considered.
+    // Default: 0
+    double min_saved_bytes_per_us;
+};
+
+} // namespace brpc
+
+#endif  // BRPC_ADAPTIVE_COMPRESSION_H
@@ -0,0 +1,211 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <map>
+#include "butil/containers/doubly_buffered_data.h"
+#include "butil/time.h"
+#include "bvar/bvar.h"
+#include "brpc/backup_request_policy.h"
+
+
+namespace brpc {
+
+// Backup requests are limited by tokens: every finished RPC deposits
+// `max_backup_ratio' tokens and every backup request withdraws one token.
+// Tokens are scaled by TOKEN_UNIT to be integers.
+static const int64_t TOKEN_UNIT = 1000;
+// Allow a burst of so many backup requests.
+static const int64_t MAX_TOKENS = 10 * TOKEN_UNIT;
+// Percentiles of latencies are not cheap to compute, refresh the delay
+// periodically rather than in every RPC.
+static const int64_t UPDATE_INTERVAL_US = 100000;
+
+AdaptiveBackupRequestOptions::AdaptiveBackupRequestOptions()
+    : latency_percentile(0.95)
+    , default_backup_request_ms(-1)
+    , min_backup_request_ms(1)
+    , max_backup_request_ms(-1)
+    , max_backup_ratio(0.1)
+    , window_size(10)
+    , min_sample_count(100) {}
+
+struct AdaptiveBackupRequestPolicy::MethodStats {
+    explicit MethodStats(int window_size)
+        : latency(window_size)
+        , latency_percentile_us(-1)
+        , next_update_us(0) {}
+
+    bvar::LatencyRecorder latency;
+    butil::atomic<int64_t> latency_percentile_us;
+    butil::atomic<int64_t> next_update_us;
+};
+
+struct AdaptiveBackupRequestPolicy::Stats {
+    typedef std::map<const google::protobuf::MethodDescriptor*,
+                     MethodStats*> MethodMap;
+
+    Stats()
+        : nbackup_second(&nbackup)
+        , tokens(MAX_TOKENS) {}
+
+    static size_t AddMethod(MethodMap& m,
+                            const google::protobuf::MethodDescriptor* method,
+                            MethodStats* stats) {
+        return m.insert(std::make_pair(method, stats)).second ? 1 : 0;
+    }
+
+    butil::DoublyBufferedData<MethodMap> methods;
+    bvar::Adder<int64_t> nbackup;
+    bvar::PerSecond<bvar::Adder<int64_t> > nbackup_second;
+    bvar::Adder<int64_t> nbackup_win;
+    bvar::Adder<int64_t> nbackup_rejected;
+    butil::atomic<int64_t> tokens;
+};
+
+AdaptiveBackupRequestPolicy::AdaptiveBackupRequestPolicy()
+    : _stats(new Stats) {}
+
+AdaptiveBackupRequestPolicy::AdaptiveBackupRequestPolicy(
+    const AdaptiveBackupRequestOptions& options)
+    : _options(options)
+    , _stats(new Stats) {}
+
+AdaptiveBackupRequestPolicy::~AdaptiveBackupRequestPolicy() {
+    {
+        butil::DoublyBufferedData<Stats::MethodMap>::ScopedPtr ptr;
+        if (_stats->methods.Read(&ptr) == 0) {
+            for (Stats::MethodMap::const_iterator it = ptr->begin();
+                 it != ptr->end(); ++it) {
+                delete it->second;
+            }
+        }
+    }
+    delete _stats;
+    _stats = NULL;
+}
+
+int AdaptiveBackupRequestPolicy::Expose(const butil::StringPiece& prefix) {
+    if (_stats->nbackup.expose_as(prefix, "backup_request_count") != 0 ||
+        _stats->nbackup_second.expose_as(prefix, "backup_request_second") != 0 ||
+        _stats->nbackup_win.expose_as(prefix, "backup_request_win_count") != 0 ||
+        _stats->nbackup_rejected.expose_as(
+            prefix, "backup_request_rejected_count") != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+AdaptiveBackupRequestPolicy::MethodStats*
+AdaptiveBackupRequestPolicy::GetMethodStats(const Controller* cntl) const {
+    const google::protobuf::MethodDescriptor* method = cntl->method();
+    {
+        butil::DoublyBufferedData<Stats::MethodMap>::ScopedPtr ptr;
+        if (_stats->methods.Read(&ptr) != 0) {
+            return NULL;
+        }
+        Stats::MethodMap::const_iterator it = ptr->find(method);
+        if (it != ptr->end()) {
+            return it->second;
+        }
+    }
+    MethodStats* stats = new MethodStats(_options.window_size);
+    if (_stats->methods.Modify(Stats::AddMethod, method, stats) == 0) {
+        // Another thread added the method before us.
+        delete stats;
+        butil::DoublyBufferedData<Stats::MethodMap>::ScopedPtr ptr;
+        if (_stats->methods.Read(&ptr) != 0) {
+            return NULL;
+        }
+        Stats::MethodMap::const_iterator it = ptr->find(method);
+        return (it != ptr->end() ? it->second : NULL);
+    }
+    return stats;
+}
+
+int64_t AdaptiveBackupRequestPolicy::GetLatencyPercentile(
+    const Controller* controller) const {
+    MethodStats* stats = GetMethodStats(controller);
+    if (stats == NULL) {
+        return -1;
+    }
+    const int64_t now_us = butil::cpuwide_time_us();
+    if (now_us >= stats->next_update_us.load(butil::memory_order_relaxed)) {
+        stats->next_update_us.store(now_us + UPDATE_INTERVAL_US,
+                                    butil::memory_order_relaxed);
+        int64_t latency_us = -1;
+        if (stats->latency.qps(_options.window_size) * _options.window_size
+            >= _options.min_sample_count) {
+            latency_us =
+                stats->latency.latency_percentile(_options.latency_percentile);
+        }
+        stats->latency_percentile_us.store(latency_us,
+                                           butil::memory_order_relaxed);
+    }
+    return stats->latency_percentile_us.load(butil::memory_order_relaxed);
+}
+
+int32_t AdaptiveBackupRequestPolicy::GetBackupRequestMs(
+    const Controller* controller) const {
+    const int64_t latency_us = GetLatencyPercentile(controller);
+    if (latency_us < 0) {
+        return _options.default_backup_request_ms;
+    }
+    int32_t backup_ms = std::max<int64_t>((latency_us + 999) / 1000,
+                                          _options.min_backup_request_ms);
+    if (_options.max_backup_request_ms >= 0) {
+        backup_ms = std::min(backup_ms, _options.max_backup_request_ms);
+    }
+    return backup_ms;
+}
+
+bool AdaptiveBackupRequestPolicy::DoBackup(const Controller*) const {
+    int64_t tokens = _stats->tokens.load(butil::memory_order_relaxed);
+    do {
+        if (tokens < TOKEN_UNIT) {
+            _stats->nbackup_rejected << 1;
+            return false;
+        }
+    } while (!_stats->tokens.compare_exchange_weak(
+                 tokens, tokens - TOKEN_UNIT, butil::memory_order_relaxed));
+    _stats->nbackup << 1;
+    return true;
+}
+
+void AdaptiveBackupRequestPolicy::OnBackupRequestCanceled(const Controller*) {
+    _stats->tokens.fetch_add(TOKEN_UNIT, butil::memory_order_relaxed);
+    _stats->nbackup << -1;
+    _stats->nbackup_rejected << 1;
+}
+
+void AdaptiveBackupRequestPolicy::OnRPCEnd(const Controller* controller) {
+    MethodStats* stats = GetMethodStats(controller);
+    if (stats != NULL && !controller->Failed()) {
+        stats->latency << controller->latency_us();
+    }
+    if (controller->backup_request_won()) {
+        _stats->nbackup_win << 1;
+    }
+    const int64_t deposit = (int64_t)(_options.max_backup_ratio * TOKEN_UNIT);
+    int64_t tokens = _stats->tokens.load(butil::memory_order_relaxed);
+    while (tokens < MAX_TOKENS &&
+           !_stats->tokens.compare_exchange_weak(
+               tokens, std::min(tokens + deposit, MAX_TOKENS),
+               butil::memory_order_relaxed)) {}
+}
+
+} // namespace brpc
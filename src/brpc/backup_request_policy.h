@@ -19,6 +19,7 @@
 #ifndef BRPC_BACKUP_REQUEST_POLICY_H
 #define BRPC_BACKUP_REQUEST_POLICY_H
 
+#include "butil/strings/string_piece.h"
 #include "brpc/controller.h"
 
 namespace brpc {
@@ -36,6 +37,96 @@ public:
 
     // Called  when a rpc is end, user can collect call information to adjust policy.
     virtual void OnRPCEnd(const Controller* controller) = 0;
+
+    // Called when the backup request allowed by DoBackup() is not sent
+    // after all, e.g. rejected by the retry budget of the channel. Policies
+    // limiting backup requests should give back what DoBackup() took.
+    virtual void OnBackupRequestCanceled(const Controller* controller) {}
+};
+
+struct AdaptiveBackupRequestOptions {
+    // Constructed with default options.
+    AdaptiveBackupRequestOptions();
+
+    // Send backup request when RPC does not finish after this percentile of
+    // latencies of the method, in (0, 1).
+    // Default: 0.95
+    double latency_percentile;
+
+    // Delay in milliseconds before enough latencies of the method are
+    // collected. -1 means no backup request during the period.
+    // Default: -1
+    int32_t default_backup_request_ms;
+
+    // Bounds of the adaptive delay in milliseconds. Negative
+    // `max_backup_request_ms' means no upper bound.
+    // Default: 1 and -1
+    int32_t min_backup_request_ms;
+    int32_t max_backup_request_ms;
+
+    // At most so much ratio of RPCs send backup requests, to avoid doubling
+    // load on servers when latencies of all servers increase.
+    // Default: 0.1
+    double max_backup_ratio;
+
+    // Latencies within so many seconds are used to compute the percentile.
+    // Default: 10
+    int window_size;
+
+    // Minimum number of RPCs in the window before the percentile is trusted.
+    // Default: 100
+    int min_sample_count;
+};
+
+// A BackupRequestPolicy sending backup requests at a percentile of latencies
+// observed for each method, instead of a fixed delay tuned by hand. The
+// number of backup requests is limited by a budget proportional to number
+// of RPCs. This object is NOT owned by channel and should remain valid when
+// channel is used.
+// Example:
+//   brpc::AdaptiveBackupRequestOptions opt;
+//   opt.latency_percentile = 0.9;
+//   static brpc::AdaptiveBackupRequestPolicy policy(opt);
+//   policy.Expose("my_channel");
+//   channel_options.backup_request_policy = &policy;
+class AdaptiveBackupRequestPolicy : public BackupRequestPolicy {
+public:
+    AdaptiveBackupRequestPolicy();
+    explicit AdaptiveBackupRequestPolicy(
+        const AdaptiveBackupRequestOptions& options);
+    ~AdaptiveBackupRequestPolicy() override;
+
+    // Expose number of backup requests, number of backup requests answered
+    // earlier than the original requests and number of backup requests
+    // rejected by the budget as bvars prefixed with `prefix'.
+    // Returns 0 on success, -1 otherwise.
+    int Expose(const butil::StringPiece& prefix);
+
+    int32_t GetBackupRequestMs(const Controller* controller) const override;
+    bool DoBackup(const Controller* controller) const override;
+    void OnRPCEnd(const Controller* controller) override;
+    void OnBackupRequestCanceled(const Controller* controller) override;
+
+    const AdaptiveBackupRequestOptions& options() const { return _options; }
+
+protected:
+    // Returns latency in microseconds at `latency_percentile' of successful
+    // RPCs of the method in recent `window_size' seconds, -1 if there are
+    // fewer than `min_sample_count' RPCs. The percentile is read from bvar
+    // which samples once per second and is refreshed every 100ms, tests
+    // override this to feed latencies directly.
+    virtual int64_t GetLatencyPercentile(const Controller* controller) const;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(AdaptiveBackupRequestPolicy);
+
+    struct MethodStats;
+    struct Stats;
+    MethodStats* GetMethodStats(const Controller* controller) const;
+
+    AdaptiveBackupRequestOptions _options;
+    // Use opaque pointer to not depend on bvar in this header.
+    Stats* _stats;
 };
 
 }
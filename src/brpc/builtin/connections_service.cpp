@@ -121,7 +121,8 @@ void ConnectionsService::PrintConnections(
         if (is_channel_conn) {
             os << "<th>Local</th>"
                 "<th>RecentErr</th>"
-                "<th>nbreak</th>";
+                "<th>nbreak</th>"
+                "<th>nslow</th>";
         }
         os << "<th>SSL</th>"
             "<th>Protocol</th>"
@@ -140,7 +141,7 @@ void ConnectionsService::PrintConnections(
     } else {
         os << "CreatedTime               |RemoteSide         |";
         if (is_channel_conn) {
-            os << "Local|RecentErr|nbreak|";
+            os << "Local|RecentErr|nbreak|nslow|";
         }
         os << "SSL|Protocol    |fd   |"
             "InBytes/s|In/s  |InBytes/m |In/m    |"
@@ -178,7 +179,8 @@ void ConnectionsService::PrintConnections(
             if (is_channel_conn) {
                 os << min_width(ptr->local_side().port, 5) << bar
                    << min_width(ptr->recent_error_count(), 10) << bar
-                   << min_width(ptr->isolated_times(), 7) << bar;
+                   << min_width(ptr->isolated_times(), 7) << bar
+                   << min_width(ptr->latency_outlier_times(), 5) << bar;
             }
             os << min_width("-", 3) << bar
                << min_width("-", 12) << bar
@@ -284,7 +286,8 @@ void ConnectionsService::PrintConnections(
                     os << min_width("-", 5) << bar;
                 }
                 os << min_width(ptr->recent_error_count(), 10) << bar
-                   << min_width(ptr->isolated_times(), 7) << bar;
+                   << min_width(ptr->isolated_times(), 7) << bar
+                   << min_width(ptr->latency_outlier_times(), 5) << bar;
             }
             os << SSLStateToYesNo(ptr->ssl_state(), use_html) << bar;
             char protname[32];
@@ -30,6 +30,8 @@
 #include "brpc/global.h"
 #include "brpc/span.h"
 #include "brpc/details/load_balancer_with_naming.h"
+#include "brpc/details/channel_concurrency_limiter.h"
+#include "brpc/details/adaptive_compressor.h"
 #include "brpc/controller.h"
 #include "brpc/channel.h"
 #include "brpc/serialized_request.h"
@@ -64,7 +66,14 @@ ChannelOptions::ChannelOptions()
     , auth(NULL)
     , backup_request_policy(NULL)
     , retry_policy(NULL)
+    , retry_budget(NULL)
     , ns_filter(NULL)
+    , subset_size(0)
+    , subset_client_id(-1)
+    , subset_client_count(0)
+    , max_concurrency(0)
+    , write_linger_us(0)
+    , http_pipelining(false)
 {}
 
 ChannelSSLOptions* ChannelOptions::mutable_ssl_options() {
@@ -216,7 +225,9 @@ int Channel::InitChannelOptions(const ChannelOptions* options) {
         // connection_type.
         const bool has_error = _options.connection_type.has_error();
         
-        if (protocol->supported_connection_type & CONNECTION_TYPE_SINGLE) {
+        // Pipelining http requests over a single connection is opt-in.
+        if ((protocol->supported_connection_type & CONNECTION_TYPE_SINGLE) &&
+            _options.protocol != PROTOCOL_HTTP) {
             _options.connection_type = CONNECTION_TYPE_SINGLE;
         } else if (protocol->supported_connection_type & CONNECTION_TYPE_POOLED) {
             _options.connection_type = CONNECTION_TYPE_POOLED;
@@ -234,6 +245,13 @@ int Channel::InitChannelOptions(const ChannelOptions* options) {
                        << ConnectionTypeToString(_options.connection_type);
             return -1;
         }
+        if (_options.connection_type == CONNECTION_TYPE_SINGLE &&
+            _options.protocol == PROTOCOL_HTTP && !_options.http_pipelining) {
+            LOG(ERROR) << "connection_type=single pipelines http requests, "
+                "set ChannelOptions.http_pipelining if the server answers "
+                "them in order";
+            return -1;
+        }
     }
 
     _preferred_index = get_client_side_messenger()->FindProtocolIndex(_options.protocol);
@@ -254,6 +272,18 @@ int Channel::InitChannelOptions(const ChannelOptions* options) {
     if (!cg.empty() && (::isspace(cg.front()) || ::isspace(cg.back()))) {
         butil::TrimWhitespace(cg, butil::TRIM_ALL, &cg);
     }
+
+    if (ChannelConcurrencyLimiter::Create(
+            _options.max_concurrency, &_concurrency_limiter) != 0) {
+        LOG(ERROR) << "Fail to create ConcurrencyLimiter for max_concurrency="
+                   << _options.max_concurrency.value();
+        return -1;
+    }
+    if (_options.adaptive_compression.compress_type != COMPRESS_TYPE_NONE) {
+        _adaptive_compressors.reset(new ClientAdaptiveCompressors);
+    } else {
+        _adaptive_compressors.reset();
+    }
     return 0;
 }
 
@@ -409,6 +439,13 @@ int Channel::Init(const char* ns_url,
     ns_opt.use_rdma = _options.use_rdma;
     ns_opt.channel_signature = ComputeChannelSignature(_options);
     ns_opt.hc_option =  _options.hc_option;
+    if (_options.subset_size > 0) {
+        ns_opt.subset.size = _options.subset_size;
+        ns_opt.subset.client_id = (_options.subset_client_id >= 0 ?
+                                   _options.subset_client_id :
+                                   DefaultSubsetClientId());
+        ns_opt.subset.client_count = _options.subset_client_count;
+    }
     if (CreateSocketSSLContext(_options, &ns_opt.ssl_ctx) != 0) {
         return -1;
     }
@@ -461,6 +498,10 @@ void Channel::CallMethod(const google::protobuf::MethodDescriptor* method,
     }
     cntl->_preferred_index = _preferred_index;
     cntl->_retry_policy = _options.retry_policy;
+    cntl->_retry_budget = _options.retry_budget;
+    if (cntl->_retry_budget) {
+        cntl->_retry_budget->OnRequest();
+    }
     if (_options.enable_circuit_breaker) {
         cntl->add_flag(Controller::FLAGS_ENABLED_CIRCUIT_BREAKER);
     }
@@ -530,6 +571,13 @@ void Channel::CallMethod(const google::protobuf::MethodDescriptor* method,
     cntl->_pack_request = _pack_request;
     cntl->_method = method;
     cntl->_auth = _options.auth;
+    cntl->_write_linger_us = (_options.write_linger_us > 0 ?
+                              _options.write_linger_us : 0);
+    if (_adaptive_compressors != NULL && method != NULL &&
+        cntl->request_compress_type() == COMPRESS_TYPE_NONE) {
+        cntl->_adaptive_compression = &_options.adaptive_compression;
+        cntl->_adaptive_compressor = _adaptive_compressors->Get(method);
+    }
 
     if (SingleServer()) {
         cntl->_single_server_id = _server_id;
@@ -543,6 +591,8 @@ void Channel::CallMethod(const google::protobuf::MethodDescriptor* method,
     // possible executions, including:
     //   HandleSendFailed => OnVersionedRPCReturned => IssueRPC(pack_request)
     _serialize_request(&cntl->_request_buf, cntl, request);
+    cntl->_adaptive_compression = NULL;
+    cntl->_adaptive_compressor = NULL;
     if (cntl->FailedInline()) {
         // Handle failures caused by serialize_request, and these error_codes
         // should be excluded from the retry_policy.
@@ -555,6 +605,16 @@ void Channel::CallMethod(const google::protobuf::MethodDescriptor* method,
                         "-usercode_in_pthread is on");
         return cntl->HandleSendFailed();
     }
+    if (_concurrency_limiter) {
+        cntl->_concurrency_limiter = _concurrency_limiter;
+        if (!_concurrency_limiter->OnRequested(cntl)) {
+            cntl->SetFailed(ELIMIT, "Reached max_concurrency=%d of channel",
+                            _concurrency_limiter->MaxConcurrency());
+            // The RPC is rejected locally, retrying makes no sense.
+            cntl->set_max_retry(0);
+            return cntl->HandleSendFailed();
+        }
+    }
 
     if (!cntl->_request_streams.empty()) {
         // Currently we cannot handle retry and backup request correctly
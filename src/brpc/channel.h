@@ -23,6 +23,7 @@
 // on internal structures, use opaque pointers instead.
 
 #include <ostream>                          // std::ostream
+#include <memory>                           // std::unique_ptr
 #include "bthread/errno.h"                  // Redefine errno
 #include "butil/intrusive_ptr.hpp"          // butil::intrusive_ptr
 #include "butil/ptr_container.h"
@@ -30,16 +31,21 @@
 #include "brpc/channel_base.h"              // ChannelBase
 #include "brpc/adaptive_protocol_type.h"    // AdaptiveProtocolType
 #include "brpc/adaptive_connection_type.h"  // AdaptiveConnectionType
+#include "brpc/adaptive_max_concurrency.h"  // AdaptiveMaxConcurrency
+#include "brpc/adaptive_compression.h"      // AdaptiveCompressionOptions
 #include "brpc/socket_id.h"                 // SocketId
 #include "brpc/controller.h"                // brpc::Controller
 #include "brpc/details/profiler_linker.h"
 #include "brpc/retry_policy.h"
+#include "brpc/retry_budget.h"
 #include "brpc/backup_request_policy.h"
 #include "brpc/naming_service_filter.h"
 #include "brpc/health_check_option.h"
 
 namespace brpc {
 
+class ClientAdaptiveCompressors;
+
 struct ChannelOptions {
     // Constructed with default options.
     ChannelOptions();
@@ -130,6 +136,15 @@ struct ChannelOptions {
     // Default: NULL
     const RetryPolicy* retry_policy;
 
+    // Limit retries and backup requests of all RPCs over this channel(or
+    // channels sharing the budget) to avoid overloading servers by retrying
+    // during partial outages. The interface is defined in
+    // src/brpc/retry_budget.h
+    // This object is NOT owned by channel and should remain valid when
+    // channel is used.
+    // Default: NULL
+    RetryBudget* retry_budget;
+
     // Filter ServerNodes (i.e. based on `tag' field of `ServerNode')
     // which are generated by NamingService. The interface is defined
     // in src/brpc/naming_service_filter.h
@@ -148,6 +163,62 @@ struct ChannelOptions {
     // Its priority is higher than FLAGS_health_check_path and FLAGS_health_check_timeout_ms.
     // When it is not set, FLAGS_health_check_path and FLAGS_health_check_timeout_ms will take effect.
     HealthCheckOption hc_option;
+
+    // Connect to a deterministic subset of at most so many servers in the
+    // NamingService instead of all of them, which reduces connections and
+    // health checks dramatically when there are many clients and servers.
+    // The subset is stable and changes little when servers are added or
+    // removed. Subsetting is applied before `ns_filter'.
+    // Default: 0 (disabled)
+    int subset_size;
+
+    // Identify this client when selecting the subset. Clients with different
+    // ids select different subsets. Negative value means using an id derived
+    // from hostname and pid of this process.
+    // Default: -1
+    int64_t subset_client_id;
+
+    // Total number of clients, set this along with `subset_client_id' in
+    // [0, subset_client_count) to spread clients evenly over servers.
+    // Otherwise subsets are chosen by rendezvous hashing which is only
+    // balanced on average.
+    // Default: 0
+    int subset_client_count;
+
+    // Max number of outstanding RPCs over this channel. RPCs beyond the
+    // limit fail immediately with ELIMIT without being sent or retried, so
+    // that overload is shed at client side before requests queue up on
+    // saturated servers. Accepts the same values as
+    // ServerOptions.max_concurrency, e.g. a number for a constant limit, or
+    // "auto" to adjust the limit by observed latencies and errors of the
+    // downstream cluster.
+    // Default: "unlimited"
+    AdaptiveMaxConcurrency max_concurrency;
+
+    // Compress requests of each method only when it pays off, instead of
+    // setting Controller::set_request_compress_type for each RPC. See
+    // brpc/adaptive_compression.h for details.
+    // Default: disabled
+    AdaptiveCompressionOptions adaptive_compression;
+
+    // Wait for at most so many microseconds before writing a small request
+    // into a connection, so that small requests issued concurrently to the
+    // same connection are sent in one writev. Trading a little latency for
+    // far fewer syscalls pays off when many threads send small requests
+    // over a few connections at high QPS. Values larger than 16383 are
+    // truncated, requests larger than -socket_write_linger_max_size are
+    // written without waiting.
+    // Default: 0 (write immediately)
+    int32_t write_linger_us;
+
+    // Pipeline http requests when connection_type is "single". Set this only
+    // when the server answers pipelined HTTP/1.1 requests in the order they
+    // arrive, otherwise responses are matched with wrong requests. brpc
+    // servers may answer requests from one connection out of order, use h2
+    // with them instead. Channel.Init() fails when connection_type of a http
+    // channel is "single" and this option is false.
+    // Default: false
+    bool http_pipelining;
 private:
     // SSLOptions is large and not often used, allocate it on heap to
     // prevent ChannelOptions from being bloated in most cases.
@@ -251,6 +322,12 @@ protected:
     // It will be destroyed after channel's destruction and all
     // the RPC above has finished
     butil::intrusive_ptr<SharedLoadBalancer> _lb;
+    // Shared with controllers like _lb, NULL when max_concurrency is
+    // unlimited.
+    butil::intrusive_ptr<ChannelConcurrencyLimiter> _concurrency_limiter;
+    // Decide compression of requests to each method, NULL unless
+    // options.adaptive_compression is set.
+    std::unique_ptr<ClientAdaptiveCompressors> _adaptive_compressors;
     ChannelOptions _options;
     int _preferred_index;
 };
@@ -52,6 +52,24 @@ DEFINE_int32(circuit_breaker_half_open_window_size, 0,
     "go to the closed state. Otherwise, it goes back to the open state. "
     "Values == 0 disables this feature");
 BRPC_VALIDATE_GFLAG(circuit_breaker_half_open_window_size, NonNegativeInteger);
+DEFINE_double(circuit_breaker_latency_outlier_multiple, 0,
+    "Isolate a server when the ema latency of its successful requests is "
+    "larger than this multiple of the median ema latency of all servers in "
+    "the same channel. Only works for channels with enable_circuit_breaker. "
+    "Values <= 0 disables this feature");
+BRPC_VALIDATE_GFLAG(circuit_breaker_latency_outlier_multiple, PassValidate);
+DEFINE_int32(circuit_breaker_latency_outlier_window_size, 100,
+    "Sample size of the ema latency used for latency outlier detection. A "
+    "server is not considered before collecting so many successful requests.");
+DEFINE_int32(circuit_breaker_latency_outlier_min_latency_us, 1000,
+    "A server whose ema latency is less than this value is never considered "
+    "as a latency outlier.");
+BRPC_VALIDATE_GFLAG(circuit_breaker_latency_outlier_min_latency_us, NonNegativeInteger);
+DEFINE_int32(circuit_breaker_max_ejection_percent, 10,
+    "Latency outlier detection never makes more than this percentage of "
+    "servers in a channel unavailable, ranging from 0-100. One server can "
+    "be ejected in small channels as long as this value is positive.");
+BRPC_VALIDATE_GFLAG(circuit_breaker_max_ejection_percent, NonNegativeInteger);
 
 namespace {
 // EPSILON is used to generate the smoothing coefficient when calculating EMA.
@@ -180,7 +198,13 @@ CircuitBreaker::CircuitBreaker()
     , _isolated_times(0)
     , _broken(false)
     , _half_open(false)
-    , _half_open_success_count(0) {
+    , _half_open_success_count(0)
+    , _outlier_window_size(
+        std::max(FLAGS_circuit_breaker_latency_outlier_window_size, 1))
+    , _outlier_smooth(std::pow(EPSILON, 1.0 / _outlier_window_size))
+    , _outlier_sample_count(0)
+    , _outlier_ema_latency(0)
+    , _latency_outlier_times(0) {
 }
 
 bool CircuitBreaker::OnCallEnd(int error_code, int64_t latency) {
@@ -197,6 +221,9 @@ bool CircuitBreaker::OnCallEnd(int error_code, int64_t latency) {
     if (_broken.load(butil::memory_order_relaxed)) {
         return false;
     }
+    if (error_code == 0 && FLAGS_circuit_breaker_latency_outlier_multiple > 0) {
+        UpdateOutlierLatency(latency);
+    }
     if (FLAGS_circuit_breaker_half_open_window_size > 0
         && _half_open.load(butil::memory_order_relaxed)) {
         if (error_code != 0) {
@@ -222,6 +249,8 @@ void CircuitBreaker::Reset() {
     _long_window.Reset();
     _short_window.Reset();
     _last_reset_time_ms = butil::cpuwide_time_ms();
+    _outlier_sample_count.store(0, butil::memory_order_relaxed);
+    _outlier_ema_latency.store(0, butil::memory_order_relaxed);
     _broken.store(false, butil::memory_order_release);
     if (FLAGS_circuit_breaker_half_open_window_size > 0) {
         _half_open.store(true, butil::memory_order_relaxed);
@@ -236,6 +265,42 @@ void CircuitBreaker::MarkAsBroken() {
     }
 }
 
+void CircuitBreaker::MarkAsLatencyOutlier() {
+    if (!_broken.exchange(true, butil::memory_order_acquire)) {
+        _isolated_times.fetch_add(1, butil::memory_order_relaxed);
+        _latency_outlier_times.fetch_add(1, butil::memory_order_relaxed);
+        UpdateIsolationDuration();
+    }
+}
+
+int64_t CircuitBreaker::outlier_ema_latency_us() const {
+    if (FLAGS_circuit_breaker_latency_outlier_multiple <= 0 ||
+        _outlier_sample_count.load(butil::memory_order_relaxed) <
+        _outlier_window_size) {
+        return 0;
+    }
+    return _outlier_ema_latency.load(butil::memory_order_relaxed);
+}
+
+void CircuitBreaker::UpdateOutlierLatency(int64_t latency) {
+    if (_outlier_sample_count.load(butil::memory_order_relaxed) < _outlier_window_size) {
+        _outlier_sample_count.fetch_add(1, butil::memory_order_relaxed);
+    }
+    int64_t ema_latency = _outlier_ema_latency.load(butil::memory_order_relaxed);
+    do {
+        int64_t next_ema_latency = 0;
+        if (0 == ema_latency) {
+            next_ema_latency = latency;
+        } else {
+            next_ema_latency =
+                ema_latency * _outlier_smooth + latency * (1 - _outlier_smooth);
+        }
+        if (_outlier_ema_latency.compare_exchange_weak(ema_latency, next_ema_latency)) {
+            return;
+        }
+    } while (true);
+}
+
 void CircuitBreaker::UpdateIsolationDuration() {
     int64_t now_time_ms = butil::cpuwide_time_ms();
     int isolation_duration_ms = _isolation_duration_ms.load(butil::memory_order_relaxed);
@@ -47,11 +47,26 @@ public:
     // only the first call will take effect.
     void MarkAsBroken();
 
+    // Mark the Socket as broken because its latency is far above the other
+    // servers of the same cluster. See LatencyOutlierDetector.
+    void MarkAsLatencyOutlier();
+
+    // EMA of latencies of successful calls since last Reset(), used to find
+    // servers that are slow but still successful. Returns 0 when less than
+    // circuit_breaker_latency_outlier_window_size calls were sampled or
+    // latency outlier detection is disabled.
+    int64_t outlier_ema_latency_us() const;
+
     // Number of times marked as broken
     int isolated_times() const {
         return _isolated_times.load(butil::memory_order_relaxed);
     }
 
+    // Number of times isolated as a latency outlier
+    int latency_outlier_times() const {
+        return _latency_outlier_times.load(butil::memory_order_relaxed);
+    }
+
     // The duration that should be isolated when the socket fails in milliseconds.
     // The higher the frequency of socket errors, the longer the duration.
     int isolation_duration_ms() const {
@@ -60,6 +75,7 @@ public:
 
 private:
     void UpdateIsolationDuration();
+    void UpdateOutlierLatency(int64_t latency);
 
     class EmaErrorRecorder {
     public:
@@ -89,6 +105,12 @@ private:
     butil::atomic<bool> _broken;
     butil::atomic<bool> _half_open;
     butil::atomic<int32_t> _half_open_success_count;
+
+    const int _outlier_window_size;
+    const double _outlier_smooth;
+    butil::atomic<int32_t> _outlier_sample_count;
+    butil::atomic<int64_t> _outlier_ema_latency;
+    butil::atomic<int> _latency_outlier_times;
 };
 
 }  // namespace brpc
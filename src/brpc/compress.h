@@ -169,6 +169,12 @@ struct CompressHandler {
 
     // Name of the compression algorithm, must be string constant.
     const char* name;
+
+    // [Optional] Compress `data' which is serialized already into `buf'.
+    // Protocols serializing messages before choosing the compression, e.g.
+    // adaptive compression, call this to not copy `data' into a Serializer.
+    // Returns true on success, false otherwise
+    bool (*CompressSerialized)(const butil::IOBuf& data, butil::IOBuf* buf);
 };
 
 // [NOT thread-safe] Register `handler' using key=`type'
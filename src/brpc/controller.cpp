@@ -19,6 +19,7 @@
 #include <signal.h>
 #include <openssl/md5.h>
 #include <google/protobuf/descriptor.h>
+#include <google/protobuf/arena.h>
 #include <gflags/gflags.h>
 #include "bthread/bthread.h"
 #include "butil/build_config.h"    // OS_MACOSX
@@ -28,6 +29,7 @@
 #include "bthread/bthread.h"
 #include "bthread/unstable.h"
 #include "bvar/bvar.h"
+#include "butil/object_pool.h"
 #include "brpc/socket.h"
 #include "brpc/socket_map.h"
 #include "brpc/channel.h"
@@ -39,10 +41,13 @@
 #include "brpc/server.h"   // Server::_session_local_data_pool
 #include "brpc/simple_data_pool.h"
 #include "brpc/retry_policy.h"
+#include "brpc/retry_budget.h"
 #include "brpc/stream_impl.h"
 #include "brpc/policy/streaming_rpc_protocol.h" // FIXME
+#include "brpc/policy/http_rpc_protocol.h"      // ParseContentType
 #include "brpc/rpc_dump.h"
 #include "brpc/details/usercode_backup_pool.h"  // RunUserCode
+#include "brpc/details/channel_concurrency_limiter.h"
 #include "brpc/mongo_service_adaptor.h"
 
 // Force linking the .o in UT (which analysis deps by inclusions)
@@ -95,6 +100,10 @@ DEFINE_bool(graceful_quit_on_sigterm, false,
             "Register SIGTERM handle func to quit graceful");
 DEFINE_bool(graceful_quit_on_sighup, false,
             "Register SIGHUP handle func to quit graceful");            
+DEFINE_int32(response_arena_initial_block_size, 65536,
+             "Bytes of the first block of Controller::response_arena(), "
+             "which is reused by RPCs after the arena is returned to the "
+             "pool. Changes only affect newly created arenas");
 
 const IdlNames idl_single_req_single_res = { "req", "res" };
 const IdlNames idl_single_req_multi_res = { "req", "" };
@@ -118,6 +127,26 @@ static bvar::PassiveStatus<std::string> s_rpc_revision(
 
 static const int RETRY_AVOIDANCE = 8;
 
+// Pooled by butil::get_object. The first block of the arena outlives
+// Arena::Reset() so that it's reused without malloc.
+struct ResponseArena {
+    ResponseArena()
+        : initial_block_size(std::max(FLAGS_response_arena_initial_block_size, 0))
+        , initial_block(initial_block_size ? new char[initial_block_size] : NULL)
+        , arena(MakeOptions(initial_block.get(), initial_block_size)) {}
+
+    static google::protobuf::ArenaOptions MakeOptions(char* block, size_t size) {
+        google::protobuf::ArenaOptions options;
+        options.initial_block = block;
+        options.initial_block_size = size;
+        return options;
+    }
+
+    size_t initial_block_size;
+    std::unique_ptr<char[]> initial_block;
+    google::protobuf::Arena arena;
+};
+
 // Defined in parallel_channel.cpp
 void DestroyParallelChannelDone(google::protobuf::Closure* c);
 const Controller* GetSubControllerOfParallelChannel(
@@ -206,13 +235,20 @@ void Controller::ResetNonPods() {
     }
     delete _sender;
     _lb.reset(NULL);
+    _concurrency_limiter.reset(NULL);
     _current_call.Reset();
     ExcludedServers::Destroy(_accessed);
     _request_buf.clear();
+    if (_response_arena) {
+        _response_arena->arena.Reset();
+        butil::return_object(_response_arena);
+    }
     delete _http_request;
     delete _http_response;
     delete _request_user_fields;
     delete _response_user_fields;
+    delete _request_zero_copy_bytes;
+    delete _response_zero_copy_bytes;
     _request_attachment.clear();
     _response_attachment.clear();
     if (_wpa) {
@@ -254,12 +290,14 @@ void Controller::ResetPods() {
     _request_protocol = PROTOCOL_UNKNOWN;
     _max_retry = UNSET_MAGIC_NUM;
     _retry_policy = NULL;
+    _retry_budget = NULL;
     _correlation_id = INVALID_BTHREAD_ID;
     _connection_type = CONNECTION_TYPE_UNKNOWN;
     _timeout_ms = UNSET_MAGIC_NUM;
     _backup_request_ms = UNSET_MAGIC_NUM;
     _backup_request_policy = NULL;
     _connect_timeout_ms = UNSET_MAGIC_NUM;
+    _write_linger_us = 0;
     _real_timeout_ms = UNSET_MAGIC_NUM;
     _deadline_us = -1;
     _timeout_id = 0;
@@ -281,17 +319,23 @@ void Controller::ResetPods() {
     _request_code = 0;
     _single_server_id = INVALID_SOCKET_ID;
     _unfinished_call = NULL;
+    _backup_nretry = -1;
     _stream_creator = NULL;
     _accessed = NULL;
     _pack_request = NULL;
     _method = NULL;
     _auth = NULL;
+    _adaptive_compression = NULL;
+    _adaptive_compressor = NULL;
+    _response_arena = NULL;
     _idl_names = idl_single_req_single_res;
     _idl_result = IDL_VOID_RESULT;
     _http_request = NULL;
     _http_response = NULL;
     _request_user_fields = NULL;
     _response_user_fields = NULL;
+    _request_zero_copy_bytes = NULL;
+    _response_zero_copy_bytes = NULL;
     _request_content_type = CONTENT_TYPE_PB;
     _response_content_type = CONTENT_TYPE_PB;
     _request_streams.clear();
@@ -628,6 +672,16 @@ void Controller::OnVersionedRPCReturned(const CompletionInfo& info,
             CHECK_EQ(0, bthread_id_unlock(info.id));
             return;
         }
+        if (NULL != _retry_budget && !_retry_budget->TryRetry()) {
+            // Retry budget of the channel is exhausted, keep waiting for
+            // the ongoing request.
+            if (NULL != _backup_request_policy) {
+                _backup_request_policy->OnBackupRequestCanceled(this);
+            }
+            _error_code = saved_error;
+            CHECK_EQ(0, bthread_id_unlock(info.id));
+            return;
+        }
 
         // Reset timeout if needed
         int rc = 0;
@@ -660,11 +714,13 @@ void Controller::OnVersionedRPCReturned(const CompletionInfo& info,
             goto END_OF_RPC;
         }
         ++_current_call.nretry;
+        _backup_nretry = _current_call.nretry;
         add_flag(FLAGS_BACKUP_REQUEST);
         return IssueRPC(butil::gettimeofday_us());
     } else {
         auto retry_policy = _retry_policy ? _retry_policy : DefaultRetryPolicy();
-        if (retry_policy->DoRetry(this)) {
+        if (retry_policy->DoRetry(this) &&
+            (NULL == _retry_budget || _retry_budget->TryRetry())) {
             // The error must come from _current_call because:
             //  * we intercepted error from _unfinished_call in OnVersionedRPCReturned
             //  * ERPCTIMEDOUT/ECANCELED are not retrying error by default.
@@ -793,6 +849,9 @@ void Controller::Call::OnComplete(
         if (enable_circuit_breaker) {
             sending_sock->FeedbackCircuitBreaker(error_code,
                 butil::gettimeofday_us() - begin_time_us);
+            if (c->_lb) {
+                c->_lb->DetectLatencyOutliers();
+            }
         }
     }
 
@@ -898,6 +957,11 @@ void Controller::EndRPC(const CompletionInfo& info) {
             delete _unfinished_call;
             _unfinished_call = NULL;
         }
+        // Retries after a failed backup request do not count.
+        if (_backup_nretry >= 0 && info.id == get_id(_backup_nretry) &&
+            !_error_code) {
+            add_flag(FLAGS_BACKUP_REQUEST_WON);
+        }
         // TODO: Replace this with stream_creator.
         HandleStreamConnection(_current_call.sending_sock.get());
         _current_call.OnComplete(this, _error_code, info.responded, true);
@@ -944,6 +1008,13 @@ void Controller::EndRPC(const CompletionInfo& info) {
     }
     // RPC finished, now it's safe to release `LoadBalancerWithNaming'
     _lb.reset();
+    // Release the concurrency before running done so that the next RPC
+    // issued inside done is not rejected.
+    if (_concurrency_limiter) {
+        _concurrency_limiter->OnResponded(
+            _error_code, butil::gettimeofday_us() - _begin_time_us);
+        _concurrency_limiter.reset();
+    }
     if (_span) {
         _span->set_ending_cid(info.id);
         _span->set_async(_done);
@@ -1233,6 +1304,7 @@ void Controller::IssueRPC(int64_t start_realtime_us) {
     wopt.auth_flags = _auth_flags;
     wopt.ignore_eovercrowded = has_flag(FLAGS_IGNORE_EOVERCROWDED);
     wopt.write_in_background = write_to_socket_in_background();
+    wopt.linger_us = _write_linger_us;
     int rc;
     size_t packet_size = 0;
     if (user_packet_guard) {
@@ -1262,6 +1334,17 @@ void Controller::IssueRPC(int64_t start_realtime_us) {
     CHECK_EQ(0, bthread_id_unlock(cid));
 }
 
+google::protobuf::Arena* Controller::response_arena() {
+    if (_response_arena == NULL) {
+        _response_arena = butil::get_object<ResponseArena>();
+        if (_response_arena == NULL) {
+            LOG(ERROR) << "Fail to get ResponseArena";
+            return NULL;
+        }
+    }
+    return &_response_arena->arena;
+}
+
 void Controller::set_auth_context(const AuthContext* ctx) {
     if (_auth_context != NULL) {
         LOG(FATAL) << "Impossible! This function is supposed to be called "
@@ -1503,8 +1586,8 @@ Controller::CreateProgressiveAttachment(StopStyle stop_style) {
         LOG(ERROR) << "One controller can only have one ProgressiveAttachment";
         return NULL;
     }
-    if (_request_protocol != PROTOCOL_HTTP) {
-        LOG(ERROR) << "Only http supports ProgressiveAttachment now";
+    if (_request_protocol != PROTOCOL_HTTP && _request_protocol != PROTOCOL_H2) {
+        LOG(ERROR) << "Only http and h2 support ProgressiveAttachment now";
         return NULL;
     }
     if (_current_call.sending_sock == NULL) {
@@ -1517,8 +1600,13 @@ Controller::CreateProgressiveAttachment(StopStyle stop_style) {
     if (stop_style == FORCE_STOP) {
         httpsock->fail_me_at_server_stop();
     }
+    const bool is_h2 = (_request_protocol == PROTOCOL_H2);
+    bool is_grpc = false;
+    if (is_h2) {
+        policy::ParseContentType(http_request().content_type(), &is_grpc);
+    }
     _wpa.reset(new ProgressiveAttachment(
-                   httpsock, http_request().before_http_1_1()));
+                   httpsock, http_request().before_http_1_1(), is_h2, is_grpc));
     return _wpa;
 }
 
@@ -23,6 +23,7 @@
 // on internal structures, use opaque pointers instead.
 
 #include <functional>                          // std::function
+#include <map>
 #include <gflags/gflags.h>                     // Users often need gflags
 #include <string>
 #include "butil/intrusive_ptr.hpp"             // butil::intrusive_ptr
@@ -66,11 +67,16 @@ namespace brpc {
 class Span;
 class Server;
 class SharedLoadBalancer;
+class ChannelConcurrencyLimiter;
+struct AdaptiveCompressionOptions;
+class AdaptiveCompressor;
+struct ResponseArena;
 class ExcludedServers;
 class RPCSender;
 class StreamSettings;
 class MongoContext;
 class RetryPolicy;
+class RetryBudget;
 class BackupRequestPolicy;
 class InputMessageBase;
 class ThriftStub;
@@ -108,6 +114,9 @@ const int32_t UNSET_MAGIC_NUM = -123456789;
 
 typedef butil::FlatMap<std::string, std::string> UserFieldsMap;
 
+// Field number -> content of bytes fields marked with (brpc.zero_copy_bytes).
+typedef std::map<int, butil::IOBuf> ZeroCopyBytesMap;
+
 // A Controller mediates a single method call. The primary purpose of
 // the controller is to provide a way to manipulate settings per RPC-call 
 // and to find out about RPC-level errors.
@@ -151,6 +160,7 @@ friend void policy::ProcessThriftRequest(InputMessageBase*);
     static const uint32_t FLAGS_PB_SINGLE_REPEATED_TO_ARRAY = (1 << 20);
     static const uint32_t FLAGS_MANAGE_HTTP_BODY_ON_ERROR = (1 << 21);
     static const uint32_t FLAGS_WRITE_TO_SOCKET_IN_BACKGROUND = (1 << 22);
+    static const uint32_t FLAGS_BACKUP_REQUEST_WON = (1 << 23);
 
 public:
     struct Inheritable {
@@ -207,6 +217,10 @@ public:
     // True if a backup request was sent during the RPC.
     bool has_backup_request() const { return has_flag(FLAGS_BACKUP_REQUEST); }
 
+    // True if the RPC was answered by the backup request rather than the
+    // original request.
+    bool backup_request_won() const { return has_flag(FLAGS_BACKUP_REQUEST_WON); }
+
     // This function has different meanings in client and server side.
     // In client side it gets latency of the RPC call. While in server side,
     // it gets queue time before server processes the RPC call.
@@ -284,6 +298,47 @@ public:
 
     bool has_response_user_fields() const { return _response_user_fields; }
 
+    // Top-level bytes fields of request/response marked with
+    //   optional bytes data = 1 [(brpc.zero_copy_bytes) = true];
+    // indexed by field numbers. The sender puts contents of such fields here
+    // instead of into the message, which are appended to the serialized
+    // message without copying. The receiver finds contents of such fields
+    // here instead of in the message, which reference the received buffers
+    // without copying. Receivers not marking the fields parse them as usual,
+    // so this is wire-compatible with plain protobuf. Not working with
+    // compressed messages or content types other than protobuf at sender
+    // side, and only supported by baidu_std.
+    ZeroCopyBytesMap* request_zero_copy_bytes() {
+        if (!_request_zero_copy_bytes) {
+            _request_zero_copy_bytes = new ZeroCopyBytesMap;
+        }
+        return _request_zero_copy_bytes;
+    }
+    bool has_request_zero_copy_bytes() const {
+        return _request_zero_copy_bytes && !_request_zero_copy_bytes->empty();
+    }
+    ZeroCopyBytesMap* response_zero_copy_bytes() {
+        if (!_response_zero_copy_bytes) {
+            _response_zero_copy_bytes = new ZeroCopyBytesMap;
+        }
+        return _response_zero_copy_bytes;
+    }
+    bool has_response_zero_copy_bytes() const {
+        return _response_zero_copy_bytes && !_response_zero_copy_bytes->empty();
+    }
+
+    // [Client-side] Arena to allocate the response on, e.g.
+    //   MyResponse* res = google::protobuf::Arena::CreateMessage<MyResponse>(
+    //       cntl.response_arena());
+    //   stub.MyMethod(&cntl, &req, res, NULL);
+    // Fields of the response are allocated from the arena when the response
+    // is parsed, instead of being malloc-ed one by one. Arenas are pooled and
+    // first -response_arena_initial_block_size bytes of them are reused by
+    // later RPCs. The arena and all messages on it are destroyed when this
+    // Controller is Reset() or destructed, don't use the response afterwards.
+    // Responses created on arenas owned by users are parsed in the same way.
+    google::protobuf::Arena* response_arena();
+
     // User attached data or body of http request, which is wired to network
     // directly instead of being serialized into protobuf messages.
     butil::IOBuf& request_attachment() { return _request_attachment; }
@@ -822,6 +877,7 @@ private:
     // after CallMethod.
     int _max_retry;
     const RetryPolicy* _retry_policy;
+    RetryBudget* _retry_budget;
     // Synchronization object for one RPC call. It remains unchanged even
     // when retry happens. Synchronous RPC will wait on this id.
     CallId _correlation_id;
@@ -833,6 +889,9 @@ private:
     
     uint32_t _pipelined_count;
 
+    // Copied from ChannelOptions.write_linger_us
+    uint32_t _write_linger_us;
+
     // [Timeout related]
     int32_t _timeout_ms;
     int32_t _connect_timeout_ms;
@@ -865,12 +924,16 @@ private:
     uint64_t _request_code;
     SocketId _single_server_id;
     butil::intrusive_ptr<SharedLoadBalancer> _lb;
+    // Limiter of the channel, released when RPC ends.
+    butil::intrusive_ptr<ChannelConcurrencyLimiter> _concurrency_limiter;
 
     // for passing parameters to created bthread, don't modify it otherwhere.
     CompletionInfo _tmp_completion_info;
     
     Call _current_call;
     Call* _unfinished_call;
+    // `nretry' of the backup request, -1 if no backup request was sent.
+    int _backup_nretry;
     ExcludedServers* _accessed;
     
     StreamCreator* _stream_creator;
@@ -879,7 +942,12 @@ private:
     Protocol::PackRequest _pack_request;
     const google::protobuf::MethodDescriptor* _method;
     const Authenticator* _auth;
+    // Options of the channel and its compressor of the method, only valid
+    // during serialize_request.
+    const AdaptiveCompressionOptions* _adaptive_compression;
+    AdaptiveCompressor* _adaptive_compressor;
     butil::IOBuf _request_buf;
+    ResponseArena* _response_arena;
     IdlNames _idl_names;
     int64_t _idl_result;
 
@@ -890,6 +958,10 @@ private:
     UserFieldsMap* _request_user_fields;
     UserFieldsMap* _response_user_fields;
 
+    // Bytes fields sent and received without copying.
+    ZeroCopyBytesMap* _request_zero_copy_bytes;
+    ZeroCopyBytesMap* _response_zero_copy_bytes;
+
     std::unique_ptr<KVMap> _session_kv;
 
     // Fields with large size but low access frequency 
@@ -0,0 +1,210 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+
+#include <gflags/gflags.h>
+#include <google/protobuf/descriptor.h>
+#include "brpc/reloadable_flags.h"
+#include "brpc/details/adaptive_compressor.h"
+
+namespace brpc {
+
+DEFINE_int32(adaptive_compression_window_size, 32,
+             "Decide whether to keep compressing messages of a method after "
+             "so many of them are compressed");
+BRPC_VALIDATE_GFLAG(adaptive_compression_window_size, PositiveInteger);
+
+DEFINE_int32(adaptive_compression_probe_interval, 128,
+             "Compress one of so many messages of a method whose compression "
+             "is off, to find out whether compressing pays off again");
+BRPC_VALIDATE_GFLAG(adaptive_compression_probe_interval, PositiveInteger);
+
+static double GetRatio(void* arg) {
+    return static_cast<AdaptiveCompressor*>(arg)->ratio();
+}
+
+static double GetCpuUs(void* arg) {
+    return static_cast<AdaptiveCompressor*>(arg)->cpu_us();
+}
+
+AdaptiveCompressor::AdaptiveCompressor(AdaptiveCompressor* stats)
+    : _stats(stats != NULL ? stats : this)
+    , _enabled(true)
+    , _nprobe(0)
+    , _window_count(0)
+    , _window_original_size(0)
+    , _window_compressed_size(0)
+    , _window_cpu_ns(0)
+    , _ratio_bvar(GetRatio, this)
+    , _cpu_us_bvar(GetCpuUs, this) {}
+
+CompressType AdaptiveCompressor::Select(
+    size_t size, const AdaptiveCompressionOptions& options) {
+    if (options.compress_type == COMPRESS_TYPE_NONE) {
+        return COMPRESS_TYPE_NONE;
+    }
+    if (size >= options.min_size) {
+        if (enabled()) {
+            return options.compress_type;
+        }
+        // Samples from probes turn compression on again if the messages
+        // become compressible.
+        if (_nprobe.fetch_add(1, butil::memory_order_relaxed) %
+            FLAGS_adaptive_compression_probe_interval == 0) {
+            return options.compress_type;
+        }
+    }
+    _stats->_nuncompressed << 1;
+    return COMPRESS_TYPE_NONE;
+}
+
+void AdaptiveCompressor::OnCompressed(
+    size_t original_size, size_t compressed_size, int64_t cpu_ns,
+    const AdaptiveCompressionOptions& options) {
+    _stats->_ncompressed << 1;
+    _stats->_original_size << original_size;
+    _stats->_compressed_size << compressed_size;
+    _stats->_cpu_ns << cpu_ns;
+
+    BAIDU_SCOPED_LOCK(_mutex);
+    ++_window_count;
+    _window_original_size += original_size;
+    _window_compressed_size += compressed_size;
+    _window_cpu_ns += cpu_ns;
+    if (_window_count < FLAGS_adaptive_compression_window_size) {
+        return;
+    }
+    bool worth = (_window_compressed_size <=
+                  options.max_ratio * _window_original_size);
+    if (worth && options.min_saved_bytes_per_us > 0) {
+        const int64_t saved = _window_original_size - _window_compressed_size;
+        worth = (saved * 1000.0 >=
+                 options.min_saved_bytes_per_us * _window_cpu_ns);
+    }
+    _enabled.store(worth, butil::memory_order_relaxed);
+    _window_count = 0;
+    _window_original_size = 0;
+    _window_compressed_size = 0;
+    _window_cpu_ns = 0;
+}
+
+double AdaptiveCompressor::ratio() const {
+    const int64_t original_size = _original_size.get_value();
+    if (original_size <= 0) {
+        return 0;
+    }
+    return _compressed_size.get_value() / (double)original_size;
+}
+
+double AdaptiveCompressor::cpu_us() const {
+    const int64_t n = _ncompressed.get_value();
+    if (n <= 0) {
+        return 0;
+    }
+    return _cpu_ns.get_value() / 1000.0 / n;
+}
+
+int AdaptiveCompressor::Expose(const butil::StringPiece& prefix) {
+    if (_ncompressed.expose_as(prefix, "compress_count") != 0 ||
+        _nuncompressed.expose_as(prefix, "uncompressed_count") != 0 ||
+        _ratio_bvar.expose_as(prefix, "compress_ratio") != 0 ||
+        _cpu_us_bvar.expose_as(prefix, "compress_cpu_us") != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+void AdaptiveCompressor::Describe(std::ostream& os) const {
+    os << (enabled() ? "on" : "off")
+       << " compressed=" << _ncompressed.get_value()
+       << " uncompressed=" << _nuncompressed.get_value()
+       << " ratio=" << ratio()
+       << " cpu_us=" << cpu_us();
+}
+
+typedef std::map<const google::protobuf::MethodDescriptor*,
+                 AdaptiveCompressor*> CompressorMap;
+
+static size_t AddCompressor(CompressorMap& m,
+                            const google::protobuf::MethodDescriptor* method,
+                            AdaptiveCompressor* compressor) {
+    return m.insert(std::make_pair(method, compressor)).second ? 1 : 0;
+}
+
+static pthread_once_t g_client_compressors_once = PTHREAD_ONCE_INIT;
+static butil::DoublyBufferedData<CompressorMap>* g_client_compressors = NULL;
+
+static void InitClientCompressors() {
+    g_client_compressors = new butil::DoublyBufferedData<CompressorMap>;
+}
+
+static AdaptiveCompressor* FindCompressor(
+    butil::DoublyBufferedData<CompressorMap>& compressors,
+    const google::protobuf::MethodDescriptor* method) {
+    butil::DoublyBufferedData<CompressorMap>::ScopedPtr ptr;
+    if (compressors.Read(&ptr) != 0) {
+        return NULL;
+    }
+    CompressorMap::const_iterator it = ptr->find(method);
+    return (it != ptr->end() ? it->second : NULL);
+}
+
+AdaptiveCompressor* GetClientCompressionStats(
+    const google::protobuf::MethodDescriptor* method) {
+    pthread_once(&g_client_compressors_once, InitClientCompressors);
+    AdaptiveCompressor* stats = FindCompressor(*g_client_compressors, method);
+    if (stats != NULL) {
+        return stats;
+    }
+    // Statistics are never deleted since methods are not.
+    stats = new AdaptiveCompressor;
+    if (g_client_compressors->Modify(AddCompressor, method, stats) == 0) {
+        // Another thread added the method before us.
+        delete stats;
+        return FindCompressor(*g_client_compressors, method);
+    }
+    stats->Expose("rpc_client_" + method->full_name());
+    return stats;
+}
+
+ClientAdaptiveCompressors::~ClientAdaptiveCompressors() {
+    butil::DoublyBufferedData<CompressorMap>::ScopedPtr ptr;
+    if (_compressors.Read(&ptr) == 0) {
+        for (CompressorMap::const_iterator it = ptr->begin();
+             it != ptr->end(); ++it) {
+            delete it->second;
+        }
+    }
+}
+
+AdaptiveCompressor* ClientAdaptiveCompressors::Get(
+    const google::protobuf::MethodDescriptor* method) {
+    AdaptiveCompressor* compressor = FindCompressor(_compressors, method);
+    if (compressor != NULL) {
+        return compressor;
+    }
+    compressor = new AdaptiveCompressor(GetClientCompressionStats(method));
+    if (_compressors.Modify(AddCompressor, method, compressor) == 0) {
+        // Another thread added the method before us.
+        delete compressor;
+        return FindCompressor(_compressors, method);
+    }
+    return compressor;
+}
+
+} // namespace brpc
@@ -0,0 +1,125 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifndef BRPC_ADAPTIVE_COMPRESSOR_H
+#define BRPC_ADAPTIVE_COMPRESSOR_H
+
+#include <map>
+#include <ostream>
+#include "butil/atomicops.h"
+#include "butil/containers/doubly_buffered_data.h"
+#include "butil/synchronization/lock.h"
+#include "bvar/bvar.h"
+#include "brpc/adaptive_compression.h"
+
+namespace google {
+namespace protobuf {
+class MethodDescriptor;
+}  // namespace protobuf
+}  // namespace google
+
+
+namespace brpc {
+
+// Sample compression of messages of a method and decide whether compressing
+// them is worthwhile according to AdaptiveCompressionOptions.
+class AdaptiveCompressor {
+public:
+    // Counters of compressed messages are added to `stats' instead of this
+    // compressor if it's not NULL, so that compressors deciding separately
+    // can share statistics.
+    explicit AdaptiveCompressor(AdaptiveCompressor* stats = NULL);
+
+    // Get compression of a message serialized into `size' bytes,
+    // COMPRESS_TYPE_NONE means the message should be sent as it is.
+    CompressType Select(size_t size, const AdaptiveCompressionOptions& options);
+
+    // Call this after a message of `original_size' bytes is compressed into
+    // `compressed_size' bytes within `cpu_ns' nanoseconds.
+    void OnCompressed(size_t original_size, size_t compressed_size,
+                      int64_t cpu_ns, const AdaptiveCompressionOptions& options);
+
+    // True if messages large enough are compressed now.
+    bool enabled() const { return _enabled.load(butil::memory_order_relaxed); }
+
+    // Compressed size / original size of all compressed messages.
+    double ratio() const;
+
+    // Average microseconds spent on compressing a message.
+    double cpu_us() const;
+
+    // Expose internal vars.
+    // Return 0 on success, -1 otherwise.
+    int Expose(const butil::StringPiece& prefix);
+
+    // Describe states in one line, used by /status.
+    void Describe(std::ostream& os) const;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(AdaptiveCompressor);
+
+    AdaptiveCompressor* _stats;
+    butil::atomic<bool> _enabled;
+    // Counting messages not compressed, to probe the compression once in
+    // a while after it's turned off.
+    butil::atomic<int64_t> _nprobe;
+
+    // Samples of the current decision window.
+    butil::Mutex _mutex;
+    int _window_count;
+    int64_t _window_original_size;
+    int64_t _window_compressed_size;
+    int64_t _window_cpu_ns;
+
+    bvar::Adder<int64_t> _ncompressed;
+    bvar::Adder<int64_t> _nuncompressed;
+    bvar::Adder<int64_t> _original_size;
+    bvar::Adder<int64_t> _compressed_size;
+    bvar::Adder<int64_t> _cpu_ns;
+    bvar::PassiveStatus<double> _ratio_bvar;
+    bvar::PassiveStatus<double> _cpu_us_bvar;
+};
+
+// Get statistics of compressing requests to `method' over all channels,
+// exposed as rpc_client_<method full name>_compress_*.
+AdaptiveCompressor* GetClientCompressionStats(
+    const google::protobuf::MethodDescriptor* method);
+
+// Compressors of requests to methods over one channel. Channels to
+// different servers may carry different data, so each of them decides
+// whether compressing pays off separately. Thread-safe.
+class ClientAdaptiveCompressors {
+public:
+    ClientAdaptiveCompressors() {}
+    ~ClientAdaptiveCompressors();
+
+    // Get the compressor of requests to `method', created on first call.
+    AdaptiveCompressor* Get(const google::protobuf::MethodDescriptor* method);
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(ClientAdaptiveCompressors);
+
+    typedef std::map<const google::protobuf::MethodDescriptor*,
+                     AdaptiveCompressor*> CompressorMap;
+    butil::DoublyBufferedData<CompressorMap> _compressors;
+};
+
+} // namespace brpc
+
+
+#endif  // BRPC_ADAPTIVE_COMPRESSOR_H
@@ -0,0 +1,79 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+
+#include <pthread.h>
+#include "butil/logging.h"
+#include "bvar/bvar.h"
+#include "brpc/details/channel_concurrency_limiter.h"
+
+
+namespace brpc {
+
+// RPCs rejected by limiters of all channels in this process.
+static bvar::Adder<int64_t>* g_channel_cl_rejected = NULL;
+static pthread_once_t s_create_vars_once = PTHREAD_ONCE_INIT;
+
+static void CreateVars() {
+    g_channel_cl_rejected =
+        new bvar::Adder<int64_t>("rpc_channel_concurrency_rejected_count");
+}
+
+int ChannelConcurrencyLimiter::Create(
+    const AdaptiveMaxConcurrency& amc,
+    butil::intrusive_ptr<ChannelConcurrencyLimiter>* out) {
+    out->reset();
+    if (amc.type() == AdaptiveMaxConcurrency::UNLIMITED) {
+        return 0;
+    }
+    const ConcurrencyLimiter* cl =
+        ConcurrencyLimiterExtension()->Find(amc.type().c_str());
+    if (cl == NULL) {
+        LOG(ERROR) << "Fail to find ConcurrencyLimiter by `" << amc.value() << "'";
+        return -1;
+    }
+    ConcurrencyLimiter* cl_copy = cl->New(amc);
+    if (cl_copy == NULL) {
+        LOG(ERROR) << "Fail to new ConcurrencyLimiter";
+        return -1;
+    }
+    pthread_once(&s_create_vars_once, CreateVars);
+    out->reset(new ChannelConcurrencyLimiter(cl_copy));
+    return 0;
+}
+
+ChannelConcurrencyLimiter::ChannelConcurrencyLimiter(ConcurrencyLimiter* cl)
+    : _cl(cl)
+    , _nconcurrency(0) {
+}
+
+bool ChannelConcurrencyLimiter::OnRequested(Controller* cntl) {
+    const int cc = _nconcurrency.fetch_add(1, butil::memory_order_relaxed) + 1;
+    if (_cl->OnRequested(cc, cntl)) {
+        return true;
+    }
+    *g_channel_cl_rejected << 1;
+    return false;
+}
+
+void ChannelConcurrencyLimiter::OnResponded(int error_code, int64_t latency_us) {
+    _nconcurrency.fetch_sub(1, butil::memory_order_relaxed);
+    _cl->OnResponded(error_code, latency_us);
+}
+
+} // namespace brpc
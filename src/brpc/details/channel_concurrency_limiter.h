@@ -0,0 +1,68 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifndef BRPC_CHANNEL_CONCURRENCY_LIMITER_H
+#define BRPC_CHANNEL_CONCURRENCY_LIMITER_H
+
+#include <memory>
+#include "butil/atomicops.h"
+#include "butil/intrusive_ptr.hpp"
+#include "brpc/shared_object.h"                   // SharedObject
+#include "brpc/concurrency_limiter.h"             // ConcurrencyLimiter
+
+
+namespace brpc {
+
+// Limit outstanding RPCs of a Channel so that overload is shed at the
+// caller before requests queue up on saturated servers. Any ConcurrencyLimiter
+// of servers works here, e.g. "auto" adjusts the limit by observed latencies
+// and errors of the downstream cluster.
+// Shared by the channel and RPCs in progress, so that it outlives the channel
+// when asynchronous RPCs are still running.
+class ChannelConcurrencyLimiter : public SharedObject {
+public:
+    // Create a limiter from `amc'. `out' is set to NULL when `amc' is
+    // unlimited. Returns 0 on success, -1 otherwise.
+    static int Create(const AdaptiveMaxConcurrency& amc,
+                      butil::intrusive_ptr<ChannelConcurrencyLimiter>* out);
+
+    // Call this before sending a RPC. Returns false when the RPC should be
+    // rejected with ELIMIT. OnResponded() must be called in either case.
+    bool OnRequested(Controller* cntl);
+
+    // Call this after the RPC ends.
+    void OnResponded(int error_code, int64_t latency_us);
+
+    int MaxConcurrency() const { return _cl->MaxConcurrency(); }
+
+    int concurrency() const {
+        return _nconcurrency.load(butil::memory_order_relaxed);
+    }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(ChannelConcurrencyLimiter);
+    explicit ChannelConcurrencyLimiter(ConcurrencyLimiter* cl);
+
+    std::unique_ptr<ConcurrencyLimiter> _cl;
+    butil::atomic<int> _nconcurrency;
+};
+
+} // namespace brpc
+
+
+#endif  // BRPC_CHANNEL_CONCURRENCY_LIMITER_H
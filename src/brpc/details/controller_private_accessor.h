@@ -57,6 +57,14 @@ public:
         return _cntl->_current_call.sending_sock.get();
     }
 
+    // NULL unless the channel compresses requests adaptively.
+    const AdaptiveCompressionOptions* adaptive_compression() const {
+        return _cntl->_adaptive_compression;
+    }
+    AdaptiveCompressor* adaptive_compressor() const {
+        return _cntl->_adaptive_compressor;
+    }
+
     int64_t real_timeout_ms() {
         return _cntl->_real_timeout_ms;
     }
@@ -105,6 +113,22 @@ public:
     uint32_t pipelined_count() const { return _cntl->_pipelined_count; }
     void set_pipelined_count(uint32_t count) {  _cntl->_pipelined_count = count; }
 
+    // Send current call over a pooled connection of the single connection
+    // that it was about to be sent over. Called by pack_request.
+    int switch_to_pooled_socket() {
+        SocketUniquePtr pooled;
+        const int rc =
+            _cntl->_current_call.sending_sock->GetPooledSocket(&pooled);
+        if (rc != 0) {
+            return rc;
+        }
+        pooled->set_preferred_index(
+            _cntl->_current_call.sending_sock->preferred_index());
+        _cntl->_current_call.sending_sock.reset(pooled.release());
+        _cntl->_connection_type = CONNECTION_TYPE_POOLED;
+        return 0;
+    }
+
     ControllerPrivateAccessor& set_server(const Server* server) {
         _cntl->_server = server;
         return *this;
@@ -128,6 +152,9 @@ public:
     void set_readable_progressive_attachment(ReadableProgressiveAttachment* s)
     { _cntl->_rpa.reset(s); }
 
+    ProgressiveAttachment* progressive_attachment()
+    { return _cntl->_wpa.get(); }
+
     void set_auth_flags(uint32_t auth_flags) {
         _cntl->_auth_flags = auth_flags;
     }
@@ -349,128 +349,195 @@ public:
     HuffmanEncoder(butil::IOBufAppender* out, const HuffmanCode* table)
         : _out(out)
         , _table(table)
-        , _partial_byte(0)
-        , _remain_bit(8)
+        , _bits(0)
+        , _bit_len(0)
+        , _buf_len(0)
         , _out_bytes(0)
     {}
 
     void Encode(unsigned char byte) {
-        const HuffmanCode code = _table[byte];
-        uint16_t bits_left = code.bit_len;
-        while (bits_left) {
-            const uint16_t adding_bits_len = std::min(_remain_bit, bits_left);
-            const uint8_t adding_bits = static_cast<uint8_t>(
-                    (code.code & ((1u << bits_left) - 1))   // clear leading bits
-                            >> (bits_left - adding_bits_len));  // align to LSB
-            _partial_byte |= adding_bits << (_remain_bit - adding_bits_len);
-            _remain_bit -= adding_bits_len;
-            bits_left -= adding_bits_len;
-            if (!_remain_bit) {
-                ++_out_bytes;
-                _out->push_back(_partial_byte);
-                _remain_bit = 8;
-                _partial_byte = 0;
-            }
+        const HuffmanCode& code = _table[byte];
+        // Codes are at most 30 bits and less than 8 bits are left in _bits
+        // after each call, so whole codes fit in _bits.
+        _bits = (_bits << code.bit_len) | code.code;
+        _bit_len += code.bit_len;
+        while (_bit_len >= 8) {
+            _bit_len -= 8;
+            _buf[_buf_len++] = static_cast<uint8_t>(_bits >> _bit_len);
+        }
+        // At most 4 bytes are added by one call.
+        if (_buf_len + 4 > sizeof(_buf)) {
+            Flush();
         }
     }
 
     void EndStream() {
-        if (_remain_bit == 8u) {
-            return;
-        }
-        DCHECK_LT(_remain_bit, 8u);
-        // Add padding `1's to lsb to make _out aligned
-        _partial_byte |= (1 << _remain_bit) - 1;
-        // TODO: push_back is probably costly since it acquires tls everytime it
-        // is invoked.
-        _out->push_back(_partial_byte);
-        _partial_byte = 0;
-        _remain_bit = 0;
+        if (_bit_len != 0) {
+            DCHECK_LT(_bit_len, 8u);
+            // Add padding `1's to lsb to make _out aligned
+            const uint32_t padding_len = 8 - _bit_len;
+            _buf[_buf_len++] = static_cast<uint8_t>(
+                (_bits << padding_len) | ((1u << padding_len) - 1));
+            _bit_len = 0;
+        }
+        Flush();
         _out = NULL;
-        ++_out_bytes;
     }
 
     uint32_t out_bytes() const { return _out_bytes; }
 
 private:
+    // Append buffered bytes in batch rather than push_back() each byte
+    // which is costly.
+    void Flush() {
+        _out->append(_buf, _buf_len);
+        _out_bytes += _buf_len;
+        _buf_len = 0;
+    }
+
     butil::IOBufAppender* _out;
     const HuffmanCode* _table;
-    uint8_t  _partial_byte;
-    uint16_t _remain_bit;
+    uint64_t _bits;
+    uint32_t _bit_len;
+    uint32_t _buf_len;
     uint32_t _out_bytes;
+    uint8_t _buf[64];
 };
 
-class HuffmanDecoder {
-DISALLOW_COPY_AND_ASSIGN(HuffmanDecoder);
+struct HuffmanDecodeEntry {
+    uint16_t next_state;
+    uint8_t flags;
+    uint8_t symbol;
+};
+
+// Decode huffman-encoded strings 4 bits at a time, in the style of nghttp2.
+// States are internal nodes of HuffmanTree. At most one symbol is decoded
+// with each nibble since the shortest code has 5 bits.
+class BAIDU_CACHELINE_ALIGNMENT HuffmanDecodeTable {
+DISALLOW_COPY_AND_ASSIGN(HuffmanDecodeTable);
 public:
-    HuffmanDecoder(std::string* out, const HuffmanTree* tree)
-        // FIXME: resizing of out is costly
-        : _out(out)
-        , _tree(tree)
-        , _cur_node(tree->node(HuffmanTree::ROOT_NODE))
-        , _cur_depth(0)  // Depth of root node is 0
-        , _padding(true)
-    {}
-    int Decode(uint8_t byte) {
-        for (int i = 7; i >= 0; --i) {
-            if (byte & (1u << i)) {
-                _cur_node = _tree->node(_cur_node->right_child);
-                if (BAIDU_UNLIKELY(!_cur_node)) {
-                    LOG(ERROR) << "Decoder stream reaches NULL_NODE";
-                    return -1;
-                }
-                if (_cur_node->value != HuffmanTree::INVALID_VALUE) {
-                    if (BAIDU_UNLIKELY(_cur_node->value == HPACK_HUFFMAN_EOS)) {
-                        LOG(ERROR) << "Decoder stream reaches EOS";
-                        return -1;
+    enum Flag {
+        // A symbol is decoded with the nibble.
+        HAS_SYMBOL = 1,
+        // The stream can end after the nibble, namely at root or inside
+        // a valid padding(MSB of EOS shorter than 8 bits).
+        ACCEPTED = 2,
+        // The nibble reaches EOS or a NULL_NODE.
+        FAILED = 4,
+    };
+    static const uint16_t ROOT_STATE = 0;
+
+    explicit HuffmanDecodeTable(const HuffmanTree& tree) {
+        std::vector<int> node_states;
+        std::vector<HuffmanTree::NodeId> state_nodes;
+        std::vector<bool> accepted_states;
+        AddState(tree, HuffmanTree::ROOT_NODE, 0, true,
+                 &node_states, &state_nodes, &accepted_states);
+        _entries.resize(state_nodes.size() * 16);
+        for (size_t state = 0; state < state_nodes.size(); ++state) {
+            for (uint32_t nibble = 0; nibble < 16; ++nibble) {
+                HuffmanDecodeEntry& e = _entries[state * 16 + nibble];
+                e.next_state = ROOT_STATE;
+                e.flags = 0;
+                e.symbol = 0;
+                HuffmanTree::NodeId cur = state_nodes[state];
+                for (int i = 3; i >= 0; --i) {
+                    const HuffmanNode* n = tree.node(cur);
+                    cur = (nibble & (1u << i)) ? n->right_child : n->left_child;
+                    n = tree.node(cur);
+                    if (n == NULL || n->value == HPACK_HUFFMAN_EOS) {
+                        e.flags = FAILED;
+                        break;
                     }
-                    _out->push_back(static_cast<uint8_t>(_cur_node->value));
-                    _cur_node = _tree->node(HuffmanTree::ROOT_NODE);
-                    _cur_depth = 0;
-                    _padding = true;
-                    continue;
-                }
-                _padding &= 1;
-            } else {
-                _cur_node = _tree->node(_cur_node->left_child);
-                if (BAIDU_UNLIKELY(!_cur_node)) {
-                    LOG(ERROR) << "Decoder stream reaches NULL_NODE";
-                    return -1;
-                }
-                if (_cur_node->value != HuffmanTree::INVALID_VALUE) {
-                    if (BAIDU_UNLIKELY(_cur_node->value == HPACK_HUFFMAN_EOS)) {
-                        LOG(ERROR) << "Decoder stream reaches EOS";
-                        return -1;
+                    if (n->value != HuffmanTree::INVALID_VALUE) {
+                        e.flags |= HAS_SYMBOL;
+                        e.symbol = static_cast<uint8_t>(n->value);
+                        cur = HuffmanTree::ROOT_NODE;
                     }
-                    _out->push_back(static_cast<uint8_t>(_cur_node->value));
-                    _cur_node = _tree->node(HuffmanTree::ROOT_NODE);
-                    _cur_depth = 0;
-                    _padding = true;
+                }
+                if (e.flags & FAILED) {
                     continue;
                 }
-                _padding &= 0;
+                e.next_state = node_states[cur];
+                if (accepted_states[e.next_state]) {
+                    e.flags |= ACCEPTED;
+                }
             }
-            ++_cur_depth;
         }
-        return 0;
     }
-    int EndStream() {
-        if (_cur_depth == 0) {
-            return 0;
+
+    const HuffmanDecodeEntry& entry(uint16_t state, uint8_t nibble) const {
+        return _entries[state * 16 + nibble];
+    }
+
+private:
+    // Assign states to internal nodes in pre-order.
+    static void AddState(const HuffmanTree& tree, HuffmanTree::NodeId id,
+                         int depth, bool all_ones,
+                         std::vector<int>* node_states,
+                         std::vector<HuffmanTree::NodeId>* state_nodes,
+                         std::vector<bool>* accepted_states) {
+        const HuffmanNode* n = tree.node(id);
+        if (n == NULL || n->value != HuffmanTree::INVALID_VALUE) {
+            return;
         }
-        if (_cur_depth <= 7 && _padding) {
-            return 0;
+        if (node_states->size() <= id) {
+            node_states->resize(id + 1, -1);
+        }
+        (*node_states)[id] = state_nodes->size();
+        state_nodes->push_back(id);
+        accepted_states->push_back(depth == 0 || (all_ones && depth <= 7));
+        AddState(tree, n->left_child, depth + 1, false,
+                 node_states, state_nodes, accepted_states);
+        AddState(tree, n->right_child, depth + 1, all_ones,
+                 node_states, state_nodes, accepted_states);
+    }
+
+    std::vector<HuffmanDecodeEntry> _entries;
+};
+
+class HuffmanDecoder {
+DISALLOW_COPY_AND_ASSIGN(HuffmanDecoder);
+public:
+    HuffmanDecoder(std::string* out, const HuffmanDecodeTable* table)
+        : _out(out)
+        , _table(table)
+        , _state(HuffmanDecodeTable::ROOT_STATE)
+        , _accepted(true)
+    {}
+
+    int Decode(uint8_t byte) {
+        if (DecodeNibble(byte >> 4) != 0) {
+            return -1;
         }
-        // Invalid stream, the padding is not corresponding to MSB of EOS
+        return DecodeNibble(byte & 0x0F);
+    }
+
+    int EndStream() {
+        // Invalid stream if the padding is not corresponding to MSB of EOS
         // https://tools.ietf.org/html/rfc7541#section-5.2
-        return -1;
+        return _accepted ? 0 : -1;
     }
+
 private:
+    int DecodeNibble(uint8_t nibble) {
+        const HuffmanDecodeEntry& e = _table->entry(_state, nibble);
+        if (BAIDU_UNLIKELY(e.flags & HuffmanDecodeTable::FAILED)) {
+            LOG(ERROR) << "Decoder stream reaches EOS or NULL_NODE";
+            return -1;
+        }
+        if (e.flags & HuffmanDecodeTable::HAS_SYMBOL) {
+            _out->push_back(e.symbol);
+        }
+        _state = e.next_state;
+        _accepted = (e.flags & HuffmanDecodeTable::ACCEPTED);
+        return 0;
+    }
+
     std::string* _out;
-    const HuffmanTree* _tree;
-    const HuffmanNode* _cur_node;
-    uint16_t _cur_depth;
-    bool _padding;
+    const HuffmanDecodeTable* _table;
+    uint16_t _state;
+    bool _accepted;
 };
 
 // Primitive Type Representations
@@ -496,14 +563,17 @@ inline void EncodeInteger(butil::IOBufAppender* out, uint8_t msb,
 }
 
 // Static variables
-static HuffmanTree* s_huffman_tree = NULL;
+static HuffmanDecodeTable* s_huffman_decode_table = NULL;
 static IndexTable* s_static_table = NULL;
 static pthread_once_t s_create_once = PTHREAD_ONCE_INIT;
 
 static void CreateStaticTableOrDie() {
-    s_huffman_tree = new HuffmanTree;
-    for (size_t i = 0; i < ARRAY_SIZE(s_huffman_table); ++i) {
-        s_huffman_tree->AddLeafNode(i, s_huffman_table[i]);
+    {
+        HuffmanTree huffman_tree;
+        for (size_t i = 0; i < ARRAY_SIZE(s_huffman_table); ++i) {
+            huffman_tree.AddLeafNode(i, s_huffman_table[i]);
+        }
+        s_huffman_decode_table = new HuffmanDecodeTable(huffman_tree);
     }
     IndexTableOptions options;
     options.max_size = UINT_MAX;
@@ -622,7 +692,9 @@ inline ssize_t DecodeString(butil::IOBufBytesIterator& iter, std::string* out) {
         iter.copy_and_forward(out, length);
         return in_bytes;
     }
-    HuffmanDecoder d(out, s_huffman_tree);
+    // Codes are at least 5 bits.
+    out->reserve(length * 8 / 5);
+    HuffmanDecoder d(out, s_huffman_decode_table);
     for (; iter != NULL && length; ++iter, --length) {
         if (d.Decode(*iter) != 0) {
             return -1;
@@ -241,6 +241,7 @@ int HttpMessage::UnlockAndFlushToBodyReader(std::unique_lock<butil::Mutex>& mu)
             return -1;
         }
     }
+    OnBodyConsumed(body_seen.size());
     return 0;
 }
 
@@ -316,6 +317,7 @@ int HttpMessage::OnBody(const char *at, const size_t length) {
     }
     butil::Status st = r->OnReadOnePart(at, length);
     if (st.ok()) {
+        OnBodyConsumed(length);
         return 0;
     }
     mu.lock();
@@ -355,11 +357,19 @@ int HttpMessage::OnMessageComplete() {
         ProgressiveReader* r = _body_reader;
         _body_reader = NULL;
         mu.unlock();
-        r->OnEndOfMessage(butil::Status());
+        r->OnEndOfMessage(_body_status);
     }
     return 0;
 }
 
+int HttpMessage::OnMessageFailed(const butil::Status& st) {
+    {
+        BAIDU_SCOPED_LOCK(_body_mutex);
+        _body_status = st;
+    }
+    return OnMessageComplete();
+}
+
 class FailAllRead : public ProgressiveReader {
 public:
     // @ProgressiveReader
@@ -393,9 +403,10 @@ void HttpMessage::SetBodyReader(ProgressiveReader* r) {
             if (_stage <= HTTP_ON_BODY) {
                 _body_reader = r;
                 return;
-            } else {  // The body is complete and successfully consumed.
+            } else {  // The body is complete and consumed.
+                const butil::Status st = _body_status;
                 mu.unlock();
-                return r->OnEndOfMessage(butil::Status());
+                return r->OnEndOfMessage(st);
             }
         } else if (_stage <= HTTP_ON_BODY && ++ntry >= MAX_TRY) {
             // Stop making _body empty after we've tried several times.
@@ -407,6 +418,7 @@ void HttpMessage::SetBodyReader(ProgressiveReader* r) {
         }
         butil::IOBuf body_seen = _body.movable();
         mu.unlock();
+        size_t consumed = 0;
         for (size_t i = 0; i < body_seen.backing_block_num(); ++i) {
             butil::StringPiece blk = body_seen.backing_block(i);
             butil::Status st = r->OnReadOnePart(blk.data(), blk.size());
@@ -420,6 +432,10 @@ void HttpMessage::SetBodyReader(ProgressiveReader* r) {
                 ntry = MAX_TRY;
                 break;
             }
+            consumed += blk.size();
+        }
+        if (consumed != 0) {
+            OnBodyConsumed(consumed);
         }
     } while (true);
 }
@@ -682,8 +698,12 @@ void MakeRawHttpResponse(butil::IOBuf* response,
     os << "HTTP/" << h->major_version() << '.'
        << h->minor_version() << ' ' << h->status_code()
        << ' ' << h->reason_phrase() << BRPC_CRLF;
+    // 304 has no content either. Its Content-Length, if any, must be the
+    // length of the content that would have been sent with 200, which we
+    // don't know, see https://www.rfc-editor.org/rfc/rfc7230#section-3.3.2
     bool is_invalid_content = h->status_code() < HTTP_STATUS_OK ||
-                              h->status_code() == HTTP_STATUS_NO_CONTENT;
+                              h->status_code() == HTTP_STATUS_NO_CONTENT ||
+                              h->status_code() == HTTP_STATUS_NOT_MODIFIED;
     bool is_head_req = h->method() == HTTP_METHOD_HEAD;
     if (is_invalid_content) {
         // https://www.rfc-editor.org/rfc/rfc7230#section-3.3.1
@@ -99,6 +99,12 @@ public:
 protected:
     int OnBody(const char* data, size_t size);
     int OnMessageComplete();
+    // Same as OnMessageComplete() except that the progressively-read body
+    // is ended with `st', e.g. the h2 stream was reset.
+    int OnMessageFailed(const butil::Status& st);
+    // Called after `size' bytes of the body read progressively are passed
+    // to the reader set by SetBodyReader(), possibly in different threads.
+    virtual void OnBodyConsumed(size_t /*size*/) {}
     size_t _parsed_length{0};
     
 private:
@@ -115,6 +121,8 @@ private:
     // Read body progressively
     ProgressiveReader* _body_reader{NULL};
     butil::IOBuf _body;
+    // Passed to ProgressiveReader::OnEndOfMessage when the body is ended.
+    butil::Status _body_status;
 
     // Store the IOBuf information in `ParseFromIOBuf'
     // for later zero-copy usage in `OnBody'.
@@ -28,6 +28,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
 
 #ifndef ULLONG_MAX
 # define ULLONG_MAX ((uint64_t) -1) /* 2^64-1 */
@@ -509,6 +512,67 @@ bool is_url_char(char c) { return IS_URL_CHAR(c); }
 #define IS_HEADER_CHAR(ch)                                                     \
   (ch == CR || ch == LF || ch == 9 || ((unsigned char)ch > 31 && ch != 127))
 
+/* Following ranges of bytes stop the fast scanning in states
+ * that consume most bytes of a request. Bytes not in the ranges never change
+ * the state in the byte-at-a-time loop and can be skipped in batch. The
+ * ranges may include harmless bytes (e.g. '?' in query strings), which are
+ * just handled by the loop.
+ */
+/* The arrays are padded to be loaded as 16 bytes (plus the ending NUL). */
+/* CTLs, SP, '#', '?' and DEL end s_req_path/s_req_query_string. */
+static const char url_stop_ranges[17] =
+    "\x00\x20" "##" "??" "\x7f\x7f";
+/* Separators, CTLs, SP and non-ASCII bytes end tokens of header fields. */
+static const char header_field_stop_ranges[17] =
+    "\x00\x20" "\"\"" "(," "//" ":@" "[]" "{}" "\x7f\xff";
+/* CR, LF and CTLs except HT end(or invalidate) header values. */
+static const char header_value_stop_ranges[17] =
+    "\x00\x08" "\x0a\x1f" "\x7f\x7f";
+
+/* Find the first byte in [p, end) falling in any of the inclusive `ranges'
+ * (at most 8 pairs), 16 bytes at a time, in the style of picohttpparser.
+ * Bytes in the last incomplete 16-byte group are not scanned and left to
+ * the byte-at-a-time loop, so does everything without SSE4.2.
+ */
+static inline const char* find_range_char_fast(const char* p,
+                                               const char* end,
+                                               const char* ranges,
+                                               size_t ranges_size) {
+#ifdef __SSE4_2__
+  const __m128i ranges16 = _mm_loadu_si128((const __m128i*)ranges);
+  while (end - p >= 16) {
+    const __m128i b16 = _mm_loadu_si128((const __m128i*)p);
+    const int r = _mm_cmpestri(ranges16, (int)ranges_size, b16, 16,
+                               _SIDD_LEAST_SIGNIFICANT | _SIDD_CMP_RANGES |
+                               _SIDD_UBYTE_OPS);
+    if (r != 16) {
+      return p + r;
+    }
+    p += 16;
+  }
+#else
+  (void)end;
+  (void)ranges;
+  (void)ranges_size;
+#endif
+  return p;
+}
+
+/* Skip bytes after `p' not in `ranges' and count them into the header size
+ * as the byte-at-a-time loop does. The loop continues from the first byte
+ * that may change the state. Skipping stops before the header size limit
+ * so that the loop reports HPE_HEADER_OVERFLOW at the same byte.
+ */
+#define SKIP_UNTIL_RANGE_CHAR(ranges, ranges_size)                   \
+do {                                                                 \
+  const size_t room = (BRPC_HTTP_MAX_HEADER_SIZE) - parser->nread;   \
+  const char* const q = find_range_char_fast(                        \
+      p + 1, p + 1 + MIN((size_t)(data + len - (p + 1)), room),      \
+      ranges, ranges_size);                                          \
+  parser->nread += q - (p + 1);                                      \
+  p = q - 1;                                                         \
+} while (0)
+
 #if BRPC_HTTP_PARSER_STRICT
 # define STRICT_CHECK(cond)                                          \
 do {                                                                 \
@@ -1229,6 +1293,9 @@ size_t http_parser_execute (http_parser *parser,
               goto error;
             }
             parser->state = new_state;
+            if (new_state == s_req_path || new_state == s_req_query_string) {
+              SKIP_UNTIL_RANGE_CHAR(url_stop_ranges, 8);
+            }
         }
         break;
       }
@@ -1412,6 +1479,7 @@ size_t http_parser_execute (http_parser *parser,
         if (c) {
           switch (parser->header_state) {
             case h_general:
+              SKIP_UNTIL_RANGE_CHAR(header_field_stop_ranges, 16);
               break;
 
             case h_C:
@@ -1625,6 +1693,7 @@ size_t http_parser_execute (http_parser *parser,
 
         switch (parser->header_state) {
           case h_general:
+            SKIP_UNTIL_RANGE_CHAR(header_value_stop_ranges, 6);
             break;
 
           case h_connection:
@@ -0,0 +1,164 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+
+#include <pthread.h>
+#include <algorithm>
+#include <functional>                              // std::greater
+#include <gflags/gflags.h>
+#include "butil/time.h"
+#include "bvar/bvar.h"
+#include "brpc/socket.h"
+#include "brpc/details/latency_outlier_detector.h"
+
+
+namespace brpc {
+
+DECLARE_double(circuit_breaker_latency_outlier_multiple);
+DECLARE_int32(circuit_breaker_latency_outlier_min_latency_us);
+DECLARE_int32(circuit_breaker_max_ejection_percent);
+
+// Median of a cluster with too few servers does not make sense.
+static const size_t MIN_SERVERS_FOR_DETECTION = 3;
+static const int64_t DETECT_INTERVAL_US = 100000;
+
+struct OutlierVars {
+    bvar::Adder<int64_t> nejection;
+    bvar::PerSecond<bvar::Adder<int64_t> > nejection_second;
+
+    OutlierVars()
+        : nejection("rpc_latency_outlier_ejection_count")
+        , nejection_second("rpc_latency_outlier_ejection_second", &nejection) {}
+};
+static OutlierVars* g_outlier_vars = NULL;
+static pthread_once_t s_create_vars_once = PTHREAD_ONCE_INIT;
+
+static void CreateVars() {
+    g_outlier_vars = new OutlierVars;
+}
+
+LatencyOutlierDetector::LatencyOutlierDetector()
+    : _last_detect_us(0) {
+}
+
+void LatencyOutlierDetector::AddServers(const std::vector<ServerId>& servers) {
+    BAIDU_SCOPED_LOCK(_mutex);
+    for (size_t i = 0; i < servers.size(); ++i) {
+        _servers.push_back(servers[i].id);
+    }
+}
+
+void LatencyOutlierDetector::RemoveServers(const std::vector<ServerId>& servers) {
+    BAIDU_SCOPED_LOCK(_mutex);
+    for (size_t i = 0; i < servers.size(); ++i) {
+        std::vector<SocketId>::iterator it =
+            std::find(_servers.begin(), _servers.end(), servers[i].id);
+        if (it != _servers.end()) {
+            *it = _servers.back();
+            _servers.pop_back();
+        }
+    }
+}
+
+void LatencyOutlierDetector::OnCallEnd() {
+    if (FLAGS_circuit_breaker_latency_outlier_multiple <= 0) {
+        return;
+    }
+    const int64_t now_us = butil::cpuwide_time_us();
+    int64_t last_us = _last_detect_us.load(butil::memory_order_relaxed);
+    if (now_us - last_us < DETECT_INTERVAL_US ||
+        !_last_detect_us.compare_exchange_strong(
+            last_us, now_us, butil::memory_order_relaxed)) {
+        return;
+    }
+    Detect();
+}
+
+size_t LatencyOutlierDetector::Detect() {
+    const double multiple = FLAGS_circuit_breaker_latency_outlier_multiple;
+    if (multiple <= 0) {
+        return 0;
+    }
+    pthread_once(&s_create_vars_once, CreateVars);
+    std::vector<SocketId> ids;
+    {
+        BAIDU_SCOPED_LOCK(_mutex);
+        ids = _servers;
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    if (ids.size() < MIN_SERVERS_FOR_DETECTION) {
+        return 0;
+    }
+
+    // Servers failed for whatever reason count towards the ejection limit.
+    size_t nunavailable = 0;
+    std::vector<std::pair<int64_t, SocketId> > latencies;
+    latencies.reserve(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        SocketUniquePtr ptr;
+        if (Socket::Address(ids[i], &ptr) != 0) {
+            ++nunavailable;
+            continue;
+        }
+        const int64_t latency_us = ptr->outlier_ema_latency_us();
+        if (latency_us > 0) {
+            latencies.push_back(std::make_pair(latency_us, ids[i]));
+        }
+    }
+    // Allow ejecting one server in small clusters as well, as Envoy does,
+    // otherwise nothing is ejected in clusters with fewer than 10 servers
+    // at the default percentage.
+    const int max_ejection_percent = FLAGS_circuit_breaker_max_ejection_percent;
+    const size_t max_ejected = (max_ejection_percent <= 0 ? 0 :
+        std::max<size_t>(1, ids.size() * max_ejection_percent / 100));
+    if (latencies.size() < MIN_SERVERS_FOR_DETECTION ||
+        nunavailable >= max_ejected) {
+        return 0;
+    }
+
+    std::nth_element(latencies.begin(), latencies.begin() + latencies.size() / 2,
+                     latencies.end());
+    const int64_t median_us = latencies[latencies.size() / 2].first;
+    const int64_t threshold_us = std::max(
+        (int64_t)(median_us * multiple),
+        (int64_t)FLAGS_circuit_breaker_latency_outlier_min_latency_us);
+    // Eject the slowest servers first.
+    std::sort(latencies.begin(), latencies.end(),
+              std::greater<std::pair<int64_t, SocketId> >());
+    size_t nejected = 0;
+    for (size_t i = 0; i < latencies.size() && nunavailable < max_ejected; ++i) {
+        if (latencies[i].first <= threshold_us) {
+            break;
+        }
+        SocketUniquePtr ptr;
+        if (Socket::Address(latencies[i].second, &ptr) == 0 &&
+            ptr->EjectAsLatencyOutlier() == 0) {
+            ++nejected;
+        }
+        ++nunavailable;
+    }
+    if (nejected) {
+        g_outlier_vars->nejection << nejected;
+        LOG(WARNING) << "Isolated " << nejected << " latency outliers, median_latency="
+                     << median_us << "us threshold=" << threshold_us << "us";
+    }
+    return nejected;
+}
+
+} // namespace brpc
@@ -0,0 +1,63 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifndef BRPC_LATENCY_OUTLIER_DETECTOR_H
+#define BRPC_LATENCY_OUTLIER_DETECTOR_H
+
+#include <vector>
+#include "butil/atomicops.h"
+#include "butil/synchronization/lock.h"
+#include "brpc/server_id.h"                       // ServerId
+
+namespace brpc {
+
+// Finds servers that are "slow but successful", which are not isolated by
+// the error-based CircuitBreaker. The EMA latency of every server in a
+// load balancer is compared with the median of all servers periodically,
+// servers slower than FLAGS_circuit_breaker_latency_outlier_multiple times
+// the median are isolated with the same exponential back-off as the
+// CircuitBreaker. At most FLAGS_circuit_breaker_max_ejection_percent of the
+// servers (but at least one) can be unavailable at the same time to protect
+// capacity.
+class LatencyOutlierDetector {
+public:
+    LatencyOutlierDetector();
+
+    void AddServers(const std::vector<ServerId>& servers);
+    void RemoveServers(const std::vector<ServerId>& servers);
+
+    // Called after each RPC sent to one of the servers, runs Detect() at
+    // most once per detection interval.
+    void OnCallEnd();
+
+    // Isolate latency outliers. Returns number of isolated servers.
+    size_t Detect();
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(LatencyOutlierDetector);
+
+    butil::Mutex _mutex;
+    // May contain duplicated ids for servers with different tags.
+    std::vector<SocketId> _servers;
+    butil::atomic<int64_t> _last_detect_us;
+};
+
+} // namespace brpc
+
+
+#endif  // BRPC_LATENCY_OUTLIER_DETECTOR_H
@@ -65,6 +65,16 @@ int MethodStatus::Expose(const butil::StringPiece& prefix) {
             return -1;
         }
     }
+    if (_response_cache) {
+        if (_response_cache->Expose(prefix) != 0) {
+            return -1;
+        }
+    }
+    if (_coalescer) {
+        if (_coalescer->Expose(prefix) != 0) {
+            return -1;
+        }
+    }
     return 0;
 }
 
@@ -143,12 +153,57 @@ void MethodStatus::Describe(
         OutputValue(os, "max_concurrency: ", _max_concurrency_bvar.name(),
                     MaxConcurrency(), options, false);
     }
+    if (_compressor) {
+        if (options.use_html) {
+            os << "<p>compression: ";
+            _compressor->Describe(os);
+            os << "</p>\n";
+        } else {
+            os << "compression: ";
+            _compressor->Describe(os);
+            os << '\n';
+        }
+    }
+    if (_response_cache) {
+        if (options.use_html) {
+            os << "<p>response_cache: ";
+            _response_cache->Describe(os);
+            os << "</p>\n";
+        } else {
+            os << "response_cache: ";
+            _response_cache->Describe(os);
+            os << '\n';
+        }
+    }
+    if (_coalescer) {
+        if (options.use_html) {
+            os << "<p>coalescing: ";
+            _coalescer->Describe(os);
+            os << "</p>\n";
+        } else {
+            os << "coalescing: ";
+            _coalescer->Describe(os);
+            os << '\n';
+        }
+    }
 }
 
 void MethodStatus::SetConcurrencyLimiter(ConcurrencyLimiter* cl) {
     _cl.reset(cl);
 }
 
+void MethodStatus::SetAdaptiveCompressor(AdaptiveCompressor* compressor) {
+    _compressor.reset(compressor);
+}
+
+void MethodStatus::SetResponseCache(ResponseCache* cache) {
+    _response_cache.reset(cache);
+}
+
+void MethodStatus::SetRequestCoalescer(RequestCoalescer* coalescer) {
+    _coalescer.reset(coalescer);
+}
+
 int HandleResponseWritten(bthread_id_t id, void* data, int /*error_code*/) {
     auto args = static_cast<ResponseWriteInfo*>(data);
     args->sent_us = butil::cpuwide_time_us();
@@ -23,6 +23,9 @@
 #include "bvar/bvar.h"                    // vars
 #include "brpc/describable.h"
 #include "brpc/concurrency_limiter.h"
+#include "brpc/details/adaptive_compressor.h"
+#include "brpc/details/response_cache.h"
+#include "brpc/details/request_coalescer.h"
 
 
 namespace brpc {
@@ -58,6 +61,17 @@ public:
     // Current max_concurrency of the method.
     int MaxConcurrency() const { return _cl ? _cl->MaxConcurrency() : 0; }
 
+    // Decides compression of responses, NULL when adaptive compression is
+    // disabled.
+    AdaptiveCompressor* compressor() const { return _compressor.get(); }
+
+    // Cached responses of the method, NULL when the cache is disabled.
+    ResponseCache* response_cache() const { return _response_cache.get(); }
+
+    // Coalesces identical concurrent requests of the method, NULL when
+    // coalescing is disabled.
+    RequestCoalescer* coalescer() const { return _coalescer.get(); }
+
 private:
 friend class Server;
     DISALLOW_COPY_AND_ASSIGN(MethodStatus);
@@ -66,7 +80,22 @@ friend class Server;
     // before the server is started. 
     void SetConcurrencyLimiter(ConcurrencyLimiter* cl);
 
+    // Note: SetAdaptiveCompressor() is not thread safe and can only be
+    // called before the server is started.
+    void SetAdaptiveCompressor(AdaptiveCompressor* compressor);
+
+    // Note: SetResponseCache() is not thread safe and can only be called
+    // before the server is started.
+    void SetResponseCache(ResponseCache* cache);
+
+    // Note: SetRequestCoalescer() is not thread safe and can only be called
+    // before the server is started.
+    void SetRequestCoalescer(RequestCoalescer* coalescer);
+
     std::unique_ptr<ConcurrencyLimiter> _cl;
+    std::unique_ptr<AdaptiveCompressor> _compressor;
+    std::unique_ptr<ResponseCache> _response_cache;
+    std::unique_ptr<RequestCoalescer> _coalescer;
     butil::atomic<int> _nconcurrency;
     bvar::Adder<int64_t>  _nerror_bvar;
     bvar::LatencyRecorder _latency_rec;
@@ -33,11 +33,14 @@ struct NSKey {
     std::string protocol;
     std::string service_name;
     ChannelSignature channel_signature;
+    ServerSubsetOptions subset;
 
     NSKey(const std::string& prot_in,
           const std::string& service_in,
-          const ChannelSignature& sig)
-        : protocol(prot_in), service_name(service_in), channel_signature(sig) {
+          const ChannelSignature& sig,
+          const ServerSubsetOptions& subset_in)
+        : protocol(prot_in), service_name(service_in), channel_signature(sig)
+        , subset(subset_in) {
     }
 };
 struct NSKeyHasher {
@@ -45,13 +48,16 @@ struct NSKeyHasher {
         size_t h = butil::DefaultHasher<std::string>()(nskey.protocol);
         h = h * 101 + butil::DefaultHasher<std::string>()(nskey.service_name);
         h = h * 101 + nskey.channel_signature.data[1];
+        h = h * 101 + nskey.subset.size;
+        h = h * 101 + nskey.subset.client_id;
         return h;
     }
 };
 inline bool operator==(const NSKey& k1, const NSKey& k2) {
     return k1.protocol == k2.protocol &&
         k1.service_name == k2.service_name &&
-        k1.channel_signature == k2.channel_signature;
+        k1.channel_signature == k2.channel_signature &&
+        k1.subset == k2.subset;
 }
 
 typedef butil::FlatMap<NSKey, NamingServiceThread*, NSKeyHasher> NamingServiceMap;
@@ -103,6 +109,12 @@ void NamingServiceThread::Actions::ResetServers(
                      << " duplicated servers";
         _servers.resize(dedup_size);
     }
+    if (_owner->_options.subset.enabled()) {
+        // Servers out of the subset are never inserted into SocketMap,
+        // saving connections and health checks to them.
+        _all_servers.swap(_servers);
+        SelectServerSubset(_all_servers, _owner->_options.subset, &_servers);
+    }
     _added.resize(_servers.size());
     std::vector<ServerNode>::iterator _added_end = 
         std::set_difference(_servers.begin(), _servers.end(),
@@ -200,6 +212,10 @@ void NamingServiceThread::Actions::ResetServers(
         if (!_removed.empty()) {
             info << " removed " << _removed.size();
         }
+        if (_owner->_options.subset.enabled()) {
+            info << " subset " << _last_servers.size() << '/'
+                 << _all_servers.size();
+        }
         LOG(INFO) << info.str();
     }
 
@@ -233,7 +249,8 @@ NamingServiceThread::~NamingServiceThread() {
     RPC_VLOG << "~NamingServiceThread(" << *this << ')';
     // Remove from g_nsthread_map first
     if (!_protocol.empty()) {
-        const NSKey key(_protocol, _service_name, _options.channel_signature);
+        const NSKey key(_protocol, _service_name, _options.channel_signature,
+                        _options.subset);
         std::unique_lock<pthread_mutex_t> mu(g_nsthread_map_mutex);
         if (g_nsthread_map != NULL) {
             NamingServiceThread** ptr = g_nsthread_map->seek(key);
@@ -428,7 +445,8 @@ int GetNamingServiceThread(
         return -1;
     }
     const NSKey key(protocol, service_name,
-                    (options ? options->channel_signature : ChannelSignature()));
+                    (options ? options->channel_signature : ChannelSignature()),
+                    (options ? options->subset : ServerSubsetOptions()));
     bool new_thread = false;
     butil::intrusive_ptr<NamingServiceThread> nsthread;
     {
@@ -497,6 +515,9 @@ void NamingServiceThread::Describe(std::ostream& os,
         _ns->Describe(os, options);
     }
     os << "://" << _service_name;
+    if (_options.subset.enabled()) {
+        os << " subset=" << _options.subset.size;
+    }
 }
 
 std::ostream& operator<<(std::ostream& os, const NamingServiceThread& nsthr) {
@@ -27,6 +27,7 @@
 #include "brpc/naming_service.h"                // NamingService
 #include "brpc/naming_service_filter.h"         // NamingServiceFilter
 #include "brpc/socket_map.h"
+#include "brpc/details/server_subset.h"         // ServerSubsetOptions
 
 namespace brpc {
 
@@ -53,6 +54,9 @@ struct GetNamingServiceThreadOptions {
     HealthCheckOption hc_option;
     ChannelSignature channel_signature;
     std::shared_ptr<SocketSSLContext> ssl_ctx;
+    // Only a deterministic subset of servers are added into SocketMap and
+    // notified to watchers when subsetting is enabled.
+    ServerSubsetOptions subset;
 };
 
 // A dedicated thread to map a name to ServerIds
@@ -81,6 +85,7 @@ class NamingServiceThread : public SharedObject, public Describable {
         butil::atomic<bool> _has_wait_error;
         int _wait_error;
         std::vector<ServerNode> _last_servers;
+        std::vector<ServerNode> _all_servers;
         std::vector<ServerNode> _servers;
         std::vector<ServerNode> _added;
         std::vector<ServerNode> _removed;
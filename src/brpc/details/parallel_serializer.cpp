@@ -0,0 +1,178 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <vector>
+#include <algorithm>
+#include <gflags/gflags.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format.h>
+#include <google/protobuf/wire_format_lite.h>
+#include "butil/logging.h"
+#include "bthread/bthread.h"
+#include "brpc/reloadable_flags.h"
+#include "brpc/details/parallel_serializer.h"
+
+namespace brpc {
+
+DEFINE_int32(parallel_serialization_max_chunks, 8,
+             "Max number of chunks serialized in parallel for a message");
+BRPC_VALIDATE_GFLAG(parallel_serialization_max_chunks, PositiveInteger);
+
+DEFINE_int32(parallel_serialization_min_chunk_size, 256 * 1024,
+             "Min bytes of a chunk serialized in parallel");
+BRPC_VALIDATE_GFLAG(parallel_serialization_min_chunk_size, PositiveInteger);
+
+typedef google::protobuf::internal::WireFormat WireFormat;
+typedef google::protobuf::internal::WireFormatLite WireFormatLite;
+
+namespace {
+// Elements [begin, end) of `field', or the whole `field' if `begin' < 0.
+struct SerializingChunk {
+    const google::protobuf::Message* message;
+    const google::protobuf::FieldDescriptor* field;
+    int begin;
+    int end;
+    bthread_t tid;
+    bool ok;
+    butil::IOBuf buf;
+};
+}
+
+static void SerializeChunk(SerializingChunk* chunk) {
+    butil::IOBufAsZeroCopyOutputStream stream(&chunk->buf);
+    google::protobuf::io::CodedOutputStream output(&stream);
+    if (chunk->begin < 0) {
+        WireFormat::SerializeFieldWithCachedSizes(
+            chunk->field, *chunk->message, &output);
+    } else {
+        const google::protobuf::Reflection* reflection =
+            chunk->message->GetReflection();
+        for (int i = chunk->begin; i < chunk->end; ++i) {
+            const google::protobuf::Message& element =
+                reflection->GetRepeatedMessage(*chunk->message, chunk->field, i);
+            WireFormatLite::WriteTag(chunk->field->number(),
+                                     WireFormatLite::WIRETYPE_LENGTH_DELIMITED,
+                                     &output);
+            output.WriteVarint32(element.GetCachedSize());
+            element.SerializeWithCachedSizes(&output);
+        }
+    }
+    chunk->ok = !output.HadError();
+}
+
+static void* RunSerializeChunk(void* arg) {
+    SerializeChunk(static_cast<SerializingChunk*>(arg));
+    return NULL;
+}
+
+static bool IsSplittable(const google::protobuf::FieldDescriptor* field) {
+    return field->is_repeated() && !field->is_map() &&
+        field->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE;
+}
+
+bool SerializeInParallel(const google::protobuf::Message& message,
+                         size_t min_size, butil::IOBuf* buf) {
+    const google::protobuf::Descriptor* type = message.GetDescriptor();
+    if (type->options().message_set_wire_format()) {
+        butil::IOBufAsZeroCopyOutputStream stream(buf);
+        return message.SerializeToZeroCopyStream(&stream);
+    }
+    // Computes and caches sizes of all (sub) messages, which are read
+    // concurrently by the chunks.
+    const size_t size = message.ByteSizeLong();
+    if (size < min_size) {
+        // Sizes are cached, don't compute them again.
+        butil::IOBufAsZeroCopyOutputStream stream(buf);
+        google::protobuf::io::CodedOutputStream output(&stream);
+        message.SerializeWithCachedSizes(&output);
+        return !output.HadError();
+    }
+    const size_t chunk_size = std::max(
+        size / FLAGS_parallel_serialization_max_chunks,
+        (size_t)FLAGS_parallel_serialization_min_chunk_size);
+
+    const google::protobuf::Reflection* reflection = message.GetReflection();
+    std::vector<const google::protobuf::FieldDescriptor*> fields;
+    reflection->ListFields(message, &fields);
+    std::vector<SerializingChunk> chunks;
+    for (size_t i = 0; i < fields.size(); ++i) {
+        const google::protobuf::FieldDescriptor* f = fields[i];
+        SerializingChunk chunk = { &message, f, -1, -1, INVALID_BTHREAD, false,
+                                   butil::IOBuf() };
+        if (!IsSplittable(f)) {
+            chunks.push_back(chunk);
+            continue;
+        }
+        const int n = reflection->FieldSize(message, f);
+        size_t accumulated = 0;
+        chunk.begin = 0;
+        for (int j = 0; j < n; ++j) {
+            accumulated += reflection->GetRepeatedMessage(
+                message, f, j).GetCachedSize();
+            if (accumulated >= chunk_size || j + 1 == n) {
+                chunk.end = j + 1;
+                chunks.push_back(chunk);
+                chunk.begin = j + 1;
+                accumulated = 0;
+            }
+        }
+    }
+
+    // Serialize the first chunk of each field in this bthread, and others
+    // in new bthreads.
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        SerializingChunk& chunk = chunks[i];
+        if (chunk.begin <= 0 ||
+            bthread_start_background(&chunk.tid, NULL, RunSerializeChunk,
+                                     &chunk) != 0) {
+            chunk.tid = INVALID_BTHREAD;
+        }
+    }
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        if (chunks[i].tid == INVALID_BTHREAD) {
+            SerializeChunk(&chunks[i]);
+        }
+    }
+    bool ok = true;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        SerializingChunk& chunk = chunks[i];
+        if (chunk.tid != INVALID_BTHREAD) {
+            bthread_join(chunk.tid, NULL);
+        }
+        ok = ok && chunk.ok;
+        buf->append(butil::IOBuf::Movable(chunk.buf));
+    }
+    if (!ok) {
+        LOG(WARNING) << "Fail to serialize " << type->full_name()
+                     << " in parallel";
+        return false;
+    }
+    const google::protobuf::UnknownFieldSet& unknown_fields =
+        reflection->GetUnknownFields(message);
+    if (!unknown_fields.empty()) {
+        butil::IOBufAsZeroCopyOutputStream stream(buf);
+        google::protobuf::io::CodedOutputStream output(&stream);
+        WireFormat::SerializeUnknownFields(unknown_fields, &output);
+        return !output.HadError();
+    }
+    return true;
+}
+
+} // namespace brpc
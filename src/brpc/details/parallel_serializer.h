@@ -0,0 +1,39 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+
+#ifndef BRPC_PARALLEL_SERIALIZER_H
+#define BRPC_PARALLEL_SERIALIZER_H
+
+#include <google/protobuf/message.h>
+#include "butil/iobuf.h"
+
+namespace brpc {
+
+// Serialize `message' in protobuf wire format into `buf'. If the message is
+// not smaller than `min_size' bytes, elements of its top-level repeated
+// message fields are split into chunks which are serialized by parallel
+// bthreads into separate IOBufs and concatenated without copying.
+// The output is the same as Message::SerializeToZeroCopyStream.
+bool SerializeInParallel(const google::protobuf::Message& message,
+                         size_t min_size, butil::IOBuf* buf);
+
+} // namespace brpc
+
+
+#endif  // BRPC_PARALLEL_SERIALIZER_H
@@ -0,0 +1,89 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include "brpc/details/request_coalescer.h"
+
+namespace brpc {
+
+static double GetCoalescedRatio(void* arg) {
+    return static_cast<RequestCoalescer*>(arg)->coalesced_ratio();
+}
+
+RequestCoalescer::RequestCoalescer()
+    : _coalesced_ratio_bvar(GetCoalescedRatio, this) {}
+
+static bool SameRequest(const RequestKey& k1, const RequestKey& k2) {
+    return k1.content_type == k2.content_type &&
+        k1.compress_type == k2.compress_type &&
+        k1.request.equals(k2.request);
+}
+
+bool RequestCoalescer::Join(const RequestKey& key, const WaitingCall& call) {
+    {
+        Shard& shard = GetShard(key);
+        BAIDU_SCOPED_LOCK(shard.mutex);
+        auto it = shard.processing.find(key.hash);
+        if (it == shard.processing.end()) {
+            // Copying the key shares blocks of the request.
+            shard.processing[key.hash].key = key;
+        } else if (SameRequest(it->second.key, key)) {
+            it->second.calls.push_back(call);
+            _ncoalesced << 1;
+            return true;
+        }
+    }
+    _nprocessed << 1;
+    return false;
+}
+
+void RequestCoalescer::Finish(const RequestKey& key,
+                              std::vector<WaitingCall>* calls) {
+    Shard& shard = GetShard(key);
+    BAIDU_SCOPED_LOCK(shard.mutex);
+    auto it = shard.processing.find(key.hash);
+    if (it != shard.processing.end() && SameRequest(it->second.key, key)) {
+        calls->swap(it->second.calls);
+        shard.processing.erase(it);
+    }
+}
+
+double RequestCoalescer::coalesced_ratio() const {
+    const int64_t ncoalesced = _ncoalesced.get_value();
+    const int64_t total = ncoalesced + _nprocessed.get_value();
+    if (total <= 0) {
+        return 0;
+    }
+    return ncoalesced / (double)total;
+}
+
+int RequestCoalescer::Expose(const butil::StringPiece& prefix) {
+    if (_nprocessed.expose_as(prefix, "coalescing_processed") != 0 ||
+        _ncoalesced.expose_as(prefix, "coalescing_coalesced") != 0 ||
+        _coalesced_ratio_bvar.expose_as(prefix, "coalescing_ratio") != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+void RequestCoalescer::Describe(std::ostream& os) const {
+    os << "processed=" << _nprocessed.get_value()
+       << " coalesced=" << _ncoalesced.get_value()
+       << " coalesced_ratio=" << coalesced_ratio();
+}
+
+} // namespace brpc
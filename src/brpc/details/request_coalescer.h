@@ -0,0 +1,94 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifndef BRPC_DETAILS_REQUEST_COALESCER_H
+#define BRPC_DETAILS_REQUEST_COALESCER_H
+
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include "butil/synchronization/lock.h"
+#include "bvar/bvar.h"
+#include "brpc/details/response_cache.h"   // RequestKey
+
+namespace brpc {
+
+class Controller;
+
+// Let identical requests to a method arriving while one of them is being
+// processed wait for its response instead of being processed again.
+// Thread-safe.
+class RequestCoalescer {
+public:
+    // A call waiting for the response of an identical one.
+    struct WaitingCall {
+        int64_t correlation_id;
+        Controller* cntl;
+        int64_t received_us;
+    };
+
+    RequestCoalescer();
+
+    // Returns true if a request with `key' is being processed, in which
+    // case `call' waits for it. Otherwise the caller processes the request
+    // and must call Finish() with `key' later.
+    bool Join(const RequestKey& key, const WaitingCall& call);
+
+    // Call this when the request with `key' is processed. Calls waiting
+    // for it are moved into `calls'.
+    void Finish(const RequestKey& key, std::vector<WaitingCall>* calls);
+
+    // Coalesced requests / all requests since the coalescer was created.
+    double coalesced_ratio() const;
+
+    // Expose vars as <prefix>_coalescing_*.
+    int Expose(const butil::StringPiece& prefix);
+
+    void Describe(std::ostream& os) const;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(RequestCoalescer);
+
+    // A request being processed and calls waiting for it.
+    struct Processing {
+        RequestKey key;
+        std::vector<WaitingCall> calls;
+    };
+    // Requests are spread over shards by RequestKey::hash so that
+    // different requests rarely contend for the same lock.
+    struct Shard {
+        butil::Mutex mutex;
+        // Indexed by RequestKey::hash. A request with the same hash as a
+        // different one being processed is processed without coalescing.
+        std::unordered_map<uint64_t, Processing> processing;
+    };
+    static const size_t NSHARD = 16;
+
+    Shard& GetShard(const RequestKey& key) { return _shards[key.hash % NSHARD]; }
+
+    Shard _shards[NSHARD];
+
+    bvar::Adder<int64_t> _nprocessed;
+    bvar::Adder<int64_t> _ncoalesced;
+    bvar::PassiveStatus<double> _coalesced_ratio_bvar;
+};
+
+} // namespace brpc
+
+
+#endif  // BRPC_DETAILS_REQUEST_COALESCER_H
@@ -0,0 +1,163 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include "butil/time.h"
+#include "butil/third_party/murmurhash3/murmurhash3.h"
+#include "brpc/details/response_cache.h"
+
+namespace brpc {
+
+static double GetHitRatio(void* arg) {
+    return static_cast<ResponseCache*>(arg)->hit_ratio();
+}
+
+static int64_t GetBytes(void* arg) {
+    return static_cast<ResponseCache*>(arg)->bytes();
+}
+
+// Bytes taken by an entry besides the key and the body.
+static const size_t ENTRY_OVERHEAD = 128;
+
+static size_t EntryBytes(const std::string& request,
+                         const CachedResponse& res) {
+    return request.size() + res.body.size() + res.checksum_value.size() +
+        ENTRY_OVERHEAD;
+}
+
+ResponseCache::ResponseCache(const ResponseCacheOptions& options)
+    : _options(options)
+    , _lru(LRU::NO_AUTO_EVICT)
+    , _bytes(0)
+    , _hit_ratio_bvar(GetHitRatio, this)
+    , _bytes_bvar(GetBytes, this) {}
+
+RequestKey ResponseCache::MakeKey(const butil::IOBuf& request,
+                                  ContentType content_type,
+                                  CompressType compress_type) {
+    RequestKey key;
+    key.content_type = content_type;
+    key.compress_type = compress_type;
+    key.request = request;
+    const char types[2] = { static_cast<char>(content_type),
+                            static_cast<char>(compress_type) };
+    butil::MurmurHash3_x64_128_Context mm_ctx;
+    butil::MurmurHash3_x64_128_Init(&mm_ctx, 0);
+    butil::MurmurHash3_x64_128_Update(&mm_ctx, types, sizeof(types));
+    const size_t nblock = request.backing_block_num();
+    for (size_t i = 0; i < nblock; ++i) {
+        const butil::StringPiece block = request.backing_block(i);
+        butil::MurmurHash3_x64_128_Update(&mm_ctx, block.data(), block.size());
+    }
+    uint64_t hash[2];
+    butil::MurmurHash3_x64_128_Final(hash, &mm_ctx);
+    key.hash = hash[0];
+    return key;
+}
+
+bool ResponseCache::Get(const RequestKey& key, CachedResponse* response) {
+    {
+        BAIDU_SCOPED_LOCK(_mutex);
+        LRU::iterator it = _lru.Get(key.hash);
+        if (it != _lru.end()) {
+            const Entry& entry = it->second;
+            if (entry.content_type == key.content_type &&
+                entry.compress_type == key.compress_type &&
+                key.request.equals(entry.request)) {
+                if (entry.expire_us > butil::monotonic_time_us()) {
+                    *response = entry.response;
+                    _nhit << 1;
+                    return true;
+                }
+                _bytes -= EntryBytes(entry.request, entry.response);
+                _lru.Erase(it);
+            }
+        }
+    }
+    _nmiss << 1;
+    return false;
+}
+
+void ResponseCache::Put(const RequestKey& key,
+                        const CachedResponse& response) {
+    Entry entry;
+    entry.content_type = key.content_type;
+    entry.compress_type = key.compress_type;
+    const size_t nbytes =
+        key.request.size() + EntryBytes(entry.request, response);
+    if (nbytes > _options.max_bytes) {
+        return;
+    }
+    // Copied rather than referencing blocks of the request, which are
+    // usually much larger than the request.
+    key.request.copy_to(&entry.request);
+    entry.response = response;
+    entry.expire_us = butil::monotonic_time_us() + _options.ttl_ms * 1000L;
+    BAIDU_SCOPED_LOCK(_mutex);
+    LRU::iterator it = _lru.Peek(key.hash);
+    if (it != _lru.end()) {
+        _bytes -= EntryBytes(it->second.request, it->second.response);
+        _lru.Erase(it);
+    }
+    EvictUntil(_options.max_bytes - nbytes);
+    _lru.Put(key.hash, entry);
+    _bytes += nbytes;
+}
+
+void ResponseCache::EvictUntil(size_t max_bytes) {
+    while (_bytes > max_bytes && !_lru.empty()) {
+        LRU::reverse_iterator it = _lru.rbegin();
+        _bytes -= EntryBytes(it->second.request, it->second.response);
+        _lru.Erase(it);
+        _nevicted << 1;
+    }
+}
+
+size_t ResponseCache::bytes() const {
+    BAIDU_SCOPED_LOCK(_mutex);
+    return _bytes;
+}
+
+double ResponseCache::hit_ratio() const {
+    const int64_t nhit = _nhit.get_value();
+    const int64_t total = nhit + _nmiss.get_value();
+    if (total <= 0) {
+        return 0;
+    }
+    return nhit / (double)total;
+}
+
+int ResponseCache::Expose(const butil::StringPiece& prefix) {
+    if (_nhit.expose_as(prefix, "response_cache_hit") != 0 ||
+        _nmiss.expose_as(prefix, "response_cache_miss") != 0 ||
+        _nevicted.expose_as(prefix, "response_cache_evicted") != 0 ||
+        _hit_ratio_bvar.expose_as(prefix, "response_cache_hit_ratio") != 0 ||
+        _bytes_bvar.expose_as(prefix, "response_cache_bytes") != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+void ResponseCache::Describe(std::ostream& os) const {
+    os << "hit=" << _nhit.get_value()
+       << " miss=" << _nmiss.get_value()
+       << " hit_ratio=" << hit_ratio()
+       << " bytes=" << bytes()
+       << " evicted=" << _nevicted.get_value();
+}
+
+} // namespace brpc
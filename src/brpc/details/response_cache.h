@@ -0,0 +1,129 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifndef BRPC_DETAILS_RESPONSE_CACHE_H
+#define BRPC_DETAILS_RESPONSE_CACHE_H
+
+#include <ostream>
+#include <string>
+#include "butil/containers/mru_cache.h"
+#include "butil/iobuf.h"
+#include "butil/synchronization/lock.h"
+#include "bvar/bvar.h"
+#include "brpc/options.pb.h"
+#include "brpc/response_cache.h"
+
+namespace brpc {
+
+// Identifies a serialized request to a method. The request is hashed
+// block by block into `hash', so that requests are looked up by the hash
+// and the bytes are compared only when hashes are equal.
+struct RequestKey {
+    RequestKey()
+        : content_type(CONTENT_TYPE_PB)
+        , compress_type(COMPRESS_TYPE_NONE)
+        , hash(0) {}
+
+    ContentType content_type;
+    CompressType compress_type;
+    // Shares blocks with the serialized request, nothing is copied.
+    butil::IOBuf request;
+    // Hash of all the fields above.
+    uint64_t hash;
+};
+
+// A response serialized and ready to be sent.
+struct CachedResponse {
+    CachedResponse()
+        : content_type(CONTENT_TYPE_PB)
+        , compress_type(COMPRESS_TYPE_NONE)
+        , checksum_type(CHECKSUM_TYPE_NONE) {}
+
+    butil::IOBuf body;
+    ContentType content_type;
+    CompressType compress_type;
+    ChecksumType checksum_type;
+    std::string checksum_value;
+};
+
+// Serialized responses of a method, evicted when expired or least recently
+// used. Thread-safe.
+class ResponseCache {
+public:
+    explicit ResponseCache(const ResponseCacheOptions& options);
+
+    // Key of the request serialized into `request' with `content_type' and
+    // `compress_type', which are part of the key since the same message
+    // may be serialized differently.
+    static RequestKey MakeKey(const butil::IOBuf& request,
+                              ContentType content_type,
+                              CompressType compress_type);
+
+    // Get the unexpired response cached with `key'.
+    // Returns true on hit.
+    bool Get(const RequestKey& key, CachedResponse* response);
+
+    // Cache `response' with `key', replacing the one cached with `key' or
+    // with the same hash.
+    void Put(const RequestKey& key, const CachedResponse& response);
+
+    // Bytes taken by cached requests and responses.
+    size_t bytes() const;
+
+    // Hits / (hits + misses) since the cache was created.
+    double hit_ratio() const;
+
+    // Expose vars as <prefix>_response_cache_*.
+    int Expose(const butil::StringPiece& prefix);
+
+    void Describe(std::ostream& os) const;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(ResponseCache);
+
+    struct Entry {
+        ContentType content_type;
+        CompressType compress_type;
+        // Compared with RequestKey::request when hashes are equal.
+        std::string request;
+        CachedResponse response;
+        int64_t expire_us;
+    };
+    // Indexed by RequestKey::hash.
+    typedef butil::HashingMRUCache<uint64_t, Entry> LRU;
+
+    // Remove least recently used entries until bytes are within `max_bytes'.
+    // Must be called with `_mutex' held.
+    void EvictUntil(size_t max_bytes);
+
+    const ResponseCacheOptions _options;
+    mutable butil::Mutex _mutex;
+    LRU _lru;
+    size_t _bytes;
+
+    bvar::Adder<int64_t> _nhit;
+    bvar::Adder<int64_t> _nmiss;
+    bvar::Adder<int64_t> _nevicted;
+    bvar::PassiveStatus<double> _hit_ratio_bvar;
+    bvar::PassiveStatus<int64_t> _bytes_bvar;
+};
+
+} // namespace brpc
+
+
+#endif  // BRPC_DETAILS_RESPONSE_CACHE_H
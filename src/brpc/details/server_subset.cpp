@@ -0,0 +1,120 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <string.h>                                   // strlen
+#include <unistd.h>                                   // getpid
+#include <algorithm>
+#include "butil/endpoint.h"                           // my_hostname
+#include "butil/third_party/murmurhash3/murmurhash3.h"
+#include "brpc/details/server_subset.h"
+
+
+namespace brpc {
+
+namespace {
+
+// Finalizer of MurmurHash3, spreads bits of `k' to all positions.
+inline uint64_t Fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+uint64_t HashServerNode(const ServerNode& node) {
+    const butil::EndPointStr str = butil::endpoint2str(node.addr);
+    butil::MurmurHash3_x64_128_Context ctx;
+    butil::MurmurHash3_x64_128_Init(&ctx, 0);
+    butil::MurmurHash3_x64_128_Update(&ctx, str.c_str(), strlen(str.c_str()));
+    if (!node.tag.empty()) {
+        butil::MurmurHash3_x64_128_Update(&ctx, node.tag.data(), node.tag.size());
+    }
+    uint64_t out[2];
+    butil::MurmurHash3_x64_128_Final(out, &ctx);
+    return out[0];
+}
+
+struct ScoredServer {
+    uint64_t score;
+    const ServerNode* node;
+
+    // Break ties by the node itself so that the result does not depend
+    // on the order of input servers.
+    bool operator<(const ScoredServer& rhs) const {
+        return score != rhs.score ? (score < rhs.score) : (*node < *rhs.node);
+    }
+};
+
+} // namespace
+
+void SelectServerSubset(const std::vector<ServerNode>& servers,
+                        const ServerSubsetOptions& options,
+                        std::vector<ServerNode>* subset) {
+    subset->clear();
+    if (!options.enabled() || servers.size() <= (size_t)options.size) {
+        subset->assign(servers.begin(), servers.end());
+        return;
+    }
+    const size_t n = servers.size();
+    const size_t k = options.size;
+    std::vector<ScoredServer> scored(n);
+    subset->reserve(k);
+    if (options.client_count > 0) {
+        // Deterministic aperture: servers are placed on a ring ordered by
+        // their hashes and clients are placed evenly on the same ring, each
+        // client takes `k' consecutive servers starting from its position.
+        // Since hashes of servers are stable, adding or removing a server
+        // only shifts windows of clients by at most one position.
+        for (size_t i = 0; i < n; ++i) {
+            scored[i].score = HashServerNode(servers[i]);
+            scored[i].node = &servers[i];
+        }
+        std::sort(scored.begin(), scored.end());
+        const int64_t count = options.client_count;
+        const uint64_t index = ((options.client_id % count) + count) % count;
+        const size_t start = index * n / count;
+        for (size_t i = 0; i < k; ++i) {
+            subset->push_back(*scored[(start + i) % n].node);
+        }
+    } else {
+        // Rendezvous hashing: every client ranks all servers by a hash
+        // combining the client and the server, and takes the first `k'.
+        const uint64_t client_hash = Fmix64((uint64_t)options.client_id);
+        for (size_t i = 0; i < n; ++i) {
+            scored[i].score = Fmix64(HashServerNode(servers[i]) ^ client_hash);
+            scored[i].node = &servers[i];
+        }
+        std::partial_sort(scored.begin(), scored.begin() + k, scored.end());
+        for (size_t i = 0; i < k; ++i) {
+            subset->push_back(*scored[i].node);
+        }
+    }
+    std::sort(subset->begin(), subset->end());
+}
+
+int64_t DefaultSubsetClientId() {
+    const char* hostname = butil::my_hostname();
+    const pid_t pid = getpid();
+    uint64_t out[2];
+    butil::MurmurHash3_x64_128(hostname, strlen(hostname), (uint32_t)pid, out);
+    return (int64_t)(out[0] & 0x7fffffffffffffffULL);
+}
+
+} // namespace brpc
@@ -0,0 +1,71 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifndef BRPC_SERVER_SUBSET_H
+#define BRPC_SERVER_SUBSET_H
+
+#include <vector>
+#include "brpc/server_node.h"                   // ServerNode
+
+namespace brpc {
+
+// Parameters of client-side deterministic subsetting. When a large number
+// of clients talk to a large number of servers, making every client connect
+// to every server wastes connections, memory and health checks. Each client
+// instead picks a stable subset of `size' servers according to `client_id'.
+struct ServerSubsetOptions {
+    ServerSubsetOptions()
+        : size(0)
+        , client_id(0)
+        , client_count(0) {}
+
+    bool enabled() const { return size > 0; }
+
+    // Max number of servers selected by one client. <= 0 means disabled.
+    int size;
+    // Identifier of this client, clients with the same id select the
+    // same subset.
+    int64_t client_id;
+    // Total number of clients. If it's positive, clients are spread evenly
+    // on a ring of servers(deterministic aperture) so that every server is
+    // selected by nearly the same number of clients. Otherwise servers are
+    // selected by rendezvous hashing which is balanced on average.
+    int client_count;
+};
+
+inline bool operator==(const ServerSubsetOptions& o1,
+                       const ServerSubsetOptions& o2) {
+    return o1.size == o2.size && o1.client_id == o2.client_id &&
+        o1.client_count == o2.client_count;
+}
+
+// Select at most `options.size' servers from `servers' into `subset'.
+// The selection only depends on the set of servers rather than their order,
+// and when a server is added or removed, most of the subset stays the same.
+void SelectServerSubset(const std::vector<ServerNode>& servers,
+                        const ServerSubsetOptions& options,
+                        std::vector<ServerNode>* subset);
+
+// Returns an id derived from hostname and pid of this process, used when
+// user does not specify a client id.
+int64_t DefaultSubsetClientId();
+
+} // namespace brpc
+
+
+#endif  // BRPC_SERVER_SUBSET_H
@@ -0,0 +1,214 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <map>
+#include <algorithm>
+#include <google/protobuf/wire_format_lite.h>
+#include "butil/containers/doubly_buffered_data.h"
+#include "butil/logging.h"
+#include "brpc/options.pb.h"
+#include "brpc/details/zero_copy_bytes.h"
+
+namespace brpc {
+
+typedef google::protobuf::internal::WireFormatLite WireFormatLite;
+
+// Descriptors are never destroyed, neither are the vectors.
+typedef std::map<const google::protobuf::Descriptor*,
+                 const std::vector<int>*> ZeroCopyFieldsMap;
+
+static size_t AddZeroCopyFields(ZeroCopyFieldsMap& m,
+                                const google::protobuf::Descriptor* type,
+                                const std::vector<int>* numbers) {
+    return m.insert(std::make_pair(type, numbers)).second ? 1 : 0;
+}
+
+static pthread_once_t g_zero_copy_fields_once = PTHREAD_ONCE_INIT;
+static butil::DoublyBufferedData<ZeroCopyFieldsMap>* g_zero_copy_fields = NULL;
+
+static void InitZeroCopyFields() {
+    g_zero_copy_fields = new butil::DoublyBufferedData<ZeroCopyFieldsMap>;
+}
+
+static std::vector<int>* ListZeroCopyFields(
+    const google::protobuf::Descriptor* type) {
+    std::vector<int>* numbers = NULL;
+    for (int i = 0; i < type->field_count(); ++i) {
+        const google::protobuf::FieldDescriptor* f = type->field(i);
+        if (!f->options().GetExtension(zero_copy_bytes)) {
+            continue;
+        }
+        if (f->type() != google::protobuf::FieldDescriptor::TYPE_BYTES ||
+            f->is_repeated() || f->is_required()) {
+            LOG(WARNING) << "Ignore (brpc.zero_copy_bytes) of " << f->full_name()
+                         << " which is not an optional bytes field";
+            continue;
+        }
+        if (numbers == NULL) {
+            numbers = new std::vector<int>;
+        }
+        numbers->push_back(f->number());
+    }
+    return numbers;
+}
+
+const std::vector<int>* GetZeroCopyBytesFields(
+    const google::protobuf::Descriptor* type) {
+    pthread_once(&g_zero_copy_fields_once, InitZeroCopyFields);
+    {
+        butil::DoublyBufferedData<ZeroCopyFieldsMap>::ScopedPtr ptr;
+        if (g_zero_copy_fields->Read(&ptr) != 0) {
+            return NULL;
+        }
+        ZeroCopyFieldsMap::const_iterator it = ptr->find(type);
+        if (it != ptr->end()) {
+            return it->second;
+        }
+    }
+    std::vector<int>* numbers = ListZeroCopyFields(type);
+    if (g_zero_copy_fields->Modify(AddZeroCopyFields, type, numbers) == 0) {
+        // Added by another thread.
+        delete numbers;
+        return GetZeroCopyBytesFields(type);
+    }
+    return numbers;
+}
+
+static void AppendVarint(uint64_t value, butil::IOBuf* buf) {
+    char tmp[16];
+    size_t n = 0;
+    while (value >= 0x80) {
+        tmp[n++] = static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    tmp[n++] = static_cast<char>(value);
+    buf->append(tmp, n);
+}
+
+bool AppendZeroCopyBytes(const google::protobuf::Descriptor* type,
+                         const ZeroCopyBytesMap& fields, butil::IOBuf* buf) {
+    const std::vector<int>* numbers = GetZeroCopyBytesFields(type);
+    for (ZeroCopyBytesMap::const_iterator it = fields.begin();
+         it != fields.end(); ++it) {
+        if (numbers == NULL ||
+            std::find(numbers->begin(), numbers->end(), it->first) ==
+            numbers->end()) {
+            LOG(WARNING) << "Field #" << it->first << " of " << type->full_name()
+                         << " is not marked with (brpc.zero_copy_bytes)";
+            return false;
+        }
+        AppendVarint(WireFormatLite::MakeTag(
+                         it->first, WireFormatLite::WIRETYPE_LENGTH_DELIMITED),
+                     buf);
+        AppendVarint(it->second.size(), buf);
+        buf->append(it->second);
+    }
+    return true;
+}
+
+static bool ReadVarint(butil::IOBufBytesIterator& it, uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && it; shift += 7) {
+        const unsigned char c = *it;
+        ++it;
+        result |= static_cast<uint64_t>(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CutZeroCopyBytes(const butil::IOBuf& data, const std::vector<int>& numbers,
+                      butil::IOBuf* rest, ZeroCopyBytesMap* fields) {
+    butil::IOBufBytesIterator it(data);
+    // Bytes before `it' not appended to `rest' yet start from `kept'.
+    butil::IOBufBytesIterator kept(data);
+    while (it.bytes_left()) {
+        const size_t field_offset = data.size() - it.bytes_left();
+        uint64_t tag;
+        if (!ReadVarint(it, &tag)) {
+            return false;
+        }
+        uint64_t length = 0;
+        switch (WireFormatLite::GetTagWireType(tag)) {
+        case WireFormatLite::WIRETYPE_VARINT:
+            if (!ReadVarint(it, &length)) {
+                return false;
+            }
+            continue;
+        case WireFormatLite::WIRETYPE_FIXED64:
+            length = 8;
+            break;
+        case WireFormatLite::WIRETYPE_FIXED32:
+            length = 4;
+            break;
+        case WireFormatLite::WIRETYPE_LENGTH_DELIMITED:
+            if (!ReadVarint(it, &length)) {
+                return false;
+            }
+            break;
+        default:
+            // Groups are not scanned.
+            return false;
+        }
+        if (length > it.bytes_left()) {
+            return false;
+        }
+        const int number = WireFormatLite::GetTagFieldNumber(tag);
+        if (WireFormatLite::GetTagWireType(tag) !=
+            WireFormatLite::WIRETYPE_LENGTH_DELIMITED ||
+            std::find(numbers.begin(), numbers.end(), number) == numbers.end()) {
+            it.forward(length);
+            continue;
+        }
+        const size_t kept_offset = data.size() - kept.bytes_left();
+        kept.append_and_forward(rest, field_offset - kept_offset);
+        // The last one wins as protobuf does.
+        butil::IOBuf& field = (*fields)[number];
+        field.clear();
+        it.append_and_forward(&field, length);
+        kept.forward(data.size() - it.bytes_left() - field_offset);
+    }
+    kept.append_and_forward(rest, kept.bytes_left());
+    return true;
+}
+
+void MoveZeroCopyBytes(const std::vector<int>& numbers,
+                       google::protobuf::Message* message,
+                       ZeroCopyBytesMap* fields) {
+    const google::protobuf::Reflection* reflection = message->GetReflection();
+    const google::protobuf::Descriptor* type = message->GetDescriptor();
+    for (size_t i = 0; i < numbers.size(); ++i) {
+        const google::protobuf::FieldDescriptor* f =
+            type->FindFieldByNumber(numbers[i]);
+        if (!reflection->HasField(*message, f)) {
+            continue;
+        }
+        std::string scratch;
+        const std::string& value =
+            reflection->GetStringReference(*message, f, &scratch);
+        butil::IOBuf& field = (*fields)[numbers[i]];
+        field.clear();
+        field.append(value);
+        reflection->ClearField(message, f);
+    }
+}
+
+} // namespace brpc
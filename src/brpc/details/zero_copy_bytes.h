@@ -0,0 +1,58 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+
+#ifndef BRPC_ZERO_COPY_BYTES_H
+#define BRPC_ZERO_COPY_BYTES_H
+
+#include <vector>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+#include "butil/iobuf.h"
+#include "brpc/controller.h"          // ZeroCopyBytesMap
+
+namespace brpc {
+
+// Numbers of top-level optional bytes fields of `type' marked with
+// (brpc.zero_copy_bytes), NULL if there's none.
+const std::vector<int>* GetZeroCopyBytesFields(
+    const google::protobuf::Descriptor* type);
+
+// Append `fields' to `buf' holding a message of `type' serialized in
+// protobuf wire format, without copying contents of the fields.
+// Returns false if any of the fields is not marked in `type'.
+bool AppendZeroCopyBytes(const google::protobuf::Descriptor* type,
+                         const ZeroCopyBytesMap& fields, butil::IOBuf* buf);
+
+// Cut fields in `numbers' out of `data' holding a message serialized in
+// protobuf wire format into `fields' without copying, and put the rest
+// into `rest'. Returns false if `data' can't be scanned, in which case
+// `fields' and `rest' are unspecified.
+bool CutZeroCopyBytes(const butil::IOBuf& data, const std::vector<int>& numbers,
+                      butil::IOBuf* rest, ZeroCopyBytesMap* fields);
+
+// Move fields in `numbers' which were parsed into `message' as usual into
+// `fields', so that users always find them in `fields'.
+void MoveZeroCopyBytes(const std::vector<int>& numbers,
+                       google::protobuf::Message* message,
+                       ZeroCopyBytesMap* fields);
+
+} // namespace brpc
+
+
+#endif  // BRPC_ZERO_COPY_BYTES_H
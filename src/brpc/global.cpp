@@ -59,10 +59,13 @@
 #include "brpc/compress.h"
 #include "brpc/policy/gzip_compress.h"
 #include "brpc/policy/snappy_compress.h"
+#include "brpc/policy/zstd_compress.h"
+#include "brpc/policy/lz4_compress.h"
 
 // Checksum handlers
 #include "brpc/checksum.h"
 #include "brpc/policy/crc32c_checksum.h"
+#include "brpc/policy/xxh3_checksum.h"
 
 // Protocols
 #include "brpc/protocol.h"
@@ -324,6 +327,24 @@ static void BaiduStreamingLogHandler(google::protobuf::LogLevel level,
 }
 #endif
 
+// CompressHandler::CompressSerialized of the built-in compressions whose
+// IOBuf versions take more arguments.
+static bool GzipCompressSerialized(const butil::IOBuf& in, butil::IOBuf* out) {
+    return GzipCompress(in, out, NULL);
+}
+
+static bool ZlibCompressSerialized(const butil::IOBuf& in, butil::IOBuf* out) {
+    GzipCompressOptions options;
+    options.format = google::protobuf::io::GzipOutputStream::ZLIB;
+    return GzipCompress(in, out, &options);
+}
+
+#ifdef BRPC_WITH_ZSTD
+static bool ZstdCompressSerialized(const butil::IOBuf& in, butil::IOBuf* out) {
+    return ZstdCompress(in, out);
+}
+#endif
+
 static void GlobalInitializeOrDieImpl() {
     //////////////////////////////////////////////////////////////////
     // Be careful about usages of gflags inside this function which //
@@ -393,18 +414,35 @@ static void GlobalInitializeOrDieImpl() {
     LoadBalancerExtension()->RegisterOrDie("_dynpart", &g_ext->dynpart_lb);
 
     // Compress Handlers
-    CompressHandler gzip_compress = { GzipCompress, GzipDecompress, "gzip" };
+    CompressHandler gzip_compress = { GzipCompress, GzipDecompress, "gzip",
+                                       GzipCompressSerialized };
     if (RegisterCompressHandler(COMPRESS_TYPE_GZIP, gzip_compress) != 0) {
         exit(1);
     }
-    CompressHandler zlib_compress = { ZlibCompress, ZlibDecompress, "zlib" };
+    CompressHandler zlib_compress = { ZlibCompress, ZlibDecompress, "zlib",
+                                       ZlibCompressSerialized };
     if (RegisterCompressHandler(COMPRESS_TYPE_ZLIB, zlib_compress) != 0) {
         exit(1);
     }
-    CompressHandler snappy_compress = { SnappyCompress, SnappyDecompress, "snappy" };
+    CompressHandler snappy_compress = { SnappyCompress, SnappyDecompress,
+                                         "snappy", SnappyCompress };
     if (RegisterCompressHandler(COMPRESS_TYPE_SNAPPY, snappy_compress) != 0) {
         exit(1);
     }
+#ifdef BRPC_WITH_ZSTD
+    CompressHandler zstd_compress = { ZstdCompress, ZstdDecompress, "zstd",
+                                       ZstdCompressSerialized };
+    if (RegisterCompressHandler(COMPRESS_TYPE_ZSTD, zstd_compress) != 0) {
+        exit(1);
+    }
+#endif
+#ifdef BRPC_WITH_LZ4
+    CompressHandler lz4_compress = { Lz4Compress, Lz4Decompress, "lz4",
+                                      Lz4Compress };
+    if (RegisterCompressHandler(COMPRESS_TYPE_LZ4, lz4_compress) != 0) {
+        exit(1);
+    }
+#endif
 
     // Checksum Handlers
     const ChecksumHandler crc32c_checksum = {Crc32cCompute, Crc32cVerify,
@@ -412,6 +450,12 @@ static void GlobalInitializeOrDieImpl() {
     if (RegisterChecksumHandler(CHECKSUM_TYPE_CRC32C, crc32c_checksum) != 0) {
         exit(1);
     }
+#ifdef BRPC_WITH_XXHASH
+    const ChecksumHandler xxh3_checksum = {Xxh3Compute, Xxh3Verify, "xxh3"};
+    if (RegisterChecksumHandler(CHECKSUM_TYPE_XXH3, xxh3_checksum) != 0) {
+        exit(1);
+    }
+#endif
 
     // Protocols
     Protocol baidu_protocol = { ParseRpcMessage,
@@ -438,8 +482,7 @@ static void GlobalInitializeOrDieImpl() {
                                ProcessHttpRequest, ProcessHttpResponse,
                                VerifyHttpRequest, ParseHttpServerAddress,
                                GetHttpMethodName,
-                               CONNECTION_TYPE_POOLED_AND_SHORT,
-                               "http" };
+                               CONNECTION_TYPE_ALL, "http" };
     if (RegisterProtocol(PROTOCOL_HTTP, http_protocol) != 0) {
         exit(1);
     }
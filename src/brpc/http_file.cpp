@@ -0,0 +1,243 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <fcntl.h>                     // open
+#include <sys/stat.h>                  // fstat
+#include <ctype.h>
+#include <time.h>
+#include "butil/fd_guard.h"
+#include "butil/logging.h"
+#include "butil/string_printf.h"
+#include "butil/string_splitter.h"
+#include "brpc/controller.h"
+#include "brpc/http_status_code.h"
+#include "brpc/http_file.h"
+
+
+namespace brpc {
+
+int AppendFileRange(butil::IOBuf* out, int fd, off_t offset, size_t length) {
+    if (offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    butil::IOPortal buf;
+    while (length > 0) {
+        const ssize_t nr = buf.pappend_from_file_descriptor(fd, offset, length);
+        if (nr < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (nr == 0) {
+            // The file was truncated after `length' was decided.
+            errno = ENODATA;
+            return -1;
+        }
+        offset += nr;
+        length -= nr;
+    }
+    out->append(butil::IOBuf::Movable(buf));
+    return 0;
+}
+
+// Format `t' as an IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+// strftime() is not used since names of days and months depend on locale.
+static std::string HttpDate(time_t t) {
+    static const char* const days[] = {
+        "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+    };
+    static const char* const months[] = {
+        "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+    };
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return butil::string_printf("%s, %02d %s %d %02d:%02d:%02d GMT",
+                                days[tm.tm_wday], tm.tm_mday,
+                                months[tm.tm_mon], tm.tm_year + 1900,
+                                tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+// True if `etag' is listed in the value of If-None-Match or If-Range.
+// Weak comparison is used since the etags are only for caching.
+static bool MatchETag(const std::string& value, const std::string& etag) {
+    for (butil::StringSplitter sp(value.c_str(), ','); sp; ++sp) {
+        butil::StringPiece tag(sp.field(), sp.length());
+        tag.trim_spaces();
+        if (tag == "*") {
+            return true;
+        }
+        if (tag.starts_with("W/")) {
+            tag.remove_prefix(2);
+        }
+        if (tag == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool ParseRangeInteger(const char** p, int64_t* value) {
+    if (!isdigit(**p)) {
+        return false;
+    }
+    char* endptr = NULL;
+    // An overflowed position is LLONG_MAX which is beyond any file.
+    *value = strtoll(*p, &endptr, 10);
+    *p = endptr;
+    return true;
+}
+
+// Parse `value' of Range as a single byte range of a file with `size' bytes.
+// Returns 1 and sets [*first, *last] if the range is satisfiable, 0 if the
+// header should be ignored, -1 if the range is unsatisfiable.
+static int ParseByteRange(const std::string& value, int64_t size,
+                          int64_t* first, int64_t* last) {
+    const char* p = value.c_str();
+    if (strncasecmp(p, "bytes=", 6) != 0) {
+        return 0;
+    }
+    p += 6;
+    while (*p == ' ') {
+        ++p;
+    }
+    if (strchr(p, ',') != NULL) {
+        // Multiple ranges are not supported.
+        return 0;
+    }
+    if (*p == '-') {
+        // The last N bytes.
+        ++p;
+        int64_t n = 0;
+        if (!ParseRangeInteger(&p, &n)) {
+            return 0;
+        }
+        if (n == 0 || size == 0) {
+            return -1;
+        }
+        *first = (n < size ? size - n : 0);
+        *last = size - 1;
+    } else {
+        if (!ParseRangeInteger(&p, first) || *p != '-') {
+            return 0;
+        }
+        ++p;
+        *last = size - 1;
+        if (*p != '\0' && *p != ' ') {
+            int64_t l = 0;
+            if (!ParseRangeInteger(&p, &l)) {
+                return 0;
+            }
+            if (l < *first) {
+                return 0;
+            }
+            if (l < *last) {
+                *last = l;
+            }
+        }
+        if (*first >= size) {
+            return -1;
+        }
+    }
+    while (*p == ' ') {
+        ++p;
+    }
+    return (*p == '\0' ? 1 : 0);
+}
+
+int SetFileResponse(Controller* cntl, const char* path) {
+    HttpHeader& res = cntl->http_response();
+    butil::fd_guard fd(open(path, O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        const int saved_errno = errno;
+        if (saved_errno == ENOENT || saved_errno == ENOTDIR) {
+            res.set_status_code(HTTP_STATUS_NOT_FOUND);
+        } else if (saved_errno == EACCES) {
+            res.set_status_code(HTTP_STATUS_FORBIDDEN);
+        }
+        cntl->SetFailed(saved_errno, "Fail to open `%s', %s", path,
+                        berror(saved_errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        cntl->SetFailed(errno, "Fail to fstat `%s', %m", path);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        res.set_status_code(HTTP_STATUS_NOT_FOUND);
+        cntl->SetFailed(EINVAL, "`%s' is not a regular file", path);
+        return -1;
+    }
+    const int64_t size = st.st_size;
+    const std::string etag = butil::string_printf(
+        "\"%llx-%llx\"", (unsigned long long)st.st_mtime,
+        (unsigned long long)size);
+    const std::string last_modified = HttpDate(st.st_mtime);
+    res.SetHeader("ETag", etag);
+    res.SetHeader("Last-Modified", last_modified);
+    res.SetHeader("Accept-Ranges", "bytes");
+
+    int64_t first = 0;
+    int64_t last = size - 1;
+    const HttpHeader& req = cntl->http_request();
+    if (req.method() == HTTP_METHOD_GET || req.method() == HTTP_METHOD_HEAD) {
+        // If-None-Match takes precedence over If-Modified-Since, see
+        // https://datatracker.ietf.org/doc/html/rfc7232#section-6
+        const std::string* if_none_match = req.GetHeader("If-None-Match");
+        const std::string* if_modified_since =
+            req.GetHeader("If-Modified-Since");
+        if (if_none_match != NULL ? MatchETag(*if_none_match, etag) :
+            (if_modified_since != NULL && *if_modified_since == last_modified)) {
+            res.set_status_code(HTTP_STATUS_NOT_MODIFIED);
+            return 0;
+        }
+        const std::string* range = req.GetHeader("Range");
+        // If-Range requires strong comparison.
+        const std::string* if_range = req.GetHeader("If-Range");
+        if (range != NULL &&
+            (if_range == NULL || *if_range == etag ||
+             *if_range == last_modified)) {
+            const int rc = ParseByteRange(*range, size, &first, &last);
+            if (rc < 0) {
+                res.set_status_code(HTTP_STATUS_REQUEST_RANGE_NOT_SATISFIABLE);
+                res.SetHeader("Content-Range", butil::string_printf(
+                                  "bytes */%lld", (long long)size));
+                return 0;
+            } else if (rc > 0) {
+                res.set_status_code(HTTP_STATUS_PARTIAL_CONTENT);
+                res.SetHeader("Content-Range", butil::string_printf(
+                                  "bytes %lld-%lld/%lld", (long long)first,
+                                  (long long)last, (long long)size));
+            } else {
+                first = 0;
+                last = size - 1;
+            }
+        }
+    }
+    if (AppendFileRange(&cntl->response_attachment(), fd, first,
+                        last + 1 - first) != 0) {
+        cntl->SetFailed(errno, "Fail to read `%s', %m", path);
+        return -1;
+    }
+    return 0;
+}
+
+} // namespace brpc
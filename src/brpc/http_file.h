@@ -0,0 +1,54 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifndef BRPC_HTTP_FILE_H
+#define BRPC_HTTP_FILE_H
+
+#include <sys/types.h>            // off_t
+#include "butil/iobuf.h"
+
+namespace brpc {
+
+class Controller;
+
+// Append `length' bytes of file `fd' starting from `offset' to `out'.
+// The bytes are read with pread() into IOBuf blocks, so `out' does not
+// change when the file is modified or truncated afterwards, and `fd' can be
+// closed after this function returns.
+// Returns 0 on success, -1 otherwise and errno is set (ENODATA if the file
+// has fewer bytes than requested).
+int AppendFileRange(butil::IOBuf* out, int fd, off_t offset, size_t length);
+
+// Respond the http request in `cntl' with the regular file at `path'.
+// The body is read with AppendFileRange(). Following headers of the
+// request are handled:
+//   If-None-Match/If-Modified-Since: 304 is responded if the file does not
+//     change, according to ETag/Last-Modified generated from the size and
+//     the modification time of the file.
+//   Range: a single byte range is responded with 206 and Content-Range,
+//     unsatisfiable ranges are responded with 416. Multiple ranges are
+//     ignored and the whole file is responded.
+//   If-Range: Range is ignored if the file changed.
+// Content-Type of the response is not touched.
+// Returns 0 on success, -1 otherwise and `cntl' is SetFailed (with status
+// 404 or 403 if the file does not exist or is not accessible).
+int SetFileResponse(Controller* cntl, const char* path);
+
+} // namespace brpc
+
+#endif  // BRPC_HTTP_FILE_H
@@ -16,6 +16,8 @@
 // under the License.
 
 
+#include <new>                         // placement new
+#include "butil/macros.h"              // ARRAY_SIZE
 #include "brpc/http_status_code.h"     // HTTP_STATUS_*
 #include "brpc/http_header.h"
 
@@ -26,8 +28,117 @@ const char* HttpHeader::SET_COOKIE = "set-cookie";
 const char* HttpHeader::COOKIE = "cookie";
 const char* HttpHeader::CONTENT_TYPE = "content-type";
 
+struct CommonHeader {
+    const char* name;
+    size_t len;
+};
+
+#define BRPC_COMMON_HEADER(name) { name, sizeof(name) - 1 }
+// Headers which are commonly seen or used by brpc. Set-Cookie is not listed
+// since it may appear in multiple lines, Content-Type is stored separately.
+static const CommonHeader s_common_headers[] = {
+    BRPC_COMMON_HEADER("Accept"),
+    BRPC_COMMON_HEADER("Accept-Encoding"),
+    BRPC_COMMON_HEADER("Authorization"),
+    BRPC_COMMON_HEADER("Connection"),
+    BRPC_COMMON_HEADER("Content-Encoding"),
+    BRPC_COMMON_HEADER("Content-Length"),
+    BRPC_COMMON_HEADER("Cookie"),
+    BRPC_COMMON_HEADER("Expect"),
+    BRPC_COMMON_HEADER("Host"),
+    BRPC_COMMON_HEADER("Log-Id"),
+    BRPC_COMMON_HEADER("Transfer-Encoding"),
+    BRPC_COMMON_HEADER("User-Agent"),
+    BRPC_COMMON_HEADER("Te"),
+    BRPC_COMMON_HEADER("Grpc-Encoding"),
+    BRPC_COMMON_HEADER("Grpc-Accept-Encoding"),
+    BRPC_COMMON_HEADER("Grpc-Timeout"),
+    BRPC_COMMON_HEADER("Grpc-Status"),
+    BRPC_COMMON_HEADER("Grpc-Message"),
+};
+#undef BRPC_COMMON_HEADER
+
+int HttpHeader::FindCommonHeader(const char* key, size_t len) {
+    BAIDU_CASSERT(ARRAY_SIZE(s_common_headers) == (size_t)COMMON_HEADER_COUNT,
+                  common_headers_must_match_COMMON_HEADER_COUNT);
+    BAIDU_CASSERT(COMMON_HEADER_COUNT <= 32, common_header_mask_is_32_bits);
+    // Lengths tell most names apart, comparing them first is faster than
+    // hashing the key.
+    for (size_t i = 0; i < ARRAY_SIZE(s_common_headers); ++i) {
+        if (s_common_headers[i].len == len &&
+            strcasecmp(s_common_headers[i].name, key) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Returns 1 if `key' is the canonical name of the well-known header `id',
+// 2 if `key' is the name in lowercase, 0 otherwise.
+static int GetCommonHeaderSpelling(int id, const char* key, size_t len) {
+    if (memcmp(key, s_common_headers[id].name, len) == 0) {
+        return 1;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if (key[i] >= 'A' && key[i] <= 'Z') {
+            return 0;
+        }
+    }
+    return 2;
+}
+
+const std::string& HttpHeader::CommonHeaderName(int id, bool lowercase) {
+    struct Names {
+        Names() {
+            for (int i = 0; i < COMMON_HEADER_COUNT; ++i) {
+                canonical[i].assign(s_common_headers[i].name,
+                                    s_common_headers[i].len);
+                lower[i] = canonical[i];
+                for (size_t j = 0; j < lower[i].size(); ++j) {
+                    lower[i][j] = butil::ascii_tolower(lower[i][j]);
+                }
+            }
+        }
+        std::string canonical[COMMON_HEADER_COUNT];
+        std::string lower[COMMON_HEADER_COUNT];
+    };
+    static const Names* names = new Names;
+    return lowercase ? names->lower[id] : names->canonical[id];
+}
+
+void HttpHeader::HeaderIterator::SkipEmptySlots() {
+    while (_common_id < COMMON_HEADER_COUNT &&
+           !(_header->_common_header_mask & (1u << _common_id))) {
+        ++_common_id;
+    }
+}
+
+HttpHeader::HeaderIterator& HttpHeader::HeaderIterator::operator++() {
+    if (_common_id < COMMON_HEADER_COUNT) {
+        ++_common_id;
+        SkipEmptySlots();
+    } else {
+        ++_it;
+    }
+    return *this;
+}
+
+HttpHeader::HeaderIterator::pointer
+HttpHeader::HeaderIterator::operator->() const {
+    if (_common_id < COMMON_HEADER_COUNT) {
+        const bool lowercase =
+            (_header->_lowercase_header_mask & (1u << _common_id));
+        return new (&_value) value_type(
+            CommonHeaderName(_common_id, lowercase),
+            _header->_common_headers[_common_id]);
+    }
+    return new (&_value) value_type(_it->first, _it->second);
+}
+
 HttpHeader::HttpHeader() 
-    : _status_code(HTTP_STATUS_OK)
+    : _common_header_mask(0)
+    , _lowercase_header_mask(0)
+    , _status_code(HTTP_STATUS_OK)
     , _method(HTTP_METHOD_GET)
     , _version(1, 1)
     , _first_set_cookie(NULL) {
@@ -36,6 +147,11 @@ HttpHeader::HttpHeader()
 
 void HttpHeader::Swap(HttpHeader &rhs) {
     _headers.swap(rhs._headers);
+    std::swap(_common_header_mask, rhs._common_header_mask);
+    std::swap(_lowercase_header_mask, rhs._lowercase_header_mask);
+    for (int i = 0; i < COMMON_HEADER_COUNT; ++i) {
+        _common_headers[i].swap(rhs._common_headers[i]);
+    }
     _uri.Swap(rhs._uri);
     std::swap(_status_code, rhs._status_code);
     std::swap(_method, rhs._method);
@@ -46,6 +162,13 @@ void HttpHeader::Swap(HttpHeader &rhs) {
 
 void HttpHeader::Clear() {
     _headers.clear();
+    for (int i = 0; _common_header_mask != 0; ++i) {
+        if (_common_header_mask & (1u << i)) {
+            _common_headers[i].clear();
+            _common_header_mask &= ~(1u << i);
+        }
+    }
+    _lowercase_header_mask = 0;
     _uri.Clear();
     _status_code = HTTP_STATUS_OK;
     _method = HTTP_METHOD_GET;
@@ -55,15 +178,23 @@ void HttpHeader::Clear() {
 }
 
 const std::string* HttpHeader::GetHeader(const char* key) const {
-    return GetHeader(std::string(key));
+    return GetHeader(key, strlen(key));
 }
 
 const std::string* HttpHeader::GetHeader(const std::string& key) const {
-    if (IsSetCookie(key)) {
+    return GetHeader(key.c_str(), key.size());
+}
+
+const std::string* HttpHeader::GetHeader(const char* key, size_t len) const {
+    const int id = FindCommonHeader(key, len);
+    if (id >= 0 && (_common_header_mask & (1u << id))) {
+        return &_common_headers[id];
+    }
+    if (len == 10 && strcasecmp(key, SET_COOKIE) == 0) {
         return _first_set_cookie;
     }
-    std::string* val = _headers.seek(key);
-    return val;
+    // Seek with const char* to avoid creating a string for the key.
+    return _headers.seek(key);
 }
 
 std::vector<const std::string*> HttpHeader::GetAllSetCookieHeader() const {
@@ -90,6 +221,13 @@ void HttpHeader::RemoveHeader(const char* key) {
     if (IsContentType(key)) {
         _content_type.clear();
     } else {
+        const int id = FindCommonHeader(key, strlen(key));
+        if (id >= 0 && (_common_header_mask & (1u << id))) {
+            _common_headers[id].clear();
+            _common_header_mask &= ~(1u << id);
+            _lowercase_header_mask &= ~(1u << id);
+            return;
+        }
         _headers.erase(key);
         if (IsSetCookie(key)) {
             _first_set_cookie = NULL;
@@ -128,6 +266,30 @@ std::string& HttpHeader::GetOrAddHeader(const std::string& key) {
         return _content_type;
     }
 
+    const int id = FindCommonHeader(key.c_str(), key.size());
+    if (id >= 0) {
+        const uint32_t bit = (1u << id);
+        if (_common_header_mask & bit) {
+            return _common_headers[id];
+        }
+        // The header may be added with a name in other forms.
+        std::string* val = _headers.seek(key);
+        if (val != NULL) {
+            return *val;
+        }
+        const int spelling =
+            GetCommonHeaderSpelling(id, key.c_str(), key.size());
+        if (spelling != 0) {
+            _common_header_mask |= bit;
+            if (spelling == 2) {
+                _lowercase_header_mask |= bit;
+            }
+            _common_headers[id].clear();
+            return _common_headers[id];
+        }
+        return *_headers.insert({ key, "" });
+    }
+
     bool is_set_cookie = IsSetCookie(key);
     // Only returns the first Set-Cookie header field for compatibility.
     if (is_set_cookie && NULL != _first_set_cookie) {
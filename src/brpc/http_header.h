@@ -20,6 +20,7 @@
 #define  BRPC_HTTP_HEADER_H
 
 #include <vector>
+#include <iterator>                    // std::forward_iterator_tag
 #include "butil/strings/string_piece.h"  // StringPiece
 #include "butil/containers/case_ignored_flat_map.h"
 #include "brpc/uri.h"              // URI
@@ -41,9 +42,63 @@ class H2StreamContext;
 class HttpHeader {
 public:
     typedef butil::CaseIgnoredMultiFlatMap<std::string> HeaderMap;
-    typedef HeaderMap::const_iterator HeaderIterator;
     typedef HeaderMap::key_equal HeaderKeyEqual;
 
+    // Iterate well-known headers stored in slots and then other headers,
+    // without changing where the headers are stored.
+    class HeaderIterator {
+    public:
+        typedef std::pair<const std::string&, const std::string&> value_type;
+        typedef const value_type& reference;
+        typedef const value_type* pointer;
+        typedef std::forward_iterator_tag iterator_category;
+        typedef ptrdiff_t difference_type;
+
+        HeaderIterator() : _header(NULL), _common_id(COMMON_HEADER_COUNT) {}
+        HeaderIterator(const HeaderIterator& rhs)
+            : _header(rhs._header), _common_id(rhs._common_id), _it(rhs._it) {}
+        HeaderIterator& operator=(const HeaderIterator& rhs) {
+            _header = rhs._header;
+            _common_id = rhs._common_id;
+            _it = rhs._it;
+            return *this;
+        }
+
+        bool operator==(const HeaderIterator& rhs) const {
+            return _common_id == rhs._common_id &&
+                (_common_id < COMMON_HEADER_COUNT || _it == rhs._it);
+        }
+        bool operator!=(const HeaderIterator& rhs) const
+        { return !operator==(rhs); }
+
+        HeaderIterator& operator++();
+        HeaderIterator operator++(int) {
+            HeaderIterator tmp = *this;
+            operator++();
+            return tmp;
+        }
+
+        reference operator*() const { return *operator->(); }
+        pointer operator->() const;
+
+    private:
+    friend class HttpHeader;
+        HeaderIterator(const HttpHeader* header, int common_id,
+                       HeaderMap::const_iterator it)
+            : _header(header), _common_id(common_id), _it(it) {}
+        // Skip slots without headers.
+        void SkipEmptySlots();
+
+        const HttpHeader* _header;
+        // Index of the current slot, COMMON_HEADER_COUNT when iterating
+        // _headers.
+        int _common_id;
+        HeaderMap::const_iterator _it;
+        // The name and the value being pointed to, referencing the storage
+        // of HttpHeader. Constructed by operator->().
+        alignas(value_type) mutable char _value[sizeof(value_type)];
+    };
+
     HttpHeader();
 
     // Exchange internal fields with another HttpHeader.
@@ -117,10 +172,18 @@ public:
     void AppendHeader(const std::string& key, const butil::StringPiece& value);
     
     // Get header iterators which are invalidated after calling AppendHeader()
-    HeaderIterator HeaderBegin() const { return _headers.begin(); }
-    HeaderIterator HeaderEnd() const { return _headers.end(); }
+    // NOTE: Well-known headers(User-Agent, Content-Length ...) are iterated
+    // before other headers.
+    HeaderIterator HeaderBegin() const {
+        HeaderIterator it(this, 0, _headers.begin());
+        it.SkipEmptySlots();
+        return it;
+    }
+    HeaderIterator HeaderEnd() const
+    { return HeaderIterator(this, COMMON_HEADER_COUNT, _headers.end()); }
     // #headers
-    size_t HeaderCount() const { return _headers.size(); }
+    size_t HeaderCount() const
+    { return _headers.size() + __builtin_popcount(_common_header_mask); }
 
     // Get the URI object, check src/brpc/uri.h for details.
     const URI& uri() const { return _uri; }
@@ -165,6 +228,17 @@ friend void policy::ProcessHttpRequest(InputMessageBase *msg);
     static const char* COOKIE;
     static const char* CONTENT_TYPE;
 
+    // Number of well-known headers listed in http_header.cpp
+    static const int COMMON_HEADER_COUNT = 18;
+
+    // Index of the well-known header named `key', -1 if it's not.
+    static int FindCommonHeader(const char* key, size_t len);
+    // Name of the well-known header `id' in the canonical form or in
+    // lowercase.
+    static const std::string& CommonHeaderName(int id, bool lowercase);
+
+    const std::string* GetHeader(const char* key, size_t len) const;
+
     std::vector<const std::string*> GetMultiLineHeaders(const std::string& key) const;
 
     std::string& GetOrAddHeader(const std::string& key);
@@ -195,7 +269,18 @@ friend void policy::ProcessHttpRequest(InputMessageBase *msg);
     }
 
     HeaderKeyEqual _header_key_equal;
+    // Headers are parsed and looked up much more often than being iterated.
+    // Values of well-known headers are put in slots indexed by
+    // FindCommonHeader() rather than in _headers, which saves copying
+    // (and allocating) keys as well as hashing.
+    // A header is either in a slot(bit set in the mask) or in _headers.
     HeaderMap _headers;
+    // Only headers named in the canonical form(e.g. "User-Agent") or in
+    // lowercase(as in h2) are put in slots, so that HeaderIterator shows
+    // the names as they were set.
+    uint32_t _common_header_mask;
+    uint32_t _lowercase_header_mask;
+    std::string _common_headers[COMMON_HEADER_COUNT];
     URI _uri;
     int _status_code;
     HttpMethod _method;
@@ -20,6 +20,7 @@
 #include "brpc/reloadable_flags.h"
 #include "brpc/load_balancer.h"
 #include "brpc/socket.h"
+#include "brpc/details/latency_outlier_detector.h"
 
 
 namespace brpc {
@@ -68,7 +69,8 @@ SharedLoadBalancer::SharedLoadBalancer()
     : _lb(NULL)
     , _weight_sum(0)
     , _exposed(false)
-    , _st(DescribeLB, this) {
+    , _st(DescribeLB, this)
+    , _outlier_detector(new LatencyOutlierDetector) {
 }
 
 SharedLoadBalancer::~SharedLoadBalancer() {
@@ -77,6 +79,50 @@ SharedLoadBalancer::~SharedLoadBalancer() {
         _lb->Destroy();
         _lb = NULL;
     }
+    delete _outlier_detector;
+    _outlier_detector = NULL;
+}
+
+void SharedLoadBalancer::DetectLatencyOutliers() {
+    _outlier_detector->OnCallEnd();
+}
+
+bool SharedLoadBalancer::AddServer(const ServerId& server) {
+    if (_lb->AddServer(server)) {
+        _weight_sum.fetch_add(1, butil::memory_order_relaxed);
+        _outlier_detector->AddServers(std::vector<ServerId>(1, server));
+        return true;
+    }
+    return false;
+}
+
+bool SharedLoadBalancer::RemoveServer(const ServerId& server) {
+    if (_lb->RemoveServer(server)) {
+        _weight_sum.fetch_sub(1, butil::memory_order_relaxed);
+        _outlier_detector->RemoveServers(std::vector<ServerId>(1, server));
+        return true;
+    }
+    return false;
+}
+
+size_t SharedLoadBalancer::AddServersInBatch(
+    const std::vector<ServerId>& servers) {
+    size_t n = _lb->AddServersInBatch(servers);
+    if (n) {
+        _weight_sum.fetch_add(n, butil::memory_order_relaxed);
+    }
+    _outlier_detector->AddServers(servers);
+    return n;
+}
+
+size_t SharedLoadBalancer::RemoveServersInBatch(
+    const std::vector<ServerId>& servers) {
+    size_t n = _lb->RemoveServersInBatch(servers);
+    if (n) {
+        _weight_sum.fetch_sub(n, butil::memory_order_relaxed);
+    }
+    _outlier_detector->RemoveServers(servers);
+    return n;
 }
 
 int SharedLoadBalancer::Init(const char* lb_protocol) {
@@ -30,6 +30,7 @@
 namespace brpc {
 
 class Controller;
+class LatencyOutlierDetector;
 
 // Select a server from a set of servers (in form of ServerId).
 class LoadBalancer : public NonConstDescribable, public Destroyable {
@@ -131,37 +132,15 @@ public:
     }
 
     void Feedback(const LoadBalancer::CallInfo& info) { _lb->Feedback(info); }
-    
-    bool AddServer(const ServerId& server) {
-        if (_lb->AddServer(server)) {
-            _weight_sum.fetch_add(1, butil::memory_order_relaxed);
-            return true;
-        }
-        return false;
-    }
-    bool RemoveServer(const ServerId& server) {
-        if (_lb->RemoveServer(server)) {
-            _weight_sum.fetch_sub(1, butil::memory_order_relaxed);
-            return true;
-        }
-        return false;
-    }
-    
-    size_t AddServersInBatch(const std::vector<ServerId>& servers) {
-        size_t n = _lb->AddServersInBatch(servers);
-        if (n) {
-            _weight_sum.fetch_add(n, butil::memory_order_relaxed);
-        }
-        return n;
-    }
 
-    size_t RemoveServersInBatch(const std::vector<ServerId>& servers) {
-        size_t n = _lb->RemoveServersInBatch(servers);
-        if (n) {
-            _weight_sum.fetch_sub(n, butil::memory_order_relaxed);
-        }
-        return n;
-    }
+    // Called after RPCs of channels with enable_circuit_breaker to isolate
+    // servers that are much slower than other servers.
+    void DetectLatencyOutliers();
+    
+    bool AddServer(const ServerId& server);
+    bool RemoveServer(const ServerId& server);
+    size_t AddServersInBatch(const std::vector<ServerId>& servers);
+    size_t RemoveServersInBatch(const std::vector<ServerId>& servers);
 
     virtual void Describe(std::ostream& os, const DescribeOptions&);
 
@@ -181,6 +160,7 @@ private:
     volatile bool _exposed;
     butil::Mutex _st_mutex;
     bvar::PassiveStatus<std::string> _st;
+    LatencyOutlierDetector* _outlier_detector;
 };
 
 // For registering global instances.
@@ -43,6 +43,11 @@
 #include "brpc/details/usercode_backup_pool.h"
 #include "brpc/details/controller_private_accessor.h"
 #include "brpc/details/server_private_accessor.h"
+#include "brpc/details/adaptive_compressor.h"
+#include "brpc/details/zero_copy_bytes.h"
+#include "brpc/details/parallel_serializer.h"
+#include "brpc/details/response_cache.h"
+#include "brpc/details/request_coalescer.h"
 
 extern "C" {
 void bthread_assign_data(void* data);
@@ -212,8 +217,112 @@ bool SerializeRpcMessage(const google::protobuf::Message& message,
     return false;
 }
 
+static bool CopyToZeroCopyStream(
+    const butil::IOBuf& data, google::protobuf::io::ZeroCopyOutputStream* output) {
+    const size_t nblock = data.backing_block_num();
+    for (size_t i = 0; i < nblock; ++i) {
+        butil::StringPiece block = data.backing_block(i);
+        while (!block.empty()) {
+            void* buf = NULL;
+            int size = 0;
+            if (!output->Next(&buf, &size)) {
+                return false;
+            }
+            const size_t n = std::min(block.size(), (size_t)size);
+            memcpy(buf, block.data(), n);
+            output->BackUp(size - n);
+            block.remove_prefix(n);
+        }
+    }
+    return true;
+}
+
+// Serialize `message' into `buf', and compress it with the compression
+// selected by `compressor', which is stored into `compress_type'.
+static bool SerializeRpcMessageAdaptively(
+    const google::protobuf::Message& message, Controller& cntl,
+    ContentType content_type, ChecksumType checksum_type,
+    const AdaptiveCompressionOptions& options, AdaptiveCompressor* compressor,
+    CompressType* compress_type, butil::IOBuf* buf) {
+    *compress_type = COMPRESS_TYPE_NONE;
+    butil::IOBuf serialized;
+    if (!SerializeRpcMessage(message, cntl, content_type, COMPRESS_TYPE_NONE,
+                             CHECKSUM_TYPE_NONE, &serialized)) {
+        return false;
+    }
+    const CompressType type = compressor->Select(serialized.size(), options);
+    if (type == COMPRESS_TYPE_NONE) {
+        buf->append(butil::IOBuf::Movable(serialized));
+    } else {
+        const CompressHandler* handler = FindCompressHandler(type);
+        if (NULL == handler) {
+            return false;
+        }
+        const size_t old_size = buf->size();
+        const int64_t start_ns = butil::cpuwide_time_ns();
+        if (handler->CompressSerialized != NULL) {
+            if (!handler->CompressSerialized(serialized, buf)) {
+                return false;
+            }
+        } else {
+            // Compressions registered by users may not compress IOBuf,
+            // feed them with a copy.
+            Serializer serializer(
+                [&serialized](google::protobuf::io::ZeroCopyOutputStream* output) {
+                    return CopyToZeroCopyStream(serialized, output);
+                });
+            if (!handler->Compress(serializer, buf)) {
+                return false;
+            }
+        }
+        compressor->OnCompressed(serialized.size(), buf->size() - old_size,
+                                 butil::cpuwide_time_ns() - start_ns, options);
+        *compress_type = type;
+    }
+    ChecksumIn checksum_in{buf, &cntl};
+    ComputeDataChecksum(checksum_in, checksum_type);
+    return true;
+}
+
+// Serialize `message' into `buf' followed by `fields' referenced without
+// copying. Compression is not supported since it copies the fields anyway.
+static bool SerializeRpcMessageWithZeroCopyBytes(
+    const google::protobuf::Message& message, Controller& cntl,
+    ContentType content_type, CompressType compress_type,
+    ChecksumType checksum_type, const ZeroCopyBytesMap& fields,
+    butil::IOBuf* buf) {
+    if (content_type != CONTENT_TYPE_PB || compress_type != COMPRESS_TYPE_NONE) {
+        LOG(WARNING) << "Zero-copy bytes fields of " << message.GetDescriptor()->full_name()
+                     << " can't be sent with ContentType=" << ContentTypeToCStr(content_type)
+                     << " CompressType=" << CompressTypeToCStr(compress_type);
+        return false;
+    }
+    if (!SerializeRpcMessage(message, cntl, content_type, COMPRESS_TYPE_NONE,
+                             CHECKSUM_TYPE_NONE, buf) ||
+        !AppendZeroCopyBytes(message.GetDescriptor(), fields, buf)) {
+        return false;
+    }
+    ChecksumIn checksum_in{buf, &cntl};
+    ComputeDataChecksum(checksum_in, checksum_type);
+    return true;
+}
+
+// Serialize `message' in protobuf into `buf' with large repeated fields
+// serialized by parallel bthreads.
+static bool SerializeRpcMessageInParallel(
+    const google::protobuf::Message& message, Controller& cntl,
+    ChecksumType checksum_type, size_t min_size, butil::IOBuf* buf) {
+    if (!SerializeInParallel(message, min_size, buf)) {
+        return false;
+    }
+    ChecksumIn checksum_in{buf, &cntl};
+    ComputeDataChecksum(checksum_in, checksum_type);
+    return true;
+}
+
 static bool SerializeResponse(const google::protobuf::Message& res,
-                              Controller& cntl, butil::IOBuf& buf) {
+                              Controller& cntl, const Server* server,
+                              MethodStatus* method_status, butil::IOBuf& buf) {
     if (res.GetDescriptor() == SerializedResponse::descriptor()) {
         buf.swap(((SerializedResponse&)res).serialized_data());
         return true;
@@ -228,8 +337,29 @@ static bool SerializeResponse(const google::protobuf::Message& res,
     ContentType content_type = cntl.response_content_type();
     CompressType compress_type = cntl.response_compress_type();
     ChecksumType checksum_type = cntl.response_checksum_type();
-    if (!SerializeRpcMessage(res, cntl, content_type, compress_type,
-                             checksum_type, &buf)) {
+    bool ok;
+    if (cntl.has_response_zero_copy_bytes()) {
+        ok = SerializeRpcMessageWithZeroCopyBytes(
+            res, cntl, content_type, compress_type, checksum_type,
+            *cntl.response_zero_copy_bytes(), &buf);
+    } else if (compress_type == COMPRESS_TYPE_NONE && method_status != NULL &&
+               method_status->compressor() != NULL) {
+        ok = SerializeRpcMessageAdaptively(
+            res, cntl, content_type, checksum_type,
+            server->options().adaptive_compression,
+            method_status->compressor(), &compress_type, &buf);
+        cntl.set_response_compress_type(compress_type);
+    } else if (compress_type == COMPRESS_TYPE_NONE &&
+               content_type == CONTENT_TYPE_PB && server != NULL &&
+               server->options().parallel_serialization_min_size > 0) {
+        ok = SerializeRpcMessageInParallel(
+            res, cntl, checksum_type,
+            server->options().parallel_serialization_min_size, &buf);
+    } else {
+        ok = SerializeRpcMessage(res, cntl, content_type, compress_type,
+                                 checksum_type, &buf);
+    }
+    if (!ok) {
         cntl.SetFailed(ERESPONSE,
                        "Fail to serialize response=%s, "
                        "ContentType=%s, CompressType=%s, ChecksumType=%s",
@@ -266,10 +396,73 @@ struct BaiduProxyPBMessages : public RpcPBMessages {
 };
 }
 
-// Used by UT, can't be static.
+// Messages to send `response' serialized before with `cntl'.
+static RpcPBMessages* GetSerializedMessages(const CachedResponse& response,
+                                            Controller* cntl) {
+    RpcPBMessages* messages = BaiduProxyPBMessages::Get();
+    static_cast<SerializedResponse*>(messages->Response())->
+        serialized_data() = response.body;
+    cntl->set_response_content_type(response.content_type);
+    cntl->set_response_compress_type(response.compress_type);
+    cntl->set_response_checksum_type(response.checksum_type);
+    ControllerPrivateAccessor(cntl).set_checksum_value(response.checksum_value);
+    return messages;
+}
+
 void SendRpcResponse(int64_t correlation_id, Controller* cntl,
                      RpcPBMessages* messages, const Server* server,
-                     MethodStatus* method_status, int64_t received_us) {
+                     MethodStatus* method_status, int64_t received_us);
+
+// Send `response' of the request with `request_key' processed by `cntl'
+// to calls waiting for it. `response' is NULL when no response is sent.
+static void SendToCoalescedCalls(const RequestKey& request_key,
+                                 Controller* cntl,
+                                 const CachedResponse* response,
+                                 const Server* server,
+                                 MethodStatus* method_status) {
+    std::vector<RequestCoalescer::WaitingCall> calls;
+    method_status->coalescer()->Finish(request_key, &calls);
+    for (size_t i = 0; i < calls.size(); ++i) {
+        Controller* waiting_cntl = calls[i].cntl;
+        RpcPBMessages* messages = NULL;
+        if (response == NULL) {
+            if (cntl->Failed()) {
+                waiting_cntl->SetFailed(cntl->ErrorCode(), "%s",
+                                        cntl->ErrorText().c_str());
+            } else {
+                waiting_cntl->SetFailed(
+                    EINTERNAL, "Coalesced request was not responded");
+            }
+        } else {
+            messages = GetSerializedMessages(*response, waiting_cntl);
+            waiting_cntl->response_attachment() = cntl->response_attachment();
+            if (cntl->has_response_user_fields()) {
+                for (UserFieldsMap::const_iterator it =
+                         cntl->response_user_fields()->begin();
+                     it != cntl->response_user_fields()->end(); ++it) {
+                    (*waiting_cntl->response_user_fields())[it->first] =
+                        it->second;
+                }
+            }
+        }
+        SendRpcResponse(calls[i].correlation_id, waiting_cntl, messages,
+                        server, method_status, calls[i].received_us);
+    }
+}
+
+// Send the response, and if `request_key' is not NULL, cache the response
+// and send it to calls waiting for it as well.
+static void SendRpcResponseAndShare(int64_t correlation_id, Controller* cntl,
+                                    RpcPBMessages* messages,
+                                    const Server* server,
+                                    MethodStatus* method_status,
+                                    int64_t received_us,
+                                    RequestKey* request_key) {
+    std::unique_ptr<RequestKey> request_key_guard(request_key);
+    RequestCoalescer* coalescer = NULL;
+    if (request_key != NULL && method_status != NULL) {
+        coalescer = method_status->coalescer();
+    }
     ControllerPrivateAccessor accessor(cntl);
     Span* span = accessor.span();
     if (span) {
@@ -294,7 +487,9 @@ void SendRpcResponse(int64_t correlation_id, Controller* cntl,
         }
 
         cntl->CallAfterRpcResp(req, res);
-        if (NULL == server->options().baidu_master_service) {
+        // Cached responses are sent with BaiduProxyPBMessages as well.
+        if (NULL == server->options().baidu_master_service &&
+            res->GetDescriptor() != SerializedResponse::descriptor()) {
             server->options().rpc_pb_message_factory->Return(messages);
         } else {
             BaiduProxyPBMessages::Return(static_cast<BaiduProxyPBMessages*>(messages));
@@ -304,6 +499,10 @@ void SendRpcResponse(int64_t correlation_id, Controller* cntl,
     StreamIds response_stream_ids = accessor.response_streams();
 
     if (cntl->IsCloseConnection()) {
+        if (coalescer) {
+            SendToCoalescedCalls(*request_key, cntl, NULL, server,
+                                 method_status);
+        }
         for(size_t i = 0; i < response_stream_ids.size(); ++i) {
             StreamClose(response_stream_ids[i]);
         }
@@ -316,7 +515,29 @@ void SendRpcResponse(int64_t correlation_id, Controller* cntl,
     // If user calls `SetFailed' on Controller, we don't serialize
     // response either
     if (res != NULL && !cntl->Failed()) {
-        append_body = SerializeResponse(*res, *cntl, res_body);
+        append_body = SerializeResponse(*res, *cntl, server, method_status,
+                                        res_body);
+    }
+
+    if (request_key != NULL && method_status != NULL) {
+        CachedResponse cached;
+        if (append_body) {
+            cached.body = res_body;
+            cached.content_type = cntl->response_content_type();
+            cached.compress_type = cntl->response_compress_type();
+            cached.checksum_type = cntl->response_checksum_type();
+            cached.checksum_value = accessor.checksum_value();
+        }
+        if (append_body && method_status->response_cache() != NULL &&
+            cntl->response_attachment().empty() &&
+            !cntl->has_response_user_fields() && response_stream_ids.empty()) {
+            method_status->response_cache()->Put(*request_key, cached);
+        }
+        if (coalescer) {
+            SendToCoalescedCalls(*request_key, cntl,
+                                 append_body ? &cached : NULL,
+                                 server, method_status);
+        }
     }
 
     // Don't use res->ByteSize() since it may be compressed
@@ -456,6 +677,14 @@ void SendRpcResponse(int64_t correlation_id, Controller* cntl,
     }
 }
 
+// Used by UT, can't be static.
+void SendRpcResponse(int64_t correlation_id, Controller* cntl,
+                     RpcPBMessages* messages, const Server* server,
+                     MethodStatus* method_status, int64_t received_us) {
+    SendRpcResponseAndShare(correlation_id, cntl, messages, server,
+                            method_status, received_us, NULL);
+}
+
 namespace {
 struct CallMethodInBackupThreadArgs {
     ::google::protobuf::Service* service;
@@ -562,6 +791,47 @@ bool DeserializeRpcMessage(const butil::IOBuf& data, Controller& cntl,
     return false;
 }
 
+// Parse `data' into `message' like DeserializeRpcMessage, and put fields
+// marked with (brpc.zero_copy_bytes) into `fields' instead, which reference
+// `data' without copying when possible.
+static bool DeserializeRpcMessageWithZeroCopyBytes(
+    const butil::IOBuf& data, Controller& cntl, ContentType content_type,
+    CompressType compress_type, ChecksumType checksum_type,
+    google::protobuf::Message* message,
+    ZeroCopyBytesMap* (Controller::*fields)()) {
+    const std::vector<int>* numbers =
+        GetZeroCopyBytesFields(message->GetDescriptor());
+    if (numbers == NULL) {
+        return DeserializeRpcMessage(data, cntl, content_type, compress_type,
+                                     checksum_type, message);
+    }
+    if (content_type == CONTENT_TYPE_PB && compress_type == COMPRESS_TYPE_NONE) {
+        ChecksumIn checksum_in{&data, &cntl};
+        if (!VerifyDataChecksum(checksum_in, checksum_type)) {
+            return false;
+        }
+        butil::IOBuf rest;
+        ZeroCopyBytesMap cut_fields;
+        if (CutZeroCopyBytes(data, *numbers, &rest, &cut_fields)) {
+            if (!DeserializeRpcMessage(rest, cntl, content_type,
+                                       COMPRESS_TYPE_NONE, CHECKSUM_TYPE_NONE,
+                                       message)) {
+                return false;
+            }
+            (cntl.*fields)()->swap(cut_fields);
+            return true;
+        }
+        checksum_type = CHECKSUM_TYPE_NONE;  // verified
+    }
+    // Parse and move the fields.
+    if (!DeserializeRpcMessage(data, cntl, content_type, compress_type,
+                               checksum_type, message)) {
+        return false;
+    }
+    MoveZeroCopyBytes(*numbers, message, (cntl.*fields)());
+    return true;
+}
+
 void ProcessRpcRequest(InputMessageBase* msg_base) {
     const int64_t start_parse_us = butil::cpuwide_time_us();
     DestroyingPtr<MostCommonMessage> msg(static_cast<MostCommonMessage*>(msg_base));
@@ -657,6 +927,9 @@ void ProcessRpcRequest(InputMessageBase* msg_base) {
     }
 
     MethodStatus* method_status = NULL;
+    // Set when the response should be cached or shared with identical
+    // requests.
+    std::unique_ptr<RequestKey> request_key;
     do {
         if (!server->IsRunning()) {
             cntl->SetFailed(ELOGOFF, "Server is stopping");
@@ -803,11 +1076,41 @@ void ProcessRpcRequest(InputMessageBase* msg_base) {
                 static_cast<CompressType>(meta.compress_type());
             auto checksum_type =
                 static_cast<ChecksumType>(meta.checksum_type());
+            ResponseCache* response_cache = NULL;
+            RequestCoalescer* coalescer = NULL;
+            if (method_status) {
+                response_cache = method_status->response_cache();
+                coalescer = method_status->coalescer();
+            }
+            if ((response_cache != NULL || coalescer != NULL) &&
+                meta.attachment_size() == 0 &&
+                !cntl->has_remote_stream() && meta.user_fields().empty()) {
+                request_key.reset(new RequestKey(
+                    ResponseCache::MakeKey(req_buf, content_type,
+                                           compress_type)));
+                CachedResponse cached;
+                if (response_cache != NULL &&
+                    response_cache->Get(*request_key, &cached)) {
+                    // Send the cached response without calling the method.
+                    messages = GetSerializedMessages(cached, cntl.get());
+                    request_key.reset();
+                    break;
+                }
+                if (coalescer != NULL) {
+                    RequestCoalescer::WaitingCall call = {
+                        meta.correlation_id(), cntl.get(), msg->received_us() };
+                    if (coalescer->Join(*request_key, call)) {
+                        // Responded when the identical request is processed.
+                        cntl.release();
+                        return;
+                    }
+                }
+            }
             messages =
                 server->options().rpc_pb_message_factory->Get(*svc, *method);
-            if (!DeserializeRpcMessage(req_buf, *cntl, content_type,
-                                       compress_type, checksum_type,
-                                       messages->Request())) {
+            if (!DeserializeRpcMessageWithZeroCopyBytes(
+                    req_buf, *cntl, content_type, compress_type, checksum_type,
+                    messages->Request(), &Controller::request_zero_copy_bytes)) {
                 cntl->SetFailed(
                     EREQUEST,
                     "Fail to parse request=%s, ContentType=%s, "
@@ -824,9 +1127,10 @@ void ProcessRpcRequest(InputMessageBase* msg_base) {
         // `socket' will be held until response has been sent
         google::protobuf::Closure* done = ::brpc::NewCallback<
             int64_t, Controller*, RpcPBMessages*,
-            const Server*, MethodStatus*, int64_t>(
-                &SendRpcResponse, meta.correlation_id(),cntl.get(),
-                messages, server, method_status, msg->received_us());
+            const Server*, MethodStatus*, int64_t, RequestKey*>(
+                &SendRpcResponseAndShare, meta.correlation_id(), cntl.get(),
+                messages, server, method_status, msg->received_us(),
+                request_key.release());
 
         // optional, just release resource ASAP
         msg.reset();
@@ -855,10 +1159,10 @@ void ProcessRpcRequest(InputMessageBase* msg_base) {
     
     // `cntl', `req' and `res' will be deleted inside `SendRpcResponse'
     // `socket' will be held until response has been sent
-    SendRpcResponse(meta.correlation_id(),
-                    cntl.release(), messages,
-                    server, method_status,
-                    msg->received_us());
+    SendRpcResponseAndShare(meta.correlation_id(),
+                            cntl.release(), messages,
+                            server, method_status,
+                            msg->received_us(), request_key.release());
 }
 
 bool VerifyRpcRequest(const InputMessageBase* msg_base) {
@@ -989,9 +1293,10 @@ void ProcessRpcResponse(InputMessageBase* msg_base) {
             if (cntl->response()->GetDescriptor() == SerializedResponse::descriptor()) {
                 ((SerializedResponse*)cntl->response())->
                     serialized_data().append(*res_buf_ptr);
-            } else if (!DeserializeRpcMessage(*res_buf_ptr, *cntl, content_type,
-                                              compress_type, checksum_type,
-                                              cntl->response())) {
+            } else if (!DeserializeRpcMessageWithZeroCopyBytes(
+                           *res_buf_ptr, *cntl, content_type, compress_type,
+                           checksum_type, cntl->response(),
+                           &Controller::response_zero_copy_bytes)) {
                 cntl->SetFailed(
                     EREQUEST,
                     "Fail to parse response=%s, ContentType=%s, "
@@ -1027,8 +1332,24 @@ void SerializeRpcRequest(butil::IOBuf* request_buf, Controller* cntl,
     ContentType content_type = cntl->request_content_type();
     CompressType compress_type = cntl->request_compress_type();
     ChecksumType checksum_type = cntl->request_checksum_type();
-    if (!SerializeRpcMessage(*request, *cntl, content_type, compress_type,
-                             checksum_type, request_buf)) {
+    ControllerPrivateAccessor accessor(cntl);
+    const AdaptiveCompressionOptions* adaptive_compression =
+        accessor.adaptive_compression();
+    bool ok;
+    if (cntl->has_request_zero_copy_bytes()) {
+        ok = SerializeRpcMessageWithZeroCopyBytes(
+            *request, *cntl, content_type, compress_type, checksum_type,
+            *cntl->request_zero_copy_bytes(), request_buf);
+    } else if (adaptive_compression != NULL) {
+        ok = SerializeRpcMessageAdaptively(
+            *request, *cntl, content_type, checksum_type, *adaptive_compression,
+            accessor.adaptive_compressor(), &compress_type, request_buf);
+        cntl->set_request_compress_type(compress_type);
+    } else {
+        ok = SerializeRpcMessage(*request, *cntl, content_type, compress_type,
+                                 checksum_type, request_buf);
+    }
+    if (!ok) {
         return cntl->SetFailed(
             EREQUEST,
             "Fail to compress request=%s, "
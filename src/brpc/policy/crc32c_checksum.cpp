@@ -25,16 +25,21 @@
 namespace brpc {
 namespace policy {
 
-void Crc32cCompute(const ChecksumIn& in) {
-    auto buf = in.buf;
-    auto cntl = in.cntl;
-    butil::IOBufAsZeroCopyInputStream wrapper(*buf);
-    const void* data;
-    int size;
+// Extend crc block by block, large blocks are computed in interleaved
+// streams by butil::crc32c::Extend.
+static uint32_t Crc32cValue(const butil::IOBuf& buf) {
     uint32_t crc = 0;
-    while (wrapper.Next(&data, &size)) {
-        crc = butil::crc32c::Extend(crc, static_cast<const char*>(data), size);
+    const size_t nblock = buf.backing_block_num();
+    for (size_t i = 0; i < nblock; ++i) {
+        const butil::StringPiece data = buf.backing_block(i);
+        crc = butil::crc32c::Extend(crc, data.data(), data.size());
     }
+    return crc;
+}
+
+void Crc32cCompute(const ChecksumIn& in) {
+    auto cntl = in.cntl;
+    uint32_t crc = Crc32cValue(*in.buf);
     RPC_VLOG << "Crc32cCompute crc=" << crc;
     crc = butil::HostToNet32(butil::crc32c::Mask(crc));
     ControllerPrivateAccessor(cntl).set_checksum_value(
@@ -42,15 +47,8 @@ void Crc32cCompute(const ChecksumIn& in) {
 }
 
 bool Crc32cVerify(const ChecksumIn& in) {
-    auto buf = in.buf;
     auto cntl = in.cntl;
-    butil::IOBufAsZeroCopyInputStream wrapper(*buf);
-    const void* data;
-    int size;
-    uint32_t crc = 0;
-    while (wrapper.Next(&data, &size)) {
-        crc = butil::crc32c::Extend(crc, static_cast<const char*>(data), size);
-    }
+    uint32_t crc = Crc32cValue(*in.buf);
     auto& val = ControllerPrivateAccessor(const_cast<Controller*>(cntl))
                     .checksum_value();
     CHECK_EQ(val.size(), sizeof(crc));
@@ -16,10 +16,12 @@
 // under the License.
 
 
+#include <algorithm>                                // std::sort
 #include "brpc/policy/http2_rpc_protocol.h"
 #include "brpc/details/controller_private_accessor.h"
 #include "brpc/server.h"
 #include "butil/base64.h"
+#include "butil/string_splitter.h"
 #include "brpc/log.h"
 
 namespace brpc {
@@ -28,6 +30,7 @@ DECLARE_bool(http_verbose);
 DECLARE_int32(http_verbose_max_body_length);
 DECLARE_int32(health_check_interval);
 DECLARE_bool(usercode_in_pthread);
+DECLARE_int64(socket_max_unwritten_bytes);
 
 namespace policy {
 
@@ -42,9 +45,9 @@ DEFINE_int32(h2_client_max_frame_size,
              H2Settings::DEFAULT_MAX_FRAME_SIZE,
              "Size of the largest frame payload that client is willing to receive");
 
-DEFINE_bool(h2_hpack_encode_name, false,
+DEFINE_bool(h2_hpack_encode_name, true,
             "Encode name in HTTP2 headers with huffman encoding");
-DEFINE_bool(h2_hpack_encode_value, false,
+DEFINE_bool(h2_hpack_encode_value, true,
             "Encode value in HTTP2 headers with huffman encoding");
 
 static bool CheckStreamWindowSize(const char*, int32_t val) {
@@ -57,6 +60,22 @@ static bool CheckConnWindowSize(const char*, int32_t val) {
 }
 BRPC_VALIDATE_GFLAG(h2_client_connection_window_size, CheckConnWindowSize);
 
+DEFINE_bool(h2_window_auto_tuning, false,
+            "Grow stream-level and connection-level flow-control windows of "
+            "receivers (both client and server) by the bandwidth-delay "
+            "product estimated with PINGs");
+DEFINE_int32(h2_max_auto_tuned_window_size, 16 * 1024 * 1024,
+             "Flow-control windows are not auto-tuned beyond this value");
+
+static bool CheckMaxAutoTunedWindowSize(const char*, int32_t val) {
+    return val >= (int32_t)H2Settings::DEFAULT_INITIAL_WINDOW_SIZE;
+}
+BRPC_VALIDATE_GFLAG(h2_max_auto_tuned_window_size, CheckMaxAutoTunedWindowSize);
+
+// Opaque data of PINGs sent for BDP estimation, to be distinguished from
+// PINGs sent by users.
+static const char H2_BDP_PING_DATA[8] = { 'b', 'r', 'p', 'c', 'B', 'D', 'P', 0 };
+
 const char* H2StreamState2Str(H2StreamState s) {
     switch (s) {
     case H2_STREAM_IDLE: return "idle";
@@ -147,6 +166,9 @@ static int WriteAck(Socket* s, const void* data, size_t n) {
     return s->Write(&sendbuf, &wopt);
 }
 
+// Queued control frames are written immediately when they reach this size.
+static const size_t H2_MAX_QUEUED_CONTROL_FRAMES_SIZE = 16 * 1024;
+
 // [ https://tools.ietf.org/html/rfc7540#section-6.5.1 ]
 
 enum H2SettingsIdentifier {
@@ -286,6 +308,19 @@ inline bool AddWindowSize(butil::atomic<int64_t>* window_size, int64_t diff) {
     return true;
 }
 
+// Take at most `size' from a positive window, returns the size taken.
+inline int64_t TakeWindowSize(butil::atomic<int64_t>* window_size, int64_t size) {
+    int64_t left = window_size->load(butil::memory_order_relaxed);
+    while (left > 0) {
+        const int64_t taken = std::min(left, size);
+        if (window_size->compare_exchange_weak(
+                left, left - taken, butil::memory_order_relaxed)) {
+            return taken;
+        }
+    }
+    return 0;
+}
+
 inline bool MinusWindowSize(butil::atomic<int64_t>* window_size, int64_t size) {
     if (window_size->load(butil::memory_order_relaxed) < size) {
         // false negative is OK.
@@ -299,6 +334,8 @@ inline bool MinusWindowSize(butil::atomic<int64_t>* window_size, int64_t size) {
     return true;
 }
 
+const CommonStrings* get_common_strings();
+
 static H2Context::FrameHandler s_frame_handlers[H2_FRAME_TYPE_MAX + 1];
 static pthread_once_t s_frame_handlers_init_once = PTHREAD_ONCE_INIT;
 void InitFrameHandlers() {
@@ -312,6 +349,7 @@ void InitFrameHandlers() {
     s_frame_handlers[H2_FRAME_GOAWAY] = &H2Context::OnGoAway;
     s_frame_handlers[H2_FRAME_WINDOW_UPDATE] = &H2Context::OnWindowUpdate;
     s_frame_handlers[H2_FRAME_CONTINUATION] = &H2Context::OnContinuation;
+    s_frame_handlers[H2_FRAME_PRIORITY_UPDATE] = &H2Context::OnPriorityUpdate;
 }
 inline H2Context::FrameHandler FindFrameHandler(H2FrameType type) {
     pthread_once(&s_frame_handlers_init_once, InitFrameHandlers);
@@ -323,6 +361,7 @@ inline H2Context::FrameHandler FindFrameHandler(H2FrameType type) {
 
 H2Context::H2Context(Socket* socket, const Server* server)
     : _socket(socket)
+    , _server(server)
     // Maximize the window size to make sending big request possible before
     // receving the remote settings.
     , _remote_window_left(H2Settings::MAX_WINDOW_SIZE)
@@ -331,7 +370,14 @@ H2Context::H2Context(Socket* socket, const Server* server)
     , _last_sent_stream_id(1)
     , _goaway_stream_id(-1)
     , _remote_settings_received(false)
+    , _local_conn_window_size(H2Settings::DEFAULT_INITIAL_WINDOW_SIZE)
+    , _bdp_ping_sent_us(0)
+    , _bdp_sample_bytes(0)
+    , _bdp_max_bandwidth(0)
     , _deferred_window_update(0) {
+    for (int i = 0; i <= H2Priority::MAX_URGENCY; ++i) {
+        _blocked_writers[i].store(0, butil::memory_order_relaxed);
+    }
     // Stop printing the field which is useless for remote settings.
     _remote_settings.connection_window_size = 0;
     // Maximize the window size to make sending big request possible before
@@ -345,6 +391,11 @@ H2Context::H2Context(Socket* socket, const Server* server)
         _unack_local_settings.max_frame_size = FLAGS_h2_client_max_frame_size;
         _unack_local_settings.connection_window_size = FLAGS_h2_client_connection_window_size;
     }
+    if (_unack_local_settings.connection_window_size >
+        H2Settings::DEFAULT_INITIAL_WINDOW_SIZE) {
+        // Enlarged by WINDOW_UPDATE sent along with the SETTINGS.
+        _local_conn_window_size = _unack_local_settings.connection_window_size;
+    }
 #if defined(UNIT_TEST)
     // In ut, we hope _last_sent_stream_id run out quickly to test the correctness
     // of creating new h2 socket. This value is 10,000 less than 0x7FFFFFFF.
@@ -355,7 +406,7 @@ H2Context::H2Context(Socket* socket, const Server* server)
 H2Context::~H2Context() {
     for (StreamMap::iterator it = _pending_streams.begin();
          it != _pending_streams.end(); ++it) {
-        delete it->second;
+        it->second->Release(ECONNRESET, "The h2 connection was closed");
     }
     _pending_streams.clear();
 }
@@ -413,6 +464,106 @@ void H2Context::RemoveGoAwayStreams(
     }
 }
 
+butil::intrusive_ptr<H2StreamWriter> H2Context::FindStreamWriter(int stream_id) {
+    BAIDU_SCOPED_LOCK(_stream_writers_mutex);
+    std::map<int, butil::intrusive_ptr<H2StreamWriter> >::const_iterator it =
+        _stream_writers.find(stream_id);
+    if (it != _stream_writers.end()) {
+        return it->second;
+    }
+    return NULL;
+}
+
+void H2Context::RemoveStreamWriter(int stream_id) {
+    butil::intrusive_ptr<H2StreamWriter> writer;  // released outside lock
+    BAIDU_SCOPED_LOCK(_stream_writers_mutex);
+    std::map<int, butil::intrusive_ptr<H2StreamWriter> >::iterator it =
+        _stream_writers.find(stream_id);
+    if (it != _stream_writers.end()) {
+        writer.swap(it->second);
+        _stream_writers.erase(it);
+    }
+}
+
+bool H2Context::HasBlockedStreamWriters(int urgency) const {
+    for (int i = 0; i < urgency; ++i) {
+        if (_blocked_writers[i].load(butil::memory_order_relaxed) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct H2WriterOrder {
+    bool operator()(const std::pair<H2Priority, H2StreamWriter*>& a,
+                    const std::pair<H2Priority, H2StreamWriter*>& b) const {
+        if (a.first.urgency != b.first.urgency) {
+            return a.first.urgency < b.first.urgency;
+        }
+        if (a.first.incremental != b.first.incremental) {
+            return !a.first.incremental;
+        }
+        return a.second->stream_id() < b.second->stream_id();
+    }
+};
+
+bool H2Context::FlushStreamWriters(bool window_size_changed) {
+    std::vector<butil::intrusive_ptr<H2StreamWriter> > writers;
+    {
+        BAIDU_SCOPED_LOCK(_stream_writers_mutex);
+        if (_stream_writers.empty()) {
+            return true;
+        }
+        writers.reserve(_stream_writers.size());
+        for (std::map<int, butil::intrusive_ptr<H2StreamWriter> >::const_iterator
+                 it = _stream_writers.begin(); it != _stream_writers.end(); ++it) {
+            writers.push_back(it->second);
+        }
+    }
+    // Lock writers outside _stream_writers_mutex which is locked by
+    // H2StreamWriter::Create() when writers are writing. Writers created
+    // after the copy already got the changed window.
+    if (window_size_changed) {
+        for (size_t i = 0; i < writers.size(); ++i) {
+            if (!writers[i]->SetInitialWindowSize(
+                    _remote_settings.stream_window_size)) {
+                return false;
+            }
+        }
+    }
+    // Flush outside the lock since a writer may remove itself.
+    std::vector<std::pair<H2Priority, H2StreamWriter*> > order;
+    order.reserve(writers.size());
+    for (size_t i = 0; i < writers.size(); ++i) {
+        order.push_back(std::make_pair(writers[i]->priority(), writers[i].get()));
+    }
+    std::sort(order.begin(), order.end(), H2WriterOrder());
+    for (size_t i = 0; i < order.size();) {
+        // Non-incremental writers are flushed one after another.
+        if (!order[i].first.incremental) {
+            order[i++].second->Flush();
+            continue;
+        }
+        // Incremental writers of the same urgency send one frame in turn.
+        size_t end = i + 1;
+        while (end < order.size() &&
+               order[end].first.urgency == order[i].first.urgency) {
+            ++end;
+        }
+        bool more = true;
+        while (more) {
+            more = false;
+            for (size_t j = i; j < end; ++j) {
+                if (order[j].second->Flush(H2Settings::DEFAULT_MAX_FRAME_SIZE)) {
+                    more = true;
+                }
+            }
+        }
+        i = end;
+    }
+    return true;
+}
+
 H2StreamContext* H2Context::FindStream(int stream_id) {
     std::unique_lock<butil::Mutex> mu(_stream_mutex);
     H2StreamContext** psctx = _pending_streams.seek(stream_id);
@@ -498,8 +649,11 @@ ParseResult H2Context::Consume(
         }
         H2Context::FrameHandler handler = FindFrameHandler(frame_head.type);
         if (handler == NULL) {
-            LOG(ERROR) << "Invalid frame type=" << (int)frame_head.type;
-            return MakeParseError(PARSE_ERROR_ABSOLUTELY_WRONG);
+            // Implementations MUST ignore and discard frames of unknown types.
+            // https://www.rfc-editor.org/rfc/rfc9113#section-4.1
+            RPC_VLOG << "Ignore frame type=" << (int)frame_head.type;
+            it.forward(frame_head.payload_size);
+            return MakeMessage(NULL);
         }
         H2ParseResult h2_res = (this->*handler)(it, frame_head);
         if (h2_res.is_ok()) {
@@ -516,8 +670,8 @@ ParseResult H2Context::Consume(
             }
             H2StreamContext* sctx = RemoveStreamAndDeferWU(h2_res.stream_id());
             if (sctx) {
-                if (is_server_side()) {
-                    delete sctx;
+                if (is_server_side() || sctx->is_stage2()) {
+                    sctx->Release(EINTERNAL, H2ErrorToString(h2_res.error()));
                     return MakeMessage(NULL);
                 } else {
                     sctx->header().set_status_code(
@@ -642,7 +796,7 @@ H2ParseResult H2StreamContext::OnHeaders(
         if (frame_head.flags & H2_FLAGS_END_STREAM) {
             return OnEndStream();
         }
-        return MakeH2Message(NULL);
+        return OnHeadersComplete();
     } else {
         if (frame_head.flags & H2_FLAGS_END_STREAM) {
             // Delay calling OnEndStream() in OnContinuation()
@@ -692,6 +846,7 @@ H2ParseResult H2StreamContext::OnContinuation(
         if (_stream_ended) {
             return OnEndStream();
         }
+        return OnHeadersComplete();
     }
     return MakeH2Message(NULL);
 }
@@ -709,6 +864,9 @@ H2ParseResult H2Context::OnData(
         return MakeH2Error(H2_FRAME_SIZE_ERROR);
     }
     frag_size -= pad_length;
+    if (FLAGS_h2_window_auto_tuning) {
+        SampleBdp(frame_head.payload_size);
+    }
     H2StreamContext* sctx = FindStream(frame_head.stream_id);
     if (sctx == NULL) {
         // If a DATA frame is received whose stream is not in "open" or "half-closed (local)" state,
@@ -732,6 +890,29 @@ H2ParseResult H2StreamContext::OnData(
     butil::IOBuf data;
     it.append_and_forward(&data, frag_size);
     it.forward(pad_length);
+    if (is_stage2()) {
+        // The body is fed to the reader in _body_queue. The stream-level
+        // window is updated in OnBodyConsumed(), the connection-level window
+        // is updated now so that other streams are not blocked.
+        const int64_t unacked = frag_size +
+            _unacked_body_size.fetch_add(frag_size, butil::memory_order_relaxed);
+        if (unacked > _conn_ctx->local_settings().stream_window_size) {
+            LOG(ERROR) << "Fail to satisfy the stream-level flow control policy";
+            return MakeH2Error(H2_FLOW_CONTROL_ERROR, frame_head.stream_id);
+        }
+        _conn_ctx->DeferWindowUpdate(frag_size);
+        if (!data.empty()) {
+            butil::IOBuf* part = new butil::IOBuf;
+            part->swap(data);
+            if (bthread::execution_queue_execute(_body_queue, part) != 0) {
+                delete part;
+            }
+        }
+        if (frame_head.flags & H2_FLAGS_END_STREAM) {
+            return OnEndStream();
+        }
+        return MakeH2Message(NULL);
+    }
     for (size_t i = 0; i < data.backing_block_num(); ++i) {
         const butil::StringPiece blk = data.backing_block(i);
         if (OnBody(blk.data(), blk.size()) != 0) {
@@ -766,7 +947,7 @@ H2ParseResult H2StreamContext::OnData(
             const int64_t conn_wu = stream_wu + _conn_ctx->ReleaseDeferredWindowUpdate();
             SerializeFrameHead(p, 4, H2_FRAME_WINDOW_UPDATE, 0, 0);
             SaveUint32(p + FRAME_HEAD_SIZE, conn_wu);
-            if (WriteAck(_conn_ctx->_socket, winbuf, sizeof(winbuf)) != 0) {
+            if (_conn_ctx->QueueControlFrame(winbuf, sizeof(winbuf)) != 0) {
                 LOG(WARNING) << "Fail to send WINDOW_UPDATE to " << *_conn_ctx->_socket;
                 return MakeH2Error(H2_INTERNAL_ERROR);
             }
@@ -785,6 +966,12 @@ H2ParseResult H2Context::OnResetStream(
         return MakeH2Error(H2_FRAME_SIZE_ERROR);
     }
     const H2Error h2_error = static_cast<H2Error>(LoadUint32(it));
+    butil::intrusive_ptr<H2StreamWriter> writer =
+        FindStreamWriter(frame_head.stream_id);
+    if (writer != NULL) {
+        writer->OnReset();
+        RemoveStreamWriter(frame_head.stream_id);
+    }
     H2StreamContext* sctx = FindStream(frame_head.stream_id);
     if (sctx == NULL) {
         RPC_VLOG << "Fail to find stream_id=" << frame_head.stream_id;
@@ -812,16 +999,39 @@ H2ParseResult H2StreamContext::OnResetStream(
         LOG(ERROR) << "Fail to find stream_id=" << stream_id();
         return MakeH2Error(H2_PROTOCOL_ERROR);
     }
-    if (_conn_ctx->is_client_side()) {
+    if (_conn_ctx->is_client_side() && !is_stage2()) {
         sctx->header().set_status_code(H2ErrorToStatusCode(h2_error));
         return MakeH2Message(sctx);
     } else {
-        // No need to process the request.
-        delete sctx;
+        // No need to process the request, or the message was already
+        // processed after headers.
+        sctx->Release(ECANCELED, H2ErrorToString(h2_error));
         return MakeH2Message(NULL);
     }
 }
 
+// Get the status carried by grpc-status/grpc-message in trailers.
+static butil::Status GetGrpcStatus(const HttpHeader& trailers) {
+    const CommonStrings* common = get_common_strings();
+    const std::string* grpc_status = trailers.GetHeader(common->GRPC_STATUS);
+    if (grpc_status == NULL) {
+        return butil::Status();
+    }
+    const GrpcStatus status = (GrpcStatus)strtol(grpc_status->c_str(), NULL, 10);
+    if (status == GRPC_OK) {
+        return butil::Status();
+    }
+    const std::string* grpc_message = trailers.GetHeader(common->GRPC_MESSAGE);
+    if (grpc_message == NULL) {
+        return butil::Status(GrpcStatusToErrorCode(status), "%s",
+                             GrpcStatusToString(status));
+    }
+    std::string message_decoded;
+    PercentDecode(*grpc_message, &message_decoded);
+    return butil::Status(GrpcStatusToErrorCode(status), "%s",
+                         message_decoded.c_str());
+}
+
 H2ParseResult H2StreamContext::OnEndStream() {
 #if defined(BRPC_H2_STREAM_STATE)
     if (state() == H2_STREAM_OPEN) {
@@ -841,10 +1051,145 @@ H2ParseResult H2StreamContext::OnEndStream() {
     }
     CHECK_EQ(sctx, this);
 
+    if (is_stage2()) {
+        // Headers were already returned, end the body being read.
+        EndBody(_trailers ? GetGrpcStatus(*_trailers) : butil::Status());
+        RemoveOneRefForStage2();
+        return MakeH2Message(NULL);
+    }
     OnMessageComplete();
     return MakeH2Message(sctx);
 }
 
+H2ParseResult H2StreamContext::OnHeadersComplete() {
+    if (is_stage2()) {
+        return MakeH2Message(NULL);
+    }
+    if (_conn_ctx->is_server_side() &&
+        ShouldReadProgressively(_conn_ctx->_server)) {
+        set_read_body_progressively(true);
+    }
+    if (!read_body_progressively()) {
+        return MakeH2Message(NULL);
+    }
+    if (StartBodyQueue() != 0) {
+        // Read the body as a whole.
+        set_read_body_progressively(false);
+        return MakeH2Message(NULL);
+    }
+    // Go on to ProcessHttpXXX w/o waiting for the body which is fed to the
+    // reader by following DATA frames. The stream stays in the connection.
+    AddOneRefForStage2();  // released in OnEndStream() or Release()
+    return MakeH2Message(this);
+}
+
+void H2StreamContext::Release(int error_code, const char* error_text) {
+    if (!is_stage2()) {
+        delete this;
+        return;
+    }
+    EndBody(butil::Status(error_code, "%s", error_text));
+    RemoveOneRefForStage2();
+}
+
+int H2StreamContext::StartBodyQueue() {
+    bthread::ExecutionQueueOptions q_opt;
+    q_opt.bthread_attr =
+        FLAGS_usercode_in_pthread ? BTHREAD_ATTR_PTHREAD : BTHREAD_ATTR_NORMAL;
+    if (bthread::execution_queue_start(&_body_queue, &q_opt,
+                                       ConsumeBody, this) != 0) {
+        LOG(ERROR) << "Fail to create ExecutionQueue";
+        return -1;
+    }
+    // Released in ConsumeBody() when the queue is stopped.
+    butil::intrusive_ptr<HttpContext>(this).detach();
+    return 0;
+}
+
+void H2StreamContext::EndBody(const butil::Status& st) {
+    _body_end_status = st;
+    _body_ended.store(true, butil::memory_order_relaxed);
+    bthread::execution_queue_stop(_body_queue);
+}
+
+int H2StreamContext::ConsumeBody(void* meta,
+                                 bthread::TaskIterator<butil::IOBuf*>& iter) {
+    H2StreamContext* sctx = static_cast<H2StreamContext*>(meta);
+    if (iter.is_queue_stopped()) {
+        // All data was fed, end the body.
+        if (sctx->_body_end_status.ok()) {
+            sctx->OnMessageComplete();
+        } else {
+            sctx->OnMessageFailed(sctx->_body_end_status);
+        }
+        butil::intrusive_ptr<HttpContext>(sctx, false);
+        return 0;
+    }
+    for (; iter; ++iter) {
+        std::unique_ptr<butil::IOBuf> data(*iter);
+        if (sctx->_body_refused) {
+            continue;
+        }
+        for (size_t i = 0; i < data->backing_block_num(); ++i) {
+            const butil::StringPiece blk = data->backing_block(i);
+            if (sctx->OnBody(blk.data(), blk.size()) != 0) {
+                // The reader refused the body, just reset the stream.
+                sctx->_body_refused = true;
+                char rstbuf[FRAME_HEAD_SIZE + 4];
+                SerializeFrameHead(rstbuf, 4, H2_FRAME_RST_STREAM,
+                                   0, sctx->stream_id());
+                SaveUint32(rstbuf + FRAME_HEAD_SIZE, H2_CANCEL);
+                sctx->WriteFrame(rstbuf, sizeof(rstbuf), true);
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+void H2StreamContext::OnBodyConsumed(size_t size) {
+    const int64_t acc = size +
+        _consumed_body_size.fetch_add(size, butil::memory_order_relaxed);
+    if (acc < _local_window_size / 2) {
+        return;
+    }
+    const int64_t stream_wu =
+        _consumed_body_size.exchange(0, butil::memory_order_relaxed);
+    if (stream_wu <= 0) {
+        return;
+    }
+    // Before WINDOW_UPDATE is sent, the remote side may send more.
+    _unacked_body_size.fetch_sub(stream_wu, butil::memory_order_relaxed);
+    if (_body_ended.load(butil::memory_order_relaxed)) {
+        // The remote side will not send any more data.
+        return;
+    }
+    char winbuf[FRAME_HEAD_SIZE + 4];
+    SerializeFrameHead(winbuf, 4, H2_FRAME_WINDOW_UPDATE, 0, stream_id());
+    SaveUint32(winbuf + FRAME_HEAD_SIZE, stream_wu);
+    WriteFrame(winbuf, sizeof(winbuf), false);
+}
+
+void H2StreamContext::WriteFrame(const char* frame, size_t size, bool abandon) {
+    SocketUniquePtr sock;
+    if (Socket::Address(_socket_id, &sock) != 0) {
+        return;
+    }
+    H2Context* ctx = static_cast<H2Context*>(sock->parsing_context());
+    if (ctx == NULL) {
+        return;
+    }
+    if (abandon) {
+        // Removed from the connection in the parsing thread.
+        ctx->AddAbandonedStream(stream_id());
+    }
+    if (ctx->QueueControlFrame(frame, size) != 0 ||
+        ctx->FlushControlFrames() != 0) {
+        LOG(WARNING) << "Fail to send frames of stream_id=" << stream_id()
+                     << " to " << *sock;
+    }
+}
+
 H2ParseResult H2Context::OnSettings(
     butil::IOBufBytesIterator& it, const H2FrameHead& frame_head) {
     // SETTINGS frames always apply to a connection, never a single stream.
@@ -904,11 +1249,15 @@ H2ParseResult H2Context::OnSettings(
                 return MakeH2Error(H2_FLOW_CONTROL_ERROR);
             }
         }
+        mu.unlock();
+        if (!FlushStreamWriters(true)) {
+            return MakeH2Error(H2_FLOW_CONTROL_ERROR);
+        }
     }
     // Respond with ack
     char headbuf[FRAME_HEAD_SIZE];
     SerializeFrameHead(headbuf, 0, H2_FRAME_SETTINGS, H2_FLAGS_ACK, 0);
-    if (WriteAck(_socket, headbuf, sizeof(headbuf)) != 0) {
+    if (QueueControlFrame(headbuf, sizeof(headbuf)) != 0) {
         LOG(WARNING) << "Fail to respond settings with ack to " << *_socket;
         return MakeH2Error(H2_PROTOCOL_ERROR);
     }
@@ -916,9 +1265,42 @@ H2ParseResult H2Context::OnSettings(
 }
 
 H2ParseResult H2Context::OnPriority(
-    butil::IOBufBytesIterator&, const H2FrameHead&) {
-    LOG(ERROR) << "Not support PRIORITY frame yet";
-    return MakeH2Error(H2_PROTOCOL_ERROR);
+    butil::IOBufBytesIterator& it, const H2FrameHead& frame_head) {
+    if (frame_head.stream_id == 0) {
+        LOG(ERROR) << "Invalid stream_id=" << frame_head.stream_id;
+        return MakeH2Error(H2_PROTOCOL_ERROR);
+    }
+    if (frame_head.payload_size != 5) {
+        LOG(ERROR) << "Invalid payload_size=" << frame_head.payload_size;
+        return MakeH2Error(H2_FRAME_SIZE_ERROR, frame_head.stream_id);
+    }
+    // The prioritization signaled by PRIORITY frames is deprecated and
+    // ignored, see https://www.rfc-editor.org/rfc/rfc9113#section-5.3.2
+    it.forward(frame_head.payload_size);
+    return MakeH2Message(NULL);
+}
+
+H2ParseResult H2Context::OnPriorityUpdate(
+    butil::IOBufBytesIterator& it, const H2FrameHead& frame_head) {
+    if (frame_head.stream_id != 0 || frame_head.payload_size < 4) {
+        LOG(ERROR) << "Invalid PRIORITY_UPDATE with stream_id="
+                   << frame_head.stream_id
+                   << " payload_size=" << frame_head.payload_size;
+        return MakeH2Error(H2_PROTOCOL_ERROR);
+    }
+    const int stream_id = LoadUint32(it) & 0x7FFFFFFF;
+    std::string value;
+    value.resize(frame_head.payload_size - 4);
+    it.copy_and_forward(&value[0], value.size());
+    // Requests not responded yet are not reprioritized, only writers
+    // sending bodies are.
+    butil::intrusive_ptr<H2StreamWriter> writer = FindStreamWriter(stream_id);
+    if (writer != NULL) {
+        writer->SetPriority(ParseH2Priority(value));
+        // Less urgent writers may be unblocked.
+        FlushStreamWriters(false);
+    }
+    return MakeH2Message(NULL);
 }
 
 H2ParseResult H2Context::OnPushPromise(
@@ -938,19 +1320,95 @@ H2ParseResult H2Context::OnPing(
         return MakeH2Error(H2_PROTOCOL_ERROR);
     }
     if (frame_head.flags & H2_FLAGS_ACK) {
+        char data[8];
+        it.copy_and_forward(data, sizeof(data));
+        if (_bdp_ping_sent_us != 0 &&
+            memcmp(data, H2_BDP_PING_DATA, sizeof(data)) == 0) {
+            OnBdpPingAck();
+        }
         return MakeH2Message(NULL);
     }
     
     char pongbuf[FRAME_HEAD_SIZE + 8];
     SerializeFrameHead(pongbuf, 8, H2_FRAME_PING, H2_FLAGS_ACK, 0);
     it.copy_and_forward(pongbuf + FRAME_HEAD_SIZE, 8);
-    if (WriteAck(_socket, pongbuf, sizeof(pongbuf)) != 0) {
+    if (QueueControlFrame(pongbuf, sizeof(pongbuf)) != 0) {
         LOG(WARNING) << "Fail to send ack of PING to " << *_socket;
         return MakeH2Error(H2_PROTOCOL_ERROR);
     }
     return MakeH2Message(NULL);
 }
 
+// Estimate the bandwidth-delay product(BDP) as gRPC does: Send a PING on
+// receiving DATA and count DATA received until the PING is acked, which is
+// roughly the data transferred within one RTT. If the count is close to the
+// window of receiver and the bandwidth is not lower than before, the window
+// is likely to limit the throughput and is enlarged to twice of the count.
+void H2Context::SampleBdp(uint32_t size) {
+    if (_bdp_ping_sent_us != 0) {
+        _bdp_sample_bytes += size;
+        return;
+    }
+    if (_unack_local_settings.stream_window_size >=
+        (uint32_t)FLAGS_h2_max_auto_tuned_window_size) {
+        return;
+    }
+    char pingbuf[FRAME_HEAD_SIZE + 8];
+    SerializeFrameHead(pingbuf, 8, H2_FRAME_PING, 0, 0);
+    memcpy(pingbuf + FRAME_HEAD_SIZE, H2_BDP_PING_DATA, 8);
+    if (QueueControlFrame(pingbuf, sizeof(pingbuf)) != 0) {
+        LOG(WARNING) << "Fail to send PING to " << *_socket;
+        return;
+    }
+    _bdp_ping_sent_us = butil::cpuwide_time_us();
+    _bdp_sample_bytes = size;
+}
+
+void H2Context::OnBdpPingAck() {
+    const int64_t rtt_us =
+        std::max(butil::cpuwide_time_us() - _bdp_ping_sent_us, (int64_t)1);
+    const int64_t sample = _bdp_sample_bytes;
+    _bdp_ping_sent_us = 0;
+    _bdp_sample_bytes = 0;
+    const double bandwidth = (double)sample / rtt_us;
+    if (bandwidth < _bdp_max_bandwidth) {
+        return;
+    }
+    _bdp_max_bandwidth = bandwidth;
+    const int64_t window = _unack_local_settings.stream_window_size;
+    if (sample * 3 < window * 2) {
+        return;
+    }
+    const int64_t new_window =
+        std::min(sample * 2, (int64_t)FLAGS_h2_max_auto_tuned_window_size);
+    if (new_window <= window) {
+        return;
+    }
+    char buf[FRAME_HEAD_SIZE + 6 + FRAME_HEAD_SIZE + 4];
+    char* p = buf;
+    SerializeFrameHead(p, 6, H2_FRAME_SETTINGS, 0, 0);
+    SaveUint16(p + FRAME_HEAD_SIZE, H2_SETTINGS_STREAM_WINDOW_SIZE);
+    SaveUint32(p + FRAME_HEAD_SIZE + 2, new_window);
+    p += FRAME_HEAD_SIZE + 6;
+    // The connection-level window can only be changed by WINDOW_UPDATE.
+    if (new_window > _local_conn_window_size) {
+        SerializeFrameHead(p, 4, H2_FRAME_WINDOW_UPDATE, 0, 0);
+        SaveUint32(p + FRAME_HEAD_SIZE, new_window - _local_conn_window_size);
+        p += FRAME_HEAD_SIZE + 4;
+    }
+    if (QueueControlFrame(buf, p - buf) != 0) {
+        LOG(WARNING) << "Fail to send SETTINGS to " << *_socket;
+        return;
+    }
+    RPC_VLOG << "Auto-tune window of " << *_socket << " from " << window
+             << " to " << new_window << ", rtt=" << rtt_us << "us";
+    _local_conn_window_size = std::max(_local_conn_window_size, new_window);
+    _unack_local_settings.stream_window_size = new_window;
+    // Enlarging the window is safe before the SETTINGS is acked, and the
+    // remote side may send DATA with the new window before that.
+    _local_settings.stream_window_size = new_window;
+}
+
 static void* ProcessHttpResponseWrapper(void* void_arg) {
     ProcessHttpResponse(static_cast<InputMessageBase*>(void_arg));
     return NULL;
@@ -982,12 +1440,19 @@ H2ParseResult H2Context::OnGoAway(
 
         std::vector<H2StreamContext*> goaway_streams;
         RemoveGoAwayStreams(last_stream_id, &goaway_streams);
-        if (goaway_streams.empty()) {
-            return MakeH2Message(NULL);
-        }
+        size_t n = 0;
         for (size_t i = 0; i < goaway_streams.size(); ++i) {
             H2StreamContext* sctx = goaway_streams[i];
+            if (sctx->is_stage2()) {
+                sctx->Release(ELOGOFF, "The h2 connection is going away");
+                continue;
+            }
             sctx->header().set_status_code(HTTP_STATUS_SERVICE_UNAVAILABLE);
+            goaway_streams[n++] = sctx;
+        }
+        goaway_streams.resize(n);
+        if (goaway_streams.empty()) {
+            return MakeH2Message(NULL);
         }
         for (size_t i = 1; i < goaway_streams.size(); ++i) {
             bthread_t th;
@@ -1021,8 +1486,19 @@ H2ParseResult H2Context::OnWindowUpdate(
             LOG(ERROR) << "Invalid connection-level window_size_increment=" << inc;
             return MakeH2Error(H2_FLOW_CONTROL_ERROR);
         }
+        FlushStreamWriters(false);
         return MakeH2Message(NULL);
     } else {
+        butil::intrusive_ptr<H2StreamWriter> writer =
+            FindStreamWriter(frame_head.stream_id);
+        if (writer != NULL) {
+            if (!writer->AddWindowSize(inc)) {
+                LOG(ERROR) << "Invalid stream-level window_size_increment=" << inc;
+                return MakeH2Error(H2_FLOW_CONTROL_ERROR);
+            }
+            writer->Flush();
+            return MakeH2Message(NULL);
+        }
         H2StreamContext* sctx = FindStream(frame_head.stream_id);
         if (sctx == NULL) {
             RPC_VLOG << "Fail to find stream_id=" << frame_head.stream_id;
@@ -1052,7 +1528,12 @@ void H2Context::Describe(std::ostream& os, const DescribeOptions& opt) const {
        << sep << "remote_settings=" << _remote_settings
        << sep << "remote_settings_received=" << _remote_settings_received
        << sep << "local_settings=" << _local_settings
-       << sep << "hpacker={";
+       << sep << "local_conn_window_size=" << _local_conn_window_size;
+    if (FLAGS_h2_window_auto_tuning) {
+        os << sep << "bdp_max_bandwidth=" << (int64_t)(_bdp_max_bandwidth * 1000000)
+           << "B/s";
+    }
+    os << sep << "hpacker={";
     IndentingOStream os2(os, 2);
     _hpacker.Describe(os2, opt);
     os << '}';
@@ -1094,6 +1575,47 @@ void H2Context::DeferWindowUpdate(int64_t size) {
     }
 }
 
+int H2Context::QueueControlFrame(const void* data, size_t n) {
+    butil::IOBuf frames;
+    {
+        BAIDU_SCOPED_LOCK(_control_frames_mutex);
+        _control_frames.append(data, n);
+        if (_control_frames.size() < H2_MAX_QUEUED_CONTROL_FRAMES_SIZE) {
+            return 0;
+        }
+        frames.swap(_control_frames);
+    }
+    return WriteControlFrames(&frames);
+}
+
+int H2Context::FlushControlFrames() {
+    butil::IOBuf frames;
+    {
+        BAIDU_SCOPED_LOCK(_control_frames_mutex);
+        if (_control_frames.empty()) {
+            return 0;
+        }
+        frames.swap(_control_frames);
+    }
+    return WriteControlFrames(&frames);
+}
+
+int H2Context::WriteControlFrames(butil::IOBuf* frames) {
+    // Write outside _control_frames_mutex: an inline write may pack other
+    // h2 messages queued to the socket, which take the lock again in
+    // AppendControlFrames(). Control frames taken by them are sent before
+    // `frames', which is harmless since the frames don't depend on each
+    // other.
+    Socket::WriteOptions wopt;
+    wopt.ignore_eovercrowded = true;
+    return _socket->Write(frames, &wopt);
+}
+
+void H2Context::AppendControlFrames(butil::IOBuf* out) {
+    BAIDU_SCOPED_LOCK(_control_frames_mutex);
+    out->append(butil::IOBuf::Movable(_control_frames));
+}
+
 #if defined(BRPC_PROFILE_H2)
 bvar::Adder<int64_t> g_parse_time;
 bvar::PerSecond<bvar::Adder<int64_t> > g_parse_time_per_second(
@@ -1133,6 +1655,11 @@ ParseResult ParseH2Message(butil::IOBuf *source, Socket *socket,
         }
         source->pop_front(source->size() - last_bytes_left);
         ctx->ClearAbandonedStreams();
+        // Send ACKs and WINDOW_UPDATEs generated by frames parsed in this
+        // round with one write, if they're not sent along with streams yet.
+        if (ctx->FlushControlFrames() != 0) {
+            LOG(WARNING) << "Fail to send control frames to " << *socket;
+        }
         return res;
     }
 }
@@ -1150,7 +1677,7 @@ inline void H2Context::ClearAbandonedStreams() {
         mu.unlock();
         H2StreamContext* sctx = RemoveStreamAndDeferWU(stream_id);
         if (sctx != NULL) {
-            delete sctx;
+            sctx->Release(ECANCELED, "The RPC was abandoned");
         }
         mu.lock();
     }
@@ -1166,7 +1693,14 @@ H2StreamContext::H2StreamContext(bool read_body_progressively)
     , _stream_ended(false)
     , _remote_window_left(0)
     , _deferred_window_update(0)
-    , _correlation_id(INVALID_BTHREAD_ID.value) {
+    , _correlation_id(INVALID_BTHREAD_ID.value)
+    , _socket_id(INVALID_SOCKET_ID)
+    , _local_window_size(0)
+    , _unacked_body_size(0)
+    , _consumed_body_size(0)
+    , _body_ended(false)
+    , _body_refused(false) {
+    _body_queue.value = 0;
     header().set_version(2, 0);
 #ifndef NDEBUG
     get_h2_bvars()->h2_stream_context_count << 1;
@@ -1178,6 +1712,8 @@ void H2StreamContext::Init(H2Context* conn_ctx, int stream_id) {
     _stream_id = stream_id;
     _remote_window_left.store(conn_ctx->remote_settings().stream_window_size,
                               butil::memory_order_relaxed);
+    _socket_id = conn_ctx->_socket->id();
+    _local_window_size = conn_ctx->local_settings().stream_window_size;
 }
 
 H2StreamContext::~H2StreamContext() {
@@ -1220,7 +1756,15 @@ bool H2StreamContext::ConsumeWindowSize(int64_t size) {
 
 int H2StreamContext::ConsumeHeaders(butil::IOBufBytesIterator& it) {
     HPacker& hpacker = _conn_ctx->hpacker();
-    HttpHeader& h = header();
+    HttpHeader* ph = &header();
+    if (is_stage2()) {
+        // header() was moved to the controller, decode trailers aside.
+        if (_trailers == NULL) {
+            _trailers.reset(new HttpHeader);
+        }
+        ph = _trailers.get();
+    }
+    HttpHeader& h = *ph;
     while (it) {
         HPacker::Header pair;
         const int rc = hpacker.Decode(it, &pair);
@@ -1305,19 +1849,18 @@ int H2StreamContext::ConsumeHeaders(butil::IOBufBytesIterator& it) {
     return 0;
 }
 
-const CommonStrings* get_common_strings();
-
 static void PackH2Message(butil::IOBuf* out,
                           butil::IOBuf& headers,
                           butil::IOBuf& trailer_headers,
                           const butil::IOBuf& data,
                           int stream_id,
-                          H2Context* conn_ctx) {
+                          H2Context* conn_ctx,
+                          bool end_stream) {
     const H2Settings& remote_settings = conn_ctx->remote_settings();
     char headbuf[FRAME_HEAD_SIZE];
     H2FrameHead headers_head = {
         (uint32_t)headers.size(), H2_FRAME_HEADERS, 0, stream_id};
-    if (data.empty() && trailer_headers.empty()) {
+    if (end_stream && data.empty() && trailer_headers.empty()) {
         headers_head.flags |= H2_FLAGS_END_STREAM;
     }
     if (headers_head.payload_size <= remote_settings.max_frame_size) {
@@ -1350,7 +1893,7 @@ static void PackH2Message(butil::IOBuf* out,
         while (it.bytes_left()) {
             if (it.bytes_left() <= remote_settings.max_frame_size) {
                 data_head.payload_size = it.bytes_left();
-                if (trailer_headers.empty()) {
+                if (end_stream && trailer_headers.empty()) {
                     data_head.flags |= H2_FLAGS_END_STREAM;
                 }
             } else {
@@ -1377,6 +1920,8 @@ static void PackH2Message(butil::IOBuf* out,
         SaveUint32(winbuf + FRAME_HEAD_SIZE, conn_wu);
         out->append(winbuf, sizeof(winbuf));
     }
+    // Piggyback pending ACKs and WINDOW_UPDATEs.
+    conn_ctx->AppendControlFrames(out);
 }
 
 H2UnsentRequest* H2UnsentRequest::New(Controller* c) {
@@ -1589,7 +2134,8 @@ H2UnsentRequest::AppendAndDestroySelf(butil::IOBuf* out, Socket* socket) {
     butil::IOBuf frag;
     appender.move_to(frag);
     butil::IOBuf dummy_buf;
-    PackH2Message(out, frag, dummy_buf, _cntl->request_attachment(), _stream_id, ctx);
+    PackH2Message(out, frag, dummy_buf, _cntl->request_attachment(),
+                  _stream_id, ctx, true);
     return butil::Status::OK();
 }
 
@@ -1637,19 +2183,62 @@ void H2UnsentRequest::Print(std::ostream& os) const {
 
 }
 
-H2UnsentResponse::H2UnsentResponse(Controller* c, int stream_id, bool is_grpc)
+H2Priority ParseH2Priority(const butil::StringPiece& value) {
+    H2Priority priority;
+    for (butil::StringSplitter sp(value.data(), value.data() + value.size(), ',');
+         sp; ++sp) {
+        butil::StringPiece member(sp.field(), sp.length());
+        // Parameters of members are not used.
+        const size_t semicolon = member.find(';');
+        if (semicolon != butil::StringPiece::npos) {
+            member.remove_suffix(member.size() - semicolon);
+        }
+        member.trim_spaces();
+        const size_t eq = member.find('=');
+        const butil::StringPiece key = member.substr(0, eq);
+        // A member without value is boolean true.
+        const butil::StringPiece item =
+            (eq == butil::StringPiece::npos ? "?1" : member.substr(eq + 1));
+        if (key == "u") {
+            if (item.size() == 1 && item[0] >= '0' &&
+                item[0] <= '0' + H2Priority::MAX_URGENCY) {
+                priority.urgency = item[0] - '0';
+            }
+        } else if (key == "i") {
+            if (item == "?1") {
+                priority.incremental = true;
+            } else if (item == "?0") {
+                priority.incremental = false;
+            }
+        }
+    }
+    return priority;
+}
+
+H2Priority GetH2Priority(const HttpHeader& request) {
+    const std::string* value = request.GetHeader("priority");
+    return (value != NULL ? ParseH2Priority(*value) : H2Priority());
+}
+
+H2UnsentResponse::H2UnsentResponse(Controller* c, int stream_id, bool is_grpc,
+                                   bool body_follows)
     : _size(0)
     , _stream_id(stream_id)
     , _http_response(c->release_http_response())
-    , _is_grpc(is_grpc) {
-    _data.swap(c->response_attachment());
+    , _is_grpc(is_grpc)
+    , _body_follows(body_follows)
+    , _priority(GetH2Priority(c->http_request())) {
+    if (!body_follows) {
+        _data.swap(c->response_attachment());
+    }
     if (is_grpc) {
         _grpc_status = ErrorCodeToGrpcStatus(c->ErrorCode());
         PercentEncode(c->ErrorText(), &_grpc_message);
     }
 }
 
-H2UnsentResponse* H2UnsentResponse::New(Controller* c, int stream_id, bool is_grpc) {
+H2UnsentResponse* H2UnsentResponse::New(Controller* c, int stream_id,
+                                        bool is_grpc, bool body_follows) {
     const HttpHeader* const h = &c->http_response();
     const CommonStrings* const common = get_common_strings();
     const bool need_content_type = !h->content_type().empty();
@@ -1657,7 +2246,8 @@ H2UnsentResponse* H2UnsentResponse::New(Controller* c, int stream_id, bool is_gr
         + (size_t)need_content_type;
     const size_t memsize = offsetof(H2UnsentResponse, _list) +
         sizeof(HPacker::Header) * maxsize;
-    H2UnsentResponse* msg = new (malloc(memsize)) H2UnsentResponse(c, stream_id, is_grpc);
+    H2UnsentResponse* msg = new (malloc(memsize)) H2UnsentResponse(
+        c, stream_id, is_grpc, body_follows);
     // :status
     if (h->status_code() == 200) {
         msg->push(common->H2_STATUS, common->STATUS_200);
@@ -1697,18 +2287,25 @@ H2UnsentResponse::AppendAndDestroySelf(butil::IOBuf* out, Socket* socket) {
     H2Context* ctx = static_cast<H2Context*>(socket->parsing_context());
 
     // flow control
-    // NOTE: Currently the stream context is definitely removed and updating
-    // window size is useless, however it's not true when progressive request
-    // is supported.
-    // TODO(zhujiashun): Instead of just returning error to client, a better
-    // solution to handle not enough window size is to wait until WINDOW_UPDATE
-    // is received, and then retry those failed response again.
-    if (!MinusWindowSize(&ctx->_remote_window_left, _data.size())) {
-        char rstbuf[FRAME_HEAD_SIZE + 4];
-        SerializeFrameHead(rstbuf, 4, H2_FRAME_RST_STREAM, 0, _stream_id);
-        SaveUint32(rstbuf + FRAME_HEAD_SIZE, H2_FLOW_CONTROL_ERROR);
-        out->append(rstbuf, sizeof(rstbuf));
-        return butil::Status::OK();
+    // The body is sent by H2StreamWriter which waits for WINDOW_UPDATE if
+    // the body does not fit in the connection-level window, or more urgent
+    // writers are waiting for the window.
+    bool body_by_writer = false;
+    if (!_body_follows && !_data.empty()) {
+        // H2StreamWriter ends gRPC streams with OK only.
+        const bool can_defer = (!_is_grpc || _grpc_status == GRPC_OK);
+        if (can_defer && ctx->HasBlockedStreamWriters(_priority.urgency)) {
+            body_by_writer = true;
+        } else if (!MinusWindowSize(&ctx->_remote_window_left, _data.size())) {
+            if (!can_defer) {
+                char rstbuf[FRAME_HEAD_SIZE + 4];
+                SerializeFrameHead(rstbuf, 4, H2_FRAME_RST_STREAM, 0, _stream_id);
+                SaveUint32(rstbuf + FRAME_HEAD_SIZE, H2_FLOW_CONTROL_ERROR);
+                out->append(rstbuf, sizeof(rstbuf));
+                return butil::Status::OK();
+            }
+            body_by_writer = true;
+        }
     }
 
     HPacker& hpacker = ctx->hpacker();
@@ -1730,11 +2327,17 @@ H2UnsentResponse::AppendAndDestroySelf(butil::IOBuf* out, Socket* socket) {
             hpacker.Encode(&appender, header, options);
         }
     }
+    // A gRPC response without body (e.g. of a failed RPC) is Trailers-Only:
+    // the status is carried by the only HEADERS frame which ends the stream.
+    const bool trailers_only = (_is_grpc && !_body_follows && _data.empty());
     butil::IOBuf frag;
-    appender.move_to(frag);
+    if (!trailers_only) {
+        appender.move_to(frag);
+    }
 
     butil::IOBuf trailer_frag;
-    if (_is_grpc) {
+    // Trailers of a following body are sent by H2StreamWriter.
+    if (_is_grpc && !_body_follows && !body_by_writer) {
         HPacker::Header status_header("grpc-status",
                                       butil::string_printf("%d", _grpc_status));
         hpacker.Encode(&appender, status_header, options);
@@ -1742,10 +2345,23 @@ H2UnsentResponse::AppendAndDestroySelf(butil::IOBuf* out, Socket* socket) {
             HPacker::Header msg_header("grpc-message", _grpc_message);
             hpacker.Encode(&appender, msg_header, options);
         }
-        appender.move_to(trailer_frag);
+        appender.move_to(trailers_only ? frag : trailer_frag);
     }
 
-    PackH2Message(out, frag, trailer_frag, _data, _stream_id, ctx);
+    if (!body_by_writer) {
+        PackH2Message(out, frag, trailer_frag, _data, _stream_id, ctx,
+                      !_body_follows);
+        return butil::Status::OK();
+    }
+    PackH2Message(out, frag, trailer_frag, butil::IOBuf(), _stream_id, ctx, false);
+    // The socket is being written by this message, frames written by the
+    // writer are queued after the headers in `out'.
+    butil::intrusive_ptr<H2StreamWriter> writer =
+        H2StreamWriter::Create(socket, _stream_id, _is_grpc, _priority);
+    if (writer != NULL) {
+        writer->Write(&_data, true);
+        writer->Close();
+    }
     return butil::Status::OK();
 }
 
@@ -1781,6 +2397,289 @@ void H2UnsentResponse::Print(std::ostream& os) const {
     os << butil::ToPrintable(_data, FLAGS_http_verbose_max_body_length);
 }
 
+// Trailers ending a gRPC stream written by H2StreamWriter. Headers are
+// encoded in AppendAndDestroySelf() which is called in the order of writing,
+// as the HPACK context of the connection requires.
+class H2UnsentTrailers : public SocketMessage {
+public:
+    H2UnsentTrailers(int stream_id, int error_code, const std::string& error_text)
+        : _stream_id(stream_id)
+        , _grpc_status(ErrorCodeToGrpcStatus(error_code)) {
+        if (error_code != 0) {
+            PercentEncode(error_text, &_grpc_message);
+        }
+    }
+
+    // @SocketMessage
+    butil::Status AppendAndDestroySelf(butil::IOBuf* out, Socket* socket) override {
+        std::unique_ptr<H2UnsentTrailers> destroy_self(this);
+        if (socket == NULL) {
+            return butil::Status::OK();
+        }
+        H2Context* ctx = static_cast<H2Context*>(socket->parsing_context());
+        HPacker& hpacker = ctx->hpacker();
+        butil::IOBufAppender appender;
+        HPackOptions options;
+        options.encode_name = FLAGS_h2_hpack_encode_name;
+        options.encode_value = FLAGS_h2_hpack_encode_value;
+        if (ctx->remote_settings().header_table_size == 0) {
+            options.index_policy = HPACK_NEVER_INDEX_HEADER;
+        }
+        HPacker::Header status_header("grpc-status",
+                                      butil::string_printf("%d", _grpc_status));
+        hpacker.Encode(&appender, status_header, options);
+        if (!_grpc_message.empty()) {
+            HPacker::Header msg_header("grpc-message", _grpc_message);
+            hpacker.Encode(&appender, msg_header, options);
+        }
+        butil::IOBuf frag;
+        appender.move_to(frag);
+        char headbuf[FRAME_HEAD_SIZE];
+        SerializeFrameHead(headbuf, frag.size(), H2_FRAME_HEADERS,
+                           H2_FLAGS_END_STREAM | H2_FLAGS_END_HEADERS,
+                           _stream_id);
+        out->append(headbuf, sizeof(headbuf));
+        out->append(butil::IOBuf::Movable(frag));
+        return butil::Status::OK();
+    }
+    size_t EstimatedByteSize() override {
+        return FRAME_HEAD_SIZE + 16 + _grpc_message.size();
+    }
+
+private:
+    int _stream_id;
+    GrpcStatus _grpc_status;
+    std::string _grpc_message;
+};
+
+H2StreamWriter::H2StreamWriter(Socket* socket, H2Context* ctx, int stream_id,
+                               bool is_grpc, const H2Priority& priority,
+                               int64_t window_size)
+    : _socket(socket)
+    , _ctx(ctx)
+    , _stream_id(stream_id)
+    , _is_grpc(is_grpc)
+    , _priority(priority)
+    , _blocked(false)
+    , _initial_window_size(window_size)
+    , _remote_window_left(window_size)
+    , _closed(false)
+    , _end_sent(false)
+    , _reset(false)
+    , _writing(false)
+    , _error_code(0) {
+}
+
+butil::intrusive_ptr<H2StreamWriter> H2StreamWriter::Create(
+    Socket* socket, int stream_id, bool is_grpc, const H2Priority& priority) {
+    H2Context* ctx = static_cast<H2Context*>(socket->parsing_context());
+    if (ctx == NULL) {
+        return NULL;
+    }
+    // Read the initial window inside the lock, FlushStreamWriters() applies
+    // changes of the window to writers created before.
+    BAIDU_SCOPED_LOCK(ctx->_stream_writers_mutex);
+    butil::intrusive_ptr<H2StreamWriter> writer(new H2StreamWriter(
+            socket, ctx, stream_id, is_grpc, priority,
+            ctx->remote_settings().stream_window_size));
+    ctx->_stream_writers[stream_id] = writer;
+    return writer;
+}
+
+H2Priority H2StreamWriter::priority() const {
+    BAIDU_SCOPED_LOCK(_mutex);
+    return _priority;
+}
+
+void H2StreamWriter::SetPriority(const H2Priority& priority) {
+    BAIDU_SCOPED_LOCK(_mutex);
+    const bool blocked = _blocked;
+    SetBlockedLocked(false);
+    _priority = priority;
+    SetBlockedLocked(blocked);
+}
+
+void H2StreamWriter::SetBlockedLocked(bool blocked) {
+    if (_blocked != blocked) {
+        _blocked = blocked;
+        _ctx->_blocked_writers[_priority.urgency].fetch_add(
+            blocked ? 1 : -1, butil::memory_order_relaxed);
+    }
+}
+
+int H2StreamWriter::Write(butil::IOBuf* data, bool ignore_eovercrowded) {
+    std::unique_lock<butil::Mutex> mu(_mutex);
+    if (_reset || _closed) {
+        errno = ECANCELED;
+        return -1;
+    }
+    if (!ignore_eovercrowded &&
+        _pending.size() >= (size_t)FLAGS_socket_max_unwritten_bytes) {
+        errno = EOVERCROWDED;
+        return -1;
+    }
+    _pending.append(butil::IOBuf::Movable(*data));
+    return FlushAndUnlock(&mu, INT64_MAX, NULL);
+}
+
+void H2StreamWriter::Close(int error_code, const std::string& error_text) {
+    std::unique_lock<butil::Mutex> mu(_mutex);
+    if (_closed) {
+        return;
+    }
+    _closed = true;
+    _error_code = error_code;
+    _error_text = error_text;
+    FlushAndUnlock(&mu, INT64_MAX, NULL);
+}
+
+bool H2StreamWriter::AddWindowSize(int64_t diff) {
+    BAIDU_SCOPED_LOCK(_mutex);
+    if (_remote_window_left + diff > H2Settings::MAX_WINDOW_SIZE) {
+        return false;
+    }
+    _remote_window_left += diff;
+    return true;
+}
+
+bool H2StreamWriter::SetInitialWindowSize(int64_t size) {
+    BAIDU_SCOPED_LOCK(_mutex);
+    const int64_t diff = size - _initial_window_size;
+    if (_remote_window_left + diff > H2Settings::MAX_WINDOW_SIZE) {
+        return false;
+    }
+    _initial_window_size = size;
+    _remote_window_left += diff;
+    return true;
+}
+
+bool H2StreamWriter::Flush(int64_t max_size) {
+    std::unique_lock<butil::Mutex> mu(_mutex);
+    if (_pending.empty() && !_closed) {
+        return false;
+    }
+    bool more = false;
+    FlushAndUnlock(&mu, max_size, &more);
+    return more;
+}
+
+void H2StreamWriter::OnReset() {
+    bool blocked = false;
+    {
+        BAIDU_SCOPED_LOCK(_mutex);
+        _reset = true;
+        _pending.clear();
+        blocked = _blocked;
+        SetBlockedLocked(false);
+    }
+    if (blocked) {
+        // Less urgent writers yielding to this one may send now.
+        _ctx->FlushStreamWriters(false);
+    }
+}
+
+int H2StreamWriter::FlushAndUnlock(std::unique_lock<butil::Mutex>* mu,
+                                   int64_t max_size, bool* more) {
+    if (_writing) {
+        // Another thread is writing frames of this stream, which packs
+        // the data appended after it returns from Socket::Write().
+        mu->unlock();
+        return 0;
+    }
+    // Write outside the lock: an inline Socket::Write() may pack queued
+    // responses which create writers and lock H2Context. Only one thread
+    // writes at a time to keep the order of frames.
+    _writing = true;
+    int rc = 0;
+    int64_t sent = 0;
+    while (true) {
+        butil::IOBuf out;
+        bool send_trailers = false;
+        sent += PackFramesLocked(&out, &send_trailers, max_size - sent);
+        if (out.empty() && !send_trailers) {
+            break;
+        }
+        mu->unlock();
+        Socket::WriteOptions wopt;
+        wopt.ignore_eovercrowded = true;
+        if (!out.empty() && _socket->Write(&out, &wopt) != 0) {
+            rc = -1;
+        } else if (send_trailers) {
+            SocketMessagePtr<H2UnsentTrailers> trailers(
+                new H2UnsentTrailers(_stream_id, _error_code, _error_text));
+            if (_socket->Write(trailers, &wopt) != 0) {
+                rc = -1;
+            }
+        }
+        mu->lock();
+        if (rc != 0) {
+            break;
+        }
+    }
+    _writing = false;
+    if (more) {
+        *more = (!_pending.empty() && sent >= max_size);
+    }
+    const bool ended = (_end_sent || _reset);
+    mu->unlock();
+    if (ended) {
+        _ctx->RemoveStreamWriter(_stream_id);
+    }
+    return rc;
+}
+
+int64_t H2StreamWriter::PackFramesLocked(butil::IOBuf* out,
+                                         bool* send_trailers,
+                                         int64_t max_size) {
+    if (_reset || _end_sent) {
+        _pending.clear();
+        SetBlockedLocked(false);
+        return 0;
+    }
+    char headbuf[FRAME_HEAD_SIZE];
+    // Leave the connection-level window to more urgent writers waiting
+    // for it, this writer is flushed after them by FlushStreamWriters().
+    const bool yield = _ctx->HasBlockedStreamWriters(_priority.urgency);
+    int64_t sent = 0;
+    // DEFAULT_MAX_FRAME_SIZE is always acceptable to the remote side.
+    while (!yield && !_pending.empty() && _remote_window_left > 0 &&
+           sent < max_size) {
+        const int64_t size = TakeWindowSize(
+            &_ctx->_remote_window_left,
+            std::min(std::min((int64_t)_pending.size(), _remote_window_left),
+                     std::min((int64_t)H2Settings::DEFAULT_MAX_FRAME_SIZE,
+                              max_size - sent)));
+        if (size == 0) {
+            // Wait for the connection-level WINDOW_UPDATE.
+            break;
+        }
+        _remote_window_left -= size;
+        sent += size;
+        SerializeFrameHead(headbuf, size, H2_FRAME_DATA, 0, _stream_id);
+        out->append(headbuf, sizeof(headbuf));
+        _pending.cutn(out, size);
+    }
+    SetBlockedLocked(!_pending.empty() && _remote_window_left > 0);
+    if (_closed && _pending.empty()) {
+        _end_sent = true;
+        if (_is_grpc) {
+            *send_trailers = true;
+        } else if (_error_code != 0) {
+            // Plain h2 has no trailers for errors, reset the stream so that
+            // the client does not take the body as complete.
+            char rstbuf[FRAME_HEAD_SIZE + 4];
+            SerializeFrameHead(rstbuf, 4, H2_FRAME_RST_STREAM, 0, _stream_id);
+            SaveUint32(rstbuf + FRAME_HEAD_SIZE, H2_INTERNAL_ERROR);
+            out->append(rstbuf, sizeof(rstbuf));
+        } else {
+            SerializeFrameHead(headbuf, 0, H2_FRAME_DATA,
+                               H2_FLAGS_END_STREAM, _stream_id);
+            out->append(headbuf, sizeof(headbuf));
+        }
+    }
+    return sent;
+}
+
 void PackH2Request(butil::IOBuf*,
                    SocketMessage** user_message,
                    uint64_t correlation_id,
@@ -25,6 +25,10 @@
 #include "brpc/details/hpack.h"
 #include "brpc/stream_creator.h"
 #include "brpc/controller.h"
+#include "brpc/shared_object.h"
+#include "bthread/execution_queue.h"
+#include <map>
+#include <mutex>
 
 #ifndef NDEBUG
 #include "bvar/bvar.h"
@@ -77,8 +81,10 @@ enum H2FrameType {
     H2_FRAME_GOAWAY        = 0x7,
     H2_FRAME_WINDOW_UPDATE = 0x8,
     H2_FRAME_CONTINUATION  = 0x9,
+    // https://www.rfc-editor.org/rfc/rfc9218#section-7.1
+    H2_FRAME_PRIORITY_UPDATE = 0x10,
     // ============================
-    H2_FRAME_TYPE_MAX      = 0x9
+    H2_FRAME_TYPE_MAX      = 0x10
 };
 
 // https://tools.ietf.org/html/rfc7540#section-4.1
@@ -104,6 +110,27 @@ struct H2FrameHead {
     int stream_id;
 };
 
+// Priority of a response stream in the Extensible Prioritization Scheme.
+// https://www.rfc-editor.org/rfc/rfc9218
+struct H2Priority {
+    static const int MAX_URGENCY = 7;
+    static const int DEFAULT_URGENCY = 3;
+
+    // 0 is the most urgent.
+    int urgency;
+    // Streams of the same urgency sharing the bandwidth in turn rather than
+    // being sent one after another.
+    bool incremental;
+
+    H2Priority() : urgency(DEFAULT_URGENCY), incremental(false) {}
+};
+
+// Parse `value' of the `priority' header or PRIORITY_UPDATE frame, such as
+// "u=1, i". Unknown or invalid parameters are ignored and take defaults.
+H2Priority ParseH2Priority(const butil::StringPiece& value);
+// Priority of the response to `request'.
+H2Priority GetH2Priority(const HttpHeader& request);
+
 enum H2StreamState {
     H2_STREAM_IDLE = 0,
     H2_STREAM_RESERVED_LOCAL,
@@ -195,7 +222,10 @@ private:
 
 class H2UnsentResponse : public SocketMessage {
 public:
-    static H2UnsentResponse* New(Controller* c, int stream_id, bool is_grpc);
+    // If `body_follows' is true, only headers are sent and the stream is
+    // left open for H2StreamWriter, response_attachment() is ignored.
+    static H2UnsentResponse* New(Controller* c, int stream_id, bool is_grpc,
+                                 bool body_follows = false);
     void Destroy();
     void Print(std::ostream& os) const;
     // @SocketMessage
@@ -209,7 +239,8 @@ private:
     void push(const std::string& name, const std::string& value)
     { new (&_list[_size++]) HPacker::Header(name, value); }
 
-    H2UnsentResponse(Controller* c, int stream_id, bool is_grpc);
+    H2UnsentResponse(Controller* c, int stream_id, bool is_grpc,
+                     bool body_follows);
     ~H2UnsentResponse() {}
     H2UnsentResponse(const H2UnsentResponse&);
     void operator=(const H2UnsentResponse&);
@@ -220,11 +251,97 @@ private:
     std::unique_ptr<HttpHeader> _http_response;
     butil::IOBuf _data;
     bool _is_grpc;
+    bool _body_follows;
+    H2Priority _priority;
     GrpcStatus _grpc_status;
     std::string _grpc_message;
     HPacker::Header _list[0];
 };
 
+// Send the body of a server-side stream progressively after the headers
+// sent by H2UnsentResponse (ProgressiveAttachment over h2, server-streaming
+// of gRPC, or bodies not fitting in the connection-level window). DATA
+// frames are limited by windows of both the stream and the connection, data
+// exceeding the windows is buffered and sent when WINDOW_UPDATEs arrive.
+// The connection-level window is granted by `priority': a writer does not
+// take the window while more urgent writers are waiting for it.
+class H2StreamWriter : public SharedObject {
+public:
+    // Created and registered in the H2Context of `socket'.
+    static butil::intrusive_ptr<H2StreamWriter> Create(
+        Socket* socket, int stream_id, bool is_grpc,
+        const H2Priority& priority = H2Priority());
+
+    int stream_id() const { return _stream_id; }
+    H2Priority priority() const;
+    // Changed by PRIORITY_UPDATE.
+    void SetPriority(const H2Priority& priority);
+
+    // Send `data' (cut from the IOBuf) as DATA frames.
+    // Returns 0 on success, -1 otherwise and errno is set:
+    //   EOVERCROWDED: too much data is buffered due to flow control, retry
+    //                 later. Never returned if ignore_eovercrowded is true.
+    //   ECANCELED: the stream was reset by peer or already closed.
+    //   others: same as what Socket.Write may set.
+    int Write(butil::IOBuf* data, bool ignore_eovercrowded = false);
+
+    // End the stream after all buffered data is sent, with trailers
+    // carrying grpc-status for gRPC, or an empty DATA frame otherwise.
+    // If `error_code' is not 0, the trailers carry the status converted from
+    // it and `error_text' as grpc-message, or the stream is reset with
+    // INTERNAL_ERROR for non-gRPC.
+    void Close(int error_code = 0, const std::string& error_text = "");
+
+    // Called by H2Context in the parsing thread.
+    // Change the stream-level window by WINDOW_UPDATE, or by the initial
+    // window size in SETTINGS. Returns false if the window overflows.
+    bool AddWindowSize(int64_t diff);
+    bool SetInitialWindowSize(int64_t size);
+    // Send buffered data allowed by the (changed) windows, at most
+    // `max_size' bytes. Returns true if more data can be sent by the
+    // windows left.
+    bool Flush(int64_t max_size = INT64_MAX);
+    // RST_STREAM was received, drop buffered data.
+    void OnReset();
+
+private:
+    H2StreamWriter(Socket* socket, H2Context* ctx, int stream_id,
+                   bool is_grpc, const H2Priority& priority,
+                   int64_t window_size);
+    // Send data allowed by the windows, at most `max_size' bytes, and
+    // unlock `mu'. Returns 0 on success, -1 otherwise. Set *more (if not
+    // NULL) to true if `max_size' was reached with data left.
+    int FlushAndUnlock(std::unique_lock<butil::Mutex>* mu, int64_t max_size,
+                       bool* more);
+    // Cut frames allowed by the windows into `out'. Set *send_trailers to
+    // true if a gRPC stream ends after `out'. Returns bytes of data cut.
+    int64_t PackFramesLocked(butil::IOBuf* out, bool* send_trailers,
+                             int64_t max_size);
+    // Mark the writer as waiting for the connection-level window or not.
+    void SetBlockedLocked(bool blocked);
+
+    Socket* _socket;
+    H2Context* _ctx;
+    const int _stream_id;
+    const bool _is_grpc;
+    mutable butil::Mutex _mutex;
+    H2Priority _priority;
+    // Has data and stream-level window but waits for the connection-level
+    // window, counted in H2Context::_blocked_writers.
+    bool _blocked;
+    int64_t _initial_window_size;
+    int64_t _remote_window_left;
+    butil::IOBuf _pending;
+    bool _closed;
+    bool _end_sent;
+    bool _reset;
+    // A thread is writing frames with _mutex unlocked.
+    bool _writing;
+    // Passed to Close().
+    int _error_code;
+    std::string _error_text;
+};
+
 // Used in http_rpc_protocol.cpp
 class H2StreamContext : public HttpContext {
 public:
@@ -237,6 +354,14 @@ public:
     // Returns 0 on success, -1 otherwise.
     int ConsumeHeaders(butil::IOBufBytesIterator& it);
     H2ParseResult OnEndStream();
+    // Called when a header block is complete before the end of stream.
+    H2ParseResult OnHeadersComplete();
+
+    // Destroy this stream which is removed from H2Context without being
+    // returned as a message. A stream returned after headers to be read
+    // progressively is shared with the controller, its body is ended with
+    // the error instead.
+    void Release(int error_code, const char* error_text);
 
     H2ParseResult OnData(butil::IOBufBytesIterator&, const H2FrameHead&,
                        uint32_t frag_size, uint8_t pad_length);
@@ -275,7 +400,40 @@ friend class H2Context;
     butil::atomic<int64_t> _remote_window_left;
     butil::atomic<int64_t> _deferred_window_update;
     uint64_t _correlation_id;
+    // The stream-level window of the body read progressively is updated
+    // after the reader consumes the data, so that a slow reader stops the
+    // remote side from sending more.
+    SocketId _socket_id;
+    int64_t _local_window_size;
+    bthread::ExecutionQueueId<butil::IOBuf*> _body_queue;
+    // Received but not returned to the window by WINDOW_UPDATE.
+    butil::atomic<int64_t> _unacked_body_size;
+    // Consumed by the reader but not returned to the window yet.
+    butil::atomic<int64_t> _consumed_body_size;
+    butil::atomic<bool> _body_ended;
+    // Set by EndBody() before _body_queue is stopped.
+    butil::Status _body_end_status;
+    // The reader refused the body, accessed in ConsumeBody() only.
+    bool _body_refused;
     butil::IOBuf _remaining_header_fragment;
+    // Trailers of the stream returned after headers, headers() is moved
+    // to the controller concurrently.
+    std::unique_ptr<HttpHeader> _trailers;
+
+protected:
+    // @HttpMessage
+    void OnBodyConsumed(size_t size) override;
+
+private:
+    // The body read progressively is fed to the reader in _body_queue.
+    // Returns 0 on success, -1 otherwise.
+    int StartBodyQueue();
+    // End the body with `st' after data in _body_queue is fed.
+    void EndBody(const butil::Status& st);
+    static int ConsumeBody(void* meta, bthread::TaskIterator<butil::IOBuf*>& iter);
+    // Write `frame' outside the parsing thread, the connection may be closed.
+    // Abandon the stream in H2Context as well if `abandon' is true.
+    void WriteFrame(const char* frame, size_t size, bool abandon);
 };
 
 StreamCreator* get_h2_global_stream_creator();
@@ -351,10 +509,26 @@ public:
     void DeferWindowUpdate(int64_t);
     int64_t ReleaseDeferredWindowUpdate();
 
+    // Streams with body written by H2StreamWriter after response headers.
+    // Registered writers are referenced until the stream is ended or reset.
+    void RemoveStreamWriter(int stream_id);
+    // True if writers more urgent than `urgency' are waiting for the
+    // connection-level window.
+    bool HasBlockedStreamWriters(int urgency) const;
+
+    // Control frames generated in the parsing thread are queued and sent
+    // in batch: at the end of ParseH2Message(), or along with frames of
+    // the next stream packed by AppendAndDestroySelf(), whichever first.
+    // Returns non-zero on failure to write.
+    int QueueControlFrame(const void* data, size_t n);
+    int FlushControlFrames();
+    void AppendControlFrames(butil::IOBuf* out);
+
 private:
 friend class H2StreamContext;
 friend class H2UnsentRequest;
 friend class H2UnsentResponse;
+friend class H2StreamWriter;
 friend void InitFrameHandlers();
 
     ParseResult ConsumeFrameHead(butil::IOBufBytesIterator&, H2FrameHead*);
@@ -369,15 +543,31 @@ friend void InitFrameHandlers();
     H2ParseResult OnGoAway(butil::IOBufBytesIterator&, const H2FrameHead&);
     H2ParseResult OnWindowUpdate(butil::IOBufBytesIterator&, const H2FrameHead&);
     H2ParseResult OnContinuation(butil::IOBufBytesIterator&, const H2FrameHead&);
+    H2ParseResult OnPriorityUpdate(butil::IOBufBytesIterator&, const H2FrameHead&);
 
     H2StreamContext* RemoveStreamAndDeferWU(int stream_id);
     void RemoveGoAwayStreams(int goaway_stream_id, std::vector<H2StreamContext*>* out_streams);
 
     H2StreamContext* FindStream(int stream_id);
+    butil::intrusive_ptr<H2StreamWriter> FindStreamWriter(int stream_id);
+    // Send data buffered in writers after the connection-level window grew,
+    // or after the initial window size in remote settings changed if
+    // `window_size_changed' is true. Returns false on overflow of windows.
+    // Writers are flushed in the order of urgency, incremental ones of the
+    // same urgency send one frame in turn.
+    bool FlushStreamWriters(bool window_size_changed);
+
+    // Auto-tune flow-control windows by estimating BDP, see comments
+    // in the .cpp file.
+    void SampleBdp(uint32_t data_size);
+    void OnBdpPingAck();
+
+    int WriteControlFrames(butil::IOBuf* frames);
 
     // True if the connection is established by client, otherwise it's
     // accepted by server.
     Socket* _socket;
+    const Server* _server;
     butil::atomic<int64_t> _remote_window_left;
     H2ConnectionState _conn_state;
     int _last_received_stream_id;
@@ -387,7 +577,20 @@ friend void InitFrameHandlers();
     bool _remote_settings_received;
     H2Settings _local_settings;
     H2Settings _unack_local_settings;
+    // Connection-level window of receiving, changed by WINDOW_UPDATE only.
+    int64_t _local_conn_window_size;
+    // [BDP estimation] Only accessed in the parsing thread.
+    int64_t _bdp_ping_sent_us;
+    int64_t _bdp_sample_bytes;
+    // in bytes per microsecond
+    double _bdp_max_bandwidth;
     HPacker _hpacker;
+    butil::Mutex _control_frames_mutex;
+    butil::IOBuf _control_frames;
+    butil::Mutex _stream_writers_mutex;
+    std::map<int, butil::intrusive_ptr<H2StreamWriter> > _stream_writers;
+    // Number of blocked writers of each urgency.
+    butil::atomic<int> _blocked_writers[H2Priority::MAX_URGENCY + 1];
     mutable butil::Mutex _abandoned_streams_mutex;
     std::vector<uint32_t> _abandoned_streams;
     typedef butil::FlatMap<int, H2StreamContext*> StreamMap;
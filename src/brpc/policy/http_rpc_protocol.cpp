@@ -38,8 +38,10 @@
 #include "brpc/rpc_dump.h"                          // SampledRequest
 #include "brpc/http_status_code.h"                  // HTTP_STATUS_*
 #include "brpc/details/controller_private_accessor.h"
+#include "brpc/reloadable_flags.h"
 #include "brpc/builtin/index_service.h"             // IndexService
 #include "brpc/policy/gzip_compress.h"
+#include "brpc/policy/lz4_compress.h"
 #include "brpc/policy/http2_rpc_protocol.h"
 #include "brpc/details/usercode_backup_pool.h"
 #include "brpc/grpc.h"
@@ -80,6 +82,11 @@ DEFINE_string(request_id_header, "x-request-id", "The http header to mark a sess
 DEFINE_bool(use_http_error_code, false, "Whether set the x-bd-error-code header "
                                         "of http response to brpc error code");
 
+DEFINE_int32(http_max_pipelined_requests, 16, "Max number of unanswered "
+             "requests pipelined over a http connection when connection_type "
+             "is single. Requests beyond are sent over pooled connections");
+BRPC_VALIDATE_GFLAG(http_max_pipelined_requests, PositiveInteger);
+
 // Read user address from the header specified by -http_header_of_user_ip
 static bool GetUserAddressFromHeaderImpl(const HttpHeader& headers,
                                          butil::EndPoint* user_addr) {
@@ -130,6 +137,7 @@ CommonStrings::CommonStrings()
     , EXPECT("expect")
     , CONTINUE_100("100-continue")
     , GZIP("gzip")
+    , LZ4("lz4")
     , CONNECTION("connection")
     , KEEP_ALIVE("keep-alive")
     , CLOSE("close")
@@ -273,15 +281,44 @@ static bool RemoveGrpcPrefix(butil::IOBuf* body, bool* compressed) {
     return (message_length + 5 == sz);
 }
 
+// Get content-coding of `type', NULL if `type' is not supported by http
+// (or gRPC when `is_grpc' is true).
+static const std::string* CompressTypeToEncoding(CompressType type,
+                                                 bool is_grpc) {
+    switch (type) {
+    case COMPRESS_TYPE_GZIP:
+        return &common->GZIP;
+#ifdef BRPC_WITH_LZ4
+    case COMPRESS_TYPE_LZ4:
+        // Not a registered grpc-encoding.
+        return is_grpc ? NULL : &common->LZ4;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+// Compress http body `in' into `out' with `type' which must be supported
+// according to CompressTypeToEncoding().
+static bool CompressBody(CompressType type, const butil::IOBuf& in,
+                         butil::IOBuf* out) {
+#ifdef BRPC_WITH_LZ4
+    if (type == COMPRESS_TYPE_LZ4) {
+        return Lz4Compress(in, out);
+    }
+#endif
+    return GzipCompress(in, out, NULL);
+}
+
 static bool JsonToProtoMessage(const butil::IOBuf& body,
                                google::protobuf::Message* message,
                                Controller* cntl, int error_code) {
-    butil::IOBufAsZeroCopyInputStream wrapper(body);
     json2pb::Json2PbOptions options;
     options.base64_to_bytes = cntl->has_pb_bytes_to_base64();
     options.array_to_single_repeated = cntl->has_pb_single_repeated_to_array();
     std::string error;
-    bool ok = json2pb::JsonToProtoMessage(&wrapper, message, options, &error);
+    // Convert in a single pass without building a json document.
+    bool ok = json2pb::JsonToProtoMessage(body, message, options, &error);
     if (!ok) {
         cntl->SetFailed(error_code, "Fail to parse http json body as %s: %s",
                         message->GetDescriptor()->full_name().c_str(),
@@ -291,7 +328,7 @@ static bool JsonToProtoMessage(const butil::IOBuf& body,
 }
 
 static bool ProtoMessageToJson(const google::protobuf::Message& message,
-                               butil::IOBufAsZeroCopyOutputStream* wrapper,
+                               butil::IOBuf* body,
                                Controller* cntl, int error_code) {
     json2pb::Pb2JsonOptions options;
     options.bytes_to_base64 = cntl->has_pb_bytes_to_base64();
@@ -302,7 +339,7 @@ static bool ProtoMessageToJson(const google::protobuf::Message& message,
                           ? json2pb::OUTPUT_ENUM_BY_NUMBER
                           : json2pb::OUTPUT_ENUM_BY_NAME;
     std::string error;
-    bool ok = json2pb::ProtoMessageToJson(message, wrapper, options, &error);
+    bool ok = json2pb::ProtoMessageToJson(message, body, options, &error);
     if (!ok) {
         cntl->SetFailed(error_code, "Fail to convert %s to json: %s",
                         message.GetDescriptor()->full_name().c_str(),
@@ -351,6 +388,8 @@ void ProcessHttpResponse(InputMessageBase* msg) {
     if (is_http2) {
         H2StreamContext* h2_sctx = static_cast<H2StreamContext*>(msg);
         cid_value = h2_sctx->correlation_id();
+    } else if (imsg_guard->pipelined_correlation_id() != 0) {
+        cid_value = imsg_guard->pipelined_correlation_id();
     } else {
         cid_value = socket->correlation_id();
     }
@@ -404,7 +443,9 @@ void ProcessHttpResponse(InputMessageBase* msg) {
                 }
             }
         } else if (is_grpc) {
-            if (!RemoveGrpcPrefix(&res_body, &grpc_compressed)) {
+            // The body read progressively is a stream of prefixed messages.
+            if (!imsg_guard->read_body_progressively() &&
+                !RemoveGrpcPrefix(&res_body, &grpc_compressed)) {
                 cntl->SetFailed(ERESPONSE, "Invalid gRPC response");
                 break;
             }
@@ -524,6 +565,18 @@ void ProcessHttpResponse(InputMessageBase* msg) {
             }
             res_body.swap(uncompressed);
         }
+#ifdef BRPC_WITH_LZ4
+        else if (encoding != NULL && *encoding == common->LZ4) {
+            TRACEPRINTF("Decompressing response=%lu",
+                        (unsigned long)res_body.size());
+            butil::IOBuf uncompressed;
+            if (!policy::Lz4Decompress(res_body, &uncompressed)) {
+                cntl->SetFailed(ERESPONSE, "Fail to un-lz4 response body");
+                break;
+            }
+            res_body.swap(uncompressed);
+        }
+#endif
         if (content_type == HTTP_CONTENT_PROTO) {
             if (!ParsePbFromIOBuf(cntl->response(), res_body)) {
                 cntl->SetFailed(ERESPONSE, "Fail to parse content as %s",
@@ -560,6 +613,23 @@ void ProcessHttpResponse(InputMessageBase* msg) {
     accessor.OnResponse(cid, saved_error);
 }
 
+// Requests with non-idempotent methods should not be pipelined, see
+// https://datatracker.ietf.org/doc/html/rfc7230#section-6.3.2
+// HEAD is not pipelined either since the parser has to know that the
+// response has no body, which is recorded per connection.
+static bool CanBePipelined(HttpMethod method) {
+    switch (method) {
+    case HTTP_METHOD_GET:
+    case HTTP_METHOD_PUT:
+    case HTTP_METHOD_DELETE:
+    case HTTP_METHOD_OPTIONS:
+    case HTTP_METHOD_TRACE:
+        return true;
+    default:
+        return false;
+    }
+}
+
 void SerializeHttpRequest(butil::IOBuf* /*not used*/,
                           Controller* cntl,
                           const google::protobuf::Message* pbreq) {
@@ -626,7 +696,8 @@ void SerializeHttpRequest(butil::IOBuf* /*not used*/,
                 return;
             }
         } else if (content_type == HTTP_CONTENT_JSON) {
-            if (!ProtoMessageToJson(*pbreq, &wrapper, cntl, EREQUEST)) {
+            if (!ProtoMessageToJson(*pbreq, &cntl->request_attachment(),
+                                    cntl, EREQUEST)) {
                 cntl->request_attachment().clear();
                 return;
             }
@@ -646,24 +717,29 @@ void SerializeHttpRequest(butil::IOBuf* /*not used*/,
     }
     bool grpc_compressed = false;
     if (cntl->request_compress_type() != COMPRESS_TYPE_NONE) {
-        if (cntl->request_compress_type() != COMPRESS_TYPE_GZIP) {
-            return cntl->SetFailed(EREQUEST, "http does not support %s",
+        const std::string* encoding =
+            CompressTypeToEncoding(cntl->request_compress_type(), is_grpc);
+        if (encoding == NULL) {
+            return cntl->SetFailed(EREQUEST, "%s does not support %s",
+                            (is_grpc ? "grpc" : "http"),
                             CompressTypeToCStr(cntl->request_compress_type()));
         }
         const size_t request_size = cntl->request_attachment().size();
         if (request_size >= (size_t)FLAGS_http_body_compress_threshold) {
             TRACEPRINTF("Compressing request=%lu", (unsigned long)request_size);
             butil::IOBuf compressed;
-            if (GzipCompress(cntl->request_attachment(), &compressed, NULL)) {
+            if (CompressBody(cntl->request_compress_type(),
+                             cntl->request_attachment(), &compressed)) {
                 cntl->request_attachment().swap(compressed);
                 if (is_grpc) {
                     grpc_compressed = true;
-                    hreq.SetHeader(common->GRPC_ENCODING, common->GZIP);
+                    hreq.SetHeader(common->GRPC_ENCODING, *encoding);
                 } else {
-                    hreq.SetHeader(common->CONTENT_ENCODING, common->GZIP);
+                    hreq.SetHeader(common->CONTENT_ENCODING, *encoding);
                 }
             } else {
-                cntl->SetFailed("Fail to gzip the request body, skip compressing");
+                cntl->SetFailed("Fail to " + *encoding +
+                                " the request body, skip compressing");
             }
         }
     }
@@ -726,6 +802,13 @@ void SerializeHttpRequest(butil::IOBuf* /*not used*/,
         hreq.SetHeader("x-bd-parent-span-id", butil::string_printf(
                            "%llu", (unsigned long long)span->parent_span_id()));
     }
+
+    if (!is_http2 && cntl->connection_type() == CONNECTION_TYPE_SINGLE &&
+        (!CanBePipelined(hreq.method()) ||
+         cntl->is_response_read_progressively())) {
+        // Send the request over a pooled connection to the same server.
+        cntl->set_connection_type(CONNECTION_TYPE_POOLED);
+    }
 }
 
 void PackHttpRequest(butil::IOBuf* buf,
@@ -735,10 +818,17 @@ void PackHttpRequest(butil::IOBuf* buf,
                      Controller* cntl,
                      const butil::IOBuf& /*unused*/,
                      const Authenticator* auth) {
-    if (cntl->connection_type() == CONNECTION_TYPE_SINGLE) {
-        return cntl->SetFailed(EREQUEST, "http can't work with CONNECTION_TYPE_SINGLE");
-    }
     ControllerPrivateAccessor accessor(cntl);
+    if (cntl->connection_type() == CONNECTION_TYPE_SINGLE && auth == NULL &&
+        accessor.get_sending_socket()->PipelinedInfoCount() >=
+        (size_t)FLAGS_http_max_pipelined_requests) {
+        // The pipeline is full. Requests packed concurrently may still
+        // exceed the limit slightly, which is harmless.
+        const int rc = accessor.switch_to_pooled_socket();
+        if (rc != 0) {
+            return cntl->SetFailed(rc, "Fail to get pooled connection");
+        }
+    }
     HttpHeader* header = &cntl->http_request();
     if (auth != NULL && header->GetHeader(common->AUTHORIZATION) == NULL) {
         std::string auth_data;
@@ -748,9 +838,16 @@ void PackHttpRequest(butil::IOBuf* buf,
         header->SetHeader(common->AUTHORIZATION, auth_data);
     }
 
-    // Store `correlation_id' into Socket since http server
-    // may not echo back this field. But we send it anyway.
-    accessor.get_sending_socket()->set_correlation_id(correlation_id);
+    if (cntl->connection_type() == CONNECTION_TYPE_SINGLE) {
+        // Requests are pipelined. Responses come back in the same order and
+        // are matched with PipelinedInfo pushed by Socket::Write().
+        accessor.set_pipelined_count(1);
+    } else {
+        // Store `correlation_id' into Socket since http server
+        // may not echo back this field. But we send it anyway.
+        accessor.set_pipelined_count(0);
+        accessor.get_sending_socket()->set_correlation_id(correlation_id);
+    }
 
     // Store http request method into Socket since http response parser needs it,
     // and skips response body if request method is HEAD.
@@ -763,10 +860,10 @@ void PackHttpRequest(butil::IOBuf* buf,
     }
 }
 
-inline bool SupportGzip(Controller* cntl) {
+inline bool SupportEncoding(Controller* cntl, const std::string& encoding) {
     const std::string* encodings =
         cntl->http_request().GetHeader(common->ACCEPT_ENCODING);
-    return (encodings && encodings->find(common->GZIP) != std::string::npos);
+    return (encodings && encodings->find(encoding) != std::string::npos);
 }
 
 class HttpResponseSender {
@@ -889,7 +986,7 @@ HttpResponseSender::~HttpResponseSender() {
         } else if (content_type == HTTP_CONTENT_PROTO_JSON) {
             ProtoMessageToProtoJson(*res, &wrapper, cntl, ERESPONSE);
         } else {
-            ProtoMessageToJson(*res, &wrapper, cntl, ERESPONSE);
+            ProtoMessageToJson(*res, &cntl->response_attachment(), cntl, ERESPONSE);
         }
     }
 
@@ -930,6 +1027,8 @@ HttpResponseSender::~HttpResponseSender() {
     }
     
     bool grpc_compressed = false;
+    const std::string* encoding =
+        CompressTypeToEncoding(cntl->response_compress_type(), is_grpc);
     if (cntl->Failed()) {
         if (!cntl->does_manage_http_body_on_error()) {
             cntl->response_attachment().clear();
@@ -964,22 +1063,26 @@ HttpResponseSender::~HttpResponseSender() {
                 " ignored when CreateProgressiveAttachment() was called";
         }
         // not set_content to enable chunked mode.
-    } else if (cntl->response_compress_type() == COMPRESS_TYPE_GZIP) {
+    } else if (encoding != NULL) {
+        const CompressType type = cntl->response_compress_type();
         const size_t response_size = cntl->response_attachment().size();
+        // h2 clients are assumed to accept gzip, as gRPC clients do.
         if (response_size >= (size_t)FLAGS_http_body_compress_threshold
-            && (is_http2 || SupportGzip(cntl))) {
+            && ((is_http2 && type == COMPRESS_TYPE_GZIP) ||
+                SupportEncoding(cntl, *encoding))) {
             TRACEPRINTF("Compressing response=%lu", (unsigned long)response_size);
             butil::IOBuf tmpbuf;
-            if (GzipCompress(cntl->response_attachment(), &tmpbuf, NULL)) {
+            if (CompressBody(type, cntl->response_attachment(), &tmpbuf)) {
                 cntl->response_attachment().swap(tmpbuf);
                 if (is_grpc) {
                     grpc_compressed = true;
-                    res_header->SetHeader(common->GRPC_ENCODING, common->GZIP);
+                    res_header->SetHeader(common->GRPC_ENCODING, *encoding);
                 } else {
-                    res_header->SetHeader(common->CONTENT_ENCODING, common->GZIP);
+                    res_header->SetHeader(common->CONTENT_ENCODING, *encoding);
                 }
             } else {
-                LOG(ERROR) << "Fail to gzip the http response, skip compression.";
+                LOG(ERROR) << "Fail to " << *encoding << " the http response,"
+                    " skip compression.";
             }
         }
     } else {
@@ -1001,13 +1104,17 @@ HttpResponseSender::~HttpResponseSender() {
         wopt.id_wait = response_id;
         wopt.notify_on_success = true;
     }
+    // The h2 stream is left open after headers for the progressive
+    // attachment, e.g. server-streaming of gRPC.
+    const bool h2_body_follows =
+        (is_http2 && !cntl->Failed() && cntl->has_progressive_writer());
     if (is_http2) {
-        if (is_grpc) {
+        if (is_grpc && !h2_body_follows) {
             // Append compressed and length before body
             AddGrpcPrefix(&cntl->response_attachment(), grpc_compressed);
         }
         SocketMessagePtr<H2UnsentResponse> h2_response(
-                H2UnsentResponse::New(cntl, _h2_stream_id, is_grpc));
+            H2UnsentResponse::New(cntl, _h2_stream_id, is_grpc, h2_body_follows));
         if (h2_response == NULL) {
             LOG(ERROR) << "Fail to make http2 response";
             errno = EINVAL;
@@ -1045,6 +1152,13 @@ HttpResponseSender::~HttpResponseSender() {
         cntl->SetFailed(errcode, "Fail to write into %s", socket->description().c_str());
         return;
     }
+    if (h2_body_follows) {
+        // Data written into the attachment since now are sent as DATA frames
+        // of the stream, see ProgressiveAttachment::MarkRPCAsDone().
+        accessor.progressive_attachment()->_h2_writer =
+            H2StreamWriter::Create(socket, _h2_stream_id, is_grpc,
+                                   GetH2Priority(*req_header));
+    }
 
     if (span) {
         bthread_id_join(response_id);
@@ -1241,6 +1355,14 @@ ParseResult ParseHttpMessage(butil::IOBuf *source, Socket *socket,
         source->pop_front(rc);
         if (http_imsg->Completed()) {
             CHECK_EQ(http_imsg, socket->release_parsing_context());
+            if (http_imsg->parser().type == HTTP_RESPONSE) {
+                // Match the response with the pipelined request in order.
+                // The queue is always empty for non-single connections.
+                PipelinedInfo pi;
+                if (socket->PopPipelinedInfo(&pi)) {
+                    http_imsg->set_pipelined_correlation_id(pi.id_wait.value);
+                }
+            }
             const ParseResult result = MakeMessage(http_imsg);
             http_imsg->CheckProgressiveRead(arg, socket);
             if (socket->is_read_progressive()) {
@@ -1622,7 +1744,10 @@ void ProcessHttpRequest(InputMessageBase *msg) {
         return;
     }
     if (mp->params.allow_http_body_to_pb &&
-        method->input_type()->field_count() > 0) {
+        method->input_type()->field_count() > 0 &&
+        // ^ a pb service
+        !imsg_guard->read_body_progressively()) {
+        // ^ the body is read by the service itself.
         // A protobuf service. No matter if Content-type is set to
         // applcation/json or body is empty, we have to treat body as a json
         // and try to convert it to pb, which guarantees that a protobuf
@@ -1674,6 +1799,18 @@ void ProcessHttpRequest(InputMessageBase *msg) {
                 }
                 req_body.swap(uncompressed);
             }
+#ifdef BRPC_WITH_LZ4
+            else if (encoding != NULL && *encoding == common->LZ4) {
+                TRACEPRINTF("Decompressing request=%lu",
+                            (unsigned long)req_body.size());
+                butil::IOBuf uncompressed;
+                if (!policy::Lz4Decompress(req_body, &uncompressed)) {
+                    cntl->SetFailed(EREQUEST, "Fail to un-lz4 request body");
+                    return;
+                }
+                req_body.swap(uncompressed);
+            }
+#endif
             if (content_type == HTTP_CONTENT_PROTO) {
                 if (!ParsePbFromIOBuf(req, req_body)) {
                     cntl->SetFailed(EREQUEST, "Fail to parse http body as %s",
@@ -1772,15 +1909,19 @@ const std::string& GetHttpMethodName(
     return !path.empty() ? path : common->DEFAULT_PATH;
 }
 
-void HttpContext::CheckProgressiveRead(const void* arg, Socket *socket) {
-    if (arg == NULL || !((Server *)arg)->has_progressive_read_method()) {
-        // arg == NULL indicates not in server-end
-        return;
+bool HttpContext::ShouldReadProgressively(const Server* server) {
+    if (server == NULL || !server->has_progressive_read_method()) {
+        // server == NULL indicates not in server-end
+        return false;
     }
     const Server::MethodProperty *const sp = FindMethodPropertyByURI(
-        header().uri().path(), (Server *)arg,
+        header().uri().path(), server,
         const_cast<std::string *>(&header().unresolved_path()));
-    if (sp != NULL && sp->params.enable_progressive_read) {
+    return sp != NULL && sp->params.enable_progressive_read;
+}
+
+void HttpContext::CheckProgressiveRead(const void* arg, Socket *socket) {
+    if (ShouldReadProgressively(static_cast<const Server*>(arg))) {
         set_read_body_progressively(true);
         socket->read_will_be_progressive(CONNECTION_TYPE_SHORT);
     }
@@ -24,6 +24,8 @@
 #include "brpc/protocol.h"
 
 namespace brpc {
+class Server;
+
 namespace policy {
 
 // Put commonly used std::strings (or other constants that need memory
@@ -46,6 +48,7 @@ struct CommonStrings {
     std::string EXPECT;
     std::string CONTINUE_100;
     std::string GZIP;
+    std::string LZ4;
     std::string CONNECTION;
     std::string KEEP_ALIVE;
     std::string CLOSE;
@@ -91,7 +94,8 @@ public:
                          HttpMethod request_method = HTTP_METHOD_GET)
         : InputMessageBase()
         , HttpMessage(read_body_progressively, request_method)
-        , _is_stage2(false) {
+        , _is_stage2(false)
+        , _pipelined_correlation_id(0) {
         // add one ref for Destroy
         butil::intrusive_ptr<HttpContext>(this).detach();
     }
@@ -120,8 +124,20 @@ public:
 
     void CheckProgressiveRead(const void* arg, Socket *socket);
 
+    // True if the request should be read progressively by the method
+    // it's sent to. `server' is NULL at client-side.
+    bool ShouldReadProgressively(const Server* server);
+
+    // Correlation id of the pipelined request that this response answers,
+    // 0 if the request was not pipelined.
+    uint64_t pipelined_correlation_id() const
+    { return _pipelined_correlation_id; }
+    void set_pipelined_correlation_id(uint64_t id)
+    { _pipelined_correlation_id = id; }
+
 private:
     bool _is_stage2;
+    uint64_t _pipelined_correlation_id;
 };
 
 // Implement functions required in protocol.h
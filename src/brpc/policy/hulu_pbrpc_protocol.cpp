@@ -91,6 +91,9 @@ HuluCompressType CompressType2Hulu(CompressType type) {
     case COMPRESS_TYPE_LZ4:
         LOG(ERROR) << "Hulu doesn't support LZ4";
         return HULU_COMPRESS_TYPE_NONE;
+    case COMPRESS_TYPE_ZSTD:
+        LOG(ERROR) << "Hulu doesn't support zstd";
+        return HULU_COMPRESS_TYPE_NONE;
     default:
         LOG(ERROR) << "Unknown CompressType=" << type;
         return HULU_COMPRESS_TYPE_NONE;
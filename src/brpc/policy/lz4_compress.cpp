@@ -0,0 +1,273 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+
+#ifdef BRPC_WITH_LZ4
+
+#include <lz4frame.h>
+#include "butil/logging.h"
+#include "butil/macros.h"
+#include "butil/thread_local.h"
+#include "brpc/policy/lz4_compress.h"
+#include "brpc/compress.h"
+
+namespace brpc {
+namespace policy {
+
+// Every LZ4F_compressUpdate() with autoFlush writes a block of at most 64KB,
+// which costs at most 4 bytes of block header plus reserved room for the
+// frame end checked by LZ4F.
+static const size_t LZ4_BLOCK_OVERHEAD = 16;
+static const size_t LZ4_MAX_CHUNK_SIZE = 64 * 1024;
+// Chunks smaller than this are compressed into a buffer on stack and copied,
+// to avoid generating many tiny blocks at the tail of IOBuf blocks.
+static const size_t LZ4_MIN_CHUNK_SIZE = 512;
+
+static void DeleteCCtx(void* arg) {
+    LZ4F_freeCompressionContext(static_cast<LZ4F_cctx*>(arg));
+}
+
+static void DeleteDCtx(void* arg) {
+    LZ4F_freeDecompressionContext(static_cast<LZ4F_dctx*>(arg));
+}
+
+// Contexts hold sizable buffers, reuse them in each thread. Compression
+// never yields so that bthreads can share the contexts safely.
+static LZ4F_cctx* GetThreadLocalCCtx() {
+    static BAIDU_THREAD_LOCAL LZ4F_cctx* tls_cctx = NULL;
+    if (tls_cctx == NULL) {
+        LZ4F_cctx* cctx = NULL;
+        if (LZ4F_isError(LZ4F_createCompressionContext(&cctx, LZ4F_VERSION))) {
+            return NULL;
+        }
+        tls_cctx = cctx;
+        butil::thread_atexit(DeleteCCtx, tls_cctx);
+    }
+    return tls_cctx;
+}
+
+static LZ4F_dctx* GetThreadLocalDCtx() {
+    static BAIDU_THREAD_LOCAL LZ4F_dctx* tls_dctx = NULL;
+    if (tls_dctx == NULL) {
+        LZ4F_dctx* dctx = NULL;
+        if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) {
+            return NULL;
+        }
+        tls_dctx = dctx;
+        butil::thread_atexit(DeleteDCtx, tls_dctx);
+    }
+    return tls_dctx;
+}
+
+// Append `data' to `stream'.
+static bool CopyToStream(butil::IOBufAsZeroCopyOutputStream* stream,
+                         const char* data, size_t len) {
+    while (len > 0) {
+        void* block = NULL;
+        int size = 0;
+        if (!stream->Next(&block, &size)) {
+            LOG(WARNING) << "Fail to allocate output of lz4";
+            return false;
+        }
+        const size_t n = std::min(len, (size_t)size);
+        memcpy(block, data, n);
+        stream->BackUp(size - n);
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Compress `data' into blocks of `stream' directly. Only small chunks
+// which don't fit in the remaining space of current block are copied.
+static bool CompressChunks(LZ4F_cctx* cctx, const char* data, size_t len,
+                           butil::IOBufAsZeroCopyOutputStream* stream) {
+    // The input is referenced by IOBuf during the compression, LZ4 does not
+    // need to save it as dictionary of the following blocks.
+    LZ4F_compressOptions_t options;
+    memset(&options, 0, sizeof(options));
+    options.stableSrc = 1;
+    while (len > 0) {
+        void* block = NULL;
+        int size = 0;
+        if (!stream->Next(&block, &size)) {
+            LOG(WARNING) << "Fail to allocate output of lz4";
+            return false;
+        }
+        size_t n = 0;
+        size_t rc = 0;
+        if ((size_t)size >= LZ4_MIN_CHUNK_SIZE + LZ4_BLOCK_OVERHEAD) {
+            n = std::min(len, std::min((size_t)size - LZ4_BLOCK_OVERHEAD,
+                                       LZ4_MAX_CHUNK_SIZE));
+            rc = LZ4F_compressUpdate(cctx, block, size, data, n, &options);
+            stream->BackUp(LZ4F_isError(rc) ? size : size - rc);
+        } else {
+            stream->BackUp(size);
+            char buf[LZ4_MIN_CHUNK_SIZE + LZ4_BLOCK_OVERHEAD];
+            n = std::min(len, LZ4_MIN_CHUNK_SIZE);
+            rc = LZ4F_compressUpdate(cctx, buf, sizeof(buf), data, n, &options);
+            if (!LZ4F_isError(rc) && !CopyToStream(stream, buf, rc)) {
+                return false;
+            }
+        }
+        if (LZ4F_isError(rc)) {
+            LOG(WARNING) << "Fail to LZ4F_compressUpdate: "
+                         << LZ4F_getErrorName(rc);
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool Lz4Compress(const butil::IOBuf& in, butil::IOBuf* out) {
+    LZ4F_cctx* cctx = GetThreadLocalCCtx();
+    if (cctx == NULL) {
+        LOG(WARNING) << "Fail to create LZ4F_cctx";
+        return false;
+    }
+    LZ4F_preferences_t prefs;
+    memset(&prefs, 0, sizeof(prefs));
+    prefs.frameInfo.blockSizeID = LZ4F_max64KB;
+    prefs.frameInfo.contentSize = in.size();
+    prefs.autoFlush = 1;
+    butil::IOBufAsZeroCopyOutputStream stream(out);
+    char header[LZ4F_HEADER_SIZE_MAX];
+    size_t rc = LZ4F_compressBegin(cctx, header, sizeof(header), &prefs);
+    if (LZ4F_isError(rc)) {
+        LOG(WARNING) << "Fail to LZ4F_compressBegin: " << LZ4F_getErrorName(rc);
+        return false;
+    }
+    if (!CopyToStream(&stream, header, rc)) {
+        return false;
+    }
+    const size_t nblock = in.backing_block_num();
+    for (size_t i = 0; i < nblock; ++i) {
+        const butil::StringPiece block = in.backing_block(i);
+        if (!CompressChunks(cctx, block.data(), block.size(), &stream)) {
+            return false;
+        }
+    }
+    char end[LZ4_BLOCK_OVERHEAD];
+    rc = LZ4F_compressEnd(cctx, end, sizeof(end), NULL);
+    if (LZ4F_isError(rc)) {
+        LOG(WARNING) << "Fail to LZ4F_compressEnd: " << LZ4F_getErrorName(rc);
+        return false;
+    }
+    return CopyToStream(&stream, end, rc);
+}
+
+bool Lz4Decompress(const butil::IOBuf& in, butil::IOBuf* out) {
+    LZ4F_dctx* dctx = GetThreadLocalDCtx();
+    if (dctx == NULL) {
+        LOG(WARNING) << "Fail to create LZ4F_dctx";
+        return false;
+    }
+    // Discard states left by previous failures.
+    LZ4F_resetDecompressionContext(dctx);
+    butil::IOBufAsZeroCopyOutputStream stream(out);
+    char* output = NULL;
+    size_t output_size = 0;
+    size_t output_pos = 0;
+    // Non-zero until a frame is completely decoded and flushed.
+    size_t rc = 1;
+    const size_t nblock = in.backing_block_num();
+    for (size_t i = 0; i <= nblock; ++i) {
+        const butil::StringPiece block =
+            (i < nblock ? in.backing_block(i) : butil::StringPiece());
+        const char* data = block.data();
+        size_t len = block.size();
+        // Input of the last round is empty, which flushes remaining data
+        // inside dctx.
+        while (i < nblock ? len > 0 : rc != 0) {
+            if (output_pos == output_size) {
+                void* buf = NULL;
+                int size = 0;
+                if (!stream.Next(&buf, &size)) {
+                    LOG(WARNING) << "Fail to allocate output of lz4";
+                    return false;
+                }
+                output = static_cast<char*>(buf);
+                output_size = size;
+                output_pos = 0;
+            }
+            size_t dst_size = output_size - output_pos;
+            size_t src_size = len;
+            rc = LZ4F_decompress(dctx, output + output_pos, &dst_size,
+                                 data, &src_size, NULL);
+            if (LZ4F_isError(rc)) {
+                stream.BackUp(output_size - output_pos);
+                LOG(WARNING) << "Fail to LZ4F_decompress: "
+                             << LZ4F_getErrorName(rc);
+                return false;
+            }
+            output_pos += dst_size;
+            data += src_size;
+            len -= src_size;
+            if (i == nblock && rc != 0 && dst_size == 0) {
+                stream.BackUp(output_size - output_pos);
+                LOG(WARNING) << "Truncated lz4 frame, size=" << in.size();
+                return false;
+            }
+        }
+    }
+    stream.BackUp(output_size - output_pos);
+    return true;
+}
+
+bool Lz4Compress(const google::protobuf::Message& msg, butil::IOBuf* buf) {
+    butil::IOBuf serialized_pb;
+    butil::IOBufAsZeroCopyOutputStream wrapper(&serialized_pb);
+    bool ok;
+    if (msg.GetDescriptor() == Serializer::descriptor()) {
+        ok = ((const Serializer&)msg).SerializeTo(&wrapper);
+    } else {
+        ok = msg.SerializeToZeroCopyStream(&wrapper);
+    }
+    if (!ok) {
+        LOG(WARNING) << "Fail to serialize input pb="
+                     << msg.GetDescriptor()->full_name();
+        return false;
+    }
+    return Lz4Compress(serialized_pb, buf);
+}
+
+bool Lz4Decompress(const butil::IOBuf& data, google::protobuf::Message* msg) {
+    butil::IOBuf binary_pb;
+    if (!Lz4Decompress(data, &binary_pb)) {
+        return false;
+    }
+    bool ok;
+    butil::IOBufAsZeroCopyInputStream stream(binary_pb);
+    if (msg->GetDescriptor() == Deserializer::descriptor()) {
+        ok = ((Deserializer*)msg)->DeserializeFrom(&stream);
+    } else {
+        ok = msg->ParseFromZeroCopyStream(&stream);
+    }
+    if (!ok) {
+        LOG(WARNING) << "Fail to deserialize input message="
+                     << msg->GetDescriptor()->full_name();
+    }
+    return ok;
+}
+
+}  // namespace policy
+} // namespace brpc
+
+#endif  // BRPC_WITH_LZ4
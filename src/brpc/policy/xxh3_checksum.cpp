@@ -0,0 +1,73 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifdef BRPC_WITH_XXHASH
+
+#define XXH_STATIC_LINKING_ONLY  // XXH3_state_t
+#include <xxhash.h>
+#include "brpc/policy/xxh3_checksum.h"
+#include "brpc/details/controller_private_accessor.h"
+#include "brpc/log.h"
+#include "butil/sys_byteorder.h"
+
+namespace brpc {
+namespace policy {
+
+uint64_t Xxh3Value(const butil::IOBuf& buf) {
+    const size_t nblock = buf.backing_block_num();
+    if (nblock <= 1) {
+        const butil::StringPiece data = buf.backing_block(0);
+        return XXH3_64bits(data.data(), data.size());
+    }
+    XXH3_state_t state;
+    XXH3_64bits_reset(&state);
+    for (size_t i = 0; i < nblock; ++i) {
+        const butil::StringPiece data = buf.backing_block(i);
+        XXH3_64bits_update(&state, data.data(), data.size());
+    }
+    return XXH3_64bits_digest(&state);
+}
+
+void Xxh3Compute(const ChecksumIn& in) {
+    const uint64_t value = Xxh3Value(*in.buf);
+    RPC_VLOG << "Xxh3Compute value=" << value;
+    const uint64_t net_value = butil::HostToNet64(value);
+    ControllerPrivateAccessor(in.cntl).set_checksum_value(
+        reinterpret_cast<const char*>(&net_value), sizeof(net_value));
+}
+
+bool Xxh3Verify(const ChecksumIn& in) {
+    const uint64_t value = Xxh3Value(*in.buf);
+    const std::string& val =
+        ControllerPrivateAccessor(const_cast<Controller*>(in.cntl))
+        .checksum_value();
+    if (val.size() != sizeof(uint64_t)) {
+        LOG(WARNING) << "Invalid size of xxh3 checksum=" << val.size();
+        return false;
+    }
+    uint64_t expected;
+    memcpy(&expected, val.data(), sizeof(expected));
+    expected = butil::NetToHost64(expected);
+    RPC_VLOG << "Xxh3Verify value=" << value << " expected=" << expected;
+    return value == expected;
+}
+
+}  // namespace policy
+}  // namespace brpc
+
+#endif  // BRPC_WITH_XXHASH
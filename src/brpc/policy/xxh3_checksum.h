@@ -0,0 +1,45 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifndef BRPC_POLICY_XXH3_CHECKSUM_H
+#define BRPC_POLICY_XXH3_CHECKSUM_H
+
+#ifdef BRPC_WITH_XXHASH
+
+#include "brpc/checksum.h"
+#include "brpc/controller.h"
+#include "butil/iobuf.h"  // butil::IOBuf
+
+namespace brpc {
+namespace policy {
+
+// 64-bit XXH3 of `buf', computed block by block without flattening.
+uint64_t Xxh3Value(const butil::IOBuf& buf);
+
+// Compute checksum
+void Xxh3Compute(const ChecksumIn& in);
+
+// Verify checksum
+bool Xxh3Verify(const ChecksumIn& in);
+
+}  // namespace policy
+}  // namespace brpc
+
+#endif  // BRPC_WITH_XXHASH
+
+#endif  // BRPC_POLICY_XXH3_CHECKSUM_H
@@ -0,0 +1,327 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+
+#ifdef BRPC_WITH_ZSTD
+
+#include <map>
+#include <gflags/gflags.h>
+#include <zstd.h>
+#include "butil/logging.h"
+#include "butil/thread_local.h"
+#include "brpc/policy/zstd_compress.h"
+#include "brpc/reloadable_flags.h"
+#include "brpc/compress.h"
+
+namespace brpc {
+namespace policy {
+
+static bool ValidateZstdCompressionLevel(const char*, int32_t level) {
+    return level >= ZSTD_minCLevel() && level <= ZSTD_maxCLevel();
+}
+DEFINE_int32(zstd_compression_level, ZSTD_CLEVEL_DEFAULT,
+             "Compression level of zstd, negative values are faster and "
+             "larger values compress better. Messages with dictionaries are "
+             "compressed with the level when the dictionary was registered");
+BRPC_VALIDATE_GFLAG(zstd_compression_level, ValidateZstdCompressionLevel);
+
+// Max size of a zstd frame header, see ZSTD_FRAMEHEADERSIZE_MAX
+static const size_t ZSTD_FRAME_HEADER_SIZE_MAX = 18;
+
+// Dictionaries are registered before any RPC and never removed.
+typedef std::map<std::string, ZSTD_CDict*> CDictMap;    // by message type
+typedef std::map<unsigned, ZSTD_DDict*> DDictMap;       // by dictionary id
+static CDictMap* g_cdicts = NULL;
+static DDictMap* g_ddicts = NULL;
+
+// Creating contexts is expensive, reuse them in each thread. Compression
+// never yields so that bthreads can share the contexts safely.
+static void DeleteCCtx(void* arg) {
+    ZSTD_freeCCtx(static_cast<ZSTD_CCtx*>(arg));
+}
+
+static void DeleteDCtx(void* arg) {
+    ZSTD_freeDCtx(static_cast<ZSTD_DCtx*>(arg));
+}
+
+static ZSTD_CCtx* GetThreadLocalCCtx() {
+    static BAIDU_THREAD_LOCAL ZSTD_CCtx* tls_cctx = NULL;
+    if (tls_cctx == NULL) {
+        tls_cctx = ZSTD_createCCtx();
+        if (tls_cctx != NULL) {
+            butil::thread_atexit(DeleteCCtx, tls_cctx);
+        }
+    }
+    return tls_cctx;
+}
+
+static ZSTD_DCtx* GetThreadLocalDCtx() {
+    static BAIDU_THREAD_LOCAL ZSTD_DCtx* tls_dctx = NULL;
+    if (tls_dctx == NULL) {
+        tls_dctx = ZSTD_createDCtx();
+        if (tls_dctx != NULL) {
+            butil::thread_atexit(DeleteDCtx, tls_dctx);
+        }
+    }
+    return tls_dctx;
+}
+
+static const ZSTD_CDict* FindCDict(const std::string& message_type) {
+    if (g_cdicts == NULL || message_type.empty()) {
+        return NULL;
+    }
+    CDictMap::const_iterator it = g_cdicts->find(message_type);
+    return it != g_cdicts->end() ? it->second : NULL;
+}
+
+// Point `output' to the next writable block of `stream'.
+static bool NextOutput(butil::IOBufAsZeroCopyOutputStream* stream,
+                       ZSTD_outBuffer* output) {
+    void* data = NULL;
+    int size = 0;
+    if (!stream->Next(&data, &size)) {
+        LOG(WARNING) << "Fail to allocate output of zstd";
+        return false;
+    }
+    output->dst = data;
+    output->size = size;
+    output->pos = 0;
+    return true;
+}
+
+// Feed blocks of `in' to `cctx' and write compressed data into blocks of
+// `stream' directly, without flattening either side.
+static bool CompressBlocks(ZSTD_CCtx* cctx, const butil::IOBuf& in,
+                           butil::IOBufAsZeroCopyOutputStream* stream,
+                           ZSTD_outBuffer* output) {
+    const size_t nblock = in.backing_block_num();
+    size_t i = 0;
+    do {
+        ZSTD_inBuffer input = { NULL, 0, 0 };
+        if (i < nblock) {
+            const butil::StringPiece block = in.backing_block(i);
+            input.src = block.data();
+            input.size = block.size();
+        }
+        ++i;
+        const ZSTD_EndDirective mode = (i >= nblock ? ZSTD_e_end : ZSTD_e_continue);
+        bool finished = false;
+        do {
+            if (output->pos == output->size && !NextOutput(stream, output)) {
+                return false;
+            }
+            const size_t rc = ZSTD_compressStream2(cctx, output, &input, mode);
+            if (ZSTD_isError(rc)) {
+                LOG(WARNING) << "Fail to ZSTD_compressStream2: "
+                             << ZSTD_getErrorName(rc);
+                return false;
+            }
+            // ZSTD_e_end returns 0 when the frame is completely flushed.
+            finished = (mode == ZSTD_e_end ? rc == 0 : input.pos == input.size);
+        } while (!finished);
+    } while (i < nblock);
+    return true;
+}
+
+static bool DecompressBlocks(ZSTD_DCtx* dctx, const butil::IOBuf& in,
+                             butil::IOBufAsZeroCopyOutputStream* stream,
+                             ZSTD_outBuffer* output) {
+    // Non-zero until a frame is completely decoded and flushed.
+    size_t rc = 1;
+    const size_t nblock = in.backing_block_num();
+    for (size_t i = 0; i < nblock; ++i) {
+        const butil::StringPiece block = in.backing_block(i);
+        ZSTD_inBuffer input = { block.data(), block.size(), 0 };
+        while (input.pos < input.size) {
+            if (output->pos == output->size && !NextOutput(stream, output)) {
+                return false;
+            }
+            rc = ZSTD_decompressStream(dctx, output, &input);
+            if (ZSTD_isError(rc)) {
+                LOG(WARNING) << "Fail to ZSTD_decompressStream: "
+                             << ZSTD_getErrorName(rc);
+                return false;
+            }
+        }
+    }
+    // Flush data buffered inside dctx.
+    while (rc != 0) {
+        if (output->pos == output->size && !NextOutput(stream, output)) {
+            return false;
+        }
+        const size_t last_pos = output->pos;
+        ZSTD_inBuffer input = { NULL, 0, 0 };
+        rc = ZSTD_decompressStream(dctx, output, &input);
+        if (ZSTD_isError(rc)) {
+            LOG(WARNING) << "Fail to ZSTD_decompressStream: "
+                         << ZSTD_getErrorName(rc);
+            return false;
+        }
+        if (rc != 0 && output->pos == last_pos) {
+            LOG(WARNING) << "Truncated zstd frame, size=" << in.size();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ZstdCompress(const butil::IOBuf& in, butil::IOBuf* out,
+                  const std::string& message_type) {
+    ZSTD_CCtx* cctx = GetThreadLocalCCtx();
+    if (cctx == NULL) {
+        LOG(WARNING) << "Fail to create ZSTD_CCtx";
+        return false;
+    }
+    ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+    const ZSTD_CDict* cdict = FindCDict(message_type);
+    size_t rc = 0;
+    if (cdict != NULL) {
+        rc = ZSTD_CCtx_refCDict(cctx, cdict);
+    } else {
+        rc = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel,
+                                    FLAGS_zstd_compression_level);
+    }
+    if (!ZSTD_isError(rc)) {
+        // Record the content size in frame header.
+        rc = ZSTD_CCtx_setPledgedSrcSize(cctx, in.size());
+    }
+    if (ZSTD_isError(rc)) {
+        LOG(WARNING) << "Fail to set parameters of ZSTD_CCtx: "
+                     << ZSTD_getErrorName(rc);
+        return false;
+    }
+    butil::IOBufAsZeroCopyOutputStream stream(out);
+    ZSTD_outBuffer output = { NULL, 0, 0 };
+    const bool ok = CompressBlocks(cctx, in, &stream, &output);
+    stream.BackUp(output.size - output.pos);
+    return ok;
+}
+
+bool ZstdDecompress(const butil::IOBuf& in, butil::IOBuf* out) {
+    ZSTD_DCtx* dctx = GetThreadLocalDCtx();
+    if (dctx == NULL) {
+        LOG(WARNING) << "Fail to create ZSTD_DCtx";
+        return false;
+    }
+    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_and_parameters);
+    if (g_ddicts != NULL) {
+        char header[ZSTD_FRAME_HEADER_SIZE_MAX];
+        const size_t n = in.copy_to(header, sizeof(header));
+        const unsigned dict_id = ZSTD_getDictID_fromFrame(header, n);
+        if (dict_id != 0) {
+            DDictMap::const_iterator it = g_ddicts->find(dict_id);
+            if (it == g_ddicts->end()) {
+                LOG(WARNING) << "Unknown zstd dictionary id=" << dict_id;
+                return false;
+            }
+            const size_t rc = ZSTD_DCtx_refDDict(dctx, it->second);
+            if (ZSTD_isError(rc)) {
+                LOG(WARNING) << "Fail to ZSTD_DCtx_refDDict: "
+                             << ZSTD_getErrorName(rc);
+                return false;
+            }
+        }
+    }
+    butil::IOBufAsZeroCopyOutputStream stream(out);
+    ZSTD_outBuffer output = { NULL, 0, 0 };
+    const bool ok = DecompressBlocks(dctx, in, &stream, &output);
+    stream.BackUp(output.size - output.pos);
+    return ok;
+}
+
+bool ZstdCompress(const google::protobuf::Message& msg, butil::IOBuf* buf) {
+    butil::IOBuf serialized_pb;
+    butil::IOBufAsZeroCopyOutputStream wrapper(&serialized_pb);
+    bool ok;
+    if (msg.GetDescriptor() == Serializer::descriptor()) {
+        ok = ((const Serializer&)msg).SerializeTo(&wrapper);
+    } else {
+        ok = msg.SerializeToZeroCopyStream(&wrapper);
+    }
+    if (!ok) {
+        LOG(WARNING) << "Fail to serialize input pb="
+                     << msg.GetDescriptor()->full_name();
+        return false;
+    }
+    return ZstdCompress(serialized_pb, buf, msg.GetDescriptor()->full_name());
+}
+
+bool ZstdDecompress(const butil::IOBuf& data, google::protobuf::Message* msg) {
+    butil::IOBuf binary_pb;
+    if (!ZstdDecompress(data, &binary_pb)) {
+        return false;
+    }
+    bool ok;
+    butil::IOBufAsZeroCopyInputStream stream(binary_pb);
+    if (msg->GetDescriptor() == Deserializer::descriptor()) {
+        ok = ((Deserializer*)msg)->DeserializeFrom(&stream);
+    } else {
+        ok = msg->ParseFromZeroCopyStream(&stream);
+    }
+    if (!ok) {
+        LOG(WARNING) << "Fail to deserialize input message="
+                     << msg->GetDescriptor()->full_name();
+    }
+    return ok;
+}
+
+int RegisterZstdDictionary(const std::string& message_type,
+                           const butil::StringPiece& dict) {
+    if (message_type.empty() || dict.empty()) {
+        LOG(ERROR) << "message_type and dict must be non-empty";
+        return -1;
+    }
+    const unsigned dict_id = ZSTD_getDictID_fromDict(dict.data(), dict.size());
+    if (dict_id == 0) {
+        // Raw-content dictionaries have no id, receivers can't find them.
+        LOG(ERROR) << "Dictionary of " << message_type
+                   << " has no id, is it trained by `zstd --train'?";
+        return -1;
+    }
+    if (g_cdicts == NULL) {
+        g_cdicts = new CDictMap;
+        g_ddicts = new DDictMap;
+    }
+    if (g_cdicts->find(message_type) != g_cdicts->end()) {
+        LOG(ERROR) << "Dictionary of " << message_type << " was registered";
+        return -1;
+    }
+    ZSTD_CDict* cdict = ZSTD_createCDict(dict.data(), dict.size(),
+                                         FLAGS_zstd_compression_level);
+    if (cdict == NULL) {
+        LOG(ERROR) << "Fail to create ZSTD_CDict for " << message_type;
+        return -1;
+    }
+    // Message types may share one dictionary.
+    if (g_ddicts->find(dict_id) == g_ddicts->end()) {
+        ZSTD_DDict* ddict = ZSTD_createDDict(dict.data(), dict.size());
+        if (ddict == NULL) {
+            LOG(ERROR) << "Fail to create ZSTD_DDict for " << message_type;
+            ZSTD_freeCDict(cdict);
+            return -1;
+        }
+        (*g_ddicts)[dict_id] = ddict;
+    }
+    (*g_cdicts)[message_type] = cdict;
+    return 0;
+}
+
+}  // namespace policy
+} // namespace brpc
+
+#endif  // BRPC_WITH_ZSTD
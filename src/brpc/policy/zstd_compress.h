@@ -0,0 +1,66 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifndef BRPC_POLICY_ZSTD_COMPRESS_H
+#define BRPC_POLICY_ZSTD_COMPRESS_H
+
+#ifdef BRPC_WITH_ZSTD
+
+#include <string>
+#include <google/protobuf/message.h>          // Message
+#include "butil/iobuf.h"                       // IOBuf
+#include "butil/strings/string_piece.h"
+
+
+namespace brpc {
+namespace policy {
+
+// Compress serialized `msg' into `buf'.
+bool ZstdCompress(const google::protobuf::Message& msg, butil::IOBuf* buf);
+
+// Parse `msg' from decompressed `buf'
+bool ZstdDecompress(const butil::IOBuf& data, google::protobuf::Message* msg);
+
+// Put compressed `in' into `out' with the dictionary registered for
+// `message_type'. No dictionary is used if `message_type' is empty or
+// has no dictionary.
+bool ZstdCompress(const butil::IOBuf& in, butil::IOBuf* out,
+                  const std::string& message_type = std::string());
+
+// Put decompressed `in' into `out'. The dictionary is chosen by the
+// dictionary id recorded in the zstd frame.
+bool ZstdDecompress(const butil::IOBuf& in, butil::IOBuf* out);
+
+// [NOT thread-safe] Compress messages whose type is `message_type' (full
+// name, e.g. "example.EchoRequest") with the pre-trained dictionary `dict',
+// which is generated by `zstd --train' or ZDICT_trainFromBuffer() over
+// sample messages. Small messages are compressed much better with a
+// dictionary since they don't carry enough context themselves.
+// Receivers must register the same dictionary to decompress the messages,
+// they find the dictionary by its id. Dictionaries should be registered
+// before sending or receiving any messages.
+// Returns 0 on success, -1 otherwise.
+int RegisterZstdDictionary(const std::string& message_type,
+                           const butil::StringPiece& dict);
+
+}  // namespace policy
+} // namespace brpc
+
+#endif  // BRPC_WITH_ZSTD
+
+#endif // BRPC_POLICY_ZSTD_COMPRESS_H
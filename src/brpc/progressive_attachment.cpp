@@ -16,11 +16,14 @@
 // under the License.
 
 
+#include <string.h>                    // memcpy
 #include "butil/logging.h"
+#include "butil/sys_byteorder.h"
 #include "bthread/bthread.h"   // INVALID_BTHREAD_ID before bthread r32748
 #include "brpc/progressive_attachment.h"
 #include "brpc/socket.h"
 #include "brpc/errno.pb.h"
+#include "brpc/policy/http2_rpc_protocol.h"   // H2StreamWriter
 
 
 namespace brpc {
@@ -33,11 +36,16 @@ const int ProgressiveAttachment::RPC_SUCCEED = 1;
 const int ProgressiveAttachment::RPC_FAILED = 2;
 
 ProgressiveAttachment::ProgressiveAttachment(SocketUniquePtr& movable_httpsock,
-                                             bool before_http_1_1)
+                                             bool before_http_1_1,
+                                             bool is_h2,
+                                             bool is_grpc)
     : _before_http_1_1(before_http_1_1)
+    , _is_h2(is_h2)
+    , _is_grpc(is_grpc)
     , _pause_from_mark_rpc_as_done(false)
     , _rpc_state(RPC_RUNNING)
-    , _notify_id(INVALID_BTHREAD_ID) {
+    , _notify_id(INVALID_BTHREAD_ID)
+    , _error_code(0) {
     _httpsock.swap(movable_httpsock);
 }
 
@@ -45,7 +53,12 @@ ProgressiveAttachment::~ProgressiveAttachment() {
     if (_httpsock) {
         CHECK(_rpc_state.load(butil::memory_order_relaxed) != RPC_RUNNING);
         CHECK(_saved_buf.empty());
-        if (!_before_http_1_1) {
+        if (_is_h2) {
+            // End the stream after buffered data.
+            if (_h2_writer != NULL) {
+                _h2_writer->Close(_error_code, _error_text);
+            }
+        } else if (!_before_http_1_1) {
             // note: _httpsock may already be failed.
             if (_rpc_state.load(butil::memory_order_relaxed) == RPC_SUCCEED) {
                 butil::IOBuf tmpbuf;
@@ -115,6 +128,51 @@ inline void AppendAsChunk(butil::IOBuf* chunk_buf, const void* data,
     }
 }
 
+// Prefix of a gRPC message: compressed-flag and length.
+inline void AppendGrpcPrefix(butil::IOBuf* buf, size_t size) {
+    char prefix[5];
+    prefix[0] = 0;
+    const uint32_t net_size = butil::HostToNet32(size);
+    memcpy(prefix + 1, &net_size, sizeof(net_size));  // unaligned
+    buf->append(prefix, sizeof(prefix));
+}
+
+void ProgressiveAttachment::AppendData(butil::IOBuf* buf,
+                                       const butil::IOBuf& data) const {
+    if (!_is_h2) {
+        return AppendAsChunk(buf, data, _before_http_1_1);
+    }
+    if (_is_grpc) {
+        AppendGrpcPrefix(buf, data.size());
+    }
+    buf->append(data);
+}
+
+void ProgressiveAttachment::AppendData(butil::IOBuf* buf,
+                                       const void* data, size_t n) const {
+    if (!_is_h2) {
+        return AppendAsChunk(buf, data, n, _before_http_1_1);
+    }
+    if (_is_grpc) {
+        AppendGrpcPrefix(buf, n);
+    }
+    buf->append(data, n);
+}
+
+int ProgressiveAttachment::WriteFramed(butil::IOBuf* buf,
+                                       bool ignore_eovercrowded) {
+    if (!_is_h2) {
+        Socket::WriteOptions wopt;
+        wopt.ignore_eovercrowded = ignore_eovercrowded;
+        return _httpsock->Write(buf, &wopt);
+    }
+    if (_h2_writer == NULL) {
+        errno = ECANCELED;
+        return -1;
+    }
+    return _h2_writer->Write(buf, ignore_eovercrowded);
+}
+
 int ProgressiveAttachment::Write(const butil::IOBuf& data) {
     if (data.empty()) {
         LOG_EVERY_SECOND(WARNING)
@@ -133,7 +191,7 @@ int ProgressiveAttachment::Write(const butil::IOBuf& data) {
                 errno = EOVERCROWDED;
                 return -1;
             }
-            AppendAsChunk(&_saved_buf, data, _before_http_1_1);
+            AppendData(&_saved_buf, data);
             return 0;
         }
     }
@@ -141,8 +199,8 @@ int ProgressiveAttachment::Write(const butil::IOBuf& data) {
     // write into the socket directly.
     if (rpc_state == RPC_SUCCEED) {
         butil::IOBuf tmpbuf;
-        AppendAsChunk(&tmpbuf, data, _before_http_1_1);
-        return _httpsock->Write(&tmpbuf);
+        AppendData(&tmpbuf, data);
+        return WriteFramed(&tmpbuf, false);
     } else {
         errno = ECANCELED;
         return -1;
@@ -166,7 +224,7 @@ int ProgressiveAttachment::Write(const void* data, size_t n) {
                 errno = EOVERCROWDED;
                 return -1;
             }
-            AppendAsChunk(&_saved_buf, data, n, _before_http_1_1);
+            AppendData(&_saved_buf, data, n);
             return 0;
         }
     }
@@ -174,8 +232,8 @@ int ProgressiveAttachment::Write(const void* data, size_t n) {
     // write into the socket directly.
     if (rpc_state == RPC_SUCCEED) {
         butil::IOBuf tmpbuf;
-        AppendAsChunk(&tmpbuf, data, n, _before_http_1_1);
-        return _httpsock->Write(&tmpbuf);
+        AppendData(&tmpbuf, data, n);
+        return WriteFramed(&tmpbuf, false);
     } else {
         errno = ECANCELED;
         return -1;
@@ -216,14 +274,24 @@ void ProgressiveAttachment::MarkRPCAsDone(bool rpc_failed) {
         butil::IOBuf copied;
         copied.swap(_saved_buf);
         mu.unlock();
-        Socket::WriteOptions wopt;
-        wopt.ignore_eovercrowded = true;
-        if (_httpsock->Write(&copied, &wopt) != 0) {
+        if (WriteFramed(&copied, true) != 0) {
             permanent_error = true;
         }
     } while (true);
 }
 
+int ProgressiveAttachment::SetFailed(int error_code,
+                                     const std::string& error_text) {
+    if (!_is_h2) {
+        LOG(ERROR) << "Only h2 can end ProgressiveAttachment as failed";
+        return -1;
+    }
+    BAIDU_SCOPED_LOCK(_mutex);
+    _error_code = error_code;
+    _error_text = error_text;
+    return 0;
+}
+
 butil::EndPoint ProgressiveAttachment::remote_side() const {
     return _httpsock ? _httpsock->remote_side() : butil::EndPoint();
 }
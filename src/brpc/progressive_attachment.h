@@ -28,17 +28,32 @@
 #include "brpc/shared_object.h"   // SharedObject
 
 namespace brpc {
+namespace policy {
+class H2StreamWriter;
+class HttpResponseSender;
+}
 
 class ProgressiveAttachment : public SharedObject {
 friend class Controller;
+friend class policy::HttpResponseSender;
 public:
     // [Thread-safe]
-    // Write `data' as one HTTP chunk to peer ASAP.
+    // Write `data' as one HTTP chunk to peer ASAP. In h2, `data' is sent as
+    // DATA frames of the stream, and as one message if the RPC is gRPC.
     // Returns 0 on success, -1 otherwise and errno is set.
     // Errnos are same as what Socket.Write may set.
     int Write(const butil::IOBuf& data);
     int Write(const void* data, size_t n);
 
+    // [Thread-safe] [h2 only]
+    // End the stream as failed instead of successfully: for gRPC, trailers
+    // carry `error_code' converted to grpc-status and `error_text' as
+    // grpc-message; otherwise the stream is reset. The stream is still
+    // ended after all data written and all ProgressiveAttachment are
+    // destructed.
+    // Returns 0 on success, -1 if the response is not h2.
+    int SetFailed(int error_code, const std::string& error_text);
+
     // Get ip/port of peer/self.
     butil::EndPoint remote_side() const;
     butil::EndPoint local_side() const;
@@ -57,19 +72,33 @@ protected:
     // data has been written (so the client would receive EOF). Otherwise we
     // will encode each piece of data in the format of chunked-encoding.
     ProgressiveAttachment(SocketUniquePtr& movable_httpsock,
-                          bool before_http_1_1);
+                          bool before_http_1_1,
+                          bool is_h2 = false,
+                          bool is_grpc = false);
     ~ProgressiveAttachment();
 
+    void AppendData(butil::IOBuf* buf, const butil::IOBuf& data) const;
+    void AppendData(butil::IOBuf* buf, const void* data, size_t n) const;
+    // Send framed data after the RPC is done.
+    int WriteFramed(butil::IOBuf* buf, bool ignore_eovercrowded);
+
     // Called by controller only.
     void MarkRPCAsDone(bool rpc_failed);
     
     bool _before_http_1_1;
+    bool _is_h2;
+    bool _is_grpc;
     bool _pause_from_mark_rpc_as_done;
     butil::atomic<int> _rpc_state;
     butil::Mutex _mutex;
     SocketUniquePtr _httpsock;
+    // Send data as DATA frames of the h2 stream after the RPC is done.
+    butil::intrusive_ptr<policy::H2StreamWriter> _h2_writer;
     butil::IOBuf _saved_buf;
     bthread_id_t _notify_id;
+    // Set by SetFailed(), protected by _mutex.
+    int _error_code;
+    std::string _error_text;
 
 private:
     static const int RPC_RUNNING;
@@ -0,0 +1,57 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+
+#ifndef BRPC_RESPONSE_CACHE_H
+#define BRPC_RESPONSE_CACHE_H
+
+// To brpc developers: This is a header included by user, don't depend
+// on internal structures, use opaque pointers instead.
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace brpc {
+
+// Cache serialized responses of a read-only method, keyed by bytes of
+// requests. Requests identical to a cached one are answered with the
+// cached response directly, without calling the method or serializing.
+// Only successful responses without attachments, user fields or streams
+// are cached. Only baidu_std supports response cache right now.
+// Enable it by Server::ResponseCacheOf() before the server is started.
+struct ResponseCacheOptions {
+    ResponseCacheOptions()
+        : ttl_ms(0)
+        , max_bytes(64 * 1024 * 1024) {}
+
+    // Cached responses expire after so many milliseconds. 0 disables
+    // the cache.
+    // Default: 0
+    int64_t ttl_ms;
+
+    // Least recently used responses are evicted when cached requests and
+    // responses take more bytes than this value.
+    // Default: 64MB
+    size_t max_bytes;
+
+    bool enabled() const { return ttl_ms > 0 && max_bytes > 0; }
+};
+
+} // namespace brpc
+
+#endif  // BRPC_RESPONSE_CACHE_H
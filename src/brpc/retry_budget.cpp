@@ -0,0 +1,132 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <algorithm>
+#include <pthread.h>
+#include "butil/time.h"
+#include "butil/logging.h"
+#include "bvar/bvar.h"
+#include "brpc/retry_budget.h"
+
+
+namespace brpc {
+
+// Retries rejected by all budgets in this process.
+static bvar::Adder<int64_t>* g_retry_budget_rejected = NULL;
+static pthread_once_t s_create_vars_once = PTHREAD_ONCE_INIT;
+
+static void CreateVars() {
+    g_retry_budget_rejected =
+        new bvar::Adder<int64_t>("rpc_retry_budget_rejected_count");
+}
+
+RetryBudgetOptions::RetryBudgetOptions()
+    : max_retry_ratio(0.1)
+    , min_retries_per_second(10)
+    , window_size(10) {}
+
+struct RetryBudget::Stats {
+    bvar::Adder<int64_t> nretry;
+    bvar::Adder<int64_t> nrejected;
+};
+
+RetryBudget::RetryBudget() {
+    Init();
+}
+
+RetryBudget::RetryBudget(const RetryBudgetOptions& options)
+    : _options(options) {
+    Init();
+}
+
+void RetryBudget::Init() {
+    CHECK_EQ(0, pthread_once(&s_create_vars_once, CreateVars));
+    if (_options.window_size <= 0) {
+        LOG(WARNING) << "Invalid window_size=" << _options.window_size
+                     << ", use 1 instead";
+        _options.window_size = 1;
+    }
+    _buckets = new Bucket[_options.window_size];
+    for (int i = 0; i < _options.window_size; ++i) {
+        _buckets[i].second.store(-1, butil::memory_order_relaxed);
+        _buckets[i].nrequest.store(0, butil::memory_order_relaxed);
+        _buckets[i].nretry.store(0, butil::memory_order_relaxed);
+    }
+    _stats = new Stats;
+}
+
+RetryBudget::~RetryBudget() {
+    delete [] _buckets;
+    _buckets = NULL;
+    delete _stats;
+    _stats = NULL;
+}
+
+int RetryBudget::Expose(const butil::StringPiece& prefix) {
+    if (_stats->nretry.expose_as(prefix, "retry_budget_allowed_count") != 0 ||
+        _stats->nrejected.expose_as(prefix, "retry_budget_rejected_count") != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+RetryBudget::Bucket* RetryBudget::GetBucket(int64_t now_s) {
+    Bucket* b = &_buckets[now_s % _options.window_size];
+    int64_t second = b->second.load(butil::memory_order_acquire);
+    if (second < now_s &&
+        b->second.compare_exchange_strong(second, now_s,
+                                          butil::memory_order_acq_rel)) {
+        // Counts added by other threads between the CAS and resetting are
+        // lost, which is acceptable for an approximate budget.
+        b->nrequest.store(0, butil::memory_order_relaxed);
+        b->nretry.store(0, butil::memory_order_relaxed);
+    }
+    return b;
+}
+
+void RetryBudget::OnRequest() {
+    GetBucket(butil::cpuwide_time_s())->nrequest.fetch_add(
+        1, butil::memory_order_relaxed);
+}
+
+bool RetryBudget::TryRetry() {
+    const int64_t now_s = butil::cpuwide_time_s();
+    int64_t nrequest = 0;
+    int64_t nretry = 0;
+    for (int i = 0; i < _options.window_size; ++i) {
+        const Bucket& b = _buckets[i];
+        const int64_t second = b.second.load(butil::memory_order_acquire);
+        if (second > now_s - _options.window_size && second <= now_s) {
+            nrequest += b.nrequest.load(butil::memory_order_relaxed);
+            nretry += b.nretry.load(butil::memory_order_relaxed);
+        }
+    }
+    const double allowed = std::max(
+        (double)_options.min_retries_per_second * _options.window_size,
+        _options.max_retry_ratio * nrequest);
+    if (nretry >= allowed) {
+        _stats->nrejected << 1;
+        *g_retry_budget_rejected << 1;
+        return false;
+    }
+    GetBucket(now_s)->nretry.fetch_add(1, butil::memory_order_relaxed);
+    _stats->nretry << 1;
+    return true;
+}
+
+} // namespace brpc
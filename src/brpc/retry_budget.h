@@ -0,0 +1,101 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifndef BRPC_RETRY_BUDGET_H
+#define BRPC_RETRY_BUDGET_H
+
+#include <stdint.h>
+#include "butil/atomicops.h"
+#include "butil/macros.h"
+#include "butil/strings/string_piece.h"
+
+
+namespace brpc {
+
+struct RetryBudgetOptions {
+    // Constructed with default options.
+    RetryBudgetOptions();
+
+    // Max ratio of retries(including backup requests) to RPCs within
+    // the window.
+    // Default: 0.1
+    double max_retry_ratio;
+
+    // Retries allowed per second regardless of `max_retry_ratio', so that
+    // channels with low traffic can still retry.
+    // Default: 10
+    int min_retries_per_second;
+
+    // Number of seconds that RPCs and retries are counted.
+    // Default: 10
+    int window_size;
+};
+
+// Limit retries of all RPCs over a channel, which is more robust than
+// limiting retries of each RPC only: during a partial outage, clients
+// retrying every failed RPC multiply the load on the remaining servers and
+// possibly make them fail as well.
+// Retries and backup requests of RPCs are not sent once retries in recent
+// `window_size' seconds exceed max(min_retries_per_second * window_size,
+// max_retry_ratio * RPCs in the window).
+// This object is NOT owned by channel and should remain valid when channel
+// is used. It can be shared by multiple channels to limit retries of them
+// together.
+class RetryBudget {
+public:
+    RetryBudget();
+    explicit RetryBudget(const RetryBudgetOptions& options);
+    ~RetryBudget();
+
+    // Called by channel for each RPC.
+    void OnRequest();
+
+    // Returns true if a retry or backup request is allowed and counts it,
+    // false otherwise.
+    bool TryRetry();
+
+    // Expose numbers of allowed and rejected retries as bvars prefixed
+    // with `prefix'.
+    // Returns 0 on success, -1 otherwise.
+    int Expose(const butil::StringPiece& prefix);
+
+    const RetryBudgetOptions& options() const { return _options; }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(RetryBudget);
+
+    struct Bucket {
+        butil::atomic<int64_t> second;
+        butil::atomic<int64_t> nrequest;
+        butil::atomic<int64_t> nretry;
+    };
+    struct Stats;
+
+    void Init();
+    Bucket* GetBucket(int64_t now_s);
+
+    RetryBudgetOptions _options;
+    // Counters of the last `window_size' seconds, indexed by second.
+    Bucket* _buckets;
+    Stats* _stats;
+};
+
+} // namespace brpc
+
+
+#endif  // BRPC_RETRY_BUDGET_H
@@ -135,6 +135,7 @@ ServerOptions::ServerOptions()
     , server_owns_interceptor(false)
     , num_threads(8)
     , max_concurrency(0)
+    , parallel_serialization_min_size(0)
     , session_local_data_factory(NULL)
     , reserved_session_local_data(0)
     , thread_local_data_factory(NULL)
@@ -181,7 +182,8 @@ Server::MethodProperty::MethodProperty()
     , service(NULL)
     , method(NULL)
     , status(NULL)
-    , ignore_eovercrowded(false) {
+    , ignore_eovercrowded(false)
+    , coalesce_requests(false) {
 }
 
 static timeval GetUptime(void* arg/*start_time*/) {
@@ -428,6 +430,8 @@ Server::Server(ProfilerLinker)
     , _virtual_service_count(0)
     , _failed_to_set_max_concurrency_of_method(false)
     , _failed_to_set_ignore_eovercrowded(false)
+    , _failed_to_set_response_cache(false)
+    , _failed_to_set_coalesce_requests(false)
     , _am(NULL)
     , _internal_am(NULL)
     , _first_service(NULL)
@@ -795,6 +799,8 @@ static bool OptionsAvailableOverRdma(const ServerOptions* opt) {
 
 static AdaptiveMaxConcurrency g_default_max_concurrency_of_method(0);
 static bool g_default_ignore_eovercrowded(false);
+static ResponseCacheOptions g_default_response_cache;
+static bool g_default_coalesce_requests(false);
 
 inline void copy_and_fill_server_options(ServerOptions& dst, const ServerOptions& src) {
 // follow Server::~Server()
@@ -858,6 +864,18 @@ int Server::StartInternal(const butil::EndPoint& endpoint,
             "fix it before starting server";
         return -1;
     }
+    if (_failed_to_set_response_cache) {
+        _failed_to_set_response_cache = false;
+        LOG(ERROR) << "previous call to ResponseCacheOf() was failed, "
+            "fix it before starting server";
+        return -1;
+    }
+    if (_failed_to_set_coalesce_requests) {
+        _failed_to_set_coalesce_requests = false;
+        LOG(ERROR) << "previous call to CoalesceRequestsOf() was failed, "
+            "fix it before starting server";
+        return -1;
+    }
     if (InitializeOnce() != 0) {
         LOG(ERROR) << "Fail to initialize Server[" << version() << ']';
         return -1;
@@ -1102,6 +1120,9 @@ int Server::StartInternal(const butil::EndPoint& endpoint,
         it != _method_map.end(); ++it) {
         if (it->second.is_builtin_service) {
             it->second.status->SetConcurrencyLimiter(NULL);
+            it->second.status->SetAdaptiveCompressor(NULL);
+            it->second.status->SetResponseCache(NULL);
+            it->second.status->SetRequestCoalescer(NULL);
         } else {
             const AdaptiveMaxConcurrency* amc = &it->second.max_concurrency;
             if (amc->type() == AdaptiveMaxConcurrency::UNLIMITED) {
@@ -1114,6 +1135,14 @@ int Server::StartInternal(const butil::EndPoint& endpoint,
             }
             it->second.status->SetConcurrencyLimiter(cl);
             it->second.max_concurrency.SetConcurrencyLimiter(cl);
+            it->second.status->SetAdaptiveCompressor(
+                _options.adaptive_compression.compress_type ==
+                COMPRESS_TYPE_NONE ? NULL : new AdaptiveCompressor);
+            it->second.status->SetResponseCache(
+                it->second.response_cache.enabled() ?
+                new ResponseCache(it->second.response_cache) : NULL);
+            it->second.status->SetRequestCoalescer(
+                it->second.coalesce_requests ? new RequestCoalescer : NULL);
         }
     }
     if (0 != SetServiceMaxConcurrency(_options.nshead_service)) {
@@ -2358,6 +2387,47 @@ bool Server::IgnoreEovercrowdedOf(const butil::StringPiece& full_method_name) co
     return mp->ignore_eovercrowded;
 }
 
+ResponseCacheOptions& Server::ResponseCacheOf(
+    const butil::StringPiece& full_method_name) {
+    MethodProperty* mp = _method_map.seek(full_method_name);
+    if (mp == NULL) {
+        LOG(ERROR) << "Fail to find method=" << full_method_name;
+        _failed_to_set_response_cache = true;
+        return g_default_response_cache;
+    }
+    if (IsRunning()) {
+        LOG(WARNING) << "ResponseCacheOf is only allowed before Server started";
+        return g_default_response_cache;
+    }
+    if (mp->status == NULL) {
+        LOG(ERROR) << "method=" << mp->method->full_name()
+                   << " does not support response cache";
+        _failed_to_set_response_cache = true;
+        return g_default_response_cache;
+    }
+    return mp->response_cache;
+}
+
+bool& Server::CoalesceRequestsOf(const butil::StringPiece& full_method_name) {
+    MethodProperty* mp = _method_map.seek(full_method_name);
+    if (mp == NULL) {
+        LOG(ERROR) << "Fail to find method=" << full_method_name;
+        _failed_to_set_coalesce_requests = true;
+        return g_default_coalesce_requests;
+    }
+    if (IsRunning()) {
+        LOG(WARNING) << "CoalesceRequestsOf is only allowed before Server started";
+        return g_default_coalesce_requests;
+    }
+    if (mp->status == NULL) {
+        LOG(ERROR) << "method=" << mp->method->full_name()
+                   << " does not support coalescing requests";
+        _failed_to_set_coalesce_requests = true;
+        return g_default_coalesce_requests;
+    }
+    return mp->coalesce_requests;
+}
+
 bool Server::AcceptRequest(Controller* cntl) const {
     const Interceptor* interceptor = _options.interceptor;
     if (!interceptor) {
@@ -39,6 +39,8 @@
 #include "brpc/details/profiler_linker.h"
 #include "brpc/health_reporter.h"
 #include "brpc/adaptive_max_concurrency.h"
+#include "brpc/adaptive_compression.h"
+#include "brpc/response_cache.h"
 #include "brpc/http2.h"
 #include "brpc/redis.h"
 #include "brpc/interceptor.h"
@@ -135,6 +137,22 @@ struct ServerOptions {
     // Overridable by Server.MaxConcurrencyOf().
     AdaptiveMaxConcurrency method_max_concurrency;
 
+    // Compress responses of each method only when it pays off, instead of
+    // calling Controller::set_response_compress_type in each service. The
+    // compression ratio and CPU time of each method are shown in /status.
+    // See brpc/adaptive_compression.h for details.
+    // Default: disabled
+    AdaptiveCompressionOptions adaptive_compression;
+
+    // Serialize baidu_std responses not smaller than so many bytes with
+    // elements of top-level repeated message fields split into chunks,
+    // which are serialized by parallel bthreads. Only for responses in
+    // protobuf without compression. Tunable by
+    // -parallel_serialization_max_chunks and
+    // -parallel_serialization_min_chunk_size.
+    // Default: 0 (disabled)
+    size_t parallel_serialization_min_size;
+
     // -------------------------------------------------------
     // Differences between session-local and thread-local data
     // -------------------------------------------------------
@@ -423,6 +441,10 @@ public:
         // while other methods(ignore_eovercrowded=false) keep returning eovercrowded.
         // currently only valid for baidu_master_service, baidu_rpc, http_rpc, hulu_pbrpc and sofa_pbrpc protocols 
         bool ignore_eovercrowded;
+        // Cache of serialized responses, see brpc/response_cache.h
+        ResponseCacheOptions response_cache;
+        // Coalesce identical concurrent requests of the method.
+        bool coalesce_requests;
 
         MethodProperty();
     };
@@ -604,6 +626,21 @@ public:
     bool& IgnoreEovercrowdedOf(const butil::StringPiece& full_method_name);
     bool IgnoreEovercrowdedOf(const butil::StringPiece& full_method_name) const;
 
+    // Cache responses of the read-only method, e.g.
+    //    server.ResponseCacheOf("example.EchoService.Echo").ttl_ms = 1000;
+    // Note: This interface can ONLY be called before the server is started.
+    // See brpc/response_cache.h for details.
+    ResponseCacheOptions& ResponseCacheOf(const butil::StringPiece& full_method_name);
+
+    // Let identical requests (in bytes) of the method arriving while one of
+    // them is being processed share its response instead of being processed
+    // again, e.g. server.CoalesceRequestsOf("example.EchoService.Echo") = true;
+    // Only for read-only methods whose responses only depend on requests.
+    // Only baidu_std requests without attachments, user fields or streams
+    // are coalesced.
+    // Note: This interface can ONLY be called before the server is started.
+    bool& CoalesceRequestsOf(const butil::StringPiece& full_method_name);
+
     int Concurrency() const {
         return butil::subtle::NoBarrier_Load(&_concurrency);
     };
@@ -741,6 +778,8 @@ friend class Controller;
     int _virtual_service_count;
     bool _failed_to_set_max_concurrency_of_method;
     bool _failed_to_set_ignore_eovercrowded;
+    bool _failed_to_set_response_cache;
+    bool _failed_to_set_coalesce_requests;
     Acceptor* _am;
     Acceptor* _internal_am;
 
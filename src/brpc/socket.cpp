@@ -86,6 +86,10 @@ DEFINE_int64(socket_max_unwritten_bytes, 64 * 1024 * 1024,
              "Max unwritten bytes in each socket, if the limit is reached,"
              " Socket.Write fails with EOVERCROWDED");
 
+DEFINE_int32(socket_write_linger_max_size, 4096,
+             "Only writes no larger than this value linger for "
+             "Socket::WriteOptions.linger_us");
+
 DEFINE_int64(socket_max_streams_unconsumed_bytes, 0,
              "Max stream receivers' unconsumed bytes in one socket,"
              " it used in stream for receiver buffer control.");
@@ -303,6 +307,8 @@ bool Socket::CreatedByConnect() const {
 
 SocketMessage* const DUMMY_USER_MESSAGE = (SocketMessage*)0x1;
 const uint32_t MAX_PIPELINED_COUNT = 16384;
+// Stored in the highest 14 bits of the control bits of WriteRequest.
+const uint32_t MAX_WRITE_LINGER_US = 16383;
 
 struct BAIDU_CACHELINE_ALIGNMENT Socket::WriteRequest {
     static WriteRequest* const UNCONNECTED;
@@ -312,8 +318,11 @@ struct BAIDU_CACHELINE_ALIGNMENT Socket::WriteRequest {
     bthread_id_t id_wait;
 
     void clear_and_set_control_bits(bool notify_on_success,
-                                    bool shutdown_write) {
+                                    bool shutdown_write,
+                                    uint32_t linger_us) {
+        linger_us = std::min(linger_us, MAX_WRITE_LINGER_US);
         _socket_and_control_bits.set_extra(
+            (uint16_t)(linger_us << 2) |
             (uint16_t)notify_on_success << 1 | (uint16_t)shutdown_write);
     }
 
@@ -331,6 +340,11 @@ struct BAIDU_CACHELINE_ALIGNMENT Socket::WriteRequest {
         return _socket_and_control_bits.extra() & (uint16_t)1;
     }
 
+    // Microseconds to wait for other writes before writing this one.
+    uint32_t linger_us() const {
+        return _socket_and_control_bits.extra() >> 2;
+    }
+
     Socket* get_socket() const {
         return _socket_and_control_bits.get();
     }
@@ -1100,6 +1114,33 @@ void Socket::FeedbackCircuitBreaker(int error_code, int64_t latency_us) {
     }
 }
 
+int Socket::latency_outlier_times() const {
+    SharedPart* sp = GetSharedPart();
+    if (sp) {
+        return sp->circuit_breaker.latency_outlier_times();
+    }
+    return 0;
+}
+
+int64_t Socket::outlier_ema_latency_us() const {
+    SharedPart* sp = GetSharedPart();
+    if (sp) {
+        return sp->circuit_breaker.outlier_ema_latency_us();
+    }
+    return 0;
+}
+
+int Socket::EjectAsLatencyOutlier() {
+    const int64_t ema_latency_us = outlier_ema_latency_us();
+    GetOrNewSharedPart()->circuit_breaker.MarkAsLatencyOutlier();
+    if (SetFailed(main_socket_id()) != 0) {
+        return -1;
+    }
+    LOG(ERROR) << "Socket[" << *this << "] isolated as latency outlier, ema_latency="
+               << ema_latency_us << "us";
+    return 0;
+}
+
 int Socket::ReleaseReferenceIfIdle(int idle_seconds) {
     const int64_t last_active_us = last_active_time_us();
     if (butil::cpuwide_time_us() - last_active_us <= idle_seconds * 1000000L) {
@@ -1644,12 +1685,17 @@ int Socket::Write(butil::IOBuf* data, const WriteOptions* options_in) {
         return SetError(opt.id_wait, ENOMEM);
     }
 
+    // Only small writes linger, large ones fill the writev by themselves.
+    const uint32_t linger_us =
+        (data->size() <= (size_t)FLAGS_socket_write_linger_max_size ?
+         opt.linger_us : 0);
     req->data.swap(*data);
     // Set `req->next' to UNCONNECTED so that the KeepWrite thread will
     // wait until it points to a valid WriteRequest or NULL.
     req->next = WriteRequest::UNCONNECTED;
     req->id_wait = opt.id_wait;
-    req->clear_and_set_control_bits(opt.notify_on_success, opt.shutdown_write);
+    req->clear_and_set_control_bits(
+        opt.notify_on_success, opt.shutdown_write, linger_us);
     req->set_pipelined_count_and_user_message(
         opt.pipelined_count, DUMMY_USER_MESSAGE, opt.auth_flags);
     return StartWrite(req, opt);
@@ -1686,7 +1732,17 @@ int Socket::Write(SocketMessagePtr<>& msg, const WriteOptions* options_in) {
     // wait until it points to a valid WriteRequest or NULL.
     req->next = WriteRequest::UNCONNECTED;
     req->id_wait = opt.id_wait;
-    req->clear_and_set_control_bits(opt.notify_on_success, opt.shutdown_write);
+    // Messages with unknown size(EstimatedByteSize() returns 0) don't linger.
+    uint32_t linger_us = 0;
+    if (opt.linger_us > 0) {
+        const size_t est_size = msg->EstimatedByteSize();
+        if (est_size > 0 &&
+            est_size <= (size_t)FLAGS_socket_write_linger_max_size) {
+            linger_us = opt.linger_us;
+        }
+    }
+    req->clear_and_set_control_bits(
+        opt.notify_on_success, opt.shutdown_write, linger_us);
     req->set_pipelined_count_and_user_message(
         opt.pipelined_count, msg.release(), opt.auth_flags);
     return StartWrite(req, opt);
@@ -1740,9 +1796,11 @@ int Socket::StartWrite(WriteRequest* req, const WriteOptions& opt) {
     // in some protocols(namely RTMP).
     req->Setup(this);
     
-    if (opt.write_in_background || ssl_state() != SSL_OFF) {
+    if (opt.write_in_background || ssl_state() != SSL_OFF ||
+        req->linger_us() > 0) {
         // Writing into SSL may block the current bthread, always write
-        // in the background.
+        // in the background. Lingering writes wait in KeepWrite thread
+        // for more requests to be batched.
         goto KEEPWRITE_IN_BACKGROUND;
     }
     
@@ -1811,6 +1869,13 @@ void* Socket::KeepWrite(void* void_arg) {
     // returning directly otherwise _write_head is permantly non-NULL which
     // makes later Write() abnormal.
     WriteRequest* cur_tail = NULL;
+    if (req->linger_us() > 0 && req->next == NULL && !req->data.empty()) {
+        // Nothing was written yet. Give concurrent writers a chance to
+        // append their requests so that all of them go out in one writev.
+        g_vars->nlingerwrite << 1;
+        bthread_usleep(req->linger_us());
+        s->IsWriteComplete(req, false, &cur_tail);
+    }
     do {
         // req was written, skip it.
         bool need_shutdown = false;
@@ -1923,6 +1988,7 @@ void* Socket::KeepWrite(void* void_arg) {
 }
 
 ssize_t Socket::DoWrite(WriteRequest* req) {
+    g_vars->nbatchwrite << 1;
     // Group butil::IOBuf in the list into a batch array.
     butil::IOBuf* data_list[DATA_LIST_MAX];
     size_t ndata = 0;
@@ -144,6 +144,9 @@ struct SocketVarsCollector {
         , nkeepwrite_second("rpc_keepwrite_second", &nkeepwrite)
         , nwaitepollout("rpc_waitepollout_count")
         , nwaitepollout_second("rpc_waitepollout_second", &nwaitepollout)
+        , nlingerwrite("rpc_lingerwrite_count")
+        , nlingerwrite_second("rpc_lingerwrite_second", &nlingerwrite)
+        , nbatchwrite("rpc_batchwrite_count")
     {}
 
     bvar::Adder<int64_t> nsocket;
@@ -155,6 +158,11 @@ struct SocketVarsCollector {
     bvar::PerSecond<bvar::Adder<int64_t> > nkeepwrite_second;
     bvar::Adder<int64_t> nwaitepollout;
     bvar::PerSecond<bvar::Adder<int64_t> > nwaitepollout_second;
+    bvar::Adder<int64_t> nlingerwrite;
+    bvar::PerSecond<bvar::Adder<int64_t> > nlingerwrite_second;
+    // Number of writes in KeepWrite, each of which writes all requests
+    // queued (at most 256) with one writev.
+    bvar::Adder<int64_t> nbatchwrite;
 };
 
 struct PipelinedInfo {
@@ -382,6 +390,15 @@ public:
         // Default: false
         bool shutdown_write;
 
+        // If positive and the data (or EstimatedByteSize() of the message)
+        // is small (no larger than -socket_write_linger_max_size), the writer that gets the right to
+        // write does not write immediately but waits for at most so many
+        // microseconds in KeepWrite thread so that small writes issued
+        // concurrently by other threads are sent together in one writev.
+        // Values larger than 16383 are truncated.
+        // Default: 0
+        uint32_t linger_us;
+
         WriteOptions()
             : id_wait(INVALID_BTHREAD_ID)
             , notify_on_success(false)
@@ -390,7 +407,8 @@ public:
             , auth_flags(0)
             , ignore_eovercrowded(false)
             , write_in_background(false)
-            , shutdown_write(false) {}
+            , shutdown_write(false)
+            , linger_us(0) {}
     };
 
     // True if write of socket is shutdown.
@@ -479,6 +497,17 @@ public:
 
     void FeedbackCircuitBreaker(int error_code, int64_t latency_us);
 
+    // Number of times isolated for being much slower than other servers.
+    int latency_outlier_times() const;
+
+    // EMA latency of successful calls fed by FeedbackCircuitBreaker(), 0 when
+    // not enough calls were sampled.
+    int64_t outlier_ema_latency_us() const;
+
+    // Isolate this socket as a latency outlier. Returns 0 on success, -1
+    // if the socket was already failed.
+    int EjectAsLatencyOutlier();
+
     // Notify `id' object (by calling bthread_id_error) when this Socket
     // has been `SetFailed'. If it already has, notify `id' immediately
     void NotifyOnFailed(bthread_id_t id);
@@ -533,6 +562,8 @@ public:
     bool PopPipelinedInfo(PipelinedInfo* info);
     // Undo previous PopPipelinedInfo
     void GivebackPipelinedInfo(const PipelinedInfo&);
+    // Number of PipelinedInfo pushed and not popped yet.
+    size_t PipelinedInfoCount();
 
     void set_preferred_index(int index) { _preferred_index = index; }
     int preferred_index() const { return _preferred_index; }
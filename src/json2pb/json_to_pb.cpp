@@ -316,138 +316,49 @@ bool JsonValueToProtoMessage(const BUTIL_RAPIDJSON_NAMESPACE::Value& json_value,
         })
 
 
-static bool JsonValueToProtoField(const BUTIL_RAPIDJSON_NAMESPACE::Value& value,
-                                  const google::protobuf::FieldDescriptor* field,
-                                  google::protobuf::Message* message,
-                                  const Json2PbOptions& options,
-                                  std::string* err,
-                                  int depth) {
-    if (value.IsNull()) {
-        if (field->is_required()) {
-            J2PERROR(err, "Missing required field: %s", field->full_name().c_str());
-            return false;
-        }
-        return true;
-    }
-        
-    if (field->is_repeated()) {
-        if (!value.IsArray()) {
-            J2PERROR(err, "Invalid value for repeated field: %s",
-                     field->full_name().c_str());
-            return false;
-        }
-    } 
-
+// Set (or add when `repeated' is true) `item' to `field' of `message'.
+// `field' is not a message. Returns false if `item' is invalid for a
+// required or repeated field.
+static bool JsonValueToProtoScalar(const BUTIL_RAPIDJSON_NAMESPACE::Value& item,
+                                   const google::protobuf::FieldDescriptor* field,
+                                   google::protobuf::Message* message,
+                                   bool repeated,
+                                   const Json2PbOptions& options,
+                                   std::string* err) {
     const google::protobuf::Reflection* reflection = message->GetReflection();
     switch (field->cpp_type()) {
 #define CASE_FIELD_TYPE(cpptype, method, jsontype)                      \
         case google::protobuf::FieldDescriptor::CPPTYPE_##cpptype: {                      \
-            if (field->is_repeated()) {                                 \
-                const BUTIL_RAPIDJSON_NAMESPACE::SizeType size = value.Size();          \
-                for (BUTIL_RAPIDJSON_NAMESPACE::SizeType index = 0; index < size; ++index) { \
-                    const BUTIL_RAPIDJSON_NAMESPACE::Value & item = value[index];       \
-                    if (TYPE_MATCH == J2PCHECKTYPE(item, cpptype, jsontype)) { \
-                        reflection->Add##method(message, field, item.Get##jsontype()); \
-                    }                                                   \
+            if (TYPE_MATCH == J2PCHECKTYPE(item, cpptype, jsontype)) {  \
+                if (repeated) {                                         \
+                    reflection->Add##method(message, field, item.Get##jsontype()); \
+                } else {                                                \
+                    reflection->Set##method(message, field, item.Get##jsontype()); \
                 }                                                       \
-            } else if (TYPE_MATCH == J2PCHECKTYPE(value, cpptype, jsontype)) { \
-                reflection->Set##method(message, field, value.Get##jsontype()); \
             }                                                           \
             break;                                                      \
         }                                                               \
-          
+
         CASE_FIELD_TYPE(INT32,  Int32,  Int);
         CASE_FIELD_TYPE(UINT32, UInt32, Uint);
         CASE_FIELD_TYPE(BOOL,   Bool,   Bool);
 #undef CASE_FIELD_TYPE
 
     case google::protobuf::FieldDescriptor::CPPTYPE_INT64:
-        if (field->is_repeated()) {
-            const BUTIL_RAPIDJSON_NAMESPACE::SizeType size = value.Size();
-            for (BUTIL_RAPIDJSON_NAMESPACE::SizeType index = 0; index < size;
-                 ++index) {
-                const BUTIL_RAPIDJSON_NAMESPACE::Value& item = value[index];
-                if (!convert_int64_type(item, true, message, field, reflection,
-                                        err)) {
-                    return false;
-                }
-            }
-        } else if (!convert_int64_type(value, false, message, field, reflection,
-                                       err)) {
-            return false;
-        }
-        break;
+        return convert_int64_type(item, repeated, message, field, reflection, err);
 
     case google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
-        if (field->is_repeated()) {
-            const BUTIL_RAPIDJSON_NAMESPACE::SizeType size = value.Size();
-            for (BUTIL_RAPIDJSON_NAMESPACE::SizeType index = 0; index < size;
-                 ++index) {
-                const BUTIL_RAPIDJSON_NAMESPACE::Value& item = value[index];
-                if (!convert_uint64_type(item, true, message, field, reflection,
-                                         err)) {
-                    return false;
-                }
-            }
-        } else if (!convert_uint64_type(value, false, message, field, reflection,
-                                       err)) {
-            return false;
-        }
-        break;
+        return convert_uint64_type(item, repeated, message, field, reflection, err);
 
     case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
-        if (field->is_repeated()) {
-            const BUTIL_RAPIDJSON_NAMESPACE::SizeType size = value.Size();
-            for (BUTIL_RAPIDJSON_NAMESPACE::SizeType index = 0; index < size; ++index) {
-                const BUTIL_RAPIDJSON_NAMESPACE::Value & item = value[index];
-                if (!convert_float_type(item, true, message, field,
-                                        reflection, err)) {
-                    return false;
-                }
-            }
-        } else if (!convert_float_type(value, false, message, field,
-                                       reflection, err)) {
-            return false;
-        }
-        break;
+        return convert_float_type(item, repeated, message, field, reflection, err);
+
+    case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+        return convert_double_type(item, repeated, message, field, reflection, err);
 
-    case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE: 
-        if (field->is_repeated()) {
-            const BUTIL_RAPIDJSON_NAMESPACE::SizeType size = value.Size();
-            for (BUTIL_RAPIDJSON_NAMESPACE::SizeType index = 0; index < size; ++index) {
-                const BUTIL_RAPIDJSON_NAMESPACE::Value & item = value[index];
-                if (!convert_double_type(item, true, message, field,
-                                         reflection, err)) {
-                    return false;
-                }
-            }
-        } else if (!convert_double_type(value, false, message, field,
-                                        reflection, err)) {
-            return false;
-        }
-        break;
-        
     case google::protobuf::FieldDescriptor::CPPTYPE_STRING:
-        if (field->is_repeated()) {
-            const BUTIL_RAPIDJSON_NAMESPACE::SizeType size = value.Size();
-            for (BUTIL_RAPIDJSON_NAMESPACE::SizeType index = 0; index < size; ++index) {
-                const BUTIL_RAPIDJSON_NAMESPACE::Value & item = value[index];
-                if (TYPE_MATCH == J2PCHECKTYPE(item, string, String)) { 
-                    std::string str(item.GetString(), item.GetStringLength());
-                    if (field->type() == google::protobuf::FieldDescriptor::TYPE_BYTES &&
-                        options.base64_to_bytes) {
-                        std::string str_decoded;
-                        if (!butil::Base64Decode(str, &str_decoded)) {
-                            J2PERROR_WITH_PB(message, err, "Fail to decode base64 string=%s", str.c_str());
-                            return false;
-                        }
-                        str = str_decoded;
-                    }
-                    reflection->AddString(message, field, str);
-                }  
-            }
-        } else if (TYPE_MATCH == J2PCHECKTYPE(value, string, String)) {
-            std::string str(value.GetString(), value.GetStringLength());
+        if (TYPE_MATCH == J2PCHECKTYPE(item, string, String)) {
+            std::string str(item.GetString(), item.GetStringLength());
             if (field->type() == google::protobuf::FieldDescriptor::TYPE_BYTES &&
                 options.base64_to_bytes) {
                 std::string str_decoded;
@@ -457,27 +368,48 @@ static bool JsonValueToProtoField(const BUTIL_RAPIDJSON_NAMESPACE::Value& value,
                 }
                 str = str_decoded;
             }
-            reflection->SetString(message, field, str);
+            if (repeated) {
+                reflection->AddString(message, field, str);
+            } else {
+                reflection->SetString(message, field, str);
+            }
         }
         break;
 
     case google::protobuf::FieldDescriptor::CPPTYPE_ENUM:
-        if (field->is_repeated()) {
-            const BUTIL_RAPIDJSON_NAMESPACE::SizeType size = value.Size();
-            for (BUTIL_RAPIDJSON_NAMESPACE::SizeType index = 0; index < size; ++index) {
-                const BUTIL_RAPIDJSON_NAMESPACE::Value & item = value[index];
-                if (!convert_enum_type(item, true, message, field,
-                                       reflection, err)) {
-                    return false;
-                }
-            }
-        } else if (!convert_enum_type(value, false, message, field,
-                                      reflection, err)) {
+        return convert_enum_type(item, repeated, message, field, reflection, err);
+
+    case google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE:
+        // Handled by callers.
+        break;
+    }
+    return true;
+}
+
+static bool JsonValueToProtoField(const BUTIL_RAPIDJSON_NAMESPACE::Value& value,
+                                  const google::protobuf::FieldDescriptor* field,
+                                  google::protobuf::Message* message,
+                                  const Json2PbOptions& options,
+                                  std::string* err,
+                                  int depth) {
+    if (value.IsNull()) {
+        if (field->is_required()) {
+            J2PERROR(err, "Missing required field: %s", field->full_name().c_str());
             return false;
         }
-        break;
+        return true;
+    }
         
-    case google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE:
+    if (field->is_repeated()) {
+        if (!value.IsArray()) {
+            J2PERROR(err, "Invalid value for repeated field: %s",
+                     field->full_name().c_str());
+            return false;
+        }
+    } 
+
+    const google::protobuf::Reflection* reflection = message->GetReflection();
+    if (field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
         if (field->is_repeated()) {
             const BUTIL_RAPIDJSON_NAMESPACE::SizeType size = value.Size();
             for (BUTIL_RAPIDJSON_NAMESPACE::SizeType index = 0; index < size; ++index) {
@@ -493,9 +425,20 @@ static bool JsonValueToProtoField(const BUTIL_RAPIDJSON_NAMESPACE::Value& value,
             value, reflection->MutableMessage(message, field), options, err, depth + 1)) {
             return false;
         }
-        break;
+        return true;
     }
-    return true;
+
+    if (field->is_repeated()) {
+        const BUTIL_RAPIDJSON_NAMESPACE::SizeType size = value.Size();
+        for (BUTIL_RAPIDJSON_NAMESPACE::SizeType index = 0; index < size; ++index) {
+            if (!JsonValueToProtoScalar(value[index], field, message, true,
+                                        options, err)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return JsonValueToProtoScalar(value, field, message, false, options, err);
 }
 
 bool JsonMapToProtoMap(const BUTIL_RAPIDJSON_NAMESPACE::Value& value,
@@ -626,6 +569,366 @@ bool JsonValueToProtoMessage(const BUTIL_RAPIDJSON_NAMESPACE::Value& json_value,
     return true;
 }
 
+// Handler of rapidjson::Reader to convert json to protobuf in a single pass.
+// Fields are set as soon as their values are parsed instead of after
+// building the DOM of the whole json, thus memory for the DOM is saved and
+// fields are found by names of keys rather than by iterating members of the
+// json objects.
+class JsonToProtoHandler {
+public:
+    JsonToProtoHandler(google::protobuf::Message* message,
+                       const Json2PbOptions& options,
+                       std::string* err)
+        : _root(message), _options(options), _err(err)
+        , _skip_depth(0), _failed(false) {}
+
+    // True if the conversion failed and the error was set.
+    bool failed() const { return _failed; }
+
+    bool Null() { return OnScalar(BUTIL_RAPIDJSON_NAMESPACE::Value()); }
+    bool Bool(bool b) { return OnScalar(BUTIL_RAPIDJSON_NAMESPACE::Value(b)); }
+    bool AddInt(int i) { return OnScalar(BUTIL_RAPIDJSON_NAMESPACE::Value(i)); }
+    bool AddUint(unsigned u) { return OnScalar(BUTIL_RAPIDJSON_NAMESPACE::Value(u)); }
+    bool AddInt64(int64_t i) { return OnScalar(BUTIL_RAPIDJSON_NAMESPACE::Value(i)); }
+    bool AddUint64(uint64_t u) { return OnScalar(BUTIL_RAPIDJSON_NAMESPACE::Value(u)); }
+    bool Double(double d) { return OnScalar(BUTIL_RAPIDJSON_NAMESPACE::Value(d)); }
+    bool String(const char* str, BUTIL_RAPIDJSON_NAMESPACE::SizeType length, bool) {
+        // `str' is referenced rather than copied.
+        return OnScalar(BUTIL_RAPIDJSON_NAMESPACE::Value(str, length));
+    }
+    bool StartObject();
+    bool Key(const char* str, BUTIL_RAPIDJSON_NAMESPACE::SizeType length, bool);
+    bool EndObject(BUTIL_RAPIDJSON_NAMESPACE::SizeType);
+    bool StartArray();
+    bool EndArray(BUTIL_RAPIDJSON_NAMESPACE::SizeType);
+
+private:
+    enum FrameType {
+        FRAME_MESSAGE,  // json object of a message
+        FRAME_MAP,      // json object of a map field, see protobuf_map.h
+        FRAME_ARRAY,    // json array of a repeated field
+    };
+    struct Frame {
+        FrameType type;
+        int depth;
+        // Values are set to `field' of `message'. For FRAME_MESSAGE, `field'
+        // is found by the last key and is NULL if the key is unknown. For
+        // FRAME_MAP, `message' is the entry added by the last key.
+        google::protobuf::Message* message;
+        const google::protobuf::FieldDescriptor* field;
+        // The message containing the map field for FRAME_MAP.
+        google::protobuf::Message* map_owner;
+        const google::protobuf::FieldDescriptor* map_field;
+        // Index of the field following the last found one in FRAME_MESSAGE.
+        int next_field;
+    };
+
+    bool OnScalar(const BUTIL_RAPIDJSON_NAMESPACE::Value& value);
+    bool PushMessage(google::protobuf::Message* message, int depth);
+    void PushFrame(FrameType type, int depth, google::protobuf::Message* message,
+                   const google::protobuf::FieldDescriptor* field);
+    const google::protobuf::FieldDescriptor* FindField(
+        const google::protobuf::Descriptor* descriptor,
+        const char* name, size_t length);
+    // True if the json name of `field', namely the decoded name, is
+    // `name'.
+    bool MatchName(const google::protobuf::FieldDescriptor* field,
+                   const char* name, size_t length);
+    // Fields of `message' which can be set by a json array at the root.
+    int CountFields(const google::protobuf::Message* message,
+                    const google::protobuf::FieldDescriptor** first);
+    bool Fail() {
+        _failed = true;
+        return false;
+    }
+
+    google::protobuf::Message* _root;
+    const Json2PbOptions& _options;
+    std::string* _err;
+    // Values inside unknown fields are skipped, this is the depth of
+    // objects/arrays being skipped.
+    int _skip_depth;
+    bool _failed;
+    std::vector<Frame> _frames;
+    std::string _name;
+    std::string _encoded_name;
+    std::string _decoded_name;
+};
+
+void JsonToProtoHandler::PushFrame(FrameType type, int depth,
+                                   google::protobuf::Message* message,
+                                   const google::protobuf::FieldDescriptor* field) {
+    Frame f;
+    f.type = type;
+    f.depth = depth;
+    f.message = message;
+    f.field = field;
+    f.map_owner = NULL;
+    f.map_field = NULL;
+    f.next_field = 0;
+    _frames.push_back(f);
+}
+
+bool JsonToProtoHandler::PushMessage(google::protobuf::Message* message, int depth) {
+    if (depth > FLAGS_json2pb_max_recursion_depth) {
+        J2PERROR_WITH_PB(message, _err, "Exceeded maximum recursion depth");
+        return Fail();
+    }
+    PushFrame(FRAME_MESSAGE, depth, message, NULL);
+    return true;
+}
+
+const google::protobuf::FieldDescriptor* JsonToProtoHandler::FindField(
+    const google::protobuf::Descriptor* descriptor,
+    const char* name, size_t length) {
+    // Names of fields are encoded in protobuf, see encode_decode.h
+    _name.assign(name, length);
+    const std::string& pb_name =
+        (encode_name(_name, _encoded_name) ? _encoded_name : _name);
+    const google::protobuf::FieldDescriptor* field =
+        descriptor->FindFieldByName(pb_name);
+    if (field != NULL || descriptor->extension_range_count() == 0) {
+        // A name which looks encoded, e.g. "_Z045_", is not encoded again,
+        // but the field is named "-" in json.
+        return (field != NULL && MatchName(field, name, length)) ? field : NULL;
+    }
+    std::vector<const google::protobuf::FieldDescriptor*> ext_fields;
+    descriptor->file()->pool()->FindAllExtensions(descriptor, &ext_fields);
+    for (size_t i = 0; i < ext_fields.size(); ++i) {
+        if (ext_fields[i]->name() == pb_name &&
+            MatchName(ext_fields[i], name, length)) {
+            return ext_fields[i];
+        }
+    }
+    return NULL;
+}
+
+bool JsonToProtoHandler::MatchName(const google::protobuf::FieldDescriptor* field,
+                                   const char* name, size_t length) {
+    const std::string& json_name =
+        (decode_name(field->name(), _decoded_name) ? _decoded_name : field->name());
+    return json_name.size() == length &&
+        memcmp(json_name.data(), name, length) == 0;
+}
+
+int JsonToProtoHandler::CountFields(
+    const google::protobuf::Message* message,
+    const google::protobuf::FieldDescriptor** first) {
+    const google::protobuf::Descriptor* descriptor = message->GetDescriptor();
+    std::vector<const google::protobuf::FieldDescriptor*> fields;
+    if (descriptor->extension_range_count() > 0) {
+        descriptor->file()->pool()->FindAllExtensions(descriptor, &fields);
+    }
+    for (int i = 0; i < descriptor->field_count() && fields.size() < 2; ++i) {
+        fields.push_back(descriptor->field(i));
+    }
+    if (!fields.empty()) {
+        *first = fields.front();
+    }
+    return fields.size();
+}
+
+bool JsonToProtoHandler::OnScalar(const BUTIL_RAPIDJSON_NAMESPACE::Value& value) {
+    if (_skip_depth > 0) {
+        return true;
+    }
+    if (_frames.empty()) {
+        J2PERROR_WITH_PB(_root, _err, "The input is not a json object");
+        return Fail();
+    }
+    const Frame& f = _frames.back();
+    const google::protobuf::FieldDescriptor* field = f.field;
+    if (field == NULL) {
+        // Unknown field.
+        return true;
+    }
+    const bool in_array = (f.type == FRAME_ARRAY);
+    if (!in_array) {
+        if (value.IsNull()) {
+            if (field->is_required()) {
+                J2PERROR(_err, "Missing required field: %s", field->full_name().c_str());
+                return Fail();
+            }
+            return true;
+        }
+        if (field->is_repeated()) {
+            J2PERROR(_err, "Invalid value for repeated field: %s",
+                     field->full_name().c_str());
+            return Fail();
+        }
+    }
+    if (field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+        if (in_array) {
+            value_invalid(field, "message", value, _err);
+        } else {
+            J2PERROR_WITH_PB(f.message->GetReflection()->MutableMessage(f.message, field),
+                             _err, "The input is not a json object");
+        }
+        return Fail();
+    }
+    if (!JsonValueToProtoScalar(value, field, f.message, in_array, _options, _err)) {
+        return Fail();
+    }
+    return true;
+}
+
+bool JsonToProtoHandler::StartObject() {
+    if (_skip_depth > 0) {
+        ++_skip_depth;
+        return true;
+    }
+    if (_frames.empty()) {
+        return PushMessage(_root, 0);
+    }
+    const Frame& f = _frames.back();
+    const google::protobuf::FieldDescriptor* field = f.field;
+    if (field == NULL) {
+        _skip_depth = 1;
+        return true;
+    }
+    const bool in_array = (f.type == FRAME_ARRAY);
+    if (!in_array && field->is_repeated()) {
+        if (f.type == FRAME_MESSAGE && IsProtobufMap(field)) {
+            // Parse json like {"key":value, ...} into protobuf map
+            google::protobuf::Message* owner = f.message;
+            PushFrame(FRAME_MAP, f.depth + 1, NULL, NULL);
+            _frames.back().map_owner = owner;
+            _frames.back().map_field = field;
+            return true;
+        }
+        J2PERROR(_err, "Invalid value for repeated field: %s",
+                 field->full_name().c_str());
+        return Fail();
+    }
+    if (field->cpp_type() != google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+        if (!JsonValueToProtoScalar(
+                BUTIL_RAPIDJSON_NAMESPACE::Value(BUTIL_RAPIDJSON_NAMESPACE::kObjectType),
+                field, f.message, in_array, _options, _err)) {
+            return Fail();
+        }
+        _skip_depth = 1;
+        return true;
+    }
+    const google::protobuf::Reflection* reflection = f.message->GetReflection();
+    return PushMessage(in_array ? reflection->AddMessage(f.message, field)
+                       : reflection->MutableMessage(f.message, field),
+                       f.depth + 1);
+}
+
+bool JsonToProtoHandler::Key(const char* str,
+                             BUTIL_RAPIDJSON_NAMESPACE::SizeType length, bool) {
+    if (_skip_depth > 0) {
+        return true;
+    }
+    Frame& f = _frames.back();
+    if (f.type == FRAME_MAP) {
+        const google::protobuf::Descriptor* entry_desc = f.map_field->message_type();
+        f.message = f.map_owner->GetReflection()->AddMessage(f.map_owner, f.map_field);
+        f.message->GetReflection()->SetString(
+            f.message, entry_desc->FindFieldByName(KEY_NAME), std::string(str, length));
+        f.field = entry_desc->FindFieldByName(VALUE_NAME);
+        return true;
+    }
+    const google::protobuf::Descriptor* descriptor = f.message->GetDescriptor();
+    // Keys are usually in the same order as fields, e.g. printed by
+    // ProtoMessageToJson, try the field following the last one first to
+    // save encoding and hashing of the name.
+    if (f.next_field < descriptor->field_count()) {
+        const google::protobuf::FieldDescriptor* field =
+            descriptor->field(f.next_field);
+        if (MatchName(field, str, length)) {
+            f.field = field;
+            ++f.next_field;
+            return true;
+        }
+    }
+    f.field = FindField(descriptor, str, length);
+    if (f.field != NULL && !f.field->is_extension()) {
+        f.next_field = f.field->index() + 1;
+    }
+    return true;
+}
+
+bool JsonToProtoHandler::EndObject(BUTIL_RAPIDJSON_NAMESPACE::SizeType) {
+    if (_skip_depth > 0) {
+        --_skip_depth;
+        return true;
+    }
+    const Frame& f = _frames.back();
+    if (f.type == FRAME_MESSAGE) {
+        const google::protobuf::Descriptor* descriptor = f.message->GetDescriptor();
+        const google::protobuf::Reflection* reflection = f.message->GetReflection();
+        for (int i = 0; i < descriptor->field_count(); ++i) {
+            const google::protobuf::FieldDescriptor* field = descriptor->field(i);
+            if (field->is_required() && !reflection->HasField(*f.message, field)) {
+                J2PERROR(_err, "Missing required field: %s", field->full_name().c_str());
+                return Fail();
+            }
+        }
+    }
+    _frames.pop_back();
+    return true;
+}
+
+bool JsonToProtoHandler::StartArray() {
+    if (_skip_depth > 0) {
+        ++_skip_depth;
+        return true;
+    }
+    if (_frames.empty()) {
+        const google::protobuf::FieldDescriptor* field = NULL;
+        if (!_options.array_to_single_repeated) {
+            J2PERROR_WITH_PB(_root, _err, "The input is not a json object");
+            return Fail();
+        }
+        if (CountFields(_root, &field) != 1 || !field->is_repeated()) {
+            J2PERROR_WITH_PB(_root, _err, "the input json can't be array here");
+            return Fail();
+        }
+        PushFrame(FRAME_ARRAY, 0, _root, field);
+        return true;
+    }
+    const Frame& f = _frames.back();
+    const google::protobuf::FieldDescriptor* field = f.field;
+    if (field == NULL) {
+        _skip_depth = 1;
+        return true;
+    }
+    const BUTIL_RAPIDJSON_NAMESPACE::Value array(BUTIL_RAPIDJSON_NAMESPACE::kArrayType);
+    if (f.type == FRAME_ARRAY) {
+        // Nested arrays are not allowed.
+        if (field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+            value_invalid(field, "message", array, _err);
+        } else {
+            JsonValueToProtoScalar(array, field, f.message, true, _options, _err);
+        }
+        return Fail();
+    }
+    if (field->is_repeated()) {
+        PushFrame(FRAME_ARRAY, f.depth, f.message, field);
+        return true;
+    }
+    if (field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+        J2PERROR_WITH_PB(f.message->GetReflection()->MutableMessage(f.message, field),
+                         _err, "The input is not a json object");
+        return Fail();
+    }
+    if (!JsonValueToProtoScalar(array, field, f.message, false, _options, _err)) {
+        return Fail();
+    }
+    _skip_depth = 1;
+    return true;
+}
+
+bool JsonToProtoHandler::EndArray(BUTIL_RAPIDJSON_NAMESPACE::SizeType) {
+    if (_skip_depth > 0) {
+        --_skip_depth;
+        return true;
+    }
+    _frames.pop_back();
+    return true;
+}
+
 inline bool JsonToProtoMessageInline(const std::string& json_string, 
                         google::protobuf::Message* message,
                         const Json2PbOptions& options,
@@ -705,6 +1008,43 @@ bool JsonToProtoMessage(ZeroCopyStreamReader* reader,
     return JsonValueToProtoMessage(d, message, options, error, 0);
 }
 
+bool JsonToProtoMessage(const butil::IOBuf& json,
+                        google::protobuf::Message* message,
+                        const Json2PbOptions& options,
+                        std::string* error,
+                        size_t* parsed_offset) {
+    if (error) {
+        error->clear();
+    }
+    butil::IOBufAsZeroCopyInputStream stream(json);
+    ZeroCopyStreamReader reader(&stream);
+    JsonToProtoHandler handler(message, options, error);
+    BUTIL_RAPIDJSON_NAMESPACE::Reader json_reader;
+    if (options.allow_remaining_bytes_after_parsing) {
+        json_reader.Parse<RAPIDJSON_PARSE_FLAG_STOP_WHEN_DONE>(reader, handler);
+        if (parsed_offset != nullptr) {
+            *parsed_offset = json_reader.GetErrorOffset();
+        }
+    } else {
+        json_reader.Parse<RAPIDJSON_PARSE_FLAG_DEFAULT>(reader, handler);
+    }
+    if (handler.failed()) {
+        return false;
+    }
+    if (json_reader.HasParseError()) {
+        if (options.allow_remaining_bytes_after_parsing) {
+            if (json_reader.GetParseErrorCode() == BUTIL_RAPIDJSON_NAMESPACE::kParseErrorDocumentEmpty) {
+                // This is usual when parsing multiple jsons, don't waste time
+                // on setting the `empty error'
+                return false;
+            }
+        }
+        J2PERROR_WITH_PB(message, error, "Invalid json: %s", BUTIL_RAPIDJSON_NAMESPACE::GetParseError_En(json_reader.GetParseErrorCode()));
+        return false;
+    }
+    return true;
+}
+
 bool JsonToProtoMessage(const std::string& json_string, 
                         google::protobuf::Message* message,
                         std::string* error) {
@@ -25,6 +25,10 @@
 #include <google/protobuf/io/zero_copy_stream.h>    // ZeroCopyInputStream
 #include <google/protobuf/util/json_util.h>
 
+namespace butil {
+class IOBuf;
+}
+
 namespace json2pb {
 
 struct Json2PbOptions {
@@ -76,6 +80,19 @@ bool JsonToProtoMessage(ZeroCopyStreamReader* json,
                         std::string* error = nullptr,
                         size_t* parsed_offset = nullptr);
 
+// Use IOBuf as input and convert in a single pass: fields are set while
+// `json' is being parsed rather than after building the DOM of the whole
+// json, which is faster and allocates much less for large messages.
+// Differences from the overloads above:
+// * Errors are reported in the order that fields appear in `json'.
+// * A non-repeated field appearing more than once is set by the last value.
+// * `message' may be partially filled on failure.
+bool JsonToProtoMessage(const butil::IOBuf& json,
+                        google::protobuf::Message* message,
+                        const Json2PbOptions& options,
+                        std::string* error = nullptr,
+                        size_t* parsed_offset = nullptr);
+
 // Using default Json2PbOptions.
 bool JsonToProtoMessage(const std::string& json,
                         google::protobuf::Message* message,
@@ -387,6 +387,41 @@ bool ProtoMessageToJson(const google::protobuf::Message& message,
     return false;
 }
 
+// Output stream of rapidjson writing into butil::IOBufAppender which puts
+// characters into blocks directly, rather than going through the virtual
+// interfaces of ZeroCopyOutputStream for each block.
+class IOBufAppenderStream {
+public:
+    typedef char Ch;
+    explicit IOBufAppenderStream(butil::IOBufAppender* appender)
+        : _appender(appender) {}
+
+    void Put(char c) { _appender->push_back(c); }
+    void PutN(char c, size_t n) {
+        for (; n > 0; --n) {
+            _appender->push_back(c);
+        }
+    }
+    void Puts(const char* str, size_t length) { _appender->append(str, length); }
+    void Flush() {}
+
+private:
+    butil::IOBufAppender* _appender;
+};
+
+bool ProtoMessageToJson(const google::protobuf::Message& message,
+                        butil::IOBuf* json,
+                        const Pb2JsonOptions& options,
+                        std::string* error) {
+    butil::IOBufAppender appender;
+    IOBufAppenderStream stream(&appender);
+    if (!json2pb::ProtoMessageToJsonStream(message, options, stream, error)) {
+        return false;
+    }
+    json->append(butil::IOBuf::Movable(appender.buf()));
+    return true;
+}
+
 bool ProtoMessageToJson(const google::protobuf::Message& message,
                         std::string* json, std::string* error) {
     return ProtoMessageToJson(message, json, Pb2JsonOptions(), error);
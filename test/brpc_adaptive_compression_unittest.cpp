@@ -0,0 +1,278 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <gtest/gtest.h>
+#include <gflags/gflags.h>
+#include "butil/fast_rand.h"
+#include "brpc/server.h"
+#include "brpc/channel.h"
+#include "brpc/controller.h"
+#include "brpc/compress.h"
+#include "brpc/global.h"
+#include "brpc/details/method_status.h"
+#include "brpc/details/adaptive_compressor.h"
+#include "echo.pb.h"
+
+namespace brpc {
+DECLARE_int32(adaptive_compression_window_size);
+DECLARE_int32(adaptive_compression_probe_interval);
+} // namespace brpc
+
+namespace {
+
+const int kWindowSize = 4;
+const int kProbeInterval = 8;
+
+class AdaptiveCompressionTest : public ::testing::Test {
+protected:
+    AdaptiveCompressionTest()
+        : _saved_window_size(brpc::FLAGS_adaptive_compression_window_size)
+        , _saved_probe_interval(brpc::FLAGS_adaptive_compression_probe_interval) {
+        brpc::FLAGS_adaptive_compression_window_size = kWindowSize;
+        brpc::FLAGS_adaptive_compression_probe_interval = kProbeInterval;
+        _options.compress_type = brpc::COMPRESS_TYPE_SNAPPY;
+    }
+    ~AdaptiveCompressionTest() {
+        brpc::FLAGS_adaptive_compression_window_size = _saved_window_size;
+        brpc::FLAGS_adaptive_compression_probe_interval = _saved_probe_interval;
+    }
+
+    void Feed(brpc::AdaptiveCompressor* c, size_t original_size,
+              size_t compressed_size, int64_t cpu_ns) {
+        for (int i = 0; i < kWindowSize; ++i) {
+            c->OnCompressed(original_size, compressed_size, cpu_ns, _options);
+        }
+    }
+
+    int32_t _saved_window_size;
+    int32_t _saved_probe_interval;
+    brpc::AdaptiveCompressionOptions _options;
+};
+
+class EchoServiceImpl : public ::test::EchoService {
+public:
+    void Echo(google::protobuf::RpcController*,
+              const ::test::EchoRequest* req,
+              ::test::EchoResponse* res,
+              google::protobuf::Closure* done) {
+        res->set_message(req->message());
+        done->Run();
+    }
+};
+
+std::string RandomString(size_t size) {
+    std::string s(size, 0);
+    for (size_t i = 0; i < size; ++i) {
+        // Printable to be valid UTF-8, still incompressible by snappy.
+        s[i] = (char)butil::fast_rand_in(33, 126);
+    }
+    return s;
+}
+
+TEST_F(AdaptiveCompressionTest, disabled_by_default) {
+    brpc::AdaptiveCompressor c;
+    brpc::AdaptiveCompressionOptions options;
+    ASSERT_EQ(brpc::COMPRESS_TYPE_NONE, c.Select(1024 * 1024, options));
+}
+
+TEST_F(AdaptiveCompressionTest, skip_small_messages) {
+    brpc::AdaptiveCompressor c;
+    ASSERT_EQ(brpc::COMPRESS_TYPE_NONE, c.Select(_options.min_size - 1, _options));
+    ASSERT_EQ(brpc::COMPRESS_TYPE_SNAPPY, c.Select(_options.min_size, _options));
+}
+
+TEST_F(AdaptiveCompressionTest, turn_off_and_probe) {
+    brpc::AdaptiveCompressor c;
+    ASSERT_TRUE(c.enabled());
+    Feed(&c, 1000, 300, 1000);
+    ASSERT_TRUE(c.enabled());
+    ASSERT_DOUBLE_EQ(0.3, c.ratio());
+    ASSERT_DOUBLE_EQ(1.0, c.cpu_us());
+
+    // Incompressible messages turn compression off.
+    Feed(&c, 1000, 990, 1000);
+    ASSERT_FALSE(c.enabled());
+    int ncompressed = 0;
+    for (int i = 0; i < kProbeInterval * 4; ++i) {
+        if (c.Select(1000, _options) != brpc::COMPRESS_TYPE_NONE) {
+            ++ncompressed;
+        }
+    }
+    ASSERT_EQ(4, ncompressed);
+
+    // Probes showing that messages are compressible again turn it on.
+    Feed(&c, 1000, 300, 1000);
+    ASSERT_TRUE(c.enabled());
+    ASSERT_EQ(brpc::COMPRESS_TYPE_SNAPPY, c.Select(1000, _options));
+}
+
+TEST_F(AdaptiveCompressionTest, min_saved_bytes_per_us) {
+    brpc::AdaptiveCompressor c;
+    _options.min_saved_bytes_per_us = 100;
+    // Saving 700 bytes with 1us is fine.
+    Feed(&c, 1000, 300, 1000);
+    ASSERT_TRUE(c.enabled());
+    // But not with 100us.
+    Feed(&c, 1000, 300, 100000);
+    ASSERT_FALSE(c.enabled());
+}
+
+TEST_F(AdaptiveCompressionTest, client_compressor_per_channel_and_method) {
+    const google::protobuf::MethodDescriptor* echo =
+        ::test::EchoService::descriptor()->FindMethodByName("Echo");
+    const google::protobuf::MethodDescriptor* combo =
+        ::test::EchoService::descriptor()->FindMethodByName("ComboEcho");
+    brpc::ClientAdaptiveCompressors channel1;
+    brpc::ClientAdaptiveCompressors channel2;
+    brpc::AdaptiveCompressor* c1 = channel1.Get(echo);
+    ASSERT_TRUE(c1 != NULL);
+    ASSERT_EQ(c1, channel1.Get(echo));
+    ASSERT_NE(c1, channel1.Get(combo));
+    brpc::AdaptiveCompressor* c2 = channel2.Get(echo);
+    ASSERT_NE(c1, c2);
+    brpc::AdaptiveCompressor* stats = brpc::GetClientCompressionStats(echo);
+    const int64_t ncompressed = stats->_ncompressed.get_value();
+
+    // Incompressible requests over one channel do not turn off compression
+    // of the other one.
+    Feed(c1, 1000, 990, 1000);
+    ASSERT_FALSE(c1->enabled());
+    ASSERT_TRUE(c2->enabled());
+    Feed(c2, 1000, 300, 1000);
+    ASSERT_TRUE(c2->enabled());
+
+    // Statistics of both channels are aggregated per method.
+    ASSERT_EQ(stats, brpc::GetClientCompressionStats(echo));
+    ASSERT_NE(stats, brpc::GetClientCompressionStats(combo));
+    ASSERT_EQ(ncompressed + 2 * kWindowSize, stats->_ncompressed.get_value());
+    ASSERT_EQ(0, c1->_ncompressed.get_value());
+}
+
+TEST_F(AdaptiveCompressionTest, compress_serialized) {
+    // Built-in compressions compress serialized messages without copying
+    // them into a Serializer, and the result is decompressed as usual.
+    brpc::GlobalInitializeOrDie();
+    test::EchoRequest req;
+    req.set_message(std::string(4096, 'a'));
+    butil::IOBuf serialized;
+    {
+        butil::IOBufAsZeroCopyOutputStream stream(&serialized);
+        ASSERT_TRUE(req.SerializeToZeroCopyStream(&stream));
+    }
+    const brpc::CompressType types[] = {
+        brpc::COMPRESS_TYPE_GZIP, brpc::COMPRESS_TYPE_ZLIB,
+        brpc::COMPRESS_TYPE_SNAPPY
+    };
+    for (size_t i = 0; i < arraysize(types); ++i) {
+        const brpc::CompressHandler* handler =
+            brpc::FindCompressHandler(types[i]);
+        ASSERT_TRUE(handler != NULL);
+        ASSERT_TRUE(handler->CompressSerialized != NULL) << handler->name;
+        butil::IOBuf compressed;
+        ASSERT_TRUE(handler->CompressSerialized(serialized, &compressed));
+        ASSERT_LT(compressed.size(), serialized.size()) << handler->name;
+        test::EchoRequest req2;
+        ASSERT_TRUE(brpc::ParseFromCompressedData(compressed, &req2, types[i]))
+            << handler->name;
+        ASSERT_EQ(req.message(), req2.message());
+    }
+}
+
+TEST_F(AdaptiveCompressionTest, baidu_std) {
+    brpc::Server server;
+    EchoServiceImpl service;
+    ASSERT_EQ(0, server.AddService(&service, brpc::SERVER_DOESNT_OWN_SERVICE));
+    brpc::ServerOptions server_options;
+    server_options.adaptive_compression = _options;
+    ASSERT_EQ(0, server.Start(8924, &server_options));
+
+    brpc::Channel channel;
+    brpc::ChannelOptions channel_options;
+    channel_options.adaptive_compression = _options;
+    ASSERT_EQ(0, channel.Init("127.0.0.1:8924", &channel_options));
+    test::EchoService_Stub stub(&channel);
+
+    // Small messages are not compressed.
+    {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message("hello");
+        stub.Echo(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(brpc::COMPRESS_TYPE_NONE, cntl.request_compress_type());
+        ASSERT_EQ(brpc::COMPRESS_TYPE_NONE, cntl.response_compress_type());
+    }
+    // Compressible messages are.
+    const std::string compressible(4096, 'a');
+    {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message(compressible);
+        stub.Echo(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(compressible, res.message());
+        ASSERT_EQ(brpc::COMPRESS_TYPE_SNAPPY, cntl.request_compress_type());
+        ASSERT_EQ(brpc::COMPRESS_TYPE_SNAPPY, cntl.response_compress_type());
+    }
+    // Compress types set by users are kept.
+    {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message(compressible);
+        cntl.set_request_compress_type(brpc::COMPRESS_TYPE_GZIP);
+        stub.Echo(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(brpc::COMPRESS_TYPE_GZIP, cntl.request_compress_type());
+    }
+    // Incompressible messages turn compression off on both sides.
+    bool request_compressed = true;
+    bool response_compressed = true;
+    for (int i = 0; i < kWindowSize * 4 &&
+             (request_compressed || response_compressed); ++i) {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message(RandomString(4096));
+        stub.Echo(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(req.message(), res.message());
+        request_compressed =
+            (cntl.request_compress_type() != brpc::COMPRESS_TYPE_NONE);
+        response_compressed =
+            (cntl.response_compress_type() != brpc::COMPRESS_TYPE_NONE);
+    }
+    ASSERT_FALSE(request_compressed);
+    ASSERT_FALSE(response_compressed);
+
+    brpc::MethodStatus* status = server.FindMethodPropertyByFullName(
+        "test.EchoService.Echo")->status;
+    ASSERT_TRUE(status->compressor() != NULL);
+    ASSERT_FALSE(status->compressor()->enabled());
+    std::ostringstream os;
+    status->Describe(os, brpc::DescribeOptions());
+    ASSERT_NE(std::string::npos, os.str().find("compression: off"))
+        << os.str();
+
+    ASSERT_EQ(0, server.Stop(0));
+    ASSERT_EQ(0, server.Join());
+}
+
+} // namespace
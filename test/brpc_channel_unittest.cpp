@@ -36,6 +36,7 @@
 #include "brpc/policy/most_common_message.h"
 #include "brpc/channel.h"
 #include "brpc/details/load_balancer_with_naming.h"
+#include "brpc/details/channel_concurrency_limiter.h"
 #include "brpc/parallel_channel.h"
 #include "brpc/selective_channel.h"
 #include "brpc/socket_map.h"
@@ -2783,6 +2784,91 @@ TEST_F(ChannelTest, retry_backoff) {
     }
 }
 
+TEST_F(ChannelTest, retry_budget) {
+    brpc::RetryBudgetOptions opt;
+    opt.max_retry_ratio = 0.5;
+    opt.min_retries_per_second = 1;
+    // Long enough that no bucket expires during the test, so the budget is
+    // exactly max(1 * 60, 0.5 * nrequest) wherever the second boundaries are.
+    opt.window_size = 60;
+    brpc::RetryBudget budget(opt);
+    ASSERT_EQ(0, budget.Expose("retry_budget_test"));
+    // min_retries_per_second * window_size retries are always allowed.
+    int nretry = 0;
+    while (budget.TryRetry()) {
+        ++nretry;
+    }
+    ASSERT_EQ(60, nretry);
+    for (int i = 0; i < 200; ++i) {
+        budget.OnRequest();
+    }
+    nretry = 0;
+    while (budget.TryRetry()) {
+        ++nretry;
+    }
+    ASSERT_EQ(100 - 60, nretry);
+
+    // Retries of the channel are rejected when the budget is exhausted.
+    ASSERT_EQ(0, StartAccept(_ep));
+    brpc::RetryBudgetOptions opt2;
+    opt2.max_retry_ratio = 0;
+    opt2.min_retries_per_second = 0;
+    brpc::RetryBudget budget2(opt2);
+    brpc::ChannelOptions chan_opt;
+    chan_opt.retry_budget = &budget2;
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init(_ep, &chan_opt));
+    test::EchoRequest req;
+    test::EchoResponse res;
+    req.set_message(__FUNCTION__);
+    req.set_close_fd(true);
+    brpc::Controller cntl;
+    CallMethod(&channel, &cntl, &req, &res, false);
+    ASSERT_EQ(brpc::EEOF, cntl.ErrorCode()) << cntl.ErrorText();
+    ASSERT_EQ(0, cntl.retried_count());
+    StopAndJoin();
+}
+
+TEST_F(ChannelTest, max_concurrency) {
+    ASSERT_EQ(0, StartAccept(_ep));
+    brpc::ChannelOptions opt;
+    opt.max_concurrency = 1;
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init(_ep, &opt));
+
+    test::EchoRequest req;
+    test::EchoResponse res;
+    req.set_message(__FUNCTION__);
+    req.set_sleep_us(100000);
+    brpc::Controller cntl;
+    const brpc::CallId cid = cntl.call_id();
+    ::test::EchoService::Stub(&channel).Echo(
+        &cntl, &req, &res, brpc::DoNothing());
+
+    // Exceeding RPCs fail immediately without being retried.
+    test::EchoRequest req2;
+    test::EchoResponse res2;
+    req2.set_message(__FUNCTION__);
+    brpc::Controller cntl2;
+    CallMethod(&channel, &cntl2, &req2, &res2, false);
+    ASSERT_EQ(brpc::ELIMIT, cntl2.ErrorCode()) << cntl2.ErrorText();
+    ASSERT_EQ(0, cntl2.retried_count());
+    ASSERT_LT(cntl2.latency_us(), 50000);
+
+    brpc::Join(cid);
+    ASSERT_EQ(0, cntl.ErrorCode()) << cntl.ErrorText();
+    ASSERT_EQ(0, channel._concurrency_limiter->concurrency());
+    cntl2.Reset();
+    CallMethod(&channel, &cntl2, &req2, &res2, true);
+    ASSERT_EQ(0, cntl2.ErrorCode()) << cntl2.ErrorText();
+
+    brpc::ChannelOptions opt2;
+    opt2.max_concurrency = "no_such_limiter";
+    brpc::Channel channel2;
+    ASSERT_EQ(-1, channel2.Init(_ep, &opt2));
+    StopAndJoin();
+}
+
 TEST_F(ChannelTest, backup_request) {
     for (int i = 0; i <= 1; ++i) { // Flag SingleServer
         for (int j = 0; j <= 1; ++j) { // Flag Asynchronous
@@ -2803,6 +2889,70 @@ TEST_F(ChannelTest, backup_request_policy) {
     }
 }
 
+class FakeLatencyBackupRequestPolicy : public brpc::AdaptiveBackupRequestPolicy {
+public:
+    explicit FakeLatencyBackupRequestPolicy(
+        const brpc::AdaptiveBackupRequestOptions& opt)
+        : brpc::AdaptiveBackupRequestPolicy(opt), latency_us(-1) {}
+
+    int64_t GetLatencyPercentile(const brpc::Controller*) const override {
+        return latency_us;
+    }
+
+    int64_t latency_us;
+};
+
+TEST_F(ChannelTest, adaptive_backup_request_policy) {
+    brpc::AdaptiveBackupRequestOptions opt;
+    opt.default_backup_request_ms = 50;
+    opt.min_backup_request_ms = 2;
+    opt.max_backup_request_ms = 30;
+    FakeLatencyBackupRequestPolicy policy(opt);
+    ASSERT_EQ(0, policy.Expose("adaptive_backup_test"));
+
+    brpc::Controller cntl;
+    // Not enough samples, use the default delay.
+    brpc::AdaptiveBackupRequestPolicy bvar_policy(opt);
+    ASSERT_EQ(50, bvar_policy.GetBackupRequestMs(&cntl));
+    ASSERT_EQ(50, policy.GetBackupRequestMs(&cntl));
+
+    // The budget allows a burst of backup requests and is refilled by
+    // finished RPCs.
+    int nbackup = 0;
+    while (policy.DoBackup(&cntl)) {
+        ++nbackup;
+    }
+    ASSERT_EQ(10, nbackup);
+    for (int i = 0; i < 20; ++i) {
+        cntl._begin_time_us = butil::cpuwide_time_us() - 1000;
+        policy.OnRPCEnd(&cntl);
+        cntl._end_time_us = brpc::UNSET_MAGIC_NUM;
+    }
+    ASSERT_TRUE(policy.DoBackup(&cntl));
+    ASSERT_TRUE(policy.DoBackup(&cntl));
+    ASSERT_FALSE(policy.DoBackup(&cntl));
+    // Canceled backup requests give back the tokens.
+    policy.OnBackupRequestCanceled(&cntl);
+    ASSERT_TRUE(policy.DoBackup(&cntl));
+    ASSERT_FALSE(policy.DoBackup(&cntl));
+
+    // Delay is the percentile of latencies rounded up to milliseconds.
+    policy.latency_us = 7200;
+    ASSERT_EQ(8, policy.GetBackupRequestMs(&cntl));
+    policy.latency_us = 20000;
+    ASSERT_EQ(20, policy.GetBackupRequestMs(&cntl));
+
+    // Delay is bounded by min/max_backup_request_ms.
+    policy.latency_us = 100;
+    ASSERT_EQ(2, policy.GetBackupRequestMs(&cntl));
+    policy.latency_us = 100000;
+    ASSERT_EQ(30, policy.GetBackupRequestMs(&cntl));
+
+    // Back to the default delay when samples are not enough.
+    policy.latency_us = -1;
+    ASSERT_EQ(50, policy.GetBackupRequestMs(&cntl));
+}
+
 TEST_F(ChannelTest, multiple_threads_single_channel) {
     srand(time(NULL));
     ASSERT_EQ(0, StartAccept(_ep));
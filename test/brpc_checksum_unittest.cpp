@@ -0,0 +1,181 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <gtest/gtest.h>
+#include <gflags/gflags.h>
+#include "butil/crc32c.h"
+#include "butil/time.h"
+#include "brpc/checksum.h"
+#include "brpc/global.h"
+#include "brpc/controller.h"
+#include "brpc/server.h"
+#include "brpc/channel.h"
+#include "brpc/policy/xxh3_checksum.h"
+#include "brpc/details/controller_private_accessor.h"
+#include "echo.pb.h"
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
+    brpc::GlobalInitializeOrDie();
+    return RUN_ALL_TESTS();
+}
+
+namespace {
+
+class EchoServiceImpl : public ::test::EchoService {
+public:
+    void Echo(google::protobuf::RpcController* cntl_base,
+              const ::test::EchoRequest* req,
+              ::test::EchoResponse* res,
+              google::protobuf::Closure* done) {
+        brpc::Controller* cntl = static_cast<brpc::Controller*>(cntl_base);
+        cntl->set_response_checksum_type(cntl->request_checksum_type());
+        res->set_message(req->message());
+        done->Run();
+    }
+};
+
+// Data spread over IOBuf blocks of default size.
+void MakeData(size_t size, butil::IOBuf* buf) {
+    std::string block(8192, 0);
+    for (size_t i = 0; i < block.size(); ++i) {
+        block[i] = static_cast<char>(i * 2654435761u >> 24);
+    }
+    while (buf->size() < size) {
+        buf->append(block.data(), std::min(block.size(), size - buf->size()));
+    }
+}
+
+void TestChecksum(brpc::ChecksumType type) {
+    for (size_t size : { 0, 1, 100, 8192, 100000 }) {
+        butil::IOBuf buf;
+        MakeData(size, &buf);
+        brpc::Controller cntl;
+        brpc::ChecksumIn in = { &buf, &cntl };
+        brpc::ComputeDataChecksum(in, type);
+        ASSERT_FALSE(brpc::ControllerPrivateAccessor(&cntl)
+                     .checksum_value().empty());
+        ASSERT_TRUE(brpc::VerifyDataChecksum(in, type));
+
+        // Same checksum no matter how data is split into blocks.
+        butil::IOBuf flat;
+        flat.append(buf.to_string());
+        brpc::Controller cntl2;
+        brpc::ChecksumIn in2 = { &flat, &cntl2 };
+        brpc::ComputeDataChecksum(in2, type);
+        ASSERT_EQ(brpc::ControllerPrivateAccessor(&cntl).checksum_value(),
+                  brpc::ControllerPrivateAccessor(&cntl2).checksum_value());
+
+        if (size == 0) {
+            continue;
+        }
+        std::string corrupted = buf.to_string();
+        corrupted[size / 2] ^= 1;
+        butil::IOBuf corrupted_buf;
+        corrupted_buf.append(corrupted);
+        in.buf = &corrupted_buf;
+        ASSERT_FALSE(brpc::VerifyDataChecksum(in, type));
+    }
+}
+
+TEST(ChecksumTest, crc32c) {
+    TestChecksum(brpc::CHECKSUM_TYPE_CRC32C);
+}
+
+#ifdef BRPC_WITH_XXHASH
+TEST(ChecksumTest, xxh3) {
+    ASSERT_STREQ("xxh3", brpc::ChecksumTypeToCStr(brpc::CHECKSUM_TYPE_XXH3));
+    butil::IOBuf buf;
+    buf.append("hello ");
+    buf.append(std::string("world"));
+    ASSERT_EQ(0xd447b1ea40e6988bULL, brpc::policy::Xxh3Value(buf));
+    TestChecksum(brpc::CHECKSUM_TYPE_XXH3);
+}
+
+TEST(ChecksumTest, xxh3_rpc) {
+    brpc::Server server;
+    EchoServiceImpl service;
+    ASSERT_EQ(0, server.AddService(&service, brpc::SERVER_DOESNT_OWN_SERVICE));
+    ASSERT_EQ(0, server.Start(8925, NULL));
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init("127.0.0.1:8925", NULL));
+    test::EchoService_Stub stub(&channel);
+    brpc::Controller cntl;
+    test::EchoRequest req;
+    test::EchoResponse res;
+    req.set_message(std::string(100000, 'a'));
+    cntl.set_request_checksum_type(brpc::CHECKSUM_TYPE_XXH3);
+    stub.Echo(&cntl, &req, &res, NULL);
+    ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    ASSERT_EQ(brpc::CHECKSUM_TYPE_XXH3, cntl.response_checksum_type());
+    ASSERT_EQ(req.message(), res.message());
+    ASSERT_EQ(0, server.Stop(0));
+    ASSERT_EQ(0, server.Join());
+}
+#endif  // BRPC_WITH_XXHASH
+
+void ChecksumThroughput(const char* method_name, brpc::ChecksumType type,
+                        size_t size) {
+    butil::IOBuf buf;
+    MakeData(size, &buf);
+    brpc::Controller cntl;
+    brpc::ChecksumIn in = { &buf, &cntl };
+    const size_t num = std::max<size_t>(1, (64 << 20) / size);
+    butil::Timer timer;
+    timer.start();
+    for (size_t i = 0; i < num; ++i) {
+        brpc::ComputeDataChecksum(in, type);
+    }
+    timer.stop();
+    printf("%20s%20zu%20f%30f\n", method_name, size,
+           timer.n_elapsed() / 1000.0 / num,
+           1000000000.0 / 1024 / 1024 * num * size / timer.n_elapsed());
+}
+
+void FlatCrc32cThroughput(size_t size) {
+    butil::IOBuf buf;
+    MakeData(size, &buf);
+    const std::string data = buf.to_string();
+    const size_t num = std::max<size_t>(1, (64 << 20) / size);
+    uint32_t crc = 0;
+    butil::Timer timer;
+    timer.start();
+    for (size_t i = 0; i < num; ++i) {
+        crc ^= butil::crc32c::Value(data.data(), data.size());
+    }
+    timer.stop();
+    printf("%20s%20zu%20f%30f\n", "crc32c(flat)", size,
+           timer.n_elapsed() / 1000.0 / num,
+           1000000000.0 / 1024 / 1024 * num * size / timer.n_elapsed());
+}
+
+TEST(ChecksumTest, throughput) {
+    printf("%20s%20s%20s%30s\n", "Checksum method", "Size(B)",
+           "Time(us)", "Throughput(MB/s)");
+    for (size_t size = 64; size <= (64 << 20); size *= 4) {
+        ChecksumThroughput("crc32c", brpc::CHECKSUM_TYPE_CRC32C, size);
+        FlatCrc32cThroughput(size);
+#ifdef BRPC_WITH_XXHASH
+        ChecksumThroughput("xxh3", brpc::CHECKSUM_TYPE_XXH3, size);
+#endif
+        printf("\n");
+    }
+}
+
+} // namespace
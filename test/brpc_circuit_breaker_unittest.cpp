@@ -27,6 +27,7 @@
 #include "brpc/circuit_breaker.h"
 #include "brpc/socket.h"
 #include "brpc/server.h"
+#include "brpc/details/latency_outlier_detector.h"
 #include "echo.pb.h"
 
 namespace {
@@ -56,6 +57,9 @@ DECLARE_int32(circuit_breaker_long_window_error_percent);
 DECLARE_int32(circuit_breaker_min_isolation_duration_ms);
 DECLARE_int32(circuit_breaker_max_isolation_duration_ms);
 DECLARE_int32(circuit_breaker_half_open_window_size);
+DECLARE_double(circuit_breaker_latency_outlier_multiple);
+DECLARE_int32(circuit_breaker_latency_outlier_window_size);
+DECLARE_int32(circuit_breaker_max_ejection_percent);
 } // namespace brpc
 
 int main(int argc, char* argv[]) {
@@ -291,3 +295,102 @@ TEST_F(CircuitBreakerTest, maximum_isolation_duration) {
     EXPECT_EQ(_circuit_breaker.isolation_duration_ms(),
               brpc::FLAGS_circuit_breaker_max_isolation_duration_ms);
 }
+
+TEST_F(CircuitBreakerTest, latency_outlier_ejection) {
+    brpc::FLAGS_circuit_breaker_latency_outlier_multiple = 3;
+    const int kServerNum = 10;
+    std::vector<brpc::ServerId> servers;
+    for (int i = 0; i < kServerNum; ++i) {
+        brpc::SocketOptions options;
+        options.remote_side = butil::EndPoint(butil::my_ip(), 9000 + i);
+        brpc::SocketId id;
+        ASSERT_EQ(0, brpc::Socket::Create(options, &id));
+        servers.push_back(brpc::ServerId(id));
+    }
+    brpc::LatencyOutlierDetector detector;
+    detector.AddServers(servers);
+    // Servers without enough samples are never ejected.
+    ASSERT_EQ(0u, detector.Detect());
+
+    // servers[0] and servers[1] are slow but successful.
+    for (int i = 0; i < kServerNum; ++i) {
+        brpc::SocketUniquePtr ptr;
+        ASSERT_EQ(0, brpc::Socket::Address(servers[i].id, &ptr));
+        const int64_t latency = (i == 0 ? 30 : (i == 1 ? 20 : 1)) * kLatency;
+        for (int j = 0; j < brpc::FLAGS_circuit_breaker_latency_outlier_window_size; ++j) {
+            ptr->FeedbackCircuitBreaker(kErrorCodeForSucc, latency);
+        }
+        ASSERT_EQ(latency, ptr->outlier_ema_latency_us());
+    }
+
+    // At most 10% of servers are ejected, the slowest one goes first.
+    ASSERT_EQ(10, brpc::FLAGS_circuit_breaker_max_ejection_percent);
+    ASSERT_EQ(1u, detector.Detect());
+    brpc::SocketUniquePtr ptr;
+    ASSERT_NE(0, brpc::Socket::Address(servers[0].id, &ptr));
+    ASSERT_EQ(0, brpc::Socket::Address(servers[1].id, &ptr));
+    ASSERT_EQ(0, ptr->latency_outlier_times());
+    ASSERT_EQ(0u, detector.Detect());
+
+    brpc::FLAGS_circuit_breaker_max_ejection_percent = 50;
+    ASSERT_EQ(1u, detector.Detect());
+    ASSERT_NE(0, brpc::Socket::Address(servers[1].id, &ptr));
+    for (int i = 2; i < kServerNum; ++i) {
+        ASSERT_EQ(0, brpc::Socket::Address(servers[i].id, &ptr));
+    }
+    ASSERT_EQ(0u, detector.Detect());
+
+    for (int i = 0; i < kServerNum; ++i) {
+        brpc::Socket::SetFailed(servers[i].id);
+    }
+    brpc::FLAGS_circuit_breaker_max_ejection_percent = 10;
+    brpc::FLAGS_circuit_breaker_latency_outlier_multiple = 0;
+}
+
+TEST_F(CircuitBreakerTest, latency_outlier_ejection_in_small_cluster) {
+    brpc::FLAGS_circuit_breaker_latency_outlier_multiple = 3;
+    // 10% of 4 servers rounds down to 0, but one server can still be ejected.
+    const int kServerNum = 4;
+    std::vector<brpc::ServerId> servers;
+    for (int i = 0; i < kServerNum; ++i) {
+        brpc::SocketOptions options;
+        options.remote_side = butil::EndPoint(butil::my_ip(), 9100 + i);
+        brpc::SocketId id;
+        ASSERT_EQ(0, brpc::Socket::Create(options, &id));
+        servers.push_back(brpc::ServerId(id));
+    }
+    brpc::LatencyOutlierDetector detector;
+    detector.AddServers(servers);
+
+    // servers[0] and servers[1] are slow but successful.
+    for (int i = 0; i < kServerNum; ++i) {
+        brpc::SocketUniquePtr ptr;
+        ASSERT_EQ(0, brpc::Socket::Address(servers[i].id, &ptr));
+        const int64_t latency = (i == 0 ? 30 : (i == 1 ? 20 : 1)) * kLatency;
+        for (int j = 0; j < brpc::FLAGS_circuit_breaker_latency_outlier_window_size; ++j) {
+            ptr->FeedbackCircuitBreaker(kErrorCodeForSucc, latency);
+        }
+    }
+
+    ASSERT_EQ(10, brpc::FLAGS_circuit_breaker_max_ejection_percent);
+    ASSERT_EQ(1u, detector.Detect());
+    brpc::SocketUniquePtr ptr;
+    ASSERT_NE(0, brpc::Socket::Address(servers[0].id, &ptr));
+    // The cap is reached, servers[1] stays.
+    ASSERT_EQ(0u, detector.Detect());
+    ASSERT_EQ(0, brpc::Socket::Address(servers[1].id, &ptr));
+
+    // Nothing is ejected when the percentage is 0.
+    brpc::FLAGS_circuit_breaker_max_ejection_percent = 0;
+    brpc::LatencyOutlierDetector detector2;
+    detector2.AddServers(std::vector<brpc::ServerId>(servers.begin() + 1,
+                                                     servers.end()));
+    ASSERT_EQ(0u, detector2.Detect());
+    ASSERT_EQ(0, brpc::Socket::Address(servers[1].id, &ptr));
+
+    for (int i = 0; i < kServerNum; ++i) {
+        brpc::Socket::SetFailed(servers[i].id);
+    }
+    brpc::FLAGS_circuit_breaker_max_ejection_percent = 10;
+    brpc::FLAGS_circuit_breaker_latency_outlier_multiple = 0;
+}
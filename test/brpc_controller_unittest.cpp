@@ -28,6 +28,7 @@
 #include "brpc/server.h"
 #include "brpc/channel.h"
 #include "brpc/controller.h"
+#include "echo.pb.h"
 
 class ControllerTest : public ::testing::Test{
 protected:
@@ -136,3 +137,94 @@ TEST_F(ControllerTest, SessionKV) {
     logging::SetLogSink(oldSink);
 }
 #endif
+
+class ComboEchoServiceImpl : public ::test::EchoService {
+public:
+    void ComboEcho(google::protobuf::RpcController*,
+                   const ::test::ComboRequest* req,
+                   ::test::ComboResponse* res,
+                   google::protobuf::Closure* done) {
+        // Every request is echoed 100 times to make a large response.
+        for (int i = 0; i < req->requests_size(); ++i) {
+            for (int j = 0; j < 100; ++j) {
+                ::test::EchoResponse* sub = res->add_responses();
+                sub->set_message(req->requests(i).message());
+                for (int k = 0; k < 10; ++k) {
+                    sub->add_code_list(k);
+                }
+            }
+        }
+        done->Run();
+    }
+};
+
+TEST_F(ControllerTest, response_arena) {
+    brpc::Server server;
+    ComboEchoServiceImpl service;
+    ASSERT_EQ(0, server.AddService(&service, brpc::SERVER_DOESNT_OWN_SERVICE));
+    ASSERT_EQ(0, server.Start(8926, NULL));
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init("127.0.0.1:8926", NULL));
+    test::EchoService_Stub stub(&channel);
+
+    test::ComboRequest req;
+    for (int i = 0; i < 100; ++i) {
+        req.add_requests()->set_message("hello arena");
+    }
+    google::protobuf::Arena* last_arena = NULL;
+    for (int i = 0; i < 3; ++i) {
+        brpc::Controller cntl;
+        google::protobuf::Arena* arena = cntl.response_arena();
+        ASSERT_TRUE(arena != NULL);
+        ASSERT_EQ(arena, cntl.response_arena());
+        if (last_arena != NULL) {
+            // Reused from the pool.
+            ASSERT_EQ(last_arena, arena);
+        }
+        last_arena = arena;
+        test::ComboResponse* res =
+            google::protobuf::Arena::CreateMessage<test::ComboResponse>(arena);
+        stub.ComboEcho(&cntl, &req, res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(10000, res->responses_size());
+        ASSERT_EQ("hello arena", res->responses(9999).message());
+        ASSERT_EQ(arena, res->responses(0).GetArena());
+        ASSERT_GT(arena->SpaceUsed(), 0u);
+    }
+
+    // Compare parsing of the response on heap and on pooled arenas.
+    butil::IOBuf serialized;
+    {
+        brpc::Controller cntl;
+        test::ComboResponse res;
+        stub.ComboEcho(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        butil::IOBufAsZeroCopyOutputStream wrapper(&serialized);
+        ASSERT_TRUE(res.SerializeToZeroCopyStream(&wrapper));
+    }
+    const int N = 100;
+    butil::Timer timer;
+    timer.start();
+    for (int i = 0; i < N; ++i) {
+        test::ComboResponse res;
+        butil::IOBufAsZeroCopyInputStream wrapper(serialized);
+        ASSERT_TRUE(res.ParseFromZeroCopyStream(&wrapper));
+    }
+    timer.stop();
+    const int64_t heap_us = timer.u_elapsed() / N;
+    timer.start();
+    for (int i = 0; i < N; ++i) {
+        brpc::Controller cntl;
+        test::ComboResponse* res = google::protobuf::Arena::CreateMessage<
+            test::ComboResponse>(cntl.response_arena());
+        butil::IOBufAsZeroCopyInputStream wrapper(serialized);
+        ASSERT_TRUE(res->ParseFromZeroCopyStream(&wrapper));
+    }
+    timer.stop();
+    const int64_t arena_us = timer.u_elapsed() / N;
+    LOG(INFO) << "Parse " << serialized.size() << " bytes with 10000 sub"
+              " messages: heap=" << heap_us << "us arena=" << arena_us << "us";
+
+    ASSERT_EQ(0, server.Stop(0));
+    ASSERT_EQ(0, server.Join());
+}
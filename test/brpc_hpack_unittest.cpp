@@ -22,6 +22,8 @@
 #include <gtest/gtest.h>
 #include "brpc/details/hpack.h"
 #include "butil/logging.h"
+#include "butil/fast_rand.h"
+#include "butil/time.h"
 
 class HPackTest : public testing::Test {
 };
@@ -548,3 +550,89 @@ TEST_F(HPackTest, responses_with_huffman) {
     }
     ASSERT_TRUE(buf.buf().empty());
 }
+
+TEST_F(HPackTest, huffman_random_strings) {
+    brpc::HPacker p1;
+    ASSERT_EQ(0, p1.Init(4096));
+    brpc::HPacker p2;
+    ASSERT_EQ(0, p2.Init(4096));
+    for (int i = 0; i < 10000; ++i) {
+        brpc::HPacker::Header h;
+        h.name = "x-random";
+        const size_t len = butil::fast_rand_less_than(128);
+        for (size_t j = 0; j < len; ++j) {
+            h.value.push_back((char)butil::fast_rand_less_than(256));
+        }
+        brpc::HPackOptions options;
+        options.index_policy = brpc::HPACK_NEVER_INDEX_HEADER;
+        options.encode_name = true;
+        options.encode_value = true;
+        butil::IOBufAppender buf;
+        p1.Encode(&buf, h, options);
+        butil::IOBuf encoded;
+        buf.move_to(encoded);
+        brpc::HPacker::Header h2;
+        ASSERT_GT(p2.Decode(&encoded, &h2), 0);
+        ASSERT_EQ(h.name, h2.name);
+        ASSERT_EQ(h.value, h2.value);
+        ASSERT_TRUE(encoded.empty());
+    }
+}
+
+TEST_F(HPackTest, huffman_perf) {
+    ConstHeader headers[] = {
+        {"user-agent", "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit"
+                       "/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36"},
+        {"accept", "text/html,application/xhtml+xml,application/xml;q=0.9,"
+                   "image/avif,image/webp,*/*;q=0.8"},
+        {"cookie", "session_id=abcdefghijklmnopqrstuvwxyz0123456789; "
+                   "tracking=ABCDEFGHIJKLMNOPQRSTUVWXYZ"},
+        {"x-request-id", "0123456789abcdef0123456789abcdef"},
+    };
+    const size_t loops = 100000;
+    for (int huffman = 0; huffman < 2; ++huffman) {
+        brpc::HPacker p1;
+        ASSERT_EQ(0, p1.Init(4096));
+        brpc::HPacker p2;
+        ASSERT_EQ(0, p2.Init(4096));
+        brpc::HPackOptions options;
+        // Not indexed, otherwise only indexes are sent after the first loop.
+        options.index_policy = brpc::HPACK_NEVER_INDEX_HEADER;
+        options.encode_name = huffman;
+        options.encode_value = huffman;
+        size_t raw_bytes = 0;
+        size_t encoded_bytes = 0;
+        int64_t encode_ns = 0;
+        int64_t decode_ns = 0;
+        for (size_t i = 0; i < loops; ++i) {
+            butil::IOBufAppender buf;
+            butil::Timer timer;
+            timer.start();
+            for (size_t j = 0; j < ARRAY_SIZE(headers); ++j) {
+                brpc::HPacker::Header h(headers[j].name, headers[j].value);
+                p1.Encode(&buf, h, options);
+            }
+            timer.stop();
+            encode_ns += timer.n_elapsed();
+            butil::IOBuf encoded;
+            buf.move_to(encoded);
+            encoded_bytes += encoded.size();
+            timer.start();
+            for (size_t j = 0; j < ARRAY_SIZE(headers); ++j) {
+                brpc::HPacker::Header h;
+                ASSERT_GT(p2.Decode(&encoded, &h), 0);
+                raw_bytes += h.name.size() + h.value.size();
+            }
+            timer.stop();
+            decode_ns += timer.n_elapsed();
+        }
+        LOG(INFO) << (huffman ? "With" : "Without") << " huffman encoding: "
+                  << "raw=" << raw_bytes / loops
+                  << "B encoded=" << encoded_bytes / loops
+                  << "B encode=" << encode_ns / loops
+                  << "ns decode=" << decode_ns / loops << "ns"
+                  << " decode_throughput="
+                  << raw_bytes * 1000 / std::max(decode_ns, (int64_t)1)
+                  << "MB/s";
+    }
+}
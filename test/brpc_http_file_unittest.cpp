@@ -0,0 +1,162 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <fcntl.h>
+#include <unistd.h>                    // ftruncate
+#include <gtest/gtest.h>
+#include "butil/fd_guard.h"
+#include "butil/files/temp_file.h"
+#include "brpc/controller.h"
+#include "brpc/http_file.h"
+#include "brpc/http_status_code.h"
+
+namespace {
+
+class HttpFileTest : public testing::Test {
+protected:
+    void SetUp() {
+        _content.resize(10000);
+        for (size_t i = 0; i < _content.size(); ++i) {
+            _content[i] = 'a' + i % 26;
+        }
+        ASSERT_EQ(0, _file.save_bin(_content.data(), _content.size()));
+    }
+
+    std::string _content;
+    butil::TempFile _file;
+};
+
+TEST_F(HttpFileTest, append_file_range) {
+    butil::fd_guard fd(open(_file.fname(), O_RDONLY));
+    ASSERT_GE(fd, 0);
+    butil::IOBuf buf;
+    ASSERT_EQ(0, brpc::AppendFileRange(&buf, fd, 0, _content.size()));
+    // Not aligned with pages.
+    ASSERT_EQ(0, brpc::AppendFileRange(&buf, fd, 4097, 100));
+    fd.reset(-1);
+    ASSERT_EQ(_content + _content.substr(4097, 100), buf.to_string());
+    ASSERT_EQ(-1, brpc::AppendFileRange(&buf, -1, 0, 1));
+}
+
+TEST_F(HttpFileTest, truncated_file) {
+    butil::fd_guard fd(open(_file.fname(), O_RDWR));
+    ASSERT_GE(fd, 0);
+    butil::IOBuf buf;
+    ASSERT_EQ(0, brpc::AppendFileRange(&buf, fd, 0, _content.size()));
+    // Bytes appended are not affected by truncating the file.
+    ASSERT_EQ(0, ftruncate(fd, 100));
+    ASSERT_EQ(_content, buf.to_string());
+    // Bytes beyond the end can't be appended.
+    butil::IOBuf buf2;
+    ASSERT_EQ(-1, brpc::AppendFileRange(&buf2, fd, 0, _content.size()));
+    ASSERT_EQ(ENODATA, errno);
+}
+
+TEST_F(HttpFileTest, whole_file) {
+    brpc::Controller cntl;
+    ASSERT_EQ(0, brpc::SetFileResponse(&cntl, _file.fname()));
+    ASSERT_EQ(brpc::HTTP_STATUS_OK, cntl.http_response().status_code());
+    ASSERT_EQ(_content, cntl.response_attachment().to_string());
+    ASSERT_TRUE(cntl.http_response().GetHeader("ETag") != NULL);
+    ASSERT_TRUE(cntl.http_response().GetHeader("Last-Modified") != NULL);
+
+    brpc::Controller cntl2;
+    ASSERT_EQ(-1, brpc::SetFileResponse(&cntl2, "/non/existing/file"));
+    ASSERT_TRUE(cntl2.Failed());
+    ASSERT_EQ(brpc::HTTP_STATUS_NOT_FOUND, cntl2.http_response().status_code());
+}
+
+TEST_F(HttpFileTest, not_modified) {
+    brpc::Controller cntl;
+    ASSERT_EQ(0, brpc::SetFileResponse(&cntl, _file.fname()));
+    const std::string etag = *cntl.http_response().GetHeader("ETag");
+    const std::string last_modified =
+        *cntl.http_response().GetHeader("Last-Modified");
+
+    brpc::Controller cntl2;
+    cntl2.http_request().SetHeader("If-None-Match", "\"xyz\", W/" + etag);
+    ASSERT_EQ(0, brpc::SetFileResponse(&cntl2, _file.fname()));
+    ASSERT_EQ(brpc::HTTP_STATUS_NOT_MODIFIED,
+              cntl2.http_response().status_code());
+    ASSERT_TRUE(cntl2.response_attachment().empty());
+
+    brpc::Controller cntl3;
+    cntl3.http_request().SetHeader("If-Modified-Since", last_modified);
+    ASSERT_EQ(0, brpc::SetFileResponse(&cntl3, _file.fname()));
+    ASSERT_EQ(brpc::HTTP_STATUS_NOT_MODIFIED,
+              cntl3.http_response().status_code());
+
+    // If-None-Match takes precedence.
+    brpc::Controller cntl4;
+    cntl4.http_request().SetHeader("If-None-Match", "\"xyz\"");
+    cntl4.http_request().SetHeader("If-Modified-Since", last_modified);
+    ASSERT_EQ(0, brpc::SetFileResponse(&cntl4, _file.fname()));
+    ASSERT_EQ(brpc::HTTP_STATUS_OK, cntl4.http_response().status_code());
+    ASSERT_EQ(_content, cntl4.response_attachment().to_string());
+}
+
+TEST_F(HttpFileTest, range) {
+    struct {
+        const char* range;
+        int status;
+        size_t first;
+        size_t length;
+    } cases[] = {
+        { "bytes=0-99", brpc::HTTP_STATUS_PARTIAL_CONTENT, 0, 100 },
+        { "bytes=9000-", brpc::HTTP_STATUS_PARTIAL_CONTENT, 9000, 1000 },
+        { "bytes=9000-20000", brpc::HTTP_STATUS_PARTIAL_CONTENT, 9000, 1000 },
+        { "bytes=-10", brpc::HTTP_STATUS_PARTIAL_CONTENT, 9990, 10 },
+        { "bytes=-20000", brpc::HTTP_STATUS_PARTIAL_CONTENT, 0, 10000 },
+        { "bytes=0-1,5-6", brpc::HTTP_STATUS_OK, 0, 10000 },
+        { "bytes=10-5", brpc::HTTP_STATUS_OK, 0, 10000 },
+        { "items=0-1", brpc::HTTP_STATUS_OK, 0, 10000 },
+        { "bytes=10000-", brpc::HTTP_STATUS_REQUEST_RANGE_NOT_SATISFIABLE, 0, 0 },
+        { "bytes=-0", brpc::HTTP_STATUS_REQUEST_RANGE_NOT_SATISFIABLE, 0, 0 },
+    };
+    for (size_t i = 0; i < arraysize(cases); ++i) {
+        brpc::Controller cntl;
+        cntl.http_request().SetHeader("Range", cases[i].range);
+        ASSERT_EQ(0, brpc::SetFileResponse(&cntl, _file.fname()));
+        ASSERT_EQ(cases[i].status, cntl.http_response().status_code())
+            << cases[i].range;
+        ASSERT_EQ(_content.substr(cases[i].first, cases[i].length),
+                  cntl.response_attachment().to_string()) << cases[i].range;
+    }
+    brpc::Controller cntl;
+    cntl.http_request().SetHeader("Range", "bytes=100-199");
+    ASSERT_EQ(0, brpc::SetFileResponse(&cntl, _file.fname()));
+    ASSERT_EQ("bytes 100-199/10000",
+              *cntl.http_response().GetHeader("Content-Range"));
+    const std::string etag = *cntl.http_response().GetHeader("ETag");
+
+    // Range is ignored when If-Range does not match.
+    brpc::Controller cntl2;
+    cntl2.http_request().SetHeader("Range", "bytes=100-199");
+    cntl2.http_request().SetHeader("If-Range", "\"xyz\"");
+    ASSERT_EQ(0, brpc::SetFileResponse(&cntl2, _file.fname()));
+    ASSERT_EQ(brpc::HTTP_STATUS_OK, cntl2.http_response().status_code());
+    ASSERT_EQ(_content, cntl2.response_attachment().to_string());
+
+    brpc::Controller cntl3;
+    cntl3.http_request().SetHeader("Range", "bytes=100-199");
+    cntl3.http_request().SetHeader("If-Range", etag);
+    ASSERT_EQ(0, brpc::SetFileResponse(&cntl3, _file.fname()));
+    ASSERT_EQ(brpc::HTTP_STATUS_PARTIAL_CONTENT,
+              cntl3.http_response().status_code());
+}
+
+} // namespace
@@ -17,6 +17,7 @@
 //
 // Date 2014/10/24 16:44:30
 
+#include <map>
 #include <gtest/gtest.h>
 #include <google/protobuf/descriptor.h>
 
@@ -581,6 +582,77 @@ TEST(HttpMessageTest, http_header) {
                  header.reason_phrase());
 }
 
+TEST(HttpMessageTest, common_headers) {
+    const char* request = "GET /foo HTTP/1.1\r\n"
+                          "User-Agent: curl/7.0\r\n"
+                          "host: localhost\r\n"
+                          "ACCEPT: */*\r\n"
+                          "Foo: Bar\r\n"
+                          "\r\n";
+    butil::IOBuf buf;
+    buf.append(request);
+    brpc::HttpMessage http_message;
+    ASSERT_TRUE(http_message.ParseFromIOBuf(buf) >= 0);
+    ASSERT_TRUE(http_message.Completed());
+    brpc::HttpHeader header;
+    header.Swap(http_message.header());
+    ASSERT_EQ(4u, header.HeaderCount());
+    // User-Agent and host are in slots, ACCEPT is not in a known form.
+    ASSERT_EQ(2u, header._headers.size());
+    const std::string* value = header.GetHeader("user-agent");
+    ASSERT_TRUE(value && *value == "curl/7.0");
+    value = header.GetHeader("HOST");
+    ASSERT_TRUE(value && *value == "localhost");
+    value = header.GetHeader("Accept");
+    ASSERT_TRUE(value && *value == "*/*");
+
+    header.SetHeader("Content-Length", "10");
+    header.AppendHeader("accept", "text/plain");
+    value = header.GetHeader("Accept");
+    ASSERT_TRUE(value && *value == "*/*,text/plain");
+    ASSERT_EQ(5u, header.HeaderCount());
+    header.RemoveHeader("content-length");
+    ASSERT_FALSE(header.GetHeader("Content-Length"));
+    ASSERT_EQ(4u, header.HeaderCount());
+
+    // Iterating shows names as they were set, and does not move headers.
+    const std::string* user_agent = header.GetHeader("User-Agent");
+    const brpc::HttpHeader& const_header = header;
+    std::map<std::string, std::string> headers;
+    for (brpc::HttpHeader::HeaderIterator it = const_header.HeaderBegin();
+         it != const_header.HeaderEnd(); ++it) {
+        headers[it->first] = it->second;
+    }
+    ASSERT_EQ(4u, headers.size());
+    ASSERT_EQ("curl/7.0", headers["User-Agent"]);
+    ASSERT_EQ("localhost", headers["host"]);
+    ASSERT_EQ("*/*,text/plain", headers["ACCEPT"]);
+    ASSERT_EQ("Bar", headers["Foo"]);
+    ASSERT_EQ(4u, header.HeaderCount());
+    ASSERT_EQ(2u, header._headers.size());
+    value = header.GetHeader("User-Agent");
+    ASSERT_EQ(user_agent, value);
+    ASSERT_TRUE(value && *value == "curl/7.0");
+    // Iterators are copyable and comparable.
+    brpc::HttpHeader::HeaderIterator it = const_header.HeaderBegin();
+    brpc::HttpHeader::HeaderIterator it2 = it++;
+    ASSERT_TRUE(it2 == const_header.HeaderBegin());
+    ASSERT_TRUE(it != it2);
+    size_t n = 0;
+    for (; it2 != const_header.HeaderEnd(); ++it2) {
+        ++n;
+    }
+    ASSERT_EQ(4u, n);
+    header.SetHeader("user-agent", "brpc");
+    value = header.GetHeader("User-Agent");
+    ASSERT_TRUE(value && *value == "brpc");
+    ASSERT_EQ(4u, header.HeaderCount());
+
+    header.Clear();
+    ASSERT_EQ(0u, header.HeaderCount());
+    ASSERT_FALSE(header.GetHeader("User-Agent"));
+}
+
 TEST(HttpMessageTest, empty_url) {
     butil::EndPoint host;
     ASSERT_FALSE(ParseHttpServerAddress(&host, ""));
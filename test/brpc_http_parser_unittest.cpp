@@ -17,6 +17,7 @@
 
 #include <gtest/gtest.h>
 #include <iostream>
+#include <vector>
 
 #include "butil/time.h"
 #include "butil/logging.h"
@@ -110,6 +111,140 @@ TEST_F(HttpParserTest, http_example) {
     LOG(INFO) << http_parser_execute(&parser, &settings, http_request, strlen(http_request));
 }
 
+struct ParsedEvents {
+    std::vector<std::string> events;
+};
+
+static void AddEvent(http_parser* parser, const char* name,
+                     const char* at, size_t length) {
+    std::vector<std::string>& events =
+        static_cast<ParsedEvents*>(parser->data)->events;
+    const std::string prefix = std::string(name) + ":";
+    // Data of one field may be split into multiple callbacks.
+    if (!events.empty() && events.back().compare(0, prefix.size(), prefix) == 0) {
+        events.back().append(at, length);
+    } else {
+        events.push_back(prefix + std::string(at, length));
+    }
+}
+
+int record_url(http_parser* p, const char* at, const size_t length) {
+    AddEvent(p, "url", at, length);
+    return 0;
+}
+
+int record_header_field(http_parser* p, const char* at, const size_t length) {
+    AddEvent(p, "field", at, length);
+    return 0;
+}
+
+int record_header_value(http_parser* p, const char* at, const size_t length) {
+    AddEvent(p, "value", at, length);
+    return 0;
+}
+
+int record_body(http_parser* p, const char* at, const size_t length) {
+    AddEvent(p, "body", at, length);
+    return 0;
+}
+
+// Parse `input' in blocks of `block_size' bytes. Bytes are scanned in batch
+// only within blocks not shorter than 16 bytes.
+static void ParseInBlocks(const std::string& input, size_t block_size,
+                          http_parser* parser, ParsedEvents* events) {
+    http_parser_init(parser, brpc::HTTP_REQUEST);
+    parser->data = events;
+    http_parser_settings settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.on_url = record_url;
+    settings.on_header_field = record_header_field;
+    settings.on_header_value = record_header_value;
+    settings.on_body = record_body;
+    for (size_t i = 0; i < input.size() && !parser->http_errno;
+         i += block_size) {
+        brpc::http_parser_execute(parser, &settings, input.data() + i,
+                                  std::min(block_size, input.size() - i));
+    }
+}
+
+TEST_F(HttpParserTest, batch_scanning_matches_byte_by_byte) {
+    const std::string long_value(1000, 'v');
+    const std::string inputs[] = {
+        "GET /path/to/some/resource/that/is/long.html?query=abcdefghijklmn"
+        "opqrstuvwxyz&x=1#fragment HTTP/1.1\r\n"
+        "Host: www.example.com:8080\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36\r\n"
+        "X-Very-Long-Custom-Header-Name: " + long_value + "\r\n"
+        "X-Tabs-And-Utf8: \tvalue\twith \xe4\xbd\xa0\xe5\xa5\xbd tabs\r\n"
+        "X-Folded: first line of a folded header value\r\n"
+        "  and the second line\r\n"
+        "Content-Length: 11\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n"
+        "hello world",
+        // Invalid characters in the middle of a long header value
+        "GET /index.html HTTP/1.1\r\n"
+        "X-Invalid: abcdefghijklmnopqrstuvwxyz\x01abcdefghijklmnopqrstuvwxyz\r\n"
+        "\r\n",
+        // Invalid characters in the middle of a long header name
+        "GET /index.html HTTP/1.1\r\n"
+        "X-Invalid-Header-Name-Which-Is-Long{}: value\r\n"
+        "\r\n",
+        // Headers exceeding BRPC_HTTP_MAX_HEADER_SIZE
+        "GET /index.html HTTP/1.1\r\n"
+        "X-Large: " + std::string(BRPC_HTTP_MAX_HEADER_SIZE, 'x') + "\r\n"
+        "\r\n",
+    };
+    for (size_t i = 0; i < ARRAY_SIZE(inputs); ++i) {
+        http_parser batch_parser;
+        ParsedEvents batch_events;
+        ParseInBlocks(inputs[i], inputs[i].size(), &batch_parser, &batch_events);
+        http_parser byte_parser;
+        ParsedEvents byte_events;
+        ParseInBlocks(inputs[i], 1, &byte_parser, &byte_events);
+        ASSERT_EQ(byte_parser.http_errno, batch_parser.http_errno) << i;
+        ASSERT_EQ(byte_parser.nread, batch_parser.nread) << i;
+        if (byte_parser.http_errno == 0) {
+            ASSERT_EQ(byte_parser.state, batch_parser.state) << i;
+            ASSERT_EQ(byte_events.events, batch_events.events) << i;
+        }
+    }
+}
+
+TEST_F(HttpParserTest, parse_perf) {
+    const std::string http_request =
+        "GET /api/v1/users/1234567890/profile?fields=name,email,avatar"
+        "&lang=en-US HTTP/1.1\r\n"
+        "Host: api.example.com\r\n"
+        "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit"
+        "/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+        "image/avif,image/webp,*/*;q=0.8\r\n"
+        "Accept-Language: en-US,en;q=0.9\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Cookie: session_id=abcdefghijklmnopqrstuvwxyz0123456789; "
+        "tracking=ABCDEFGHIJKLMNOPQRSTUVWXYZ\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n";
+    // Blocks shorter than 16 bytes are always parsed byte by byte.
+    const size_t block_sizes[] = { http_request.size(), 15 };
+    const size_t loops = 200000;
+    for (size_t i = 0; i < ARRAY_SIZE(block_sizes); ++i) {
+        butil::Timer timer;
+        timer.start();
+        for (size_t j = 0; j < loops; ++j) {
+            http_parser parser;
+            ParsedEvents events;
+            ParseInBlocks(http_request, block_sizes[i], &parser, &events);
+            ASSERT_EQ(0u, parser.http_errno);
+        }
+        timer.stop();
+        std::cout << "Parse " << http_request.size() << "-byte request in "
+                  << block_sizes[i] << "-byte blocks: "
+                  << timer.n_elapsed() / loops << "ns" << std::endl;
+    }
+}
+
 TEST_F(HttpParserTest, append_filename) {
     std::string dir;
 
@@ -1411,6 +1411,773 @@ TEST_F(HttpTest, http2_settings) {
     ASSERT_TRUE(ctx->_remote_settings.stream_window_size == (1u << 29) - 1);
 }
 
+TEST_F(HttpTest, http2_window_auto_tuning) {
+    brpc::policy::H2Context* ctx = new brpc::policy::H2Context(_socket.get(), NULL);
+    CHECK_EQ(ctx->Init(), 0);
+    _socket->initialize_parsing_context(&ctx);
+    ctx->_conn_state = brpc::policy::H2_CONNECTION_READY;
+    const uint32_t old_window = ctx->_local_settings.stream_window_size;
+
+    // DATA received within the RTT is close to the window.
+    ctx->SampleBdp(old_window / 2);
+    ctx->SampleBdp(old_window / 2);
+    ASSERT_EQ(0, ctx->FlushControlFrames());
+    butil::IOPortal ping_buf;
+    ASSERT_EQ(ping_buf.append_from_file_descriptor(_pipe_fds[0], 1024),
+              (ssize_t)brpc::policy::FRAME_HEAD_SIZE + 8);
+    char ping[brpc::policy::FRAME_HEAD_SIZE + 8];
+    ping_buf.copy_to(ping, sizeof(ping));
+    ASSERT_EQ(brpc::policy::H2_FRAME_PING, ping[3]);
+
+    // Ack the PING with the same opaque data.
+    brpc::policy::SerializeFrameHead(ping, 8, brpc::policy::H2_FRAME_PING,
+                                     0x01 /* H2_FLAGS_ACK */, 0);
+    butil::IOBuf buf;
+    buf.append(ping, sizeof(ping));
+    brpc::policy::ParseH2Message(&buf, _socket.get(), false, NULL);
+
+    butil::IOPortal settings_buf;
+    ASSERT_GE(settings_buf.append_from_file_descriptor(_pipe_fds[0], 1024),
+              (ssize_t)brpc::policy::FRAME_HEAD_SIZE + 6);
+    brpc::policy::H2FrameHead frame_head;
+    butil::IOBufBytesIterator it(settings_buf);
+    ctx->ConsumeFrameHead(it, &frame_head);
+    ASSERT_EQ(brpc::policy::H2_FRAME_SETTINGS, frame_head.type);
+    ASSERT_EQ(6u, frame_head.payload_size);
+    ASSERT_EQ(2 * old_window, ctx->_local_settings.stream_window_size);
+    ASSERT_EQ(2 * old_window, ctx->_unack_local_settings.stream_window_size);
+    ASSERT_EQ(0, ctx->_bdp_ping_sent_us);
+}
+
+TEST_F(HttpTest, http2_coalesce_control_frames) {
+    brpc::policy::H2Context* ctx = new brpc::policy::H2Context(_socket.get(), NULL);
+    CHECK_EQ(ctx->Init(), 0);
+    _socket->initialize_parsing_context(&ctx);
+    ctx->_conn_state = brpc::policy::H2_CONNECTION_READY;
+
+    // Frames parsed in one round are acked with one write.
+    const int N = 3;
+    butil::IOBuf buf;
+    char settingsbuf[brpc::policy::FRAME_HEAD_SIZE];
+    brpc::policy::SerializeFrameHead(settingsbuf, 0, brpc::policy::H2_FRAME_SETTINGS, 0, 0);
+    buf.append(settingsbuf, sizeof(settingsbuf));
+    for (int i = 0; i < N; ++i) {
+        char pingbuf[brpc::policy::FRAME_HEAD_SIZE + 8];
+        brpc::policy::SerializeFrameHead(pingbuf, 8, brpc::policy::H2_FRAME_PING, 0, 0);
+        memset(pingbuf + brpc::policy::FRAME_HEAD_SIZE, 'a' + i, 8);
+        buf.append(pingbuf, sizeof(pingbuf));
+    }
+    brpc::policy::ParseH2Message(&buf, _socket.get(), false, NULL);
+    ASSERT_TRUE(buf.empty());
+    ASSERT_TRUE(ctx->_control_frames.empty());
+
+    butil::IOPortal ack_buf;
+    ASSERT_EQ(ack_buf.append_from_file_descriptor(_pipe_fds[0], 1024),
+              (ssize_t)(brpc::policy::FRAME_HEAD_SIZE * (N + 1) + 8 * N));
+    butil::IOBufBytesIterator it(ack_buf);
+    brpc::policy::H2FrameHead frame_head;
+    ctx->ConsumeFrameHead(it, &frame_head);
+    ASSERT_EQ(brpc::policy::H2_FRAME_SETTINGS, frame_head.type);
+    ASSERT_EQ(0x01 /* H2_FLAGS_ACK */, frame_head.flags);
+    for (int i = 0; i < N; ++i) {
+        ctx->ConsumeFrameHead(it, &frame_head);
+        ASSERT_EQ(brpc::policy::H2_FRAME_PING, frame_head.type);
+        ASSERT_EQ(0x01 /* H2_FLAGS_ACK */, frame_head.flags);
+        char data[8];
+        ASSERT_EQ(8u, it.copy_and_forward(data, sizeof(data)));
+        ASSERT_EQ('a' + i, data[0]);
+    }
+
+    // Queued control frames are sent along with frames of streams.
+    char pingbuf[brpc::policy::FRAME_HEAD_SIZE + 8];
+    brpc::policy::SerializeFrameHead(pingbuf, 8, brpc::policy::H2_FRAME_PING, 0x01, 0);
+    ASSERT_EQ(0, ctx->QueueControlFrame(pingbuf, sizeof(pingbuf)));
+    butil::IOBuf out;
+    ctx->AppendControlFrames(&out);
+    ASSERT_EQ(sizeof(pingbuf), out.size());
+    ASSERT_TRUE(ctx->_control_frames.empty());
+}
+
+// Queues `msg' to the socket in the middle of the first write through the
+// connection, as if another thread wrote it concurrently.
+class QueueMessageConnection : public brpc::SocketConnection {
+public:
+    QueueMessageConnection(brpc::Socket* sock, brpc::SocketMessage* msg)
+        : _sock(sock), _msg(msg) {}
+
+    void BeforeRecycle(brpc::Socket*) override {}
+    int Connect(brpc::Socket*, const timespec*,
+                int (*)(int, int, void*), void*) override { return -1; }
+    ssize_t CutMessageIntoFileDescriptor(int fd, butil::IOBuf** data,
+                                         size_t ndata) override {
+        if (_msg) {
+            brpc::SocketMessagePtr<> msg(_msg);
+            _msg = NULL;
+            EXPECT_EQ(0, _sock->Write(msg));
+        }
+        return butil::IOBuf::cut_multiple_into_file_descriptor(fd, data, ndata);
+    }
+    ssize_t CutMessageIntoSSLChannel(SSL*, butil::IOBuf**, size_t) override {
+        return -1;
+    }
+
+private:
+    brpc::Socket* _sock;
+    brpc::SocketMessage* _msg;
+};
+
+TEST_F(HttpTest, http2_control_frames_with_queued_message) {
+    brpc::policy::H2Context* ctx = new brpc::policy::H2Context(_socket.get(), NULL);
+    CHECK_EQ(ctx->Init(), 0);
+    _socket->initialize_parsing_context(&ctx);
+    ctx->_conn_state = brpc::policy::H2_CONNECTION_READY;
+
+    // The h2 response is queued while control frames are written, and it's
+    // packed in the flushing thread, which takes queued control frames
+    // again. This must not deadlock.
+    brpc::Controller cntl;
+    cntl.response_attachment().append("hello");
+    QueueMessageConnection conn(_socket.get(),
+                                brpc::policy::H2UnsentResponse::New(&cntl, 1, false));
+    _socket->_conn = &conn;
+    char pingbuf[brpc::policy::FRAME_HEAD_SIZE + 8];
+    brpc::policy::SerializeFrameHead(pingbuf, 8, brpc::policy::H2_FRAME_PING, 0x01, 0);
+    memset(pingbuf + brpc::policy::FRAME_HEAD_SIZE, 'a', 8);
+    ASSERT_EQ(0, ctx->QueueControlFrame(pingbuf, sizeof(pingbuf)));
+    ASSERT_EQ(0, ctx->FlushControlFrames());
+    ASSERT_TRUE(ctx->_control_frames.empty());
+
+    // PING ack, then HEADERS and DATA of the response.
+    butil::IOPortal out_buf;
+    while (true) {
+        ASSERT_GT(out_buf.append_from_file_descriptor(_pipe_fds[0], 1024), 0);
+        butil::IOBufBytesIterator it(out_buf);
+        brpc::policy::H2FrameHead frame_head;
+        int nframe = 0;
+        bool ended = false;
+        while (it.bytes_left() >= brpc::policy::FRAME_HEAD_SIZE) {
+            ctx->ConsumeFrameHead(it, &frame_head);
+            if (it.bytes_left() < frame_head.payload_size) {
+                break;
+            }
+            it.forward(frame_head.payload_size);
+            ++nframe;
+            if (nframe == 1) {
+                ASSERT_EQ(brpc::policy::H2_FRAME_PING, frame_head.type);
+            } else if (nframe == 2) {
+                ASSERT_EQ(brpc::policy::H2_FRAME_HEADERS, frame_head.type);
+                ASSERT_EQ(1, frame_head.stream_id);
+            }
+            if (frame_head.flags & 0x01 /* H2_FLAGS_END_STREAM */ &&
+                frame_head.type == brpc::policy::H2_FRAME_DATA) {
+                ended = true;
+            }
+        }
+        if (ended) {
+            break;
+        }
+    }
+    _socket->_conn = NULL;
+}
+
+TEST_F(HttpTest, http2_stream_writer) {
+    brpc::policy::H2Context* ctx = new brpc::policy::H2Context(_socket.get(), NULL);
+    CHECK_EQ(ctx->Init(), 0);
+    _socket->initialize_parsing_context(&ctx);
+    ctx->_conn_state = brpc::policy::H2_CONNECTION_READY;
+
+    char settingsbuf[brpc::policy::FRAME_HEAD_SIZE + 36];
+    brpc::H2Settings h2_settings;
+    h2_settings.stream_window_size = 100;
+    const size_t nb = brpc::policy::SerializeH2Settings(
+        h2_settings, settingsbuf + brpc::policy::FRAME_HEAD_SIZE);
+    brpc::policy::SerializeFrameHead(settingsbuf, nb, brpc::policy::H2_FRAME_SETTINGS, 0, 0);
+    butil::IOBuf buf;
+    buf.append(settingsbuf, brpc::policy::FRAME_HEAD_SIZE + nb);
+    brpc::policy::ParseH2Message(&buf, _socket.get(), false, NULL);
+    butil::IOPortal ack_buf;
+    ASSERT_EQ(ack_buf.append_from_file_descriptor(_pipe_fds[0], 1024),
+              (ssize_t)brpc::policy::FRAME_HEAD_SIZE);
+
+    const int stream_id = 1;
+    butil::intrusive_ptr<brpc::policy::H2StreamWriter> writer =
+        brpc::policy::H2StreamWriter::Create(_socket.get(), stream_id, false);
+    ASSERT_TRUE(writer != NULL);
+    ASSERT_EQ(1u, ctx->_stream_writers.size());
+
+    // Data exceeding the stream-level window is buffered.
+    butil::IOBuf data;
+    data.resize(250, 'a');
+    ASSERT_EQ(0, writer->Write(&data));
+    butil::IOPortal data_buf;
+    ASSERT_EQ(data_buf.append_from_file_descriptor(_pipe_fds[0], 1024),
+              (ssize_t)brpc::policy::FRAME_HEAD_SIZE + 100);
+    brpc::policy::H2FrameHead frame_head;
+    {
+        butil::IOBufBytesIterator it(data_buf);
+        ctx->ConsumeFrameHead(it, &frame_head);
+        ASSERT_EQ(brpc::policy::H2_FRAME_DATA, frame_head.type);
+        ASSERT_EQ(0, frame_head.flags);
+        ASSERT_EQ(stream_id, frame_head.stream_id);
+        ASSERT_EQ(100u, frame_head.payload_size);
+    }
+
+    // WINDOW_UPDATE of the stream sends the remaining data.
+    char winbuf[brpc::policy::FRAME_HEAD_SIZE + 4];
+    brpc::policy::SerializeFrameHead(winbuf, 4, brpc::policy::H2_FRAME_WINDOW_UPDATE,
+                                     0, stream_id);
+    SaveUint32(winbuf + brpc::policy::FRAME_HEAD_SIZE, 200);
+    buf.append(winbuf, sizeof(winbuf));
+    brpc::policy::ParseH2Message(&buf, _socket.get(), false, NULL);
+    data_buf.clear();
+    ASSERT_EQ(data_buf.append_from_file_descriptor(_pipe_fds[0], 1024),
+              (ssize_t)brpc::policy::FRAME_HEAD_SIZE + 150);
+
+    // Closing the writer ends the stream and unregisters the writer.
+    writer->Close();
+    data_buf.clear();
+    ASSERT_EQ(data_buf.append_from_file_descriptor(_pipe_fds[0], 1024),
+              (ssize_t)brpc::policy::FRAME_HEAD_SIZE);
+    {
+        butil::IOBufBytesIterator it(data_buf);
+        ctx->ConsumeFrameHead(it, &frame_head);
+        ASSERT_EQ(brpc::policy::H2_FRAME_DATA, frame_head.type);
+        ASSERT_EQ(0x01 /* H2_FLAGS_END_STREAM */, frame_head.flags);
+        ASSERT_EQ(0u, frame_head.payload_size);
+    }
+    ASSERT_TRUE(ctx->_stream_writers.empty());
+    data.append("b");
+    ASSERT_EQ(-1, writer->Write(&data));
+    ASSERT_EQ(ECANCELED, errno);
+}
+
+// Flushes writers with the stream-level window changed in the middle of
+// the first write through the connection, as the parsing thread does when
+// SETTINGS arrive.
+class FlushWritersConnection : public brpc::SocketConnection {
+public:
+    explicit FlushWritersConnection(brpc::policy::H2Context* ctx)
+        : _ctx(ctx), _flushed(false) {}
+
+    void BeforeRecycle(brpc::Socket*) override {}
+    int Connect(brpc::Socket*, const timespec*,
+                int (*)(int, int, void*), void*) override { return -1; }
+    ssize_t CutMessageIntoFileDescriptor(int fd, butil::IOBuf** data,
+                                         size_t ndata) override {
+        if (!_flushed) {
+            _flushed = true;
+            EXPECT_TRUE(_ctx->FlushStreamWriters(true));
+        }
+        return butil::IOBuf::cut_multiple_into_file_descriptor(fd, data, ndata);
+    }
+    ssize_t CutMessageIntoSSLChannel(SSL*, butil::IOBuf**, size_t) override {
+        return -1;
+    }
+
+private:
+    brpc::policy::H2Context* _ctx;
+    bool _flushed;
+};
+
+TEST_F(HttpTest, http2_stream_writer_flush_while_writing) {
+    brpc::policy::H2Context* ctx = new brpc::policy::H2Context(_socket.get(), NULL);
+    CHECK_EQ(ctx->Init(), 0);
+    _socket->initialize_parsing_context(&ctx);
+    ctx->_conn_state = brpc::policy::H2_CONNECTION_READY;
+
+    const int stream_id = 1;
+    butil::intrusive_ptr<brpc::policy::H2StreamWriter> writer =
+        brpc::policy::H2StreamWriter::Create(_socket.get(), stream_id, false);
+    ASSERT_TRUE(writer != NULL);
+
+    // The writer is locked by FlushStreamWriters() while it is writing,
+    // which must not deadlock.
+    FlushWritersConnection conn(ctx);
+    _socket->_conn = &conn;
+    butil::IOBuf data;
+    data.resize(10, 'a');
+    ASSERT_EQ(0, writer->Write(&data));
+    writer->Close();
+    _socket->_conn = NULL;
+
+    // DATA, then the empty DATA ending the stream.
+    butil::IOPortal data_buf;
+    while (data_buf.size() < 2 * brpc::policy::FRAME_HEAD_SIZE + 10) {
+        ASSERT_GT(data_buf.append_from_file_descriptor(_pipe_fds[0], 1024), 0);
+    }
+    ASSERT_EQ(2 * brpc::policy::FRAME_HEAD_SIZE + 10, data_buf.size());
+    butil::IOBufBytesIterator it(data_buf);
+    brpc::policy::H2FrameHead frame_head;
+    ctx->ConsumeFrameHead(it, &frame_head);
+    ASSERT_EQ(brpc::policy::H2_FRAME_DATA, frame_head.type);
+    ASSERT_EQ(0, frame_head.flags);
+    ASSERT_EQ(10u, frame_head.payload_size);
+    it.forward(frame_head.payload_size);
+    ctx->ConsumeFrameHead(it, &frame_head);
+    ASSERT_EQ(brpc::policy::H2_FRAME_DATA, frame_head.type);
+    ASSERT_EQ(0x01 /* H2_FLAGS_END_STREAM */, frame_head.flags);
+    ASSERT_EQ(0u, frame_head.payload_size);
+    ASSERT_TRUE(ctx->_stream_writers.empty());
+}
+
+TEST_F(HttpTest, http2_stream_writer_close_with_error) {
+    brpc::policy::H2Context* ctx = new brpc::policy::H2Context(_socket.get(), NULL);
+    CHECK_EQ(ctx->Init(), 0);
+    _socket->initialize_parsing_context(&ctx);
+    ctx->_conn_state = brpc::policy::H2_CONNECTION_READY;
+
+    // gRPC streams end with the error in trailers, after the data.
+    butil::intrusive_ptr<brpc::policy::H2StreamWriter> writer =
+        brpc::policy::H2StreamWriter::Create(_socket.get(), 1, true);
+    ASSERT_TRUE(writer != NULL);
+    butil::IOBuf data;
+    data.resize(10, 'a');
+    ASSERT_EQ(0, writer->Write(&data));
+    writer->Close(brpc::EINTERNAL, "broken stream");
+    ASSERT_TRUE(ctx->_stream_writers.empty());
+    butil::IOPortal out_buf;
+    ASSERT_GT(out_buf.append_from_file_descriptor(_pipe_fds[0], 1024), 0);
+    brpc::policy::H2FrameHead frame_head;
+    butil::IOBufBytesIterator it(out_buf);
+    ctx->ConsumeFrameHead(it, &frame_head);
+    ASSERT_EQ(brpc::policy::H2_FRAME_DATA, frame_head.type);
+    ASSERT_EQ(10u, frame_head.payload_size);
+    it.forward(frame_head.payload_size);
+    ctx->ConsumeFrameHead(it, &frame_head);
+    ASSERT_EQ(brpc::policy::H2_FRAME_HEADERS, frame_head.type);
+    ASSERT_EQ(0x05 /* H2_FLAGS_END_STREAM | H2_FLAGS_END_HEADERS */,
+              frame_head.flags);
+    ASSERT_EQ(frame_head.payload_size, it.bytes_left());
+    brpc::HPacker decoder;
+    ASSERT_EQ(0, decoder.Init());
+    std::map<std::string, std::string> trailers;
+    while (it.bytes_left() > 0) {
+        brpc::HPacker::Header h;
+        ASSERT_GT(decoder.Decode(it, &h), 0);
+        trailers[h.name] = h.value;
+    }
+    ASSERT_EQ(butil::string_printf("%d", brpc::ErrorCodeToGrpcStatus(brpc::EINTERNAL)),
+              trailers["grpc-status"]);
+    ASSERT_EQ("broken%20stream", trailers["grpc-message"]);
+
+    // Other streams are reset.
+    writer = brpc::policy::H2StreamWriter::Create(_socket.get(), 3, false);
+    ASSERT_TRUE(writer != NULL);
+    writer->Close(brpc::EINTERNAL, "broken stream");
+    ASSERT_TRUE(ctx->_stream_writers.empty());
+    out_buf.clear();
+    ASSERT_EQ(out_buf.append_from_file_descriptor(_pipe_fds[0], 1024),
+              (ssize_t)brpc::policy::FRAME_HEAD_SIZE + 4);
+    butil::IOBufBytesIterator it2(out_buf);
+    ctx->ConsumeFrameHead(it2, &frame_head);
+    ASSERT_EQ(brpc::policy::H2_FRAME_RST_STREAM, frame_head.type);
+    ASSERT_EQ(3, frame_head.stream_id);
+    uint8_t error_code[4];
+    ASSERT_EQ(4u, it2.copy_and_forward(error_code, 4));
+    ASSERT_EQ(brpc::H2_INTERNAL_ERROR, (int)error_code[3]);
+}
+
+TEST_F(HttpTest, http2_priority) {
+    brpc::policy::H2Priority priority = brpc::policy::ParseH2Priority("u=1, i");
+    ASSERT_EQ(1, priority.urgency);
+    ASSERT_TRUE(priority.incremental);
+    priority = brpc::policy::ParseH2Priority("u=8;x, i=?0, y=1");
+    ASSERT_EQ(brpc::policy::H2Priority::DEFAULT_URGENCY, priority.urgency);
+    ASSERT_FALSE(priority.incremental);
+
+    brpc::policy::H2Context* ctx = new brpc::policy::H2Context(_socket.get(), NULL);
+    CHECK_EQ(ctx->Init(), 0);
+    _socket->initialize_parsing_context(&ctx);
+    ctx->_conn_state = brpc::policy::H2_CONNECTION_READY;
+
+    // PRIORITY frames and frames of unknown types are ignored.
+    butil::IOBuf buf;
+    char prioritybuf[brpc::policy::FRAME_HEAD_SIZE + 5] = {};
+    brpc::policy::SerializeFrameHead(prioritybuf, 5, brpc::policy::H2_FRAME_PRIORITY, 0, 1);
+    buf.append(prioritybuf, sizeof(prioritybuf));
+    char unknownbuf[brpc::policy::FRAME_HEAD_SIZE + 3] = {};
+    brpc::policy::SerializeFrameHead(unknownbuf, 3, (brpc::policy::H2FrameType)0xb, 0, 0);
+    buf.append(unknownbuf, sizeof(unknownbuf));
+    brpc::policy::ParseH2Message(&buf, _socket.get(), false, NULL);
+    ASSERT_TRUE(buf.empty());
+    ASSERT_FALSE(_socket->Failed());
+
+    // Data waits for the connection-level window.
+    ctx->_remote_window_left.store(0);
+    butil::intrusive_ptr<brpc::policy::H2StreamWriter> low =
+        brpc::policy::H2StreamWriter::Create(
+            _socket.get(), 1, false, brpc::policy::ParseH2Priority("u=5"));
+    butil::intrusive_ptr<brpc::policy::H2StreamWriter> high =
+        brpc::policy::H2StreamWriter::Create(
+            _socket.get(), 3, false, brpc::policy::ParseH2Priority("u=1"));
+    butil::IOBuf data;
+    data.resize(100, 'a');
+    ASSERT_EQ(0, low->Write(&data));
+    data.resize(100, 'b');
+    ASSERT_EQ(0, high->Write(&data));
+    ASSERT_EQ(1, ctx->_blocked_writers[1].load());
+    ASSERT_EQ(1, ctx->_blocked_writers[5].load());
+
+    // The more urgent stream is sent first after WINDOW_UPDATE.
+    char winbuf[brpc::policy::FRAME_HEAD_SIZE + 4];
+    brpc::policy::SerializeFrameHead(winbuf, 4, brpc::policy::H2_FRAME_WINDOW_UPDATE, 0, 0);
+    SaveUint32(winbuf + brpc::policy::FRAME_HEAD_SIZE, 150);
+    buf.append(winbuf, sizeof(winbuf));
+    brpc::policy::ParseH2Message(&buf, _socket.get(), false, NULL);
+    butil::IOPortal data_buf;
+    ASSERT_EQ(data_buf.append_from_file_descriptor(_pipe_fds[0], 1024),
+              (ssize_t)(brpc::policy::FRAME_HEAD_SIZE * 2 + 150));
+    brpc::policy::H2FrameHead frame_head;
+    {
+        butil::IOBufBytesIterator it(data_buf);
+        ctx->ConsumeFrameHead(it, &frame_head);
+        ASSERT_EQ(3, frame_head.stream_id);
+        ASSERT_EQ(100u, frame_head.payload_size);
+        it.forward(frame_head.payload_size);
+        ctx->ConsumeFrameHead(it, &frame_head);
+        ASSERT_EQ(1, frame_head.stream_id);
+        ASSERT_EQ(50u, frame_head.payload_size);
+    }
+    ASSERT_EQ(0, ctx->_blocked_writers[1].load());
+    ASSERT_EQ(1, ctx->_blocked_writers[5].load());
+
+    // Reprioritized by PRIORITY_UPDATE.
+    data.resize(10, 'b');
+    ASSERT_EQ(0, high->Write(&data));
+    const char* field = "u=0";
+    char updatebuf[brpc::policy::FRAME_HEAD_SIZE + 4 + 3];
+    brpc::policy::SerializeFrameHead(updatebuf, 4 + 3,
+                                     brpc::policy::H2_FRAME_PRIORITY_UPDATE, 0, 0);
+    SaveUint32(updatebuf + brpc::policy::FRAME_HEAD_SIZE, 1);
+    memcpy(updatebuf + brpc::policy::FRAME_HEAD_SIZE + 4, field, 3);
+    buf.append(updatebuf, sizeof(updatebuf));
+    brpc::policy::ParseH2Message(&buf, _socket.get(), false, NULL);
+    ASSERT_EQ(0, low->priority().urgency);
+    ASSERT_EQ(1, ctx->_blocked_writers[0].load());
+    ASSERT_EQ(0, ctx->_blocked_writers[5].load());
+    SaveUint32(winbuf + brpc::policy::FRAME_HEAD_SIZE, 60);
+    buf.append(winbuf, sizeof(winbuf));
+    brpc::policy::ParseH2Message(&buf, _socket.get(), false, NULL);
+    data_buf.clear();
+    ASSERT_EQ(data_buf.append_from_file_descriptor(_pipe_fds[0], 1024),
+              (ssize_t)(brpc::policy::FRAME_HEAD_SIZE * 2 + 60));
+    {
+        butil::IOBufBytesIterator it(data_buf);
+        ctx->ConsumeFrameHead(it, &frame_head);
+        ASSERT_EQ(1, frame_head.stream_id);
+        ASSERT_EQ(50u, frame_head.payload_size);
+        it.forward(frame_head.payload_size);
+        ctx->ConsumeFrameHead(it, &frame_head);
+        ASSERT_EQ(3, frame_head.stream_id);
+        ASSERT_EQ(10u, frame_head.payload_size);
+    }
+
+    // Less urgent writers do not take the window while more urgent ones
+    // are waiting for it.
+    data.resize(20, 'a');
+    ASSERT_EQ(0, low->Write(&data));
+    ctx->_remote_window_left.store(100);
+    data.resize(20, 'b');
+    ASSERT_EQ(0, high->Write(&data));
+    int bytes_in_pipe = 0;
+    ioctl(_pipe_fds[0], FIONREAD, &bytes_in_pipe);
+    ASSERT_EQ(0, bytes_in_pipe);
+    ASSERT_EQ(1, ctx->_blocked_writers[1].load());
+    // Resetting the more urgent stream lets others go.
+    char rstbuf[brpc::policy::FRAME_HEAD_SIZE + 4];
+    brpc::policy::SerializeFrameHead(rstbuf, 4, brpc::policy::H2_FRAME_RST_STREAM, 0, 1);
+    SaveUint32(rstbuf + brpc::policy::FRAME_HEAD_SIZE, brpc::H2_CANCEL);
+    buf.append(rstbuf, sizeof(rstbuf));
+    brpc::policy::ParseH2Message(&buf, _socket.get(), false, NULL);
+    data_buf.clear();
+    ASSERT_EQ(data_buf.append_from_file_descriptor(_pipe_fds[0], 1024),
+              (ssize_t)brpc::policy::FRAME_HEAD_SIZE + 20);
+    {
+        butil::IOBufBytesIterator it(data_buf);
+        ctx->ConsumeFrameHead(it, &frame_head);
+        ASSERT_EQ(3, frame_head.stream_id);
+    }
+    for (int i = 0; i <= brpc::policy::H2Priority::MAX_URGENCY; ++i) {
+        ASSERT_EQ(0, ctx->_blocked_writers[i].load());
+    }
+}
+
+TEST_F(HttpTest, http2_incremental_priority) {
+    brpc::policy::H2Context* ctx = new brpc::policy::H2Context(_socket.get(), NULL);
+    CHECK_EQ(ctx->Init(), 0);
+    _socket->initialize_parsing_context(&ctx);
+    ctx->_conn_state = brpc::policy::H2_CONNECTION_READY;
+
+    // Incremental streams of the same urgency send one frame in turn.
+    ctx->_remote_window_left.store(0);
+    const brpc::policy::H2Priority priority =
+        brpc::policy::ParseH2Priority("i");
+    butil::intrusive_ptr<brpc::policy::H2StreamWriter> writer1 =
+        brpc::policy::H2StreamWriter::Create(_socket.get(), 1, false, priority);
+    butil::intrusive_ptr<brpc::policy::H2StreamWriter> writer2 =
+        brpc::policy::H2StreamWriter::Create(_socket.get(), 3, false, priority);
+    butil::IOBuf data;
+    data.resize(40000, 'a');
+    ASSERT_EQ(0, writer1->Write(&data));
+    data.resize(40000, 'b');
+    ASSERT_EQ(0, writer2->Write(&data));
+
+    char winbuf[brpc::policy::FRAME_HEAD_SIZE + 4];
+    brpc::policy::SerializeFrameHead(winbuf, 4, brpc::policy::H2_FRAME_WINDOW_UPDATE, 0, 0);
+    SaveUint32(winbuf + brpc::policy::FRAME_HEAD_SIZE, 40000);
+    butil::IOBuf buf;
+    buf.append(winbuf, sizeof(winbuf));
+    brpc::policy::ParseH2Message(&buf, _socket.get(), false, NULL);
+    butil::IOPortal data_buf;
+    ASSERT_EQ(data_buf.append_from_file_descriptor(_pipe_fds[0], 65536),
+              (ssize_t)(brpc::policy::FRAME_HEAD_SIZE * 3 + 40000));
+    const int stream_ids[] = { 1, 3, 1 };
+    const uint32_t sizes[] = { 16384, 16384, 40000 - 16384 * 2 };
+    butil::IOBufBytesIterator it(data_buf);
+    for (size_t i = 0; i < arraysize(sizes); ++i) {
+        brpc::policy::H2FrameHead frame_head;
+        ctx->ConsumeFrameHead(it, &frame_head);
+        ASSERT_EQ(brpc::policy::H2_FRAME_DATA, frame_head.type);
+        ASSERT_EQ(stream_ids[i], frame_head.stream_id);
+        ASSERT_EQ(sizes[i], frame_head.payload_size);
+        it.forward(frame_head.payload_size);
+    }
+}
+
+TEST_F(HttpTest, http2_response_waits_for_window) {
+    brpc::policy::H2Context* ctx = new brpc::policy::H2Context(_socket.get(), NULL);
+    CHECK_EQ(ctx->Init(), 0);
+    _socket->initialize_parsing_context(&ctx);
+    ctx->_conn_state = brpc::policy::H2_CONNECTION_READY;
+
+    // The body not fitting in the window is sent after WINDOW_UPDATE
+    // rather than resetting the stream.
+    ctx->_remote_window_left.store(40);
+    brpc::Controller cntl;
+    cntl.response_attachment().resize(100, 'a');
+    brpc::policy::H2UnsentResponse* res =
+        brpc::policy::H2UnsentResponse::New(&cntl, 1, false);
+    butil::IOBuf out;
+    ASSERT_TRUE(res->AppendAndDestroySelf(&out, _socket.get()).ok());
+    brpc::policy::H2FrameHead frame_head;
+    {
+        butil::IOBufBytesIterator it(out);
+        ctx->ConsumeFrameHead(it, &frame_head);
+        ASSERT_EQ(brpc::policy::H2_FRAME_HEADERS, frame_head.type);
+        ASSERT_EQ(0x04 /* H2_FLAGS_END_HEADERS */, frame_head.flags);
+        ASSERT_EQ(brpc::policy::FRAME_HEAD_SIZE + frame_head.payload_size, out.size());
+    }
+    butil::IOPortal data_buf;
+    ASSERT_EQ(data_buf.append_from_file_descriptor(_pipe_fds[0], 1024),
+              (ssize_t)brpc::policy::FRAME_HEAD_SIZE + 40);
+    ASSERT_EQ(1u, ctx->_stream_writers.size());
+
+    char winbuf[brpc::policy::FRAME_HEAD_SIZE + 4];
+    brpc::policy::SerializeFrameHead(winbuf, 4, brpc::policy::H2_FRAME_WINDOW_UPDATE, 0, 0);
+    SaveUint32(winbuf + brpc::policy::FRAME_HEAD_SIZE, 100);
+    butil::IOBuf buf;
+    buf.append(winbuf, sizeof(winbuf));
+    brpc::policy::ParseH2Message(&buf, _socket.get(), false, NULL);
+    data_buf.clear();
+    ASSERT_EQ(data_buf.append_from_file_descriptor(_pipe_fds[0], 1024),
+              (ssize_t)(brpc::policy::FRAME_HEAD_SIZE * 2 + 60));
+    {
+        butil::IOBufBytesIterator it(data_buf);
+        ctx->ConsumeFrameHead(it, &frame_head);
+        ASSERT_EQ(60u, frame_head.payload_size);
+        it.forward(frame_head.payload_size);
+        ctx->ConsumeFrameHead(it, &frame_head);
+        ASSERT_EQ(0x01 /* H2_FLAGS_END_STREAM */, frame_head.flags);
+        ASSERT_EQ(0u, frame_head.payload_size);
+    }
+    ASSERT_TRUE(ctx->_stream_writers.empty());
+
+    // Failed gRPC responses are Trailers-Only.
+    brpc::Controller cntl2;
+    cntl2.SetFailed(brpc::EINTERNAL, "internal error");
+    cntl2.http_response().set_content_type("application/grpc");
+    res = brpc::policy::H2UnsentResponse::New(&cntl2, 3, true);
+    out.clear();
+    ASSERT_TRUE(res->AppendAndDestroySelf(&out, _socket.get()).ok());
+    butil::IOBufBytesIterator it(out);
+    ctx->ConsumeFrameHead(it, &frame_head);
+    ASSERT_EQ(brpc::policy::H2_FRAME_HEADERS, frame_head.type);
+    ASSERT_EQ(0x05 /* H2_FLAGS_END_STREAM | H2_FLAGS_END_HEADERS */,
+              frame_head.flags);
+    ASSERT_EQ(brpc::policy::FRAME_HEAD_SIZE + frame_head.payload_size, out.size());
+    const std::string headers = out.to_string();
+    ASSERT_NE(std::string::npos, headers.find("grpc-status"));
+    ASSERT_NE(std::string::npos, headers.find("grpc-message"));
+}
+
+TEST_F(HttpTest, http2_response_waits_for_window_while_writing) {
+    brpc::policy::H2Context* ctx = new brpc::policy::H2Context(_socket.get(), NULL);
+    CHECK_EQ(ctx->Init(), 0);
+    _socket->initialize_parsing_context(&ctx);
+    ctx->_conn_state = brpc::policy::H2_CONNECTION_READY;
+
+    const int stream_id = 1;
+    butil::intrusive_ptr<brpc::policy::H2StreamWriter> writer =
+        brpc::policy::H2StreamWriter::Create(_socket.get(), stream_id, false);
+    ASSERT_TRUE(writer != NULL);
+
+    // The response is queued while the writer is writing and packed by the
+    // writing thread. Its body not fitting in the window left is sent by
+    // another writer created there.
+    ctx->_remote_window_left.store(15);
+    brpc::Controller cntl;
+    cntl.response_attachment().resize(20, 'b');
+    QueueMessageConnection conn(_socket.get(),
+                                brpc::policy::H2UnsentResponse::New(&cntl, 3, false));
+    _socket->_conn = &conn;
+    butil::IOBuf data;
+    data.resize(10, 'a');
+    ASSERT_EQ(0, writer->Write(&data));
+    writer->Close();
+
+    // DATA of stream 1, then HEADERS and DATA within the window of stream 3
+    // which are queued before the end of stream 1.
+    butil::IOPortal data_buf;
+    brpc::policy::H2FrameHead frame_head;
+    std::vector<brpc::policy::H2FrameHead> frames;
+    while (frames.size() < 4) {
+        ASSERT_GT(data_buf.append_from_file_descriptor(_pipe_fds[0], 1024), 0);
+        frames.clear();
+        butil::IOBufBytesIterator it(data_buf);
+        while (it.bytes_left() >= brpc::policy::FRAME_HEAD_SIZE) {
+            ctx->ConsumeFrameHead(it, &frame_head);
+            if (it.bytes_left() < frame_head.payload_size) {
+                break;
+            }
+            it.forward(frame_head.payload_size);
+            frames.push_back(frame_head);
+        }
+    }
+    _socket->_conn = NULL;
+    ASSERT_EQ(4u, frames.size());
+    ASSERT_EQ(brpc::policy::H2_FRAME_DATA, frames[0].type);
+    ASSERT_EQ(stream_id, frames[0].stream_id);
+    ASSERT_EQ(10u, frames[0].payload_size);
+    ASSERT_EQ(brpc::policy::H2_FRAME_HEADERS, frames[1].type);
+    ASSERT_EQ(3, frames[1].stream_id);
+    ASSERT_EQ(brpc::policy::H2_FRAME_DATA, frames[2].type);
+    ASSERT_EQ(3, frames[2].stream_id);
+    ASSERT_EQ(5u, frames[2].payload_size);
+    ASSERT_EQ(brpc::policy::H2_FRAME_DATA, frames[3].type);
+    ASSERT_EQ(stream_id, frames[3].stream_id);
+    ASSERT_EQ(0x01 /* H2_FLAGS_END_STREAM */, frames[3].flags);
+    ASSERT_EQ(1u, ctx->_stream_writers.size());
+
+    // WINDOW_UPDATE of the connection sends the rest of the response.
+    char winbuf[brpc::policy::FRAME_HEAD_SIZE + 4];
+    brpc::policy::SerializeFrameHead(winbuf, 4, brpc::policy::H2_FRAME_WINDOW_UPDATE, 0, 0);
+    SaveUint32(winbuf + brpc::policy::FRAME_HEAD_SIZE, 100);
+    butil::IOBuf buf;
+    buf.append(winbuf, sizeof(winbuf));
+    brpc::policy::ParseH2Message(&buf, _socket.get(), false, NULL);
+    data_buf.clear();
+    ASSERT_EQ(data_buf.append_from_file_descriptor(_pipe_fds[0], 1024),
+              (ssize_t)(brpc::policy::FRAME_HEAD_SIZE * 2 + 15));
+    {
+        butil::IOBufBytesIterator it(data_buf);
+        ctx->ConsumeFrameHead(it, &frame_head);
+        ASSERT_EQ(3, frame_head.stream_id);
+        ASSERT_EQ(15u, frame_head.payload_size);
+        it.forward(frame_head.payload_size);
+        ctx->ConsumeFrameHead(it, &frame_head);
+        ASSERT_EQ(0x01 /* H2_FLAGS_END_STREAM */, frame_head.flags);
+        ASSERT_EQ(0u, frame_head.payload_size);
+    }
+    ASSERT_TRUE(ctx->_stream_writers.empty());
+}
+
+class CountingReader : public brpc::ProgressiveReader {
+public:
+    CountingReader() : _nread(0), _ended(false) {}
+
+    // @ProgressiveReader
+    butil::Status OnReadOnePart(const void* /*data*/, size_t length) override {
+        _nread.fetch_add(length);
+        return butil::Status::OK();
+    }
+    void OnEndOfMessage(const butil::Status& st) override {
+        _status = st;
+        _ended.store(true);
+    }
+
+    size_t read_bytes() const { return _nread.load(); }
+    bool ended() const { return _ended.load(); }
+    const butil::Status& status() const { return _status; }
+
+private:
+    butil::atomic<size_t> _nread;
+    butil::atomic<bool> _ended;
+    butil::Status _status;
+};
+
+TEST_F(HttpTest, http2_read_body_progressively_with_backpressure) {
+    brpc::policy::H2Context* ctx = new brpc::policy::H2Context(_socket.get(), NULL);
+    CHECK_EQ(ctx->Init(), 0);
+    _socket->initialize_parsing_context(&ctx);
+    ctx->_conn_state = brpc::policy::H2_CONNECTION_READY;
+
+    const int stream_id = 1;
+    brpc::policy::H2StreamContext* sctx = new brpc::policy::H2StreamContext(true);
+    sctx->Init(ctx, stream_id);
+    // Update the stream-level window after consuming 100 bytes.
+    sctx->_local_window_size = 200;
+    ASSERT_EQ(0, ctx->TryToInsertStream(stream_id, sctx));
+    ASSERT_EQ(sctx, sctx->OnHeadersComplete().message());
+    ASSERT_TRUE(sctx->is_stage2());
+
+    // The body is buffered without WINDOW_UPDATE before the reader is set.
+    char databuf[brpc::policy::FRAME_HEAD_SIZE + 150];
+    brpc::policy::SerializeFrameHead(databuf, 150, brpc::policy::H2_FRAME_DATA,
+                                     0, stream_id);
+    memset(databuf + brpc::policy::FRAME_HEAD_SIZE, 'a', 150);
+    butil::IOBuf buf;
+    buf.append(databuf, sizeof(databuf));
+    brpc::policy::ParseH2Message(&buf, _socket.get(), false, NULL);
+    usleep(100000);
+    int nbytes = -1;
+    ASSERT_EQ(0, ioctl(_pipe_fds[0], FIONREAD, &nbytes));
+    ASSERT_EQ(0, nbytes);
+    ASSERT_EQ(150, sctx->_unacked_body_size.load());
+
+    // The window is updated after the reader consumes the body.
+    CountingReader reader;
+    sctx->ReadProgressiveAttachmentBy(&reader);
+    butil::IOPortal out_buf;
+    ASSERT_EQ(out_buf.append_from_file_descriptor(_pipe_fds[0], 1024),
+              (ssize_t)brpc::policy::FRAME_HEAD_SIZE + 4);
+    ASSERT_EQ(150u, reader.read_bytes());
+    {
+        butil::IOBufBytesIterator it(out_buf);
+        brpc::policy::H2FrameHead frame_head;
+        ctx->ConsumeFrameHead(it, &frame_head);
+        ASSERT_EQ(brpc::policy::H2_FRAME_WINDOW_UPDATE, frame_head.type);
+        ASSERT_EQ(stream_id, frame_head.stream_id);
+        uint8_t inc[4];
+        ASSERT_EQ(4u, it.copy_and_forward(inc, sizeof(inc)));
+        ASSERT_EQ(150u, ((uint32_t)inc[0] << 24) | ((uint32_t)inc[1] << 16) |
+                        ((uint32_t)inc[2] << 8) | inc[3]);
+    }
+    ASSERT_EQ(0, sctx->_unacked_body_size.load());
+
+    // The end of stream ends the body after the data before it.
+    brpc::policy::SerializeFrameHead(databuf, 10, brpc::policy::H2_FRAME_DATA,
+                                     0x01 /* H2_FLAGS_END_STREAM */, stream_id);
+    buf.append(databuf, brpc::policy::FRAME_HEAD_SIZE + 10);
+    brpc::policy::ParseH2Message(&buf, _socket.get(), false, NULL);
+    while (!reader.ended()) {
+        usleep(1000);
+    }
+    ASSERT_EQ(160u, reader.read_bytes());
+    ASSERT_TRUE(reader.status().ok()) << reader.status();
+    ASSERT_TRUE(ctx->FindStream(stream_id) == NULL);
+    sctx->Destroy();
+}
+
 TEST_F(HttpTest, http2_invalid_settings) {
     {
         brpc::Server server;
@@ -1936,6 +2703,198 @@ TEST_F(HttpTest, http_head) {
     }
 }
 
+// A HTTP/1.1 server answering requests over one connection strictly in the
+// order they arrived, like servers supporting pipelining must do. Nothing is
+// answered until all `nrequest' requests arrived, so the requests must have
+// been pipelined. The body of each response is the path of its request.
+struct InOrderHttpServer {
+    enum Ending {
+        KEEP_ALIVE,        // Answer all requests.
+        CONNECTION_CLOSE,  // Answer the first request with "Connection: close"
+                           // and close the connection.
+        BREAK,             // Close the connection without answering.
+    };
+    int listenfd;
+    size_t nrequest;
+    Ending ending;
+};
+
+static void* RunInOrderHttpServer(void* arg) {
+    InOrderHttpServer* s = static_cast<InOrderHttpServer*>(arg);
+    butil::fd_guard fd(accept(s->listenfd, NULL, NULL));
+    if (fd < 0) {
+        return NULL;
+    }
+    std::string input;
+    std::vector<std::string> paths;
+    char buf[1024];
+    while (paths.size() < s->nrequest) {
+        const ssize_t nr = read(fd, buf, sizeof(buf));
+        if (nr <= 0) {
+            return NULL;
+        }
+        input.append(buf, nr);
+        // Requests are GETs without body: "GET <path> HTTP/1.1\r\n...\r\n\r\n".
+        size_t end;
+        while ((end = input.find("\r\n\r\n")) != std::string::npos) {
+            const size_t path_begin = input.find(' ') + 1;
+            paths.push_back(input.substr(
+                path_begin, input.find(' ', path_begin) - path_begin));
+            input.erase(0, end + 4);
+        }
+    }
+    if (s->ending == InOrderHttpServer::BREAK) {
+        return NULL;
+    }
+    std::string output;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        output.append("HTTP/1.1 200 OK\r\n");
+        if (s->ending == InOrderHttpServer::CONNECTION_CLOSE) {
+            output.append("Connection: close\r\n");
+        }
+        butil::string_appendf(&output, "Content-Length: %zu\r\n\r\n",
+                              paths[i].size());
+        output.append(paths[i]);
+        if (s->ending == InOrderHttpServer::CONNECTION_CLOSE) {
+            break;
+        }
+    }
+    for (size_t nw = 0; nw < output.size();) {
+        const ssize_t rc = write(fd, output.data() + nw, output.size() - nw);
+        if (rc <= 0) {
+            return NULL;
+        }
+        nw += rc;
+    }
+    if (s->ending == InOrderHttpServer::KEEP_ALIVE) {
+        // Keep the connection until the client closes it.
+        while (read(fd, buf, sizeof(buf)) > 0) {}
+    }
+    return NULL;
+}
+
+// Send `n' GETs of "/0", "/1" ... concurrently over a single connection to
+// an InOrderHttpServer on `port'.
+static void CallInOrderHttpServer(int port, InOrderHttpServer::Ending ending,
+                                  brpc::Controller* cntls, size_t n) {
+    butil::fd_guard listenfd(butil::tcp_listen(butil::EndPoint(butil::IP_ANY, port)));
+    ASSERT_GT(listenfd, 0);
+    InOrderHttpServer server = { listenfd, n, ending };
+    pthread_t tid;
+    ASSERT_EQ(0, pthread_create(&tid, NULL, RunInOrderHttpServer, &server));
+    {
+        brpc::Channel channel;
+        brpc::ChannelOptions options;
+        options.protocol = brpc::PROTOCOL_HTTP;
+        options.connection_type = brpc::CONNECTION_TYPE_SINGLE;
+        options.http_pipelining = true;
+        options.timeout_ms = 5000;
+        options.max_retry = 0;
+        ASSERT_EQ(0, channel.Init(butil::EndPoint(butil::my_ip(), port), &options));
+        for (size_t i = 0; i < n; ++i) {
+            cntls[i].http_request().uri() = butil::string_printf("/%zu", i);
+            channel.CallMethod(NULL, &cntls[i], NULL, NULL, brpc::DoNothing());
+        }
+        for (size_t i = 0; i < n; ++i) {
+            brpc::Join(cntls[i].call_id());
+        }
+    }
+    pthread_join(tid, NULL);
+}
+
+TEST_F(HttpTest, http_pipelining) {
+    const size_t N = 8;
+    brpc::Controller cntls[N];
+    CallInOrderHttpServer(8931, InOrderHttpServer::KEEP_ALIVE, cntls, N);
+    // Each response is matched with its own request.
+    for (size_t i = 0; i < N; ++i) {
+        ASSERT_FALSE(cntls[i].Failed()) << cntls[i].ErrorText();
+        ASSERT_EQ(brpc::CONNECTION_TYPE_SINGLE, cntls[i].connection_type());
+        ASSERT_EQ(cntls[i].http_request().uri().path(),
+                  cntls[i].response_attachment().to_string());
+    }
+}
+
+TEST_F(HttpTest, http_pipelining_connection_close) {
+    const size_t N = 8;
+    brpc::Controller cntls[N];
+    CallInOrderHttpServer(8932, InOrderHttpServer::CONNECTION_CLOSE, cntls, N);
+    // The first request sent is answered, requests waiting behind it fail
+    // with retryable errors.
+    size_t nsucc = 0;
+    for (size_t i = 0; i < N; ++i) {
+        if (!cntls[i].Failed()) {
+            ++nsucc;
+            ASSERT_EQ(cntls[i].http_request().uri().path(),
+                      cntls[i].response_attachment().to_string());
+        } else {
+            ASSERT_TRUE(cntls[i].ErrorCode() == brpc::EFAILEDSOCKET ||
+                        cntls[i].ErrorCode() == brpc::EEOF)
+                << cntls[i].ErrorText();
+        }
+    }
+    ASSERT_EQ(1u, nsucc);
+}
+
+TEST_F(HttpTest, http_pipelining_broken_connection) {
+    const size_t N = 8;
+    brpc::Controller cntls[N];
+    CallInOrderHttpServer(8933, InOrderHttpServer::BREAK, cntls, N);
+    // All requests waiting for responses fail with retryable errors.
+    for (size_t i = 0; i < N; ++i) {
+        ASSERT_TRUE(cntls[i].Failed());
+        ASSERT_TRUE(cntls[i].ErrorCode() == brpc::EFAILEDSOCKET ||
+                    cntls[i].ErrorCode() == brpc::EEOF)
+            << cntls[i].ErrorText();
+    }
+}
+
+TEST_F(HttpTest, http_pipelining_fallback_to_pooled) {
+    const int port = 8923;
+    brpc::Server server;
+    EXPECT_EQ(0, server.Start(port, NULL));
+
+    brpc::Channel channel;
+    brpc::ChannelOptions options;
+    options.protocol = brpc::PROTOCOL_HTTP;
+    options.connection_type = brpc::CONNECTION_TYPE_SINGLE;
+    // Pipelining must be confirmed explicitly.
+    ASSERT_EQ(-1, channel.Init(butil::EndPoint(butil::my_ip(), port), &options));
+    // The brpc server may answer pipelined requests out of order, which is
+    // harmless here since all responses to /health are the same.
+    options.http_pipelining = true;
+    ASSERT_EQ(0, channel.Init(butil::EndPoint(butil::my_ip(), port), &options));
+
+    // Non-idempotent requests are sent over pooled connections.
+    {
+        brpc::Controller cntl;
+        cntl.http_request().uri() = "/health";
+        cntl.http_request().set_method(brpc::HTTP_METHOD_POST);
+        cntl.request_attachment().append("body");
+        channel.CallMethod(NULL, &cntl, NULL, NULL, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(brpc::CONNECTION_TYPE_POOLED, cntl.connection_type());
+        ASSERT_EQ("OK", cntl.response_attachment());
+    }
+
+    // So are requests beyond -http_max_pipelined_requests.
+    ASSERT_FALSE(GFLAGS_NAMESPACE::SetCommandLineOption(
+                     "http_max_pipelined_requests", "2").empty());
+    const size_t N = 32;
+    brpc::Controller cntls[N];
+    for (size_t i = 0; i < N; ++i) {
+        cntls[i].http_request().uri() = "/health";
+        channel.CallMethod(NULL, &cntls[i], NULL, NULL, brpc::DoNothing());
+    }
+    for (size_t i = 0; i < N; ++i) {
+        brpc::Join(cntls[i].call_id());
+        ASSERT_FALSE(cntls[i].Failed()) << cntls[i].ErrorText();
+        ASSERT_EQ("OK", cntls[i].response_attachment());
+    }
+    ASSERT_FALSE(GFLAGS_NAMESPACE::SetCommandLineOption(
+                     "http_max_pipelined_requests", "16").empty());
+}
+
 #define BRPC_CRLF "\r\n"
 
 void MakeHttpRequestHeaders(butil::IOBuf* out,
@@ -2229,4 +3188,66 @@ TEST_F(HttpTest, http10_auth_failed_response) {
   _server._options.auth = original_auth;
 }
 
+#ifdef BRPC_WITH_LZ4
+class Lz4EchoService : public ::test::EchoService {
+public:
+    void Echo(::google::protobuf::RpcController* cntl_base,
+              const ::test::EchoRequest* req,
+              ::test::EchoResponse* res,
+              ::google::protobuf::Closure* done) override {
+        brpc::ClosureGuard done_guard(done);
+        brpc::Controller* cntl = static_cast<brpc::Controller*>(cntl_base);
+        const std::string* encoding =
+            cntl->http_request().GetHeader("Content-Encoding");
+        ASSERT_TRUE(encoding != NULL);
+        ASSERT_EQ("lz4", *encoding);
+        res->set_message(req->message());
+        cntl->set_response_compress_type(brpc::COMPRESS_TYPE_LZ4);
+    }
+};
+
+TEST_F(HttpTest, lz4_content_encoding) {
+    const int port = 8923;
+    brpc::Server server;
+    Lz4EchoService svc;
+    EXPECT_EQ(0, server.AddService(&svc, brpc::SERVER_DOESNT_OWN_SERVICE));
+    EXPECT_EQ(0, server.Start(port, NULL));
+
+    brpc::Channel channel;
+    brpc::ChannelOptions options;
+    options.protocol = brpc::PROTOCOL_HTTP;
+    ASSERT_EQ(0, channel.Init(butil::EndPoint(butil::my_ip(), port), &options));
+    test::EchoService_Stub stub(&channel);
+    std::string message;
+    for (int i = 0; i < 4096; ++i) {
+        message.push_back('a' + i % 7);
+    }
+    test::EchoRequest req;
+    req.set_message(message);
+    {
+        brpc::Controller cntl;
+        test::EchoResponse res;
+        cntl.set_request_compress_type(brpc::COMPRESS_TYPE_LZ4);
+        cntl.http_request().SetHeader("Accept-Encoding", "gzip, lz4");
+        stub.Echo(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        const std::string* encoding =
+            cntl.http_response().GetHeader("Content-Encoding");
+        ASSERT_TRUE(encoding != NULL);
+        ASSERT_EQ("lz4", *encoding);
+        ASSERT_EQ(message, res.message());
+    }
+    {
+        // Response is not compressed if the client does not accept lz4.
+        brpc::Controller cntl;
+        test::EchoResponse res;
+        cntl.set_request_compress_type(brpc::COMPRESS_TYPE_LZ4);
+        stub.Echo(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_TRUE(cntl.http_response().GetHeader("Content-Encoding") == NULL);
+        ASSERT_EQ(message, res.message());
+    }
+}
+#endif // BRPC_WITH_LZ4
+
 } //namespace
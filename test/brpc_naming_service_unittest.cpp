@@ -33,6 +33,8 @@
 #include "brpc/policy/remote_file_naming_service.h"
 #include "brpc/policy/discovery_naming_service.h"
 #include "brpc/policy/nacos_naming_service.h"
+#include "brpc/details/server_subset.h"
+#include "brpc/channel.h"
 #include "echo.pb.h"
 #include "brpc/server.h"
 
@@ -847,4 +849,88 @@ TEST(NamingServiceTest, nacos) {
     }
 }
 
+static std::vector<brpc::ServerNode> MakeServers(int begin, int end) {
+    std::vector<brpc::ServerNode> servers;
+    for (int i = begin; i < end; ++i) {
+        butil::EndPoint ep;
+        EXPECT_EQ(0, butil::str2endpoint(
+            butil::string_printf("10.0.%d.%d:8000", i / 256, i % 256).c_str(), &ep));
+        servers.push_back(brpc::ServerNode(ep));
+    }
+    return servers;
+}
+
+static size_t CountCommon(const std::vector<brpc::ServerNode>& s1,
+                          const std::vector<brpc::ServerNode>& s2) {
+    std::vector<brpc::ServerNode> common;
+    std::set_intersection(s1.begin(), s1.end(), s2.begin(), s2.end(),
+                          std::back_inserter(common));
+    return common.size();
+}
+
+TEST(NamingServiceTest, server_subset) {
+    std::vector<brpc::ServerNode> servers = MakeServers(0, 200);
+    brpc::ServerSubsetOptions opt;
+    std::vector<brpc::ServerNode> subset;
+    brpc::SelectServerSubset(servers, opt, &subset);
+    ASSERT_EQ(servers.size(), subset.size());
+
+    for (int client_count = 0; client_count <= 100; client_count += 100) {
+        opt.size = 10;
+        opt.client_count = client_count;
+        opt.client_id = 7;
+        brpc::SelectServerSubset(servers, opt, &subset);
+        ASSERT_EQ(10u, subset.size());
+
+        // Order of input does not matter.
+        std::vector<brpc::ServerNode> reversed(servers.rbegin(), servers.rend());
+        std::vector<brpc::ServerNode> subset2;
+        brpc::SelectServerSubset(reversed, opt, &subset2);
+        ASSERT_EQ(subset, subset2);
+
+        // Adding or removing a server changes the subset slightly.
+        std::vector<brpc::ServerNode> more = MakeServers(0, 201);
+        brpc::SelectServerSubset(more, opt, &subset2);
+        ASSERT_GE(CountCommon(subset, subset2), 8u);
+        std::vector<brpc::ServerNode> less = MakeServers(1, 200);
+        brpc::SelectServerSubset(less, opt, &subset2);
+        ASSERT_GE(CountCommon(subset, subset2), 8u);
+    }
+
+    // Clients spread evenly over servers with deterministic aperture.
+    std::map<brpc::ServerNode, int> load;
+    opt.size = 10;
+    opt.client_count = 100;
+    for (int i = 0; i < opt.client_count; ++i) {
+        opt.client_id = i;
+        brpc::SelectServerSubset(servers, opt, &subset);
+        for (size_t j = 0; j < subset.size(); ++j) {
+            ++load[subset[j]];
+        }
+    }
+    ASSERT_EQ(servers.size(), load.size());
+    for (std::map<brpc::ServerNode, int>::iterator
+             it = load.begin(); it != load.end(); ++it) {
+        ASSERT_GE(it->second, 4);
+        ASSERT_LE(it->second, 6);
+    }
+}
+
+TEST(NamingServiceTest, channel_with_subset) {
+    std::string url = "list://";
+    for (int i = 0; i < 20; ++i) {
+        url.append(butil::string_printf("127.0.0.1:%d,", 18000 + i));
+    }
+    brpc::ChannelOptions opt;
+    opt.subset_size = 5;
+    opt.subset_client_id = 1;
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init(url.c_str(), "rr", &opt));
+    ASSERT_EQ(5, channel.Weight());
+
+    brpc::Channel channel2;
+    ASSERT_EQ(0, channel2.Init(url.c_str(), "rr", NULL));
+    ASSERT_EQ(20, channel2.Weight());
+}
+
 } //namespace
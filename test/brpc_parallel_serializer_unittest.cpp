@@ -0,0 +1,156 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <gtest/gtest.h>
+#include <gflags/gflags.h>
+#include "butil/time.h"
+#include "brpc/server.h"
+#include "brpc/channel.h"
+#include "brpc/controller.h"
+#include "brpc/details/parallel_serializer.h"
+#include "addressbook.pb.h"
+#include "echo.pb.h"
+
+namespace brpc {
+DECLARE_int32(parallel_serialization_min_chunk_size);
+}
+
+namespace {
+
+class ParallelSerializerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        _saved_min_chunk_size = brpc::FLAGS_parallel_serialization_min_chunk_size;
+        brpc::FLAGS_parallel_serialization_min_chunk_size = 1024;
+    }
+    void TearDown() override {
+        brpc::FLAGS_parallel_serialization_min_chunk_size = _saved_min_chunk_size;
+    }
+private:
+    int32_t _saved_min_chunk_size;
+};
+
+void FillPerson(addressbook::Person* person, int nphone) {
+    person->set_name("person");
+    person->set_id(1);
+    person->set_email("person@example.com");
+    person->set_datadouble(1.5);
+    person->set_databyte(std::string(100, 'b'));
+    person->SetExtension(addressbook::hobby, "serializing");
+    for (int i = 0; i < nphone; ++i) {
+        addressbook::Person::PhoneNumber* phone = person->add_phone();
+        phone->set_number(std::string(32, '0' + i % 10));
+        phone->set_type(addressbook::Person::WORK);
+    }
+}
+
+void FillComboResponse(test::ComboResponse* res, int n) {
+    for (int i = 0; i < n; ++i) {
+        test::EchoResponse* r = res->add_responses();
+        r->set_message(std::string(100, 'a' + i % 26));
+        r->add_code_list(i);
+    }
+}
+
+TEST_F(ParallelSerializerTest, same_as_serial) {
+    addressbook::Person person;
+    FillPerson(&person, 10000);
+    std::string expected;
+    ASSERT_TRUE(person.SerializeToString(&expected));
+    for (size_t min_size : { (size_t)0, expected.size() + 1 }) {
+        butil::IOBuf buf;
+        ASSERT_TRUE(brpc::SerializeInParallel(person, min_size, &buf));
+        ASSERT_EQ(expected, buf.to_string());
+    }
+
+    addressbook::AddressBook book;
+    for (int i = 0; i < 100; ++i) {
+        FillPerson(book.add_person(), 10);
+    }
+    ASSERT_TRUE(book.SerializeToString(&expected));
+    butil::IOBuf buf;
+    ASSERT_TRUE(brpc::SerializeInParallel(book, 0, &buf));
+    ASSERT_EQ(expected, buf.to_string());
+
+    // Messages without splittable fields.
+    addressbook::Person empty_phone;
+    FillPerson(&empty_phone, 0);
+    ASSERT_TRUE(empty_phone.SerializeToString(&expected));
+    buf.clear();
+    ASSERT_TRUE(brpc::SerializeInParallel(empty_phone, 0, &buf));
+    ASSERT_EQ(expected, buf.to_string());
+}
+
+TEST_F(ParallelSerializerTest, performance) {
+    brpc::FLAGS_parallel_serialization_min_chunk_size = 256 * 1024;
+    test::ComboResponse res;
+    FillComboResponse(&res, 200000);
+    butil::Timer tm;
+    std::string serial;
+    tm.start();
+    ASSERT_TRUE(res.SerializeToString(&serial));
+    tm.stop();
+    const int64_t serial_us = tm.u_elapsed();
+    butil::IOBuf buf;
+    tm.start();
+    ASSERT_TRUE(brpc::SerializeInParallel(res, 0, &buf));
+    tm.stop();
+    ASSERT_EQ(serial, buf.to_string());
+    LOG(INFO) << "Serialized " << serial.size() << " bytes serially in "
+              << serial_us << "us, in parallel in " << tm.u_elapsed() << "us";
+}
+
+class ComboServiceImpl : public test::EchoService {
+public:
+    void ComboEcho(google::protobuf::RpcController*,
+                   const test::ComboRequest* req,
+                   test::ComboResponse* res,
+                   google::protobuf::Closure* done) override {
+        brpc::ClosureGuard done_guard(done);
+        FillComboResponse(res, req->requests(0).code());
+    }
+};
+
+TEST_F(ParallelSerializerTest, baidu_std) {
+    brpc::Server server;
+    ComboServiceImpl service;
+    ASSERT_EQ(0, server.AddService(&service, brpc::SERVER_DOESNT_OWN_SERVICE));
+    brpc::ServerOptions options;
+    options.parallel_serialization_min_size = 64 * 1024;
+    ASSERT_EQ(0, server.Start(8928, &options));
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init("127.0.0.1:8928", NULL));
+    test::EchoService_Stub stub(&channel);
+
+    for (int n : { 10, 50000 }) {
+        brpc::Controller cntl;
+        test::ComboRequest req;
+        test::ComboResponse res;
+        req.add_requests()->set_code(n);
+        req.mutable_requests(0)->set_message("combo");
+        stub.ComboEcho(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        test::ComboResponse expected;
+        FillComboResponse(&expected, n);
+        ASSERT_EQ(expected.SerializeAsString(), res.SerializeAsString());
+    }
+    ASSERT_EQ(0, server.Stop(0));
+    ASSERT_EQ(0, server.Join());
+}
+
+} // namespace
@@ -1787,6 +1787,291 @@ TEST_F(ProtobufJsonTest, parse_multiple_json_error) {
     ASSERT_EQ(47ul, offset);
 }
 
+TEST_F(ProtobufJsonTest, iobuf_to_pb_case) {
+    // Single-pass conversion from IOBuf should produce the same messages as
+    // the DOM-based one.
+    const std::string json1 =
+        "{\"content\":[{\"distance\":1,\"unknown_member\":{\"a\":[1,{}]},\"ext\":"
+        "{\"age\":1666666666, \"databyte\":\"d2VsY29tZQ==\", \"enumtype\":1},"
+        "\"uid\":\"someone\"},{\"distance\":10,\"unknown_member\":[[20]],"
+        "\"ext\":{\"age\":1666666660, \"databyte\":\"d2VsY29tZQ==\","
+        "\"enumtype\":\"WORK\"},\"uid\":\"someone0\"}], \"judge\":false,"
+        "\"spur\":\"-Infinity\", \"type\":[\"123\"], \"data\":[1,2,3,4,5,6,7,8,9,10]}";
+    JsonContextBody data1;
+    std::string error1;
+    ASSERT_TRUE(json2pb::JsonToProtoMessage(json1, &data1, &error1));
+    JsonContextBody data2;
+    std::string error2;
+    butil::IOBuf buf;
+    buf.append(json1);
+    ASSERT_TRUE(json2pb::JsonToProtoMessage(buf, &data2, json2pb::Json2PbOptions(),
+                                            &error2));
+    ASSERT_EQ(data1.SerializeAsString(), data2.SerializeAsString());
+    ASSERT_EQ(error1, error2);
+    ASSERT_EQ("Invalid value `array' for optional field `JsonContextBody.type' "
+              "which SHOULD be INT64", error2);
+
+    const std::string json2 =
+        "{\"@Content_Test%@\":[{\"Distance_info_\":1,"
+        "\"_ext%T_\":{\"Aa_ge(\":1666666666, \"databyte(std::string)\":"
+        "\"d2VsY29tZQ==\", \"enum--type\":\"HOME\"},\"uid*\":\"welcome\"}],"
+        "\"judge\":false, \"spur\":2, \"data:array\":[]}";
+    JsonContextBodyEncDec data3;
+    ASSERT_TRUE(json2pb::JsonToProtoMessage(json2, &data3));
+    JsonContextBodyEncDec data4;
+    buf.clear();
+    buf.append(json2);
+    ASSERT_TRUE(json2pb::JsonToProtoMessage(buf, &data4, json2pb::Json2PbOptions()));
+    ASSERT_EQ(data3.SerializeAsString(), data4.SerializeAsString());
+    ASSERT_EQ(1, data4._z064_content_test_z037__z064__size());
+
+    // Keys are matched against the decoded names of fields, the encoded
+    // names are not json names.
+    buf.clear();
+    buf.append("{\"uid_Z042_\":\"foo\",\"Distance_info_\":1}");
+    ContentEncDec content1;
+    ASSERT_TRUE(json2pb::JsonToProtoMessage(buf.to_string(), &content1));
+    ContentEncDec content2;
+    ASSERT_TRUE(json2pb::JsonToProtoMessage(buf, &content2, json2pb::Json2PbOptions()));
+    ASSERT_FALSE(content2.has_uid_z042_());
+    ASSERT_EQ(content1.SerializeAsString(), content2.SerializeAsString());
+
+    const std::string json3 =
+        "{\"addr\":\"baidu.com\","
+        "\"numbers\":{\"tel\":123456,\"cell\":654321},"
+        "\"contacts\":{\"email\":\"frank@baidu.com\","
+        "               \"office\":\"Shanghai\"},"
+        "\"friends\":{\"John\":[{\"school\":\"SJTU\",\"year\":2007}]}}";
+    buf.clear();
+    buf.append(json3);
+    AddressIntMap ab1;
+    ASSERT_TRUE(json2pb::JsonToProtoMessage(buf, &ab1, json2pb::Json2PbOptions()));
+    ASSERT_EQ(2, ab1.numbers_size());
+    ASSERT_EQ("cell", ab1.numbers(1).key());
+    ASSERT_EQ(654321, ab1.numbers(1).value());
+    AddressComplex ab2;
+    std::string error3;
+    ASSERT_TRUE(json2pb::JsonToProtoMessage(buf, &ab2, json2pb::Json2PbOptions(),
+                                            &error3)) << error3;
+    ASSERT_EQ("John", ab2.friends(0).key());
+    ASSERT_EQ("SJTU", ab2.friends(0).value(0).school());
+    ASSERT_EQ(2007, ab2.friends(0).value(0).year());
+
+    buf.clear();
+    buf.append("{\"name\":\"hello\",\"id\":9,\"datadouble\":2.2,\"hobby\":\"coding\"}");
+    Person person;
+    ASSERT_TRUE(json2pb::JsonToProtoMessage(buf, &person, json2pb::Json2PbOptions()));
+    ASSERT_EQ("coding", person.GetExtension(addressbook::hobby));
+
+    buf.clear();
+    buf.append("[{\"name\":\"foo\",\"id\":1},{\"name\":\"bar\",\"id\":2}]");
+    AddressBookEncDec ab3;
+    json2pb::Json2PbOptions options;
+    ASSERT_FALSE(json2pb::JsonToProtoMessage(buf, &ab3, options, &error3));
+    ASSERT_EQ("The input is not a json object [AddressBookEncDec]", error3);
+    options.array_to_single_repeated = true;
+    ASSERT_TRUE(json2pb::JsonToProtoMessage(buf, &ab3, options, &error3)) << error3;
+    ASSERT_EQ(2, ab3.person_size());
+    ASSERT_EQ("bar", ab3.person(1).name());
+}
+
+TEST_F(ProtobufJsonTest, iobuf_to_pb_failed_case) {
+    struct {
+        const char* json;
+        const char* error;
+    } cases[] = {
+        { "{\"content\":[{\"ext\":{\"age\":1, \"databyte\":\"d2VsY29tZQ==\"}}],"
+          "\"judge\":false, \"spur\":2}",
+          "Missing required field: Content.distance" },
+        { "{\"judge\":false, \"spur\":2}", NULL },
+        { "{\"spur\":2}", "Missing required field: JsonContextBody.judge" },
+        { "{\"judge\":\"false\", \"spur\":2}",
+          "Invalid value `\"false\"' for field `JsonContextBody.judge' which SHOULD be BOOL" },
+        { "{\"judge\":false, \"spur\":2, \"data\":[\"1\"]}",
+          "Invalid value `\"1\"' for field `JsonContextBody.data' which SHOULD be INT32" },
+        { "{\"judge\":false, \"spur\":2, \"data\":[[1]]}",
+          "Invalid value `array' for field `JsonContextBody.data' which SHOULD be INT32" },
+        { "{\"judge\":false, \"spur\":2, \"info\":2}",
+          "Invalid value for repeated field: JsonContextBody.info" },
+        { "{\"judge\":false, \"spur\":\"NaNa\"}",
+          "Invalid value `\"NaNa\"' for field `JsonContextBody.spur' which SHOULD be d" },
+        { "{\"judge\":false, \"spur\":2, \"content\":[1]}",
+          "Invalid value `1' for field `JsonContextBody.content' which SHOULD be message" },
+        { "{\"judge\":false, \"spur\":2, \"data\":[1,2}",
+          "Invalid json: Missing a comma or ']' after an array element. [JsonContextBody]" },
+        { "1", "The input is not a json object [JsonContextBody]" },
+    };
+    for (size_t i = 0; i < arraysize(cases); ++i) {
+        butil::IOBuf buf;
+        buf.append(cases[i].json);
+        JsonContextBody data;
+        std::string error;
+        const bool ret = json2pb::JsonToProtoMessage(
+            buf, &data, json2pb::Json2PbOptions(), &error);
+        if (cases[i].error == NULL) {
+            ASSERT_TRUE(ret) << error;
+        } else {
+            ASSERT_FALSE(ret) << cases[i].json;
+            ASSERT_EQ(cases[i].error, error) << cases[i].json;
+        }
+    }
+
+    // Errors are reported in the order that fields appear in the json.
+    butil::IOBuf buf;
+    buf.append("{\"content\":[{\"distance\":5,\"ext\":{\"age\":1, \"databyte\":"
+               "\"d2VsY29tZQ==\", \"enumtype\":15}}], \"judge\":false,"
+               "\"spur\":2, \"type\":[\"123\"]}");
+    JsonContextBody data;
+    std::string error;
+    ASSERT_TRUE(json2pb::JsonToProtoMessage(buf, &data, json2pb::Json2PbOptions(),
+                                            &error));
+    ASSERT_EQ("Invalid value `15' for optional field `Ext.enumtype' which SHOULD be "
+              "enum, Invalid value `array' for optional field `JsonContextBody.type' "
+              "which SHOULD be INT64", error);
+
+    std::string nested_json;
+    for (int i = 0; i < DEEP_RECURSION_TEST_DEPTH; ++i) {
+        nested_json += "{\"child\":";
+    }
+    buf.clear();
+    buf.append(nested_json);
+    test::RecursiveMessage msg;
+    ASSERT_FALSE(json2pb::JsonToProtoMessage(buf, &msg, json2pb::Json2PbOptions(),
+                                             &error));
+    ASSERT_EQ("Exceeded maximum recursion depth [RecursiveMessage]", error);
+}
+
+TEST_F(ProtobufJsonTest, parse_multiple_json_from_iobuf) {
+    butil::IOBuf buf;
+    buf.append(R"( { "name":"tom", "id":33, "datadouble":1.0 }
+               {"name":"bob", "id":12, "datadouble":2.0} )");
+    json2pb::Json2PbOptions options;
+    options.allow_remaining_bytes_after_parsing = true;
+    const char* names[] = { "tom", "bob" };
+    for (int i = 0; ; ++i) {
+        Person req;
+        std::string err;
+        size_t offset = 0;
+        if (!json2pb::JsonToProtoMessage(buf, &req, options, &err, &offset)) {
+            ASSERT_TRUE(err.empty()) << err;
+            ASSERT_EQ(2, i);
+            break;
+        }
+        ASSERT_EQ(names[i], req.name());
+        buf.pop_front(offset);
+    }
+}
+
+TEST_F(ProtobufJsonTest, pb_to_iobuf_case) {
+    Person person;
+    person.set_name("hello");
+    person.set_id(9);
+    person.set_datadouble(2.2);
+    person.set_datafloat(1);
+    butil::IOBuf buf;
+    buf.append("prefix");
+    std::string error;
+    ASSERT_TRUE(json2pb::ProtoMessageToJson(person, &buf, json2pb::Pb2JsonOptions(),
+                                            &error)) << error;
+    ASSERT_EQ("prefix{\"name\":\"hello\",\"id\":9,\"datadouble\":2.2,\"datafloat\":1.0}",
+              buf.to_string());
+
+    // Nothing is appended on failure.
+    Person incomplete;
+    incomplete.set_name("hello");
+    buf.clear();
+    ASSERT_FALSE(json2pb::ProtoMessageToJson(incomplete, &buf,
+                                             json2pb::Pb2JsonOptions(), &error));
+    ASSERT_EQ("Missing required field: addressbook.Person.id", error);
+    ASSERT_TRUE(buf.empty());
+
+    // Larger than a block of IOBuf.
+    JsonContextBody data;
+    data.set_judge(true);
+    data.set_spur(1);
+    for (int i = 0; i < 1000; ++i) {
+        data.add_info(std::string(20, 'a' + i % 26));
+    }
+    std::string expected;
+    ASSERT_TRUE(json2pb::ProtoMessageToJson(data, &expected));
+    ASSERT_TRUE(json2pb::ProtoMessageToJson(data, &buf, json2pb::Pb2JsonOptions()));
+    ASSERT_EQ(expected, buf.to_string());
+}
+
+TEST_F(ProtobufJsonTest, iobuf_nested_perf_case) {
+    // A large message with many small nested fields.
+    ::AddressBook book;
+    for (int i = 0; i < 200; ++i) {
+        PersonInfo* person = book.add_person();
+        person->set_name(butil::string_printf("person%d", i));
+        person->set_id(i);
+        JsonContextBody* body = person->mutable_json_body();
+        body->set_type(i * 1000);
+        body->set_judge(i % 2);
+        body->set_spur(i / 3.0);
+        for (int j = 0; j < 10; ++j) {
+            body->add_data(j);
+            body->add_info(butil::string_printf("info%d", j));
+            Content* content = body->add_content();
+            content->set_uid(butil::string_printf("uid%d", j));
+            content->set_distance(j / 7.0);
+            content->mutable_ext()->set_age(j);
+            content->mutable_ext()->set_databyte("welcome");
+            content->mutable_ext()->set_enumtype(Ext_PhoneType_WORK);
+        }
+    }
+    butil::IOBuf buf;
+    ASSERT_TRUE(json2pb::ProtoMessageToJson(book, &buf, json2pb::Pb2JsonOptions()));
+
+    const int times = 200;
+    std::string error;
+    butil::Timer timer;
+    int64_t dom_us = 0;
+    int64_t single_pass_us = 0;
+    ::AddressBook data;
+    for (int i = 0; i < times; i++) {
+        ::AddressBook data1;
+        butil::IOBufAsZeroCopyInputStream stream(buf);
+        timer.start();
+        ASSERT_TRUE(json2pb::JsonToProtoMessage(&stream, &data1, json2pb::Json2PbOptions(),
+                                                &error)) << error;
+        timer.stop();
+        dom_us += timer.u_elapsed();
+
+        data.Clear();
+        timer.start();
+        ASSERT_TRUE(json2pb::JsonToProtoMessage(buf, &data, json2pb::Json2PbOptions(),
+                                                &error)) << error;
+        timer.stop();
+        single_pass_us += timer.u_elapsed();
+        ASSERT_EQ(data1.SerializeAsString(), data.SerializeAsString());
+    }
+    printf("avg time to convert json(%zu bytes) to pb is %fus with DOM, "
+           "%fus in single pass\n", buf.size(),
+           (double)dom_us / times, (double)single_pass_us / times);
+
+    int64_t stream_us = 0;
+    int64_t appender_us = 0;
+    for (int i = 0; i < times; i++) {
+        butil::IOBuf out1;
+        butil::IOBufAsZeroCopyOutputStream stream(&out1);
+        timer.start();
+        ASSERT_TRUE(json2pb::ProtoMessageToJson(data, &stream, &error));
+        timer.stop();
+        stream_us += timer.u_elapsed();
+
+        butil::IOBuf out2;
+        timer.start();
+        ASSERT_TRUE(json2pb::ProtoMessageToJson(data, &out2, json2pb::Pb2JsonOptions()));
+        timer.stop();
+        appender_us += timer.u_elapsed();
+        ASSERT_EQ(out1, out2);
+    }
+    printf("avg time to convert pb to json is %fus with ZeroCopyOutputStream, "
+           "%fus with IOBufAppender\n",
+           (double)stream_us / times, (double)appender_us / times);
+}
+
 TEST_F(ProtobufJsonTest, proto_json_to_pb) {
     std::string error;
     json2pb::ProtoJson2PbOptions options;
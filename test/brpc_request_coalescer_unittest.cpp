@@ -0,0 +1,185 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <gtest/gtest.h>
+#include "butil/atomicops.h"
+#include "bthread/bthread.h"
+#include "brpc/server.h"
+#include "brpc/channel.h"
+#include "brpc/controller.h"
+#include "brpc/details/method_status.h"
+#include "brpc/details/request_coalescer.h"
+#include "echo.pb.h"
+
+namespace {
+
+brpc::RequestKey MakeKey(const std::string& request) {
+    butil::IOBuf buf;
+    buf.append(request);
+    return brpc::ResponseCache::MakeKey(buf, brpc::CONTENT_TYPE_PB,
+                                        brpc::COMPRESS_TYPE_NONE);
+}
+
+TEST(RequestCoalescerTest, join_and_finish) {
+    brpc::RequestCoalescer coalescer;
+    brpc::RequestCoalescer::WaitingCall call = { 1, NULL, 0 };
+    ASSERT_FALSE(coalescer.Join(MakeKey("a"), call));
+    ASSERT_FALSE(coalescer.Join(MakeKey("b"), call));
+    call.correlation_id = 2;
+    ASSERT_TRUE(coalescer.Join(MakeKey("a"), call));
+    call.correlation_id = 3;
+    ASSERT_TRUE(coalescer.Join(MakeKey("a"), call));
+    std::vector<brpc::RequestCoalescer::WaitingCall> calls;
+    coalescer.Finish(MakeKey("a"), &calls);
+    ASSERT_EQ(2u, calls.size());
+    ASSERT_EQ(2, calls[0].correlation_id);
+    ASSERT_EQ(3, calls[1].correlation_id);
+    ASSERT_DOUBLE_EQ(0.5, coalescer.coalesced_ratio());
+
+    // Processed again after finished.
+    ASSERT_FALSE(coalescer.Join(MakeKey("a"), call));
+    calls.clear();
+    coalescer.Finish(MakeKey("b"), &calls);
+    ASSERT_TRUE(calls.empty());
+
+    // A different request with the same hash is neither coalesced nor
+    // allowed to finish the one being processed.
+    brpc::RequestKey colliding = MakeKey("c");
+    colliding.hash = MakeKey("a").hash;
+    call.correlation_id = 4;
+    ASSERT_TRUE(coalescer.Join(MakeKey("a"), call));
+    call.correlation_id = 5;
+    ASSERT_FALSE(coalescer.Join(colliding, call));
+    calls.clear();
+    coalescer.Finish(colliding, &calls);
+    ASSERT_TRUE(calls.empty());
+    coalescer.Finish(MakeKey("a"), &calls);
+    ASSERT_EQ(1u, calls.size());
+    ASSERT_EQ(4, calls[0].correlation_id);
+}
+
+// Blocks in Echo() until released, so that identical requests arriving
+// meanwhile are coalesced.
+class BlockingEchoService : public test::EchoService {
+public:
+    BlockingEchoService() : ncalled(0), released(false) {}
+    void Echo(google::protobuf::RpcController* cntl_base,
+              const test::EchoRequest* req,
+              test::EchoResponse* res,
+              google::protobuf::Closure* done) override {
+        brpc::ClosureGuard done_guard(done);
+        // Identify the invocation in the response, so that callers served
+        // by the same invocation get the same response.
+        const std::string tag = std::to_string(ncalled.fetch_add(1) + 1);
+        while (!released.load()) {
+            bthread_usleep(1000);
+        }
+        if (req->server_fail()) {
+            cntl_base->SetFailed("fail on purpose " + tag);
+            return;
+        }
+        res->set_message(req->message() + tag);
+        static_cast<brpc::Controller*>(cntl_base)->
+            response_attachment().append("attachment" + tag);
+    }
+    butil::atomic<int> ncalled;
+    butil::atomic<bool> released;
+};
+
+struct CallArgs {
+    test::EchoService_Stub* stub;
+    int server_fail;
+    bool failed;
+    std::string error_text;
+    std::string message;
+    std::string attachment;
+};
+
+void* RunEcho(void* arg) {
+    CallArgs* args = static_cast<CallArgs*>(arg);
+    brpc::Controller cntl;
+    test::EchoRequest req;
+    test::EchoResponse res;
+    req.set_message("hello");
+    req.set_server_fail(args->server_fail);
+    args->stub->Echo(&cntl, &req, &res, NULL);
+    args->failed = cntl.Failed();
+    args->error_text = cntl.ErrorText();
+    args->message = res.message();
+    args->attachment = cntl.response_attachment().to_string();
+    return NULL;
+}
+
+TEST(RequestCoalescerTest, baidu_std) {
+    brpc::Server server;
+    BlockingEchoService service;
+    ASSERT_EQ(0, server.AddService(&service, brpc::SERVER_DOESNT_OWN_SERVICE));
+    server.CoalesceRequestsOf("test.EchoService.Echo") = true;
+    ASSERT_EQ(0, server.Start(8931, NULL));
+    brpc::RequestCoalescer* coalescer = server.FindMethodPropertyByFullName(
+        "test.EchoService.Echo")->status->coalescer();
+    ASSERT_TRUE(coalescer != NULL);
+    brpc::Channel channel;
+    brpc::ChannelOptions options;
+    options.connection_type = brpc::CONNECTION_TYPE_POOLED;
+    options.timeout_ms = 10000;
+    ASSERT_EQ(0, channel.Init("127.0.0.1:8931", &options));
+    test::EchoService_Stub stub(&channel);
+
+    for (int server_fail = 0; server_fail < 2; ++server_fail) {
+        const int N = 10;
+        const int ncalled = service.ncalled.load();
+        const int64_t ncoalesced = coalescer->_ncoalesced.get_value();
+        service.released.store(false);
+        CallArgs args[N];
+        bthread_t tids[N];
+        for (int i = 0; i < N; ++i) {
+            args[i].stub = &stub;
+            args[i].server_fail = server_fail;
+            ASSERT_EQ(0, bthread_start_background(&tids[i], NULL, RunEcho, &args[i]));
+        }
+        // Release the handler after all other requests joined it.
+        for (int i = 0; i < 5000 &&
+                 coalescer->_ncoalesced.get_value() - ncoalesced < N - 1; ++i) {
+            bthread_usleep(1000);
+        }
+        ASSERT_EQ(N - 1, coalescer->_ncoalesced.get_value() - ncoalesced);
+        service.released.store(true);
+        for (int i = 0; i < N; ++i) {
+            bthread_join(tids[i], NULL);
+        }
+        // One invocation served all the requests.
+        ASSERT_EQ(1, service.ncalled.load() - ncalled);
+        const std::string tag = std::to_string(ncalled + 1);
+        for (int i = 0; i < N; ++i) {
+            ASSERT_EQ((bool)server_fail, args[i].failed) << args[i].error_text;
+            if (server_fail) {
+                ASSERT_NE(std::string::npos,
+                          args[i].error_text.find("fail on purpose " + tag))
+                    << args[i].error_text;
+            } else {
+                ASSERT_EQ("hello" + tag, args[i].message);
+                ASSERT_EQ("attachment" + tag, args[i].attachment);
+            }
+        }
+    }
+    ASSERT_EQ(0, server.Stop(0));
+    ASSERT_EQ(0, server.Join());
+}
+
+} // namespace
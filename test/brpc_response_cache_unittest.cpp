@@ -0,0 +1,184 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <gtest/gtest.h>
+#include "butil/atomicops.h"
+#include "brpc/server.h"
+#include "brpc/channel.h"
+#include "brpc/controller.h"
+#include "brpc/details/response_cache.h"
+#include "echo.pb.h"
+
+namespace {
+
+brpc::CachedResponse MakeResponse(const std::string& body) {
+    brpc::CachedResponse res;
+    res.body.append(body);
+    return res;
+}
+
+void NoopDeleter(void*) {}
+
+brpc::RequestKey MakeKey(const std::string& request) {
+    butil::IOBuf buf;
+    buf.append(request);
+    return brpc::ResponseCache::MakeKey(buf, brpc::CONTENT_TYPE_PB,
+                                        brpc::COMPRESS_TYPE_NONE);
+}
+
+TEST(ResponseCacheTest, get_and_put) {
+    brpc::ResponseCacheOptions options;
+    options.ttl_ms = 100;
+    brpc::ResponseCache cache(options);
+    brpc::CachedResponse res;
+    ASSERT_FALSE(cache.Get(MakeKey("a"), &res));
+    cache.Put(MakeKey("a"), MakeResponse("1"));
+    ASSERT_TRUE(cache.Get(MakeKey("a"), &res));
+    ASSERT_EQ("1", res.body.to_string());
+    cache.Put(MakeKey("a"), MakeResponse("2"));
+    ASSERT_TRUE(cache.Get(MakeKey("a"), &res));
+    ASSERT_EQ("2", res.body.to_string());
+    ASSERT_FALSE(cache.Get(MakeKey("b"), &res));
+    ASSERT_DOUBLE_EQ(0.5, cache.hit_ratio());
+
+    // Same bytes in other formats are different requests.
+    butil::IOBuf buf;
+    buf.append("a");
+    ASSERT_FALSE(cache.Get(brpc::ResponseCache::MakeKey(
+                     buf, brpc::CONTENT_TYPE_JSON, brpc::COMPRESS_TYPE_NONE),
+                           &res));
+
+    // Requests spread over blocks are hashed the same as contiguous ones.
+    static char s_part[1000];
+    memset(s_part, 'a', sizeof(s_part));
+    butil::IOBuf a;
+    a.append(std::string(3000, 'a'));
+    butil::IOBuf b;
+    for (int i = 0; i < 3; ++i) {
+        b.append_user_data(s_part, sizeof(s_part), NoopDeleter);
+    }
+    ASSERT_LT(a.backing_block_num(), b.backing_block_num());
+    ASSERT_EQ(brpc::ResponseCache::MakeKey(a, brpc::CONTENT_TYPE_PB,
+                                           brpc::COMPRESS_TYPE_NONE).hash,
+              brpc::ResponseCache::MakeKey(b, brpc::CONTENT_TYPE_PB,
+                                           brpc::COMPRESS_TYPE_NONE).hash);
+
+    // Requests with the same hash are still compared by bytes.
+    brpc::RequestKey colliding = MakeKey("c");
+    colliding.hash = MakeKey("a").hash;
+    ASSERT_FALSE(cache.Get(colliding, &res));
+    ASSERT_TRUE(cache.Get(MakeKey("a"), &res));
+
+    usleep(150 * 1000);
+    ASSERT_FALSE(cache.Get(MakeKey("a"), &res));
+    ASSERT_EQ(0u, cache.bytes());
+}
+
+TEST(ResponseCacheTest, evict_least_recently_used) {
+    brpc::ResponseCacheOptions options;
+    options.ttl_ms = 10000;
+    options.max_bytes = 1000;
+    brpc::ResponseCache cache(options);
+    const std::string body(200, 'x');
+    cache.Put(MakeKey("a"), MakeResponse(body));
+    cache.Put(MakeKey("b"), MakeResponse(body));
+    cache.Put(MakeKey("c"), MakeResponse(body));
+    brpc::CachedResponse res;
+    ASSERT_TRUE(cache.Get(MakeKey("a"), &res));
+    cache.Put(MakeKey("d"), MakeResponse(body));
+    ASSERT_LE(cache.bytes(), options.max_bytes);
+    ASSERT_TRUE(cache.Get(MakeKey("a"), &res));
+    ASSERT_FALSE(cache.Get(MakeKey("b"), &res));
+    ASSERT_TRUE(cache.Get(MakeKey("d"), &res));
+
+    // Responses larger than the capacity are not cached.
+    cache.Put(MakeKey("e"), MakeResponse(std::string(2000, 'x')));
+    ASSERT_FALSE(cache.Get(MakeKey("e"), &res));
+}
+
+class CountingEchoService : public test::EchoService {
+public:
+    CountingEchoService() : ncalled(0) {}
+    void Echo(google::protobuf::RpcController*,
+              const test::EchoRequest* req,
+              test::EchoResponse* res,
+              google::protobuf::Closure* done) override {
+        brpc::ClosureGuard done_guard(done);
+        ncalled.fetch_add(1);
+        res->set_message(req->message());
+        res->add_code_list(req->code());
+    }
+    butil::atomic<int> ncalled;
+};
+
+TEST(ResponseCacheTest, baidu_std) {
+    brpc::Server server;
+    CountingEchoService service;
+    ASSERT_EQ(0, server.AddService(&service, brpc::SERVER_DOESNT_OWN_SERVICE));
+    server.ResponseCacheOf("test.EchoService.Echo").ttl_ms = 200;
+    ASSERT_EQ(0, server.Start(8929, NULL));
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init("127.0.0.1:8929", NULL));
+    test::EchoService_Stub stub(&channel);
+
+    auto call = [&stub](const std::string& message, int code) {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message(message);
+        req.set_code(code);
+        stub.Echo(&cntl, &req, &res, NULL);
+        EXPECT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        EXPECT_EQ(message, res.message());
+        EXPECT_EQ(1, res.code_list_size());
+        EXPECT_EQ(code, res.code_list(0));
+    };
+    call("hello", 1);
+    call("hello", 1);
+    ASSERT_EQ(1, service.ncalled.load());
+    call("hello", 2);
+    ASSERT_EQ(2, service.ncalled.load());
+    usleep(300 * 1000);
+    call("hello", 1);
+    ASSERT_EQ(3, service.ncalled.load());
+
+    // Requests with attachments are not cached.
+    for (int i = 0; i < 2; ++i) {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message("hello");
+        req.set_code(1);
+        cntl.request_attachment().append("attachment");
+        stub.Echo(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    }
+    ASSERT_EQ(5, service.ncalled.load());
+
+    // Unknown methods are rejected.
+    brpc::Server server2;
+    CountingEchoService service2;
+    ASSERT_EQ(0, server2.AddService(&service2, brpc::SERVER_DOESNT_OWN_SERVICE));
+    server2.ResponseCacheOf("test.EchoService.NoSuchMethod").ttl_ms = 200;
+    ASSERT_EQ(-1, server2.Start(8930, NULL));
+
+    ASSERT_EQ(0, server.Stop(0));
+    ASSERT_EQ(0, server.Join());
+}
+
+} // namespace
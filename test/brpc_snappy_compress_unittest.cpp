@@ -25,9 +25,16 @@
 #include "butil/macros.h"
 #include "butil/iobuf.h"
 #include "butil/time.h"
+#include "butil/string_printf.h"
 #include "snappy_message.pb.h"
 #include "brpc/policy/snappy_compress.h"
 #include "brpc/policy/gzip_compress.h"
+#include "brpc/policy/zstd_compress.h"
+#include "brpc/policy/lz4_compress.h"
+#ifdef BRPC_WITH_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
 
 typedef bool (*Compress)(const google::protobuf::Message&, butil::IOBuf*);
 typedef bool (*Decompress)(const butil::IOBuf&, google::protobuf::Message*);
@@ -75,6 +82,14 @@ static bool SnappyDecompressIOBuf(char* input, size_t len, butil::IOBuf* buf) {
     return true;
 }
 
+// Appending bytes to IOBuf packs them into shared blocks, put `data' into a
+// separately allocated block to really fragment the blocks of `buf'.
+inline void AppendInNewBlock(butil::IOBuf* buf, const char* data, size_t n) {
+    char* copy = (char*)malloc(n);
+    memcpy(copy, data, n);
+    ASSERT_EQ(0, buf->append_user_data(copy, n, free));
+}
+
 class test_compress_method : public testing::Test {};
 
 TEST_F(test_compress_method, snappy) {
@@ -194,6 +209,16 @@ TEST_F(test_compress_method, throughput_compare) {
         CompressMessage("Zlib", k, old_msg, len, 
                          brpc::policy::ZlibCompress, 
                          brpc::policy::ZlibDecompress);
+#ifdef BRPC_WITH_ZSTD
+        CompressMessage("Zstd", k, old_msg, len,
+                         brpc::policy::ZstdCompress,
+                         brpc::policy::ZstdDecompress);
+#endif
+#ifdef BRPC_WITH_LZ4
+        CompressMessage("Lz4", k, old_msg, len,
+                         brpc::policy::Lz4Compress,
+                         brpc::policy::Lz4Decompress);
+#endif
         printf("\n");
         delete [] text;
     }
@@ -228,6 +253,16 @@ TEST_F(test_compress_method, throughput_compare_complete_random) {
         CompressMessage("Zlib", k, old_msg, len, 
                          brpc::policy::ZlibCompress, 
                          brpc::policy::ZlibDecompress);
+#ifdef BRPC_WITH_ZSTD
+        CompressMessage("Zstd", k, old_msg, len,
+                         brpc::policy::ZstdCompress,
+                         brpc::policy::ZstdDecompress);
+#endif
+#ifdef BRPC_WITH_LZ4
+        CompressMessage("Lz4", k, old_msg, len,
+                         brpc::policy::Lz4Compress,
+                         brpc::policy::Lz4Decompress);
+#endif
         printf("\n");
         delete [] text;
     }
@@ -253,3 +288,188 @@ TEST_F(test_compress_method, mass_snappy_iobuf) {
     ASSERT_TRUE(strcmp(check_str.c_str(), text) == 0);
     delete [] text;
 }
+
+#ifdef BRPC_WITH_ZSTD
+TEST_F(test_compress_method, zstd) {
+    snappy_message::SnappyMessageProto old_msg;
+    old_msg.set_text("Hello World!");
+    old_msg.add_numbers(2);
+    old_msg.add_numbers(7);
+    old_msg.add_numbers(45);
+    butil::IOBuf buf;
+    ASSERT_TRUE(brpc::policy::ZstdCompress(old_msg, &buf));
+    snappy_message::SnappyMessageProto new_msg;
+    ASSERT_TRUE(brpc::policy::ZstdDecompress(buf, &new_msg));
+    ASSERT_EQ("Hello World!", new_msg.text());
+    ASSERT_EQ(3, new_msg.numbers_size());
+    ASSERT_EQ(2, new_msg.numbers(0));
+    ASSERT_EQ(7, new_msg.numbers(1));
+    ASSERT_EQ(45, new_msg.numbers(2));
+
+    // Empty input is still a valid frame.
+    butil::IOBuf empty, output_buf, check_buf;
+    ASSERT_TRUE(brpc::policy::ZstdCompress(empty, &output_buf));
+    ASSERT_FALSE(output_buf.empty());
+    ASSERT_TRUE(brpc::policy::ZstdDecompress(output_buf, &check_buf));
+    ASSERT_TRUE(check_buf.empty());
+}
+
+TEST_F(test_compress_method, zstd_iobuf_with_many_blocks) {
+    // Both input and output span many blocks of IOBuf.
+    butil::IOBuf buf;
+    std::string expected;
+    for (int i = 0; i < 20000; ++i) {
+        char tmp[64];
+        const int n = snprintf(tmp, sizeof(tmp), "item-%d,%d;", i, rand() % 1000);
+        AppendInNewBlock(&buf, tmp, n);
+        expected.append(tmp, n);
+    }
+    ASSERT_EQ(20000UL, buf.backing_block_num());
+    butil::IOBuf output_buf, check_buf;
+    ASSERT_TRUE(brpc::policy::ZstdCompress(buf, &output_buf));
+    ASSERT_LT(output_buf.size(), buf.size());
+    ASSERT_TRUE(brpc::policy::ZstdDecompress(output_buf, &check_buf));
+    ASSERT_EQ(expected, check_buf.to_string());
+
+    // Truncated or corrupted frames are rejected.
+    butil::IOBuf truncated;
+    output_buf.append_to(&truncated, output_buf.size() / 2);
+    check_buf.clear();
+    ASSERT_FALSE(brpc::policy::ZstdDecompress(truncated, &check_buf));
+    butil::IOBuf garbage;
+    garbage.append("not a zstd frame");
+    check_buf.clear();
+    ASSERT_FALSE(brpc::policy::ZstdDecompress(garbage, &check_buf));
+}
+
+TEST_F(test_compress_method, zstd_dictionary) {
+    // Train a dictionary over sample messages.
+    std::string samples;
+    std::vector<size_t> sample_sizes;
+    for (int i = 0; i < 1000; ++i) {
+        snappy_message::SnappyMessageProto msg;
+        msg.set_text(butil::string_printf(
+                         "{\"user\":\"user_%d\",\"region\":\"region_%d\","
+                         "\"status\":\"active\",\"tags\":[\"vip\",\"new\"]}",
+                         i, i % 17));
+        msg.add_numbers(i);
+        const std::string s = msg.SerializeAsString();
+        samples.append(s);
+        sample_sizes.push_back(s.size());
+    }
+    std::string dict(4096, '\0');
+    const size_t dict_size = ZDICT_trainFromBuffer(
+        &dict[0], dict.size(), samples.data(),
+        &sample_sizes[0], sample_sizes.size());
+    ASSERT_FALSE(ZDICT_isError(dict_size)) << ZDICT_getErrorName(dict_size);
+    dict.resize(dict_size);
+
+    snappy_message::SnappyMessageProto msg;
+    msg.set_text("{\"user\":\"user_12345\",\"region\":\"region_3\","
+                 "\"status\":\"active\",\"tags\":[\"vip\",\"new\"]}");
+    msg.add_numbers(12345);
+    butil::IOBuf plain_buf;
+    ASSERT_TRUE(brpc::policy::ZstdCompress(msg, &plain_buf));
+
+    const std::string type = msg.GetDescriptor()->full_name();
+    ASSERT_EQ(-1, brpc::policy::RegisterZstdDictionary(type, ""));
+    ASSERT_EQ(-1, brpc::policy::RegisterZstdDictionary(type, "raw content"));
+    ASSERT_EQ(0, brpc::policy::RegisterZstdDictionary(type, dict));
+    ASSERT_EQ(-1, brpc::policy::RegisterZstdDictionary(type, dict));
+
+    butil::IOBuf dict_buf;
+    ASSERT_TRUE(brpc::policy::ZstdCompress(msg, &dict_buf));
+    ASSERT_LT(dict_buf.size(), plain_buf.size());
+    snappy_message::SnappyMessageProto new_msg;
+    ASSERT_TRUE(brpc::policy::ZstdDecompress(dict_buf, &new_msg));
+    ASSERT_EQ(msg.text(), new_msg.text());
+    // Frames without dictionary are still decompressible.
+    new_msg.Clear();
+    ASSERT_TRUE(brpc::policy::ZstdDecompress(plain_buf, &new_msg));
+    ASSERT_EQ(msg.text(), new_msg.text());
+
+    // Frames compressed with an unknown dictionary are rejected.
+    std::string tampered = dict_buf.to_string();
+    const unsigned dict_id = ZSTD_getDictID_fromFrame(tampered.data(), tampered.size());
+    ASSERT_NE(0u, dict_id);
+    // Dictionary id follows the 4-byte magic and 1-byte descriptor of
+    // single-segment frames.
+    tampered[5] ^= 0x5a;
+    ASSERT_NE(dict_id, ZSTD_getDictID_fromFrame(tampered.data(), tampered.size()));
+    butil::IOBuf tampered_buf;
+    tampered_buf.append(tampered);
+    ASSERT_FALSE(brpc::policy::ZstdDecompress(tampered_buf, &new_msg));
+}
+#endif // BRPC_WITH_ZSTD
+
+#ifdef BRPC_WITH_LZ4
+TEST_F(test_compress_method, lz4) {
+    snappy_message::SnappyMessageProto old_msg;
+    old_msg.set_text("Hello World!");
+    old_msg.add_numbers(2);
+    old_msg.add_numbers(7);
+    old_msg.add_numbers(45);
+    butil::IOBuf buf;
+    ASSERT_TRUE(brpc::policy::Lz4Compress(old_msg, &buf));
+    snappy_message::SnappyMessageProto new_msg;
+    ASSERT_TRUE(brpc::policy::Lz4Decompress(buf, &new_msg));
+    ASSERT_EQ("Hello World!", new_msg.text());
+    ASSERT_EQ(3, new_msg.numbers_size());
+    ASSERT_EQ(2, new_msg.numbers(0));
+    ASSERT_EQ(7, new_msg.numbers(1));
+    ASSERT_EQ(45, new_msg.numbers(2));
+
+    butil::IOBuf empty, output_buf, check_buf;
+    ASSERT_TRUE(brpc::policy::Lz4Compress(empty, &output_buf));
+    ASSERT_FALSE(output_buf.empty());
+    ASSERT_TRUE(brpc::policy::Lz4Decompress(output_buf, &check_buf));
+    ASSERT_TRUE(check_buf.empty());
+    check_buf.clear();
+    ASSERT_FALSE(brpc::policy::Lz4Decompress(empty, &check_buf));
+}
+
+TEST_F(test_compress_method, lz4_iobuf_with_many_blocks) {
+    butil::IOBuf buf;
+    std::string expected;
+    for (int i = 0; i < 50000; ++i) {
+        char tmp[64];
+        const int n = snprintf(tmp, sizeof(tmp), "item-%d,%d;", i, rand() % 1000);
+        AppendInNewBlock(&buf, tmp, n);
+        expected.append(tmp, n);
+    }
+    ASSERT_EQ(50000UL, buf.backing_block_num());
+    // Incompressible data makes output larger than input.
+    for (int i = 0; i < 100000; ++i) {
+        const char c = (char)rand();
+        buf.push_back(c);
+        expected.push_back(c);
+    }
+    ASSERT_GT(buf.backing_block_num(), 50000UL);
+    // Output starts in the middle of a block.
+    butil::IOBuf output_buf, check_buf;
+    output_buf.append("x");
+    check_buf.append("y");
+    ASSERT_TRUE(brpc::policy::Lz4Compress(buf, &output_buf));
+    output_buf.pop_front(1);
+    ASSERT_TRUE(brpc::policy::Lz4Decompress(output_buf, &check_buf));
+    check_buf.pop_front(1);
+    ASSERT_EQ(expected, check_buf.to_string());
+
+    // Concatenated frames are decompressed as a whole.
+    butil::IOBuf concatenated = output_buf;
+    concatenated.append(output_buf);
+    check_buf.clear();
+    ASSERT_TRUE(brpc::policy::Lz4Decompress(concatenated, &check_buf));
+    ASSERT_EQ(expected + expected, check_buf.to_string());
+
+    // Truncated or corrupted frames are rejected.
+    butil::IOBuf truncated;
+    output_buf.append_to(&truncated, output_buf.size() / 2);
+    check_buf.clear();
+    ASSERT_FALSE(brpc::policy::Lz4Decompress(truncated, &check_buf));
+    butil::IOBuf garbage;
+    garbage.append("not a lz4 frame");
+    check_buf.clear();
+    ASSERT_FALSE(brpc::policy::Lz4Decompress(garbage, &check_buf));
+}
+#endif // BRPC_WITH_LZ4
@@ -31,6 +31,7 @@
 #include <butil/fd_guard.h>
 #include "bthread/unstable.h"
 #include "bthread/task_control.h"
+#include "bvar/variable.h"
 #include "brpc/socket.h"
 #include "brpc/errno.pb.h"
 #include "brpc/acceptor.h"
@@ -1681,6 +1682,121 @@ TEST_F(SocketTest, shutdown_write) {
     }
 }
 
+struct LingerWriterArg {
+    size_t times;
+    brpc::SocketId socket_id;
+    butil::atomic<size_t> success_count;
+};
+
+int HandleSocketLingerWrite(bthread_id_t id, void* data, int error_code,
+    const std::string& error_text) {
+    auto arg = static_cast<LingerWriterArg*>(data);
+    EXPECT_NE(nullptr, arg);
+    EXPECT_EQ(0, error_code) << error_text;
+    if (0 == error_code) {
+        ++arg->success_count;
+    }
+    CHECK_EQ(0, bthread_id_unlock_and_destroy(id));
+    return 0;
+}
+
+void* LingerWriter(void* void_arg) {
+    auto arg = static_cast<LingerWriterArg*>(void_arg);
+    brpc::SocketUniquePtr sock;
+    if (brpc::Socket::Address(arg->socket_id, &sock) < 0) {
+        LOG(INFO) << "Fail to address SocketId=" << arg->socket_id;
+        return NULL;
+    }
+    for (size_t c = 0; c < arg->times; ++c) {
+        bthread_id_t write_id;
+        EXPECT_EQ(0, bthread_id_create2(&write_id, arg,
+            HandleSocketLingerWrite));
+        brpc::Socket::WriteOptions wopt;
+        wopt.id_wait = write_id;
+        wopt.notify_on_success = true;
+        wopt.linger_us = 50;
+        butil::IOBuf src;
+        src.append("hello reader side!", 16);
+        if (sock->Write(&src, &wopt) != 0) {
+            if (errno == brpc::EOVERCROWDED) {
+                // The buf is full, sleep a while and retry.
+                bthread_usleep(1000);
+                --c;
+                continue;
+            }
+            PLOG(ERROR) << "Fail to write into SocketId=" << arg->socket_id;
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int64_t GetExposedCount(const char* name) {
+    return strtoll(bvar::Variable::describe_exposed(name).c_str(), NULL, 10);
+}
+
+TEST_F(SocketTest, linger_write) {
+    const size_t REP = 10000;
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+    brpc::SocketId id = 8888;
+    butil::EndPoint dummy;
+    ASSERT_EQ(0, str2endpoint("192.168.1.26:8080", &dummy));
+    brpc::SocketOptions options;
+    options.fd = fds[1];
+    options.remote_side = dummy;
+    options.user = new CheckRecycle;
+    ASSERT_EQ(0, brpc::Socket::Create(options, &id));
+    brpc::SocketUniquePtr s;
+    ASSERT_EQ(0, brpc::Socket::Address(id, &s));
+    s->_ssl_state = brpc::SSL_OFF;
+    global_sock = s.get();
+
+    pthread_t rth;
+    ReaderArg reader_arg = { fds[0], 0 };
+    pthread_create(&rth, NULL, reader, &reader_arg);
+
+    const int64_t nlingerwrite = GetExposedCount("rpc_lingerwrite_count");
+    const int64_t nbatchwrite = GetExposedCount("rpc_batchwrite_count");
+    bthread_t th[4];
+    LingerWriterArg args[ARRAY_SIZE(th)];
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        args[i].times = REP;
+        args[i].socket_id = id;
+        args[i].success_count = 0;
+        ASSERT_EQ(0, bthread_start_background(
+                      &th[i], NULL, LingerWriter, &args[i]));
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        ASSERT_EQ(0, bthread_join(th[i], NULL));
+    }
+    bthread_usleep(1000 * 1000);
+
+    size_t success_count = 0;
+    for (auto& arg : args) {
+        success_count += arg.success_count;
+    }
+    ASSERT_EQ(REP * ARRAY_SIZE(th), success_count);
+    ASSERT_EQ(REP * ARRAY_SIZE(th) * 16, reader_arg.nread);
+
+    // All writes lingered in KeepWrite, and concurrent writes were batched
+    // into much fewer writev than requests.
+    const int64_t nlinger = GetExposedCount("rpc_lingerwrite_count") - nlingerwrite;
+    const int64_t nbatch = GetExposedCount("rpc_batchwrite_count") - nbatchwrite;
+    LOG(INFO) << "requests=" << REP * ARRAY_SIZE(th) << " lingerwrite="
+              << nlinger << " batchwrite=" << nbatch;
+    ASSERT_GT(nlinger, 0);
+    ASSERT_LE(nlinger, nbatch);
+    ASSERT_LT(nbatch * 2, (int64_t)(REP * ARRAY_SIZE(th)));
+
+    ASSERT_EQ(0, s->SetFailed());
+    s.release()->Dereference();
+    pthread_join(rth, NULL);
+    ASSERT_EQ((brpc::Socket*)NULL, global_sock);
+    close(fds[0]);
+}
+
 TEST_F(SocketTest, packed_ptr) {
     brpc::PackedPtr<int> ptr;
     ASSERT_EQ(nullptr, ptr.get());
@@ -0,0 +1,164 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <gtest/gtest.h>
+#include "brpc/server.h"
+#include "brpc/channel.h"
+#include "brpc/controller.h"
+#include "brpc/details/zero_copy_bytes.h"
+#include "echo.pb.h"
+
+namespace {
+
+class BlobServiceImpl : public ::test::BlobService {
+public:
+    void Echo(google::protobuf::RpcController* cntl_base,
+              const ::test::BlobRequest* req,
+              ::test::BlobResponse* res,
+              google::protobuf::Closure* done) {
+        brpc::ClosureGuard done_guard(done);
+        brpc::Controller* cntl = static_cast<brpc::Controller*>(cntl_base);
+        EXPECT_FALSE(req->has_blob());
+        butil::IOBuf& blob = (*cntl->request_zero_copy_bytes())[2];
+        res->set_size(blob.size());
+        (*cntl->response_zero_copy_bytes())[1] = blob;
+    }
+};
+
+// Blob spreading over many blocks.
+butil::IOBuf MakeBlob(size_t size) {
+    butil::IOBuf blob;
+    for (size_t i = 0; blob.size() < size; ++i) {
+        const std::string part(std::min<size_t>(1000, size - blob.size()),
+                               'a' + i % 26);
+        blob.append(part);
+    }
+    return blob;
+}
+
+TEST(ZeroCopyBytesTest, fields) {
+    ASSERT_TRUE(brpc::GetZeroCopyBytesFields(
+                    ::test::EchoRequest::descriptor()) == NULL);
+    const std::vector<int>* fields =
+        brpc::GetZeroCopyBytesFields(::test::BlobRequest::descriptor());
+    ASSERT_TRUE(fields != NULL);
+    ASSERT_EQ(std::vector<int>{2}, *fields);
+    ASSERT_EQ(fields,
+              brpc::GetZeroCopyBytesFields(::test::BlobRequest::descriptor()));
+}
+
+TEST(ZeroCopyBytesTest, append_and_cut) {
+    ::test::BlobRequest req;
+    req.set_name("blob");
+    req.set_copied_blob("copied");
+    butil::IOBuf buf;
+    butil::IOBufAsZeroCopyOutputStream wrapper(&buf);
+    ASSERT_TRUE(req.SerializeToZeroCopyStream(&wrapper));
+
+    brpc::ZeroCopyBytesMap fields;
+    fields[2] = MakeBlob(100000);
+    ASSERT_TRUE(brpc::AppendZeroCopyBytes(::test::BlobRequest::descriptor(),
+                                          fields, &buf));
+    // Plain protobuf parses zero-copy fields as usual.
+    ::test::BlobRequest plain;
+    butil::IOBufAsZeroCopyInputStream input(buf);
+    ASSERT_TRUE(plain.ParseFromZeroCopyStream(&input));
+    ASSERT_EQ("blob", plain.name());
+    ASSERT_EQ("copied", plain.copied_blob());
+    ASSERT_EQ(fields[2].to_string(), plain.blob());
+
+    butil::IOBuf rest;
+    brpc::ZeroCopyBytesMap cut;
+    ASSERT_TRUE(brpc::CutZeroCopyBytes(buf, std::vector<int>{2}, &rest, &cut));
+    ASSERT_EQ(1u, cut.size());
+    ASSERT_EQ(fields[2], cut[2]);
+    // Blocks are shared instead of copied.
+    ASSERT_EQ(fields[2].backing_block(0).data(), cut[2].backing_block(0).data());
+    ::test::BlobRequest parsed;
+    butil::IOBufAsZeroCopyInputStream rest_input(rest);
+    ASSERT_TRUE(parsed.ParseFromZeroCopyStream(&rest_input));
+    ASSERT_EQ("blob", parsed.name());
+    ASSERT_EQ("copied", parsed.copied_blob());
+    ASSERT_FALSE(parsed.has_blob());
+
+    // Fields not marked are rejected.
+    brpc::ZeroCopyBytesMap bad_fields;
+    bad_fields[3] = MakeBlob(10);
+    ASSERT_FALSE(brpc::AppendZeroCopyBytes(::test::BlobRequest::descriptor(),
+                                           bad_fields, &buf));
+}
+
+TEST(ZeroCopyBytesTest, move_parsed_fields) {
+    ::test::BlobRequest req;
+    req.set_blob("parsed");
+    brpc::ZeroCopyBytesMap fields;
+    brpc::MoveZeroCopyBytes(std::vector<int>{2}, &req, &fields);
+    ASSERT_FALSE(req.has_blob());
+    ASSERT_EQ("parsed", fields[2].to_string());
+}
+
+TEST(ZeroCopyBytesTest, baidu_std) {
+    brpc::Server server;
+    BlobServiceImpl service;
+    ASSERT_EQ(0, server.AddService(&service, brpc::SERVER_DOESNT_OWN_SERVICE));
+    ASSERT_EQ(0, server.Start(8927, NULL));
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init("127.0.0.1:8927", NULL));
+    ::test::BlobService_Stub stub(&channel);
+
+    const butil::IOBuf blob = MakeBlob(4 * 1024 * 1024);
+    {
+        brpc::Controller cntl;
+        ::test::BlobRequest req;
+        ::test::BlobResponse res;
+        req.set_name("blob");
+        (*cntl.request_zero_copy_bytes())[2] = blob;
+        cntl.set_request_checksum_type(brpc::CHECKSUM_TYPE_CRC32C);
+        stub.Echo(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ((int)blob.size(), res.size());
+        ASSERT_FALSE(res.has_blob());
+        ASSERT_TRUE(cntl.has_response_zero_copy_bytes());
+        ASSERT_EQ(blob, (*cntl.response_zero_copy_bytes())[1]);
+    }
+    // Fields set in messages are moved into the map at receiver side.
+    {
+        brpc::Controller cntl;
+        ::test::BlobRequest req;
+        ::test::BlobResponse res;
+        req.set_blob(blob.to_string());
+        cntl.set_request_compress_type(brpc::COMPRESS_TYPE_SNAPPY);
+        stub.Echo(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(blob, (*cntl.response_zero_copy_bytes())[1]);
+    }
+    // Zero-copy fields can't be compressed.
+    {
+        brpc::Controller cntl;
+        ::test::BlobRequest req;
+        ::test::BlobResponse res;
+        (*cntl.request_zero_copy_bytes())[2] = blob;
+        cntl.set_request_compress_type(brpc::COMPRESS_TYPE_SNAPPY);
+        stub.Echo(&cntl, &req, &res, NULL);
+        ASSERT_EQ(brpc::EREQUEST, cntl.ErrorCode());
+    }
+    ASSERT_EQ(0, server.Stop(0));
+    ASSERT_EQ(0, server.Join());
+}
+
+} // namespace
@@ -7,6 +7,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+#include <string>
 #include <gtest/gtest.h>
 #include "butil/crc32c.h"
 
@@ -69,6 +70,31 @@ TEST_F(CRC, Mask) {
   ASSERT_EQ(crc, Unmask(Unmask(Mask(Mask(crc)))));
 }
 
+TEST_F(CRC, LargeBuffers) {
+  // Lengths around the boundaries of interleaved streams.
+  const size_t lengths[] = { 0, 1, 7, 8, 767, 768, 769, 1000, 24575, 24576,
+                             24577, 24576 + 768 + 13, 100000 };
+  std::string buf(100000 + 8, 0);
+  for (size_t i = 0; i < buf.size(); ++i) {
+    buf[i] = static_cast<char>(i * 2654435761u >> 24);
+  }
+  for (size_t offset = 0; offset < 8; ++offset) {
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+      const char* data = buf.data() + offset;
+      const size_t len = lengths[i];
+      // Extending byte by byte never goes through interleaved streams.
+      uint32_t expected = 0;
+      for (size_t j = 0; j < len; ++j) {
+        expected = Extend(expected, data + j, 1);
+      }
+      ASSERT_EQ(expected, Value(data, len)) << "offset=" << offset
+                                            << " len=" << len;
+      ASSERT_EQ(expected, Extend(Value(data, len / 3), data + len / 3,
+                                 len - len / 3));
+    }
+  }
+}
+
 TEST_F(CRC, fast_is_on) {
   std::cout << "IsFastCrc32Supported=" << IsFastCrc32Supported() << std::endl;
 }
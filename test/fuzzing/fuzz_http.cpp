@@ -16,6 +16,7 @@
 // under the License.
 
 #include "brpc/details/http_message.h"
+#include "brpc/details/http_parser.h"
 #include "brpc/policy/http_rpc_protocol.h"
 
 #define kMinInputLength 5
@@ -40,6 +41,27 @@ LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
         brpc::HttpMessage http_message;
         http_message.ParseFromArray((char *)data, size);
     }
+    {
+        // Bytes are scanned in batch only when the input is long enough,
+        // parsing byte by byte must end in the same state.
+        brpc::http_parser_settings settings;
+        memset(&settings, 0, sizeof(settings));
+        brpc::http_parser batch_parser;
+        brpc::http_parser_init(&batch_parser, brpc::HTTP_BOTH);
+        brpc::http_parser_execute(&batch_parser, &settings,
+                                  input.data(), input.size());
+        brpc::http_parser bytes_parser;
+        brpc::http_parser_init(&bytes_parser, brpc::HTTP_BOTH);
+        for (size_t i = 0; i < input.size() && !bytes_parser.http_errno; ++i) {
+            brpc::http_parser_execute(&bytes_parser, &settings, &input[i], 1);
+        }
+        if (batch_parser.http_errno != bytes_parser.http_errno ||
+            (!batch_parser.http_errno &&
+             (batch_parser.state != bytes_parser.state ||
+              batch_parser.nread != bytes_parser.nread))) {
+            __builtin_trap();
+        }
+    }
 
     return 0;
 }